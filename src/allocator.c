@@ -0,0 +1,288 @@
+/*
+  Another Python Sqlite Wrapper
+
+  Pooled memory allocator for SQLite
+
+  See the accompanying LICENSE file.
+*/
+
+/* SQLite makes many small allocations of a few sizes, freeing them
+   again as statements are finalized and connections closed.  The
+   pooled allocator rounds each request up to a power of two size
+   class, carving blocks out of arenas and keeping freed blocks on a
+   free list per class so they are reused without going back to the
+   system allocator.  Requests larger than the biggest class use the
+   system allocator directly.  Arenas are only given back when SQLite
+   is shut down with every block free.
+
+   Each block starts with an 8 byte header holding its usable size,
+   which keeps the 8 byte alignment SQLite requires.  Each class has
+   its own lock so threads allocating different sizes don't contend,
+   and the locks are only held to push or pop a list entry.
+
+   It is installed with apsw.config(SQLITE_CONFIG_MALLOC, "pooled") */
+
+#define APSWMEM_CLASSES 9                /* 16 to 4096 byte blocks */
+#define APSWMEM_HEADER 8
+#define APSWMEM_BLOCKSIZE(i) (16<<(i))
+#define APSWMEM_LARGEST (APSWMEM_BLOCKSIZE(APSWMEM_CLASSES-1)-APSWMEM_HEADER)
+#define APSWMEM_ARENA 65536
+
+typedef struct apswmemarena
+{
+  struct apswmemarena *next;
+  sqlite3_int64 pad;                    /* keeps blocks 8 byte aligned */
+} apswmemarena;
+
+typedef struct
+{
+  volatile int lock;
+  void *freelist;                       /* linked through the first word after the header */
+  apswmemarena *arenas;
+  sqlite3_int64 used;                   /* blocks handed out */
+} apswmemclass;
+
+static apswmemclass apswmem_classes[APSWMEM_CLASSES];
+
+/* large allocations outstanding, protected by the last class's lock */
+static sqlite3_int64 apswmem_large;
+
+#if defined(__GNUC__) && !defined(_WIN32)
+#include <sched.h>
+/* spin, yielding in case the holder was preempted */
+#define APSWMEM_SPINLOCK
+#define APSWMEM_LOCK(c)                                                 \
+  do { while(__sync_lock_test_and_set(&(c)->lock, 1)) while((c)->lock) sched_yield(); } while(0)
+#define APSWMEM_UNLOCK(c) __sync_lock_release(&(c)->lock)
+#else
+/* one mutex shared by all the classes */
+static sqlite3_mutex *apswmem_mutex;
+#define APSWMEM_LOCK(c) sqlite3_mutex_enter(apswmem_mutex)
+#define APSWMEM_UNLOCK(c) sqlite3_mutex_leave(apswmem_mutex)
+#endif
+
+static int apswmem_installed;
+static sqlite3_mem_methods apswmem_system;
+
+static int
+apswmem_class(int n)
+{
+  int i=0;
+
+  while(APSWMEM_BLOCKSIZE(i)-APSWMEM_HEADER<n)
+    i++;
+  return i;
+}
+
+/* adds a new arena's worth of blocks to the free list - called with
+   the class locked */
+static int
+apswmem_carve(apswmemclass *c, int i)
+{
+  apswmemarena *arena;
+  char *block, *end;
+
+  arena=malloc(APSWMEM_ARENA);
+  if(!arena)
+    return -1;
+  arena->next=c->arenas;
+  c->arenas=arena;
+
+  end=((char*)arena)+APSWMEM_ARENA;
+  for(block=(char*)(arena+1); block+APSWMEM_BLOCKSIZE(i)<=end; block+=APSWMEM_BLOCKSIZE(i))
+    {
+      *(sqlite3_int64*)block=APSWMEM_BLOCKSIZE(i)-APSWMEM_HEADER;
+      *(void**)(block+APSWMEM_HEADER)=c->freelist;
+      c->freelist=block;
+    }
+  return 0;
+}
+
+static void *
+apswmem_malloc(int n)
+{
+  apswmemclass *c;
+  char *block;
+
+  if(n>APSWMEM_LARGEST)
+    {
+      block=malloc((size_t)n+APSWMEM_HEADER);
+      if(!block)
+        return NULL;
+      *(sqlite3_int64*)block=n;
+      c=&apswmem_classes[APSWMEM_CLASSES-1];
+      APSWMEM_LOCK(c);
+      apswmem_large++;
+      APSWMEM_UNLOCK(c);
+      return block+APSWMEM_HEADER;
+    }
+
+  c=&apswmem_classes[apswmem_class(n)];
+  APSWMEM_LOCK(c);
+  if(!c->freelist && apswmem_carve(c, (int)(c-apswmem_classes)))
+    {
+      APSWMEM_UNLOCK(c);
+      return NULL;
+    }
+  block=c->freelist;
+  c->freelist=*(void**)(block+APSWMEM_HEADER);
+  c->used++;
+  APSWMEM_UNLOCK(c);
+
+  return block+APSWMEM_HEADER;
+}
+
+static void
+apswmem_free(void *p)
+{
+  apswmemclass *c;
+  char *block=((char*)p)-APSWMEM_HEADER;
+  sqlite3_int64 n=*(sqlite3_int64*)block;
+
+  if(n>APSWMEM_LARGEST)
+    {
+      c=&apswmem_classes[APSWMEM_CLASSES-1];
+      APSWMEM_LOCK(c);
+      apswmem_large--;
+      APSWMEM_UNLOCK(c);
+      free(block);
+      return;
+    }
+
+  c=&apswmem_classes[apswmem_class((int)n)];
+  APSWMEM_LOCK(c);
+  *(void**)p=c->freelist;
+  c->freelist=block;
+  c->used--;
+  APSWMEM_UNLOCK(c);
+}
+
+static int
+apswmem_size(void *p)
+{
+  return (int)*(sqlite3_int64*)(((char*)p)-APSWMEM_HEADER);
+}
+
+static int
+apswmem_roundup(int n)
+{
+  if(n>APSWMEM_LARGEST)
+    return (n+7)&~7;
+  return APSWMEM_BLOCKSIZE(apswmem_class(n))-APSWMEM_HEADER;
+}
+
+static void *
+apswmem_realloc(void *p, int n)
+{
+  int size=apswmem_size(p);
+  char *block;
+  void *newp;
+
+  if(apswmem_roundup(n)==size)
+    return p;
+
+  /* the system allocator can often grow in place */
+  if(size>APSWMEM_LARGEST && n>APSWMEM_LARGEST)
+    {
+      block=realloc(((char*)p)-APSWMEM_HEADER, (size_t)n+APSWMEM_HEADER);
+      if(!block)
+        return NULL;
+      *(sqlite3_int64*)block=n;
+      return block+APSWMEM_HEADER;
+    }
+
+  newp=apswmem_malloc(n);
+  if(!newp)
+    return NULL;
+  memcpy(newp, p, size<n?size:n);
+  apswmem_free(p);
+  return newp;
+}
+
+static int
+apswmem_init(APSW_ARGUNUSED void *appdata)
+{
+#ifndef APSWMEM_SPINLOCK
+  /* the mutex subsystem is set up before memory, and static mutexes
+     don't need memory */
+  apswmem_mutex=sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1); /* PYSQLITE_CALL not needed during initialization */
+#endif
+  return SQLITE_OK;
+}
+
+/* arenas of classes still in use are kept so outstanding blocks
+   remain valid */
+static void
+apswmem_shutdown(APSW_ARGUNUSED void *appdata)
+{
+  int i;
+  apswmemarena *arena;
+
+  for(i=0; i<APSWMEM_CLASSES; i++)
+    {
+      apswmemclass *c=&apswmem_classes[i];
+      if(c->used)
+        continue;
+      while(c->arenas)
+        {
+          arena=c->arenas;
+          c->arenas=arena->next;
+          free(arena);
+        }
+      c->freelist=NULL;
+    }
+}
+
+/* Returns non-zero if there are blocks allocated by the pool */
+static int
+apswmem_outstanding(void)
+{
+  int i;
+
+  if(apswmem_large)
+    return 1;
+  for(i=0; i<APSWMEM_CLASSES; i++)
+    if(apswmem_classes[i].used)
+      return 1;
+  return 0;
+}
+
+static sqlite3_mem_methods apswmem_methods=
+  {
+    apswmem_malloc,
+    apswmem_free,
+    apswmem_realloc,
+    apswmem_size,
+    apswmem_roundup,
+    apswmem_init,
+    apswmem_shutdown,
+    NULL
+  };
+
+/* Installs (pooled non-zero) or removes the pooled allocator.  SQLite
+   must not be initialized.  Returns a SQLite error code. */
+static int
+apswmem_install(int pooled)
+{
+  int res;
+
+  if(!!pooled==apswmem_installed)
+    return SQLITE_OK;
+
+  /* memory from one allocator can't be freed by the other */
+  if(pooled ? sqlite3_memory_used()!=0 : apswmem_outstanding())
+    return SQLITE_MISUSE;
+
+  if(pooled)
+    {
+      res=sqlite3_config(SQLITE_CONFIG_GETMALLOC, &apswmem_system);
+      if(res==SQLITE_OK)
+        res=sqlite3_config(SQLITE_CONFIG_MALLOC, &apswmem_methods);
+    }
+  else
+    res=sqlite3_config(SQLITE_CONFIG_MALLOC, &apswmem_system);
+
+  if(res==SQLITE_OK)
+    apswmem_installed=!!pooled;
+  return res;
+}
@@ -66,6 +66,7 @@ API Reference
 /* system headers */
 #include <assert.h>
 #include <stdarg.h>
+#include <float.h>
 
 /* Get the version number */
 #include "apswversion.h"
@@ -137,6 +138,9 @@ static PyObject *apswmodule;
 /* The statement cache */
 #include "statementcache.c"
 
+/* pooled memory allocator */
+#include "allocator.c"
+
 /* connections */
 #include "connection.c"
 
@@ -155,6 +159,14 @@ static PyObject *apswmodule;
 /* virtual file system */
 #include "vfs.c"
 
+/* connection pool */
+#include "pool.c"
+
+/* asyncio */
+#if PY_VERSION_HEX >= 0x03050000
+#include "async.c"
+#endif
+
 
 /* MODULE METHODS */
 
@@ -281,7 +293,37 @@ sqliteshutdown(void)
   SQLITE_CONFIG_SINGLETHREAD, SQLITE_CONFIG_MULTITHREAD,
   SQLITE_CONFIG_SERIALIZED, SQLITE_CONFIG_URI, SQLITE_CONFIG_MEMSTATUS,
   SQLITE_CONFIG_COVERING_INDEX_SCAN, SQLITE_CONFIG_PCACHE_HDRSZ,
-  SQLITE_CONFIG_PMASZ, and SQLITE_CONFIG_STMTJRNL_SPILL.
+  SQLITE_CONFIG_PMASZ, SQLITE_CONFIG_STMTJRNL_SPILL,
+  SQLITE_CONFIG_LOOKASIDE, SQLITE_CONFIG_MALLOC and
+  SQLITE_CONFIG_GETMALLOC.
+
+  SQLITE_CONFIG_MALLOC takes a name choosing the memory allocator
+  SQLite uses, and SQLITE_CONFIG_GETMALLOC returns the name of the
+  current one:
+
+    system
+      The default allocator SQLite was built with
+
+    pooled
+      Rounds allocations up to power of two size classes up to 4kb
+      with a free list per class, so blocks are reused without going
+      back to the system allocator.  This reduces fragmentation and
+      allocator contention when connections and statements are
+      frequently opened and closed.  Memory is kept in the pool until
+      SQLite is shut down.
+
+  The allocator can only be changed after :meth:`shutdown` when all
+  the memory from the existing allocator has been released, otherwise
+  :exc:`MisuseError` is raised::
+
+    apsw.shutdown()
+    apsw.config(apsw.SQLITE_CONFIG_MALLOC, "pooled")
+    apsw.initialize()
+
+  SQLITE_CONFIG_LOOKASIDE takes the default size and count of
+  lookaside slots for new connections, while
+  :meth:`Connection.config` with SQLITE_DBCONFIG_LOOKASIDE changes an
+  existing one.
 
   See :ref:`tips <diagnostics_tips>` for an example of how to receive
   log messages (SQLITE_CONFIG_LOG)
@@ -378,6 +420,37 @@ config(APSW_ARGUNUSED PyObject *self, PyObject *args)
         break;
       }
 
+    case SQLITE_CONFIG_LOOKASIDE:
+      {
+        int size, count;
+        if(!PyArg_ParseTuple(args, "iii", &optdup, &size, &count))
+          return NULL;
+        assert(opt==optdup);
+        res=sqlite3_config( (int)opt, size, count);
+        break;
+      }
+
+    case SQLITE_CONFIG_MALLOC:
+      {
+        const char *name;
+        if(!PyArg_ParseTuple(args, "is", &optdup, &name))
+          return NULL;
+        assert(opt==optdup);
+        if(0==strcmp(name, "pooled"))
+          res=apswmem_install(1);
+        else if(0==strcmp(name, "system"))
+          res=apswmem_install(0);
+        else
+          return PyErr_Format(PyExc_ValueError, "Unknown allocator \"%s\" - use \"system\" or \"pooled\"", name);
+        break;
+      }
+
+    case SQLITE_CONFIG_GETMALLOC:
+      if(!PyArg_ParseTuple(args, "i", &optdup))
+        return NULL;
+      assert(opt==optdup);
+      return MAKESTR(apswmem_installed?"pooled":"system");
+
     case SQLITE_CONFIG_LOG:
       {
 	PyObject *logger;
@@ -1267,14 +1340,23 @@ PyInit_apsw(void)
 
     if (PyType_Ready(&ConnectionType) < 0
         || PyType_Ready(&APSWCursorType) < 0
+        || PyType_Ready(&ColumnViewType) < 0
+        || PyType_Ready(&APSWRowType) < 0
         || PyType_Ready(&ZeroBlobBindType) <0
         || PyType_Ready(&APSWBlobType) <0
+        || PyType_Ready(&APSWBlobReadManyType) <0
         || PyType_Ready(&APSWVFSType) <0
         || PyType_Ready(&APSWVFSFileType) <0
 	|| PyType_Ready(&APSWURIFilenameType) <0
         || PyType_Ready(&APSWStatementType) <0
         || PyType_Ready(&APSWBufferType) <0
         || PyType_Ready(&FunctionCBInfoType) <0
+        || PyType_Ready(&APSWConnectionPoolType) <0
+#if PY_VERSION_HEX >= 0x03050000
+        || PyType_Ready(&APSWAsyncConnectionType) <0
+        || PyType_Ready(&APSWAsyncCursorType) <0
+        || PyType_Ready(&APSWAsyncResultType) <0
+#endif
 #ifdef EXPERIMENTAL
         || PyType_Ready(&APSWBackupType) <0
 #endif
@@ -1311,6 +1393,12 @@ PyInit_apsw(void)
     PyModule_AddObject(m, "VFSFile", (PyObject*)&APSWVFSFileType);
     Py_INCREF(&APSWURIFilenameType);
     PyModule_AddObject(m, "URIFilename", (PyObject*)&APSWURIFilenameType);
+    Py_INCREF(&APSWConnectionPoolType);
+    PyModule_AddObject(m, "ConnectionPool", (PyObject*)&APSWConnectionPoolType);
+#if PY_VERSION_HEX >= 0x03050000
+    Py_INCREF(&APSWAsyncConnectionType);
+    PyModule_AddObject(m, "AsyncConnection", (PyObject*)&APSWAsyncConnectionType);
+#endif
 
 
     /** .. attribute:: connection_hooks
@@ -1461,6 +1549,10 @@ modules etc. For example::
       ADDINT(SQLITE_INDEX_CONSTRAINT_IS),
       ADDINT(SQLITE_INDEX_CONSTRAINT_NE),
       ADDINT(SQLITE_INDEX_CONSTRAINT_FUNCTION),
+#if SQLITE_VERSION_NUMBER >= 3038000
+      ADDINT(SQLITE_INDEX_CONSTRAINT_LIMIT),
+      ADDINT(SQLITE_INDEX_CONSTRAINT_OFFSET),
+#endif
       END,
 
       /* extended result codes */
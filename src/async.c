@@ -0,0 +1,1088 @@
+/*
+  Another Python Sqlite Wrapper
+
+  Awaitable access to a connection from asyncio
+
+  See the accompanying LICENSE file.
+*/
+
+/**
+
+.. _async:
+
+Async
+*****
+
+An :class:`AsyncConnection` lets :mod:`asyncio` code use a database
+without blocking the event loop.  It owns a :class:`Connection` and a
+worker thread dedicated to it.  The awaitable methods queue their work
+for the worker, and SQLite releases the GIL while it runs so the loop
+carries on with other coroutines.  Any number of coroutines can share
+one connection (and its statement cache) with their requests run in
+the order they were made::
+
+  async def main():
+      db=apsw.AsyncConnection("app.db")
+
+      cursor=await db.execute("select id, name from item where price>?", (10,))
+      async for id, name in cursor:
+          print(id, name)
+
+      cursor=await db.execute("select count(*) from item")
+      print(await cursor.fetchone())
+
+      await db.close()
+
+The worker fetches rows in batches, the first of them before
+:meth:`~AsyncConnection.execute` completes, so most rows of an
+**async for** are returned without waiting for the worker.
+
+Important details
+=================
+
+The worker is the only thread to use the :class:`Connection`.  Use
+:meth:`~AsyncConnection.run` to call other :class:`Connection` methods
+such as registering functions.
+
+Requests from different coroutines are interleaved on the one
+connection so a transaction begun by one coroutine includes the
+changes of others until it ends.  Do a whole transaction in one
+:meth:`~AsyncConnection.run` call to keep it separate.
+
+Requests that are already queued still run when a coroutine waiting
+on them is cancelled, but their results are discarded.
+
+This is only available with Python 3.5 or later.
+*/
+
+#define CHECK_ASYNC_CLOSED(conn, e)                                     \
+do                                                                      \
+  {                                                                     \
+    if((conn)->closed)                                                  \
+      {                                                                 \
+        PyErr_Format(ExcConnectionClosed, "The connection has been closed"); \
+        return e;                                                       \
+      }                                                                 \
+  } while(0)
+
+/* Work is queued for the worker as a tuple of (kind, loop, future,
+   target, args).  loop and future are None when nothing waits for the
+   result. */
+enum { ASYNC_EXECUTE, ASYNC_EXECUTEMANY, ASYNC_FETCH, ASYNC_CLOSECURSOR, ASYNC_RUN, ASYNC_CLOSE };
+
+/* what a fetch gives back */
+enum { ASYNC_FETCH_NEXT, ASYNC_FETCH_ONE, ASYNC_FETCH_ALL };
+
+/* asyncio.get_running_loop (or get_event_loop before 3.7) and the
+   function the loop calls to complete futures */
+static PyObject *apswasync_getloop;
+static PyObject *apswasync_deliverfunc;
+
+/** .. class:: AsyncConnection(filename, flags=SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, vfs=None, statementcachesize=100, batchsize=256)
+
+  Opens the named database and starts the worker thread.  The first
+  four parameters are as for :meth:`Connection.__init__`.
+
+  :param batchsize: How many rows the worker fetches at a time for
+    each cursor.
+*/
+
+struct APSWAsyncConnection
+{
+  PyObject_HEAD
+  PyObject *queue;           /* work for the worker */
+  int closed;                /* close has been queued */
+  PyObject *weakreflist;
+};
+
+typedef struct APSWAsyncConnection APSWAsyncConnection;
+
+/** .. class:: AsyncCursor
+
+  Returned by :meth:`AsyncConnection.execute` and
+  :meth:`AsyncConnection.executemany`.  Use **async for** to iterate
+  over the rows.
+*/
+
+struct APSWAsyncCursor
+{
+  PyObject_HEAD
+  APSWAsyncConnection *connection;
+  PyObject *cursor;          /* Cursor only used by the worker */
+  PyObject *rows;            /* list of rows fetched by the worker */
+  Py_ssize_t pos;            /* next item in rows to give out */
+  int done;                  /* no more rows to fetch */
+  PyObject *weakreflist;
+};
+
+typedef struct APSWAsyncCursor APSWAsyncCursor;
+
+/* An awaitable that already has its value, used for rows that have
+   been fetched */
+typedef struct
+{
+  PyObject_HEAD
+  PyObject *value;
+} APSWAsyncResult;
+
+static PyTypeObject APSWAsyncConnectionType;
+static PyTypeObject APSWAsyncCursorType;
+static PyTypeObject APSWAsyncResultType;
+
+/* Steals value which may be NULL for an exception */
+static PyObject *
+asyncresult(PyObject *value)
+{
+  APSWAsyncResult *res;
+
+  if(!value)
+    return NULL;
+  res=PyObject_New(APSWAsyncResult, &APSWAsyncResultType);
+  if(!res)
+    {
+      Py_DECREF(value);
+      return NULL;
+    }
+  res->value=value;
+  return (PyObject*)res;
+}
+
+static void
+APSWAsyncResult_dealloc(APSWAsyncResult *self)
+{
+  Py_CLEAR(self->value);
+  PyObject_Del(self);
+}
+
+static PyObject *
+APSWAsyncResult_await(APSWAsyncResult *self)
+{
+  Py_INCREF(self);
+  return (PyObject*)self;
+}
+
+/* the value is given with StopIteration the first time */
+static PyObject *
+APSWAsyncResult_next(APSWAsyncResult *self)
+{
+  PyObject *stop;
+
+  if(!self->value)
+    return NULL;
+  /* made explicitly so a tuple value isn't taken as the arguments */
+  stop=PyObject_CallFunctionObjArgs(PyExc_StopIteration, self->value, NULL);
+  Py_CLEAR(self->value);
+  if(stop)
+    {
+      PyErr_SetObject(PyExc_StopIteration, stop);
+      Py_DECREF(stop);
+    }
+  return NULL;
+}
+
+/* Gives out the next row (ASYNC_FETCH_NEXT), the next row or None
+   (ASYNC_FETCH_ONE) or a list of the rest (ASYNC_FETCH_ALL) from the
+   rows already fetched */
+static PyObject *
+asynccursor_take(APSWAsyncCursor *acursor, int mode)
+{
+  PyObject *res;
+
+  if(mode==ASYNC_FETCH_ALL)
+    {
+      res=PyList_GetSlice(acursor->rows, acursor->pos, PY_SSIZE_T_MAX);
+      if(res)
+        {
+          acursor->pos=PyList_GET_SIZE(acursor->rows);
+          assert(acursor->done);
+        }
+      return res;
+    }
+
+  if(acursor->pos<PyList_GET_SIZE(acursor->rows))
+    {
+      res=PyList_GET_ITEM(acursor->rows, acursor->pos);
+      acursor->pos++;
+      Py_INCREF(res);
+      return res;
+    }
+
+  assert(acursor->done);
+  if(mode==ASYNC_FETCH_NEXT)
+    {
+      PyErr_SetNone(PyExc_StopAsyncIteration);
+      return NULL;
+    }
+  Py_RETURN_NONE;
+}
+
+/* The asyncio side.  This is called by the event loop to complete a
+   future unless it was cancelled. */
+static PyObject *
+apswasync_deliver(APSW_ARGUNUSED PyObject *unused, PyObject *args)
+{
+  PyObject *future, *value, *exc, *res;
+  int cancelled;
+
+  if(!PyArg_ParseTuple(args, "OOO", &future, &value, &exc))
+    return NULL;
+
+  res=PyObject_CallMethod(future, "cancelled", NULL);
+  if(!res)
+    return NULL;
+  cancelled=PyObject_IsTrue(res);
+  Py_DECREF(res);
+  if(cancelled<0)
+    return NULL;
+  if(cancelled)
+    Py_RETURN_NONE;
+
+  if(exc!=Py_None)
+    return PyObject_CallMethod(future, "set_exception", "(O)", exc);
+  return PyObject_CallMethod(future, "set_result", "(O)", value);
+}
+
+static PyMethodDef apswasync_deliverdef=
+  {"_deliver", (PyCFunction)apswasync_deliver, METH_VARARGS, "Completes a future"};
+
+/* Queues work, stealing target and args (which may be NULL for None).
+   Returns -1 with an exception on failure. */
+static int
+asyncqueue_put(PyObject *queue, int kind, PyObject *loop, PyObject *future, PyObject *target, PyObject *args)
+{
+  PyObject *res;
+
+  res=PyObject_CallMethod(queue, "put", "((iOOOO))", kind, loop?loop:Py_None, future?future:Py_None,
+                          target?target:Py_None, args?args:Py_None);
+  Py_XDECREF(target);
+  Py_XDECREF(args);
+  Py_XDECREF(res);
+  return res?0:-1;
+}
+
+/* Queues work and returns the future that will get its result.
+   Steals target and args. */
+static PyObject *
+apswasync_submit(APSWAsyncConnection *conn, int kind, PyObject *target, PyObject *args)
+{
+  PyObject *loop, *future=NULL;
+
+  loop=PyObject_CallObject(apswasync_getloop, NULL);
+  if(loop)
+    future=PyObject_CallMethod(loop, "create_future", NULL);
+  if(!future)
+    {
+      Py_XDECREF(loop);
+      Py_XDECREF(target);
+      Py_XDECREF(args);
+      return NULL;
+    }
+  if(asyncqueue_put(conn->queue, kind, loop, future, target, args))
+    Py_CLEAR(future);
+  Py_DECREF(loop);
+  return future;
+}
+
+/* THE WORKER.  All these run in the worker thread. */
+
+/* Adds up to n rows (all if n is zero) from the cursor to those
+   fetched.  The GIL is released by each step so the loop can take
+   rows meanwhile, and the list is only changed once all are
+   fetched. */
+static int
+asyncworker_fill(APSWAsyncCursor *acursor, long n)
+{
+  PyObject *more, *rows, *row, *cursor=acursor->cursor;
+  int res=0;
+
+  if(acursor->done || !cursor)
+    {
+      acursor->done=1;
+      return 0;
+    }
+
+  more=PyList_New(0);
+  if(!more)
+    return -1;
+
+  Py_INCREF(cursor);
+  while(!n || PyList_GET_SIZE(more)<n)
+    {
+      row=PyIter_Next(cursor);
+      if(!row)
+        {
+          if(PyErr_Occurred())
+            res=-1;
+          else
+            acursor->done=1;
+          break;
+        }
+      res=PyList_Append(more, row);
+      Py_DECREF(row);
+      if(res)
+        break;
+    }
+  Py_DECREF(cursor);
+
+  if(!res)
+    {
+      rows=PyList_GetSlice(acursor->rows, acursor->pos, PY_SSIZE_T_MAX);
+      if(rows && PyList_SetSlice(rows, PY_SSIZE_T_MAX, PY_SSIZE_T_MAX, more)==0)
+        {
+          Py_DECREF(acursor->rows);
+          acursor->rows=rows;
+          acursor->pos=0;
+        }
+      else
+        {
+          Py_XDECREF(rows);
+          res=-1;
+        }
+    }
+  Py_DECREF(more);
+  return res;
+}
+
+static PyObject *
+asyncworker_execute(PyObject *connection, APSWAsyncCursor *acursor, const char *method, PyObject *args, long batchsize)
+{
+  PyObject *cursor, *meth, *res=NULL;
+
+  cursor=PyObject_CallMethod(connection, "cursor", NULL);
+  if(!cursor)
+    return NULL;
+  meth=PyObject_GetAttrString(cursor, method);
+  if(meth)
+    res=PyObject_Call(meth, args, NULL);
+  Py_XDECREF(meth);
+  if(!res)
+    {
+      Py_DECREF(cursor);
+      return NULL;
+    }
+  Py_DECREF(res);
+
+  acursor->cursor=cursor;
+  if(asyncworker_fill(acursor, batchsize))
+    return NULL;
+  Py_INCREF(acursor);
+  return (PyObject*)acursor;
+}
+
+static PyObject *
+asyncworker_fetch(APSWAsyncCursor *acursor, int mode, long batchsize)
+{
+  /* the loop may have taken rows since this was queued */
+  if(mode==ASYNC_FETCH_ALL || acursor->pos>=PyList_GET_SIZE(acursor->rows))
+    if(asyncworker_fill(acursor, mode==ASYNC_FETCH_ALL?0:batchsize))
+      return NULL;
+  return asynccursor_take(acursor, mode);
+}
+
+static PyObject *
+asyncworker_closecursor(PyObject *target)
+{
+  PyObject *cursor=target;
+
+  if(Py_TYPE(target)==&APSWAsyncCursorType)
+    {
+      APSWAsyncCursor *acursor=(APSWAsyncCursor*)target;
+      PyObject *empty=PyList_New(0);
+
+      if(!empty)
+        return NULL;
+      /* rows already fetched are discarded */
+      Py_DECREF(acursor->rows);
+      acursor->rows=empty;
+      acursor->pos=0;
+      cursor=acursor->cursor;
+      acursor->cursor=NULL;
+      acursor->done=1;
+      if(!cursor)
+        Py_RETURN_NONE;
+    }
+  else
+    Py_INCREF(cursor);
+
+  target=PyObject_CallMethod(cursor, "close", NULL);
+  Py_DECREF(cursor);
+  return target;
+}
+
+/* args are (callable, *args) */
+static PyObject *
+asyncworker_run(PyObject *connection, PyObject *args)
+{
+  PyObject *callargs, *res;
+  Py_ssize_t i;
+
+  callargs=PyTuple_New(PyTuple_GET_SIZE(args));
+  if(!callargs)
+    return NULL;
+  Py_INCREF(connection);
+  PyTuple_SET_ITEM(callargs, 0, connection);
+  for(i=1; i<PyTuple_GET_SIZE(args); i++)
+    {
+      Py_INCREF(PyTuple_GET_ITEM(args, i));
+      PyTuple_SET_ITEM(callargs, i, PyTuple_GET_ITEM(args, i));
+    }
+  res=PyObject_Call(PyTuple_GET_ITEM(args, 0), callargs, NULL);
+  Py_DECREF(callargs);
+  return res;
+}
+
+/* Hands value (NULL for the current exception) to the loop */
+static void
+asyncworker_deliver(PyObject *loop, PyObject *future, PyObject *value)
+{
+  PyObject *etype=NULL, *exc=NULL, *etb=NULL, *res;
+
+  if(!value)
+    {
+      PyErr_Fetch(&etype, &exc, &etb);
+      PyErr_NormalizeException(&etype, &exc, &etb);
+      if(exc && etb)
+        PyException_SetTraceback(exc, etb);
+      if(future==Py_None)
+        {
+          /* nothing is waiting, eg closing when deallocated */
+          PyErr_Restore(etype, exc, etb);
+          apsw_write_unraiseable(NULL);
+          return;
+        }
+      Py_XDECREF(etype);
+      Py_XDECREF(etb);
+    }
+
+  if(future!=Py_None)
+    {
+      res=PyObject_CallMethod(loop, "call_soon_threadsafe", "OOOO", apswasync_deliverfunc, future,
+                              value?value:Py_None, exc?exc:Py_None);
+      /* eg the loop has been closed */
+      if(!res)
+        apsw_write_unraiseable(NULL);
+      Py_XDECREF(res);
+    }
+  Py_XDECREF(value);
+  Py_XDECREF(exc);
+}
+
+/* The worker thread's main loop.  state is (queue, connection,
+   batchsize) and is owned by the worker. */
+static void
+asyncworker(void *arg)
+{
+  PyGILState_STATE gilstate;
+  PyObject *state=arg, *queue, *connection, *item, *loop, *future, *target, *args, *value;
+  long batchsize;
+  int kind;
+
+  gilstate=PyGILState_Ensure();
+
+  queue=PyTuple_GET_ITEM(state, 0);
+  connection=PyTuple_GET_ITEM(state, 1);
+  batchsize=PyLong_AsLong(PyTuple_GET_ITEM(state, 2));
+
+  do
+    {
+      /* releases the GIL while waiting */
+      item=PyObject_CallMethod(queue, "get", NULL);
+      if(!item)
+        {
+          apsw_write_unraiseable(NULL);
+          break;
+        }
+
+      kind=(int)PyLong_AsLong(PyTuple_GET_ITEM(item, 0));
+      loop=PyTuple_GET_ITEM(item, 1);
+      future=PyTuple_GET_ITEM(item, 2);
+      target=PyTuple_GET_ITEM(item, 3);
+      args=PyTuple_GET_ITEM(item, 4);
+
+      switch(kind)
+        {
+        case ASYNC_EXECUTE:
+        case ASYNC_EXECUTEMANY:
+          value=asyncworker_execute(connection, (APSWAsyncCursor*)target, (kind==ASYNC_EXECUTE)?"execute":"executemany", args, batchsize);
+          break;
+        case ASYNC_FETCH:
+          value=asyncworker_fetch((APSWAsyncCursor*)target, (int)PyLong_AsLong(args), batchsize);
+          break;
+        case ASYNC_CLOSECURSOR:
+          value=asyncworker_closecursor(target);
+          break;
+        case ASYNC_RUN:
+          value=asyncworker_run(connection, args);
+          break;
+        default:
+          assert(kind==ASYNC_CLOSE);
+          value=PyObject_CallMethod(connection, "close", NULL);
+          break;
+        }
+
+      asyncworker_deliver(loop, future, value);
+      Py_DECREF(item);
+    } while(kind!=ASYNC_CLOSE);
+
+  Py_DECREF(state);
+  PyGILState_Release(gilstate);
+}
+
+/* ASYNC CONNECTION */
+
+static PyObject*
+APSWAsyncConnection_new(PyTypeObject *type, APSW_ARGUNUSED PyObject *args, APSW_ARGUNUSED PyObject *kwds)
+{
+  APSWAsyncConnection *self;
+
+  self=(APSWAsyncConnection*)type->tp_alloc(type, 0);
+  if(self)
+    {
+      self->queue=0;
+      self->closed=1;
+      self->weakreflist=0;
+    }
+  return (PyObject*)self;
+}
+
+/* Finds the asyncio and queue pieces the first time through */
+static int
+APSWAsyncConnection_setup(void)
+{
+  PyObject *asyncio;
+
+  if(apswasync_getloop)
+    return 0;
+
+  asyncio=PyImport_ImportModule("asyncio");
+  if(!asyncio)
+    return -1;
+  apswasync_getloop=PyObject_GetAttrString(asyncio, "get_running_loop");
+  if(!apswasync_getloop)
+    {
+      PyErr_Clear();
+      apswasync_getloop=PyObject_GetAttrString(asyncio, "get_event_loop");
+    }
+  Py_DECREF(asyncio);
+  if(!apswasync_getloop)
+    return -1;
+
+  apswasync_deliverfunc=PyCFunction_New(&apswasync_deliverdef, NULL);
+  if(!apswasync_deliverfunc)
+    {
+      Py_CLEAR(apswasync_getloop);
+      return -1;
+    }
+  return 0;
+}
+
+static int
+APSWAsyncConnection_init(APSWAsyncConnection *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[]={"filename", "flags", "vfs", "statementcachesize", "batchsize", NULL};
+  PyObject *filename=NULL, *vfs=Py_None, *openargs=NULL, *connection=NULL, *queuemod=NULL, *queuetype=NULL, *state=NULL;
+  int flags=SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+  int statementcachesize=100, batchsize=256;
+
+  if(self->queue)
+    {
+      PyErr_Format(PyExc_ValueError, "The connection has already been opened");
+      return -1;
+    }
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|iOii:AsyncConnection(filename, flags=SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE, vfs=None, statementcachesize=100, batchsize=256)",
+                                  kwlist, &filename, &flags, &vfs, &statementcachesize, &batchsize))
+    return -1;
+
+  if(batchsize<1)
+    {
+      PyErr_Format(PyExc_ValueError, "batchsize must be at least one");
+      return -1;
+    }
+
+  if(APSWAsyncConnection_setup())
+    goto error;
+
+  queuemod=PyImport_ImportModule("queue");
+  if(!queuemod) goto error;
+  /* SimpleQueue is new in 3.7 */
+  queuetype=PyObject_GetAttrString(queuemod, "SimpleQueue");
+  if(!queuetype)
+    {
+      PyErr_Clear();
+      queuetype=PyObject_GetAttrString(queuemod, "Queue");
+      if(!queuetype) goto error;
+    }
+  self->queue=PyObject_CallObject(queuetype, NULL);
+  if(!self->queue) goto error;
+
+  openargs=Py_BuildValue("(OiOi)", filename, flags, vfs, statementcachesize);
+  if(!openargs) goto error;
+  connection=PyObject_Call((PyObject*)&ConnectionType, openargs, NULL);
+  if(!connection) goto error;
+
+  state=Py_BuildValue("(OOi)", self->queue, connection, batchsize);
+  if(!state) goto error;
+  /* the worker owns state */
+  if((long)PyThread_start_new_thread(asyncworker, state)==-1)
+    {
+      PyErr_Format(PyExc_RuntimeError, "Unable to start the worker thread");
+      Py_CLEAR(state);
+      goto error;
+    }
+
+  self->closed=0;
+  Py_DECREF(connection);
+  Py_DECREF(openargs);
+  Py_DECREF(queuetype);
+  Py_DECREF(queuemod);
+  return 0;
+
+ error:
+  assert(PyErr_Occurred());
+  Py_CLEAR(self->queue);
+  Py_XDECREF(connection);
+  Py_XDECREF(openargs);
+  Py_XDECREF(queuetype);
+  Py_XDECREF(queuemod);
+  AddTraceBackHere(__FILE__, __LINE__, "AsyncConnection.__init__", "{s: O, s: i}", "filename", filename, "flags", flags);
+  return -1;
+}
+
+static void
+APSWAsyncConnection_dealloc(APSWAsyncConnection *self)
+{
+  APSW_CLEAR_WEAKREFS;
+
+  /* the worker closes the connection and exits */
+  if(!self->closed)
+    {
+      PyObject *etype, *evalue, *etb;
+
+      PyErr_Fetch(&etype, &evalue, &etb);
+      if(asyncqueue_put(self->queue, ASYNC_CLOSE, NULL, NULL, NULL, NULL))
+        apsw_write_unraiseable(NULL);
+      PyErr_Restore(etype, evalue, etb);
+      self->closed=1;
+    }
+  Py_CLEAR(self->queue);
+
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/* Queues work for a new AsyncCursor which the future returns */
+static PyObject *
+APSWAsyncConnection_cursorcall(APSWAsyncConnection *self, int kind, PyObject *args)
+{
+  APSWAsyncCursor *acursor;
+
+  acursor=PyObject_New(APSWAsyncCursor, &APSWAsyncCursorType);
+  if(!acursor)
+    return NULL;
+  acursor->connection=self;
+  Py_INCREF(self);
+  acursor->cursor=NULL;
+  acursor->pos=0;
+  acursor->done=0;
+  acursor->weakreflist=NULL;
+  acursor->rows=PyList_New(0);
+  if(!acursor->rows)
+    {
+      Py_DECREF(acursor);
+      return NULL;
+    }
+
+  Py_INCREF(args);
+  return apswasync_submit(self, kind, (PyObject*)acursor, args);
+}
+
+/** .. method:: execute(statements, bindings=None) -> AsyncCursor
+
+  Awaitable that runs :meth:`Cursor.execute` on a new cursor in the
+  worker and gives back an :class:`AsyncCursor` for the results.
+*/
+static PyObject *
+APSWAsyncConnection_execute(APSWAsyncConnection *self, PyObject *args)
+{
+  CHECK_ASYNC_CLOSED(self, NULL);
+
+  return APSWAsyncConnection_cursorcall(self, ASYNC_EXECUTE, args);
+}
+
+/** .. method:: executemany(statements, sequenceofbindings) -> AsyncCursor
+
+  Awaitable that runs :meth:`Cursor.executemany` on a new cursor in
+  the worker and gives back an :class:`AsyncCursor` for the results.
+*/
+static PyObject *
+APSWAsyncConnection_executemany(APSWAsyncConnection *self, PyObject *args)
+{
+  CHECK_ASYNC_CLOSED(self, NULL);
+
+  return APSWAsyncConnection_cursorcall(self, ASYNC_EXECUTEMANY, args);
+}
+
+/** .. method:: run(callable, *args)
+
+  Awaitable that calls *callable(connection, \*args)* in the worker
+  with the :class:`Connection` and gives back its result.  Use it for
+  anything else the connection does, or to run several statements
+  without requests from other coroutines in between::
+
+    def transfer(db, amount):
+        with db:
+            db.cursor().execute("update account set balance=balance-? where id=1", (amount,))
+            db.cursor().execute("update account set balance=balance+? where id=2", (amount,))
+
+    await adb.run(transfer, 100)
+*/
+static PyObject *
+APSWAsyncConnection_run(APSWAsyncConnection *self, PyObject *args)
+{
+  CHECK_ASYNC_CLOSED(self, NULL);
+
+  if(PyTuple_GET_SIZE(args)<1 || !PyCallable_Check(PyTuple_GET_ITEM(args, 0)))
+    return PyErr_Format(PyExc_TypeError, "The first argument must be a callable");
+
+  Py_INCREF(args);
+  return apswasync_submit(self, ASYNC_RUN, NULL, args);
+}
+
+/** .. method:: close()
+
+  Awaitable that closes the :class:`Connection` once the requests
+  already made have run, and then stops the worker thread.  Any
+  further requests raise :exc:`ConnectionClosedError`.  The connection
+  is also closed when the object is garbage collected.
+*/
+static PyObject *
+APSWAsyncConnection_close(APSWAsyncConnection *self)
+{
+  PyObject *res;
+
+  if(self->closed)
+    {
+      Py_INCREF(Py_None);
+      return asyncresult(Py_None);
+    }
+
+  res=apswasync_submit(self, ASYNC_CLOSE, NULL, NULL);
+  if(res)
+    self->closed=1;
+  return res;
+}
+
+/** .. method:: __aenter__() -> AsyncConnection
+
+  You can use the connection with **async with**, which closes it at
+  the end of the block::
+
+    async with apsw.AsyncConnection("app.db") as db:
+        ...
+*/
+static PyObject *
+APSWAsyncConnection_aenter(APSWAsyncConnection *self)
+{
+  CHECK_ASYNC_CLOSED(self, NULL);
+
+  Py_INCREF(self);
+  return asyncresult((PyObject*)self);
+}
+
+/** .. method:: __aexit__() -> False
+
+  Closes the connection as :meth:`~AsyncConnection.close` does.
+  Exceptions are not suppressed.
+*/
+static PyObject *
+APSWAsyncConnection_aexit(APSWAsyncConnection *self, APSW_ARGUNUSED PyObject *args)
+{
+  return APSWAsyncConnection_close(self);
+}
+
+static PyMethodDef APSWAsyncConnection_methods[]={
+  {"execute", (PyCFunction)APSWAsyncConnection_execute, METH_VARARGS,
+   "Executes statements in the worker"},
+  {"executemany", (PyCFunction)APSWAsyncConnection_executemany, METH_VARARGS,
+   "Executes statements repeatedly in the worker"},
+  {"run", (PyCFunction)APSWAsyncConnection_run, METH_VARARGS,
+   "Calls a function with the connection in the worker"},
+  {"close", (PyCFunction)APSWAsyncConnection_close, METH_NOARGS,
+   "Closes the connection"},
+  {"__aenter__", (PyCFunction)APSWAsyncConnection_aenter, METH_NOARGS,
+   "Async context manager entry"},
+  {"__aexit__", (PyCFunction)APSWAsyncConnection_aexit, METH_VARARGS,
+   "Async context manager exit"},
+  {0, 0, 0, 0}
+};
+
+/* ASYNC CURSOR */
+
+static void
+APSWAsyncCursor_dealloc(APSWAsyncCursor *self)
+{
+  APSW_CLEAR_WEAKREFS;
+
+  /* the cursor can only be used in the worker */
+  if(self->cursor)
+    {
+      PyObject *etype, *evalue, *etb;
+
+      PyErr_Fetch(&etype, &evalue, &etb);
+      if(asyncqueue_put(self->connection->queue, ASYNC_CLOSECURSOR, NULL, NULL, self->cursor, NULL))
+        apsw_write_unraiseable(NULL);
+      PyErr_Restore(etype, evalue, etb);
+      self->cursor=NULL;
+    }
+  Py_CLEAR(self->rows);
+  Py_CLEAR(self->connection);
+
+  PyObject_Del(self);
+}
+
+/* Returns an awaitable for rows already fetched or asks the worker
+   for more */
+static PyObject *
+APSWAsyncCursor_fetch(APSWAsyncCursor *self, int mode)
+{
+  PyObject *res;
+
+  CHECK_ASYNC_CLOSED(self->connection, NULL);
+
+  if(self->done || (mode!=ASYNC_FETCH_ALL && self->pos<PyList_GET_SIZE(self->rows)))
+    return asyncresult(asynccursor_take(self, mode));
+
+  Py_INCREF(self);
+  res=PyLong_FromLong(mode);
+  if(!res)
+    {
+      Py_DECREF(self);
+      return NULL;
+    }
+  return apswasync_submit(self->connection, ASYNC_FETCH, (PyObject*)self, res);
+}
+
+static PyObject *
+APSWAsyncCursor_aiter(APSWAsyncCursor *self)
+{
+  Py_INCREF(self);
+  return (PyObject*)self;
+}
+
+/* StopAsyncIteration is raised directly once all rows are taken */
+static PyObject *
+APSWAsyncCursor_anext(APSWAsyncCursor *self)
+{
+  return APSWAsyncCursor_fetch(self, ASYNC_FETCH_NEXT);
+}
+
+/** .. method:: fetchone() -> row or None
+
+  Awaitable giving the next row, or None when there are no more.
+*/
+static PyObject *
+APSWAsyncCursor_fetchone(APSWAsyncCursor *self)
+{
+  return APSWAsyncCursor_fetch(self, ASYNC_FETCH_ONE);
+}
+
+/** .. method:: fetchall() -> list
+
+  Awaitable giving a list of all the remaining rows.
+*/
+static PyObject *
+APSWAsyncCursor_fetchall(APSWAsyncCursor *self)
+{
+  return APSWAsyncCursor_fetch(self, ASYNC_FETCH_ALL);
+}
+
+/** .. method:: close()
+
+  Awaitable that closes the underlying :class:`Cursor`.  This is done
+  automatically when the object is garbage collected.
+*/
+static PyObject *
+APSWAsyncCursor_close(APSWAsyncCursor *self)
+{
+  CHECK_ASYNC_CLOSED(self->connection, NULL);
+
+  Py_INCREF(self);
+  return apswasync_submit(self->connection, ASYNC_CLOSECURSOR, (PyObject*)self, NULL);
+}
+
+static PyMethodDef APSWAsyncCursor_methods[]={
+  {"fetchone", (PyCFunction)APSWAsyncCursor_fetchone, METH_NOARGS,
+   "Gets the next row"},
+  {"fetchall", (PyCFunction)APSWAsyncCursor_fetchall, METH_NOARGS,
+   "Gets all the remaining rows"},
+  {"close", (PyCFunction)APSWAsyncCursor_close, METH_NOARGS,
+   "Closes the cursor"},
+  {0, 0, 0, 0}
+};
+
+static PyAsyncMethods APSWAsyncCursor_as_async=
+  {
+    0,                                   /* am_await */
+    (unaryfunc)APSWAsyncCursor_aiter,    /* am_aiter */
+    (unaryfunc)APSWAsyncCursor_anext     /* am_anext */
+  };
+
+static PyAsyncMethods APSWAsyncResult_as_async=
+  {
+    (unaryfunc)APSWAsyncResult_await,    /* am_await */
+    0,                                   /* am_aiter */
+    0                                    /* am_anext */
+  };
+
+static PyTypeObject APSWAsyncConnectionType =
+  {
+    APSW_PYTYPE_INIT
+    "apsw.AsyncConnection",    /*tp_name*/
+    sizeof(APSWAsyncConnection), /*tp_basicsize*/
+    0,                         /*tp_itemsize*/
+    (destructor)APSWAsyncConnection_dealloc, /*tp_dealloc*/
+    0,                         /*tp_print*/
+    0,                         /*tp_getattr*/
+    0,                         /*tp_setattr*/
+    0,                         /*tp_as_async*/
+    0,                         /*tp_repr*/
+    0,                         /*tp_as_number*/
+    0,                         /*tp_as_sequence*/
+    0,                         /*tp_as_mapping*/
+    0,                         /*tp_hash */
+    0,                         /*tp_call*/
+    0,                         /*tp_str*/
+    0,                         /*tp_getattro*/
+    0,                         /*tp_setattro*/
+    0,                         /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_VERSION_TAG, /*tp_flags*/
+    "Async connection",        /* tp_doc */
+    0,		               /* tp_traverse */
+    0,		               /* tp_clear */
+    0,		               /* tp_richcompare */
+    offsetof(APSWAsyncConnection,weakreflist), /* tp_weaklistoffset */
+    0,		               /* tp_iter */
+    0,		               /* tp_iternext */
+    APSWAsyncConnection_methods, /* tp_methods */
+    0,                         /* tp_members */
+    0,                         /* tp_getset */
+    0,                         /* tp_base */
+    0,                         /* tp_dict */
+    0,                         /* tp_descr_get */
+    0,                         /* tp_descr_set */
+    0,                         /* tp_dictoffset */
+    (initproc)APSWAsyncConnection_init, /* tp_init */
+    0,                         /* tp_alloc */
+    APSWAsyncConnection_new,   /* tp_new */
+    0,                         /* tp_free */
+    0,                         /* tp_is_gc */
+    0,                         /* tp_bases */
+    0,                         /* tp_mro */
+    0,                         /* tp_cache */
+    0,                         /* tp_subclasses */
+    0,                         /* tp_weaklist */
+    0                          /* tp_del */
+    APSW_PYTYPE_VERSION
+};
+
+static PyTypeObject APSWAsyncCursorType =
+  {
+    APSW_PYTYPE_INIT
+    "apsw.AsyncCursor",        /*tp_name*/
+    sizeof(APSWAsyncCursor),   /*tp_basicsize*/
+    0,                         /*tp_itemsize*/
+    (destructor)APSWAsyncCursor_dealloc, /*tp_dealloc*/
+    0,                         /*tp_print*/
+    0,                         /*tp_getattr*/
+    0,                         /*tp_setattr*/
+    &APSWAsyncCursor_as_async, /*tp_as_async*/
+    0,                         /*tp_repr*/
+    0,                         /*tp_as_number*/
+    0,                         /*tp_as_sequence*/
+    0,                         /*tp_as_mapping*/
+    0,                         /*tp_hash */
+    0,                         /*tp_call*/
+    0,                         /*tp_str*/
+    0,                         /*tp_getattro*/
+    0,                         /*tp_setattro*/
+    0,                         /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG, /*tp_flags*/
+    "Async cursor",            /* tp_doc */
+    0,		               /* tp_traverse */
+    0,		               /* tp_clear */
+    0,		               /* tp_richcompare */
+    offsetof(APSWAsyncCursor,weakreflist), /* tp_weaklistoffset */
+    0,		               /* tp_iter */
+    0,		               /* tp_iternext */
+    APSWAsyncCursor_methods,   /* tp_methods */
+    0,                         /* tp_members */
+    0,                         /* tp_getset */
+    0,                         /* tp_base */
+    0,                         /* tp_dict */
+    0,                         /* tp_descr_get */
+    0,                         /* tp_descr_set */
+    0,                         /* tp_dictoffset */
+    0,                         /* tp_init */
+    0,                         /* tp_alloc */
+    0,                         /* tp_new */
+    0,                         /* tp_free */
+    0,                         /* tp_is_gc */
+    0,                         /* tp_bases */
+    0,                         /* tp_mro */
+    0,                         /* tp_cache */
+    0,                         /* tp_subclasses */
+    0,                         /* tp_weaklist */
+    0                          /* tp_del */
+    APSW_PYTYPE_VERSION
+};
+
+static PyTypeObject APSWAsyncResultType =
+  {
+    APSW_PYTYPE_INIT
+    "apsw.AsyncResult",        /*tp_name*/
+    sizeof(APSWAsyncResult),   /*tp_basicsize*/
+    0,                         /*tp_itemsize*/
+    (destructor)APSWAsyncResult_dealloc, /*tp_dealloc*/
+    0,                         /*tp_print*/
+    0,                         /*tp_getattr*/
+    0,                         /*tp_setattr*/
+    &APSWAsyncResult_as_async, /*tp_as_async*/
+    0,                         /*tp_repr*/
+    0,                         /*tp_as_number*/
+    0,                         /*tp_as_sequence*/
+    0,                         /*tp_as_mapping*/
+    0,                         /*tp_hash */
+    0,                         /*tp_call*/
+    0,                         /*tp_str*/
+    0,                         /*tp_getattro*/
+    0,                         /*tp_setattro*/
+    0,                         /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG, /*tp_flags*/
+    "Completed awaitable",     /* tp_doc */
+    0,		               /* tp_traverse */
+    0,		               /* tp_clear */
+    0,		               /* tp_richcompare */
+    0,                         /* tp_weaklistoffset */
+    PyObject_SelfIter,         /* tp_iter */
+    (iternextfunc)APSWAsyncResult_next, /* tp_iternext */
+    0,                         /* tp_methods */
+    0,                         /* tp_members */
+    0,                         /* tp_getset */
+    0,                         /* tp_base */
+    0,                         /* tp_dict */
+    0,                         /* tp_descr_get */
+    0,                         /* tp_descr_set */
+    0,                         /* tp_dictoffset */
+    0,                         /* tp_init */
+    0,                         /* tp_alloc */
+    0,                         /* tp_new */
+    0,                         /* tp_free */
+    0,                         /* tp_is_gc */
+    0,                         /* tp_bases */
+    0,                         /* tp_mro */
+    0,                         /* tp_cache */
+    0,                         /* tp_subclasses */
+    0,                         /* tp_weaklist */
+    0                          /* tp_del */
+    APSW_PYTYPE_VERSION
+};
@@ -43,6 +43,16 @@ If you are not using **with** then you'll need to ensure
   finally:
       b.finish()
 
+:meth:`~backup.run` does the stepping loop for you in C, retrying
+when the source is busy, and only calling back into Python for
+progress::
+
+  def report(remaining, pagecount):
+      print remaining, pagecount, "\r",
+
+  with db.backup("main", source, "main") as b:
+      b.run(100, sleep=10, progress=report)
+
 Important details
 =================
 
@@ -216,6 +226,127 @@ APSWBackup_step(APSWBackup *self, PyObject *args)
   return self->done;
 }
 
+/** .. method:: run(npages=100, sleep=0, progress=None, interval=1, busytimeout=5000) -> bool
+
+  Does the whole copy by repeatedly calling :meth:`~backup.step`,
+  with the loop in C.  The GIL is released while pages are copied and
+  while sleeping, so other Python threads can keep running.
+
+  :param npages: How many pages to copy in each step.  Negative means
+     all remaining pages in one step.
+  :param sleep: Milliseconds to sleep between steps, which gives other
+     users of the source database a chance to access it.
+  :param progress: Called with ``(remaining, pagecount)`` every
+     *interval* steps and after the last one.  If it returns a true
+     value the run stops.  You can call :meth:`~backup.run` or
+     :meth:`~backup.step` later to continue copying.
+  :param interval: How many steps between calls to *progress*.
+  :param busytimeout: If a step fails because the source database is
+     busy or locked, it is retried after waiting.  The waits start at
+     1 millisecond and double up to 128 milliseconds.  An exception is
+     raised if failures keep happening for more than this many
+     milliseconds.  Negative means retry for ever.
+
+  :returns: True if all pages were copied (the same as
+     :attr:`~backup.done`), or False if *progress* stopped the run.
+
+  You still need to call :meth:`~backup.finish`.  Python signal
+  handlers (for example for keyboard interrupts) run between steps.
+  Exceptions they raise stop the run.
+
+  -* sqlite3_backup_step sqlite3_sleep
+*/
+static PyObject *
+APSWBackup_run(APSWBackup *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[]={"npages", "sleep", "progress", "interval", "busytimeout", NULL};
+  int npages=100, sleepms=0, interval=1, busytimeout=5000;
+  int res, steps=0, waited=0, backoff=1, stop;
+  PyObject *progress=NULL, *pyres;
+
+  CHECK_USE(NULL);
+  CHECK_BACKUP_CLOSED(NULL);
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "|iiOii:run(npages=100, sleep=0, progress=None, interval=1, busytimeout=5000)",
+                                  kwlist, &npages, &sleepms, &progress, &interval, &busytimeout))
+    return NULL;
+
+  if(progress==Py_None)
+    progress=NULL;
+  if(progress && !PyCallable_Check(progress))
+    return PyErr_Format(PyExc_TypeError, "progress must be callable");
+  if(sleepms<0 || interval<1)
+    return PyErr_Format(PyExc_ValueError, "sleep must be zero or positive and interval at least one");
+
+  for(;;)
+    {
+      if(PyErr_CheckSignals())
+        return NULL;
+
+      PYSQLITE_BACKUP_CALL(res=sqlite3_backup_step(self->backup, npages));
+      if(PyErr_Occurred())
+        return NULL;
+
+      if((res&0xff)==SQLITE_BUSY || (res&0xff)==SQLITE_LOCKED)
+        {
+          if(busytimeout>=0 && waited>=busytimeout)
+            {
+              SET_EXC(res, NULL);
+              return NULL;
+            }
+          INUSE_CALL(_PYSQLITE_CALL_V(sqlite3_sleep(backoff)));
+          waited+=backoff;
+          if(backoff<128)
+            backoff*=2;
+          continue;
+        }
+      waited=0;
+      backoff=1;
+
+      if(res==SQLITE_DONE)
+        {
+          if(self->done!=Py_True)
+            {
+              Py_CLEAR(self->done);
+              self->done=Py_True;
+              Py_INCREF(self->done);
+            }
+        }
+      else if(res)
+        {
+          SET_EXC(res, NULL);
+          return NULL;
+        }
+
+      steps++;
+      if(progress && (res==SQLITE_DONE || steps%interval==0))
+        {
+          pyres=PyObject_CallFunction(progress, "ii", sqlite3_backup_remaining(self->backup), sqlite3_backup_pagecount(self->backup));
+          if(!pyres)
+            {
+              AddTraceBackHere(__FILE__, __LINE__, "backup.run.progress", "{s: O}", "progress", progress);
+              return NULL;
+            }
+          stop=PyObject_IsTrue(pyres);
+          Py_DECREF(pyres);
+          if(stop<0)
+            return NULL;
+          if(res==SQLITE_DONE || stop)
+            break;
+          /* the callback could have finished the backup or closed the connections */
+          CHECK_BACKUP_CLOSED(NULL);
+        }
+      if(res==SQLITE_DONE)
+        break;
+
+      if(sleepms)
+        INUSE_CALL(_PYSQLITE_CALL_V(sqlite3_sleep(sleepms)));
+    }
+
+  Py_INCREF(self->done);
+  return self->done;
+}
+
 /** .. method:: finish()
 
   Completes the copy process.  If all pages have been copied then the
@@ -383,6 +514,8 @@ static PyMethodDef backup_methods[] = {
    "Context manager exit"},
   {"step", (PyCFunction)APSWBackup_step, METH_VARARGS,
    "Copies some pages"},
+  {"run", (PyCFunction)APSWBackup_run, METH_VARARGS|METH_KEYWORDS,
+   "Copies all pages"},
   {"finish", (PyCFunction)APSWBackup_finish, METH_NOARGS,
    "Commits or rollsback backup"},
   {"close", (PyCFunction)APSWBackup_close, METH_VARARGS,
@@ -159,6 +159,18 @@ static PyTypeObject ZeroBlobBindType = {
 
 
 
+/* raw file descriptor io for copy_to and copy_from */
+#ifdef _WIN32
+#include <io.h>
+#define apsw_fdread(fd, buf, n)  _read(fd, buf, (unsigned)(n))
+#define apsw_fdwrite(fd, buf, n) _write(fd, buf, (unsigned)(n))
+#else
+#include <unistd.h>
+#define apsw_fdread(fd, buf, n)  read(fd, buf, n)
+#define apsw_fdwrite(fd, buf, n) write(fd, buf, n)
+#endif
+#include <errno.h>
+
 /* BLOB TYPE */
 struct APSWBlob {
   PyObject_HEAD
@@ -167,6 +179,9 @@ struct APSWBlob {
   unsigned inuse;                 /* track if we are in use preventing concurrent thread mangling */
   int curoffset;                  /* SQLite only supports 32 bit signed int offsets */
   PyObject *weakreflist;          /* weak reference tracking */
+  char *poolkey;                  /* non-NULL if the handle can be parked in the connection blob pool on close */
+  size_t poolkeylen;
+  int poolable;                   /* cleared once an error has been seen */
 };
 
 typedef struct APSWBlob APSWBlob;
@@ -193,7 +208,7 @@ static PyTypeObject APSWBlobType;
 */
 
 static void
-APSWBlob_init(APSWBlob *self, Connection *connection, sqlite3_blob *blob)
+APSWBlob_init(APSWBlob *self, Connection *connection, sqlite3_blob *blob, char *poolkey, size_t poolkeylen)
 {
   Py_INCREF(connection);
   self->connection=connection;
@@ -201,6 +216,9 @@ APSWBlob_init(APSWBlob *self, Connection *connection, sqlite3_blob *blob)
   self->curoffset=0;
   self->inuse=0;
   self->weakreflist=NULL;
+  self->poolkey=poolkey;
+  self->poolkeylen=poolkeylen;
+  self->poolable=1;
 }
 
 static int
@@ -215,6 +233,14 @@ APSWBlob_close_internal(APSWBlob *self, int force)
   /* note that sqlite3_blob_close always works even if an error is
      returned - see sqlite ticket #2815 */
 
+  /* a healthy handle can be parked for reuse instead */
+  if(self->pBlob && self->poolkey && self->poolable && self->connection
+     && Connection_blobpool_park(self->connection, self->pBlob, self->poolkey, self->poolkeylen))
+    {
+      self->pBlob=0;
+      self->poolkey=0;
+    }
+
   if(self->pBlob)
     {
       int res;
@@ -237,6 +263,9 @@ APSWBlob_close_internal(APSWBlob *self, int force)
       self->pBlob=0;
     }
 
+  PyMem_Free(self->poolkey);
+  self->poolkey=0;
+
  /* Remove from connection dependents list.  Has to be done before we
      decref self->connection otherwise connection could dealloc and
      we'd still be in list */
@@ -340,6 +369,7 @@ APSWBlob_read(APSWBlob *self, PyObject *args)
   if(res!=SQLITE_OK)
     {
       Py_DECREF(buffy);
+      self->poolable=0;
       SET_EXC(res, self->connection->db);
       return NULL;
     }
@@ -437,6 +467,7 @@ APSWBlob_readinto(APSWBlob *self, PyObject *args)
 
   if(res!=SQLITE_OK)
     {
+      self->poolable=0;
       SET_EXC(res, self->connection->db);
       return NULL;
     }
@@ -553,6 +584,7 @@ APSWBlob_write(APSWBlob *self, PyObject *obj)
 
   if(res!=SQLITE_OK)
     {
+      self->poolable=0;
       SET_EXC(res, self->connection->db);
       return NULL;
     }
@@ -562,6 +594,378 @@ APSWBlob_write(APSWBlob *self, PyObject *obj)
   Py_RETURN_NONE;
 }
 
+/* Writes all of buffer to fd with the GIL released.  Returns -1 with
+   an exception on failure. */
+static int
+APSWBlob_fdwriteall(APSWBlob *self, int fd, const char *buffer, int amount)
+{
+  int written, err=0;
+
+  while(amount)
+    {
+      INUSE_CALL(_PYSQLITE_CALL_V(written=(int)apsw_fdwrite(fd, buffer, amount); err=errno));
+      if(written<0)
+        {
+          if(err==EINTR && !PyErr_CheckSignals())
+            continue;
+          if(!PyErr_Occurred())
+            {
+              errno=err;
+              PyErr_SetFromErrno(PyExc_OSError);
+            }
+          return -1;
+        }
+      buffer+=written;
+      amount-=written;
+    }
+  return 0;
+}
+
+/* Reads up to amount from fd with the GIL released, returning how
+   many bytes were read (zero at end of file) or -1 with an
+   exception. */
+static int
+APSWBlob_fdread(APSWBlob *self, int fd, char *buffer, int amount)
+{
+  int got, err=0;
+
+  for(;;)
+    {
+      INUSE_CALL(_PYSQLITE_CALL_V(got=(int)apsw_fdread(fd, buffer, amount); err=errno));
+      if(got>=0)
+        return got;
+      if(err==EINTR && !PyErr_CheckSignals())
+        continue;
+      if(!PyErr_Occurred())
+        {
+          errno=err;
+          PyErr_SetFromErrno(PyExc_OSError);
+        }
+      return -1;
+    }
+}
+
+/* works out how much to copy for copy_to and copy_from */
+static int
+APSWBlob_copylength(APSWBlob *self, int length, int chunk)
+{
+  int remaining=sqlite3_blob_bytes(self->pBlob)-self->curoffset;
+
+  if(chunk<1)
+    {
+      PyErr_Format(PyExc_ValueError, "chunk must be at least one");
+      return -1;
+    }
+  if(length<0)
+    return remaining;
+  if(length>remaining)
+    {
+      PyErr_Format(PyExc_ValueError, "length %d is more than the %d bytes remaining in the blob", length, remaining);
+      return -1;
+    }
+  return length;
+}
+
+/** .. method:: copy_to(dest[, length=remaining, chunk=1048576]) -> int
+
+  Copies from the current position in the blob to *dest*.  This is
+  quicker than :meth:`~blob.read` in a Python loop, especially for
+  large blobs.
+
+  :param dest: Either an integer file descriptor, or an object with a
+     ``write`` method such as a Python file.  File descriptors are
+     written to directly with the GIL released.
+  :param length: How many bytes to copy.  The default is up to the end
+     of the blob.
+  :param chunk: How many bytes are copied at a time.
+
+  :returns: The number of bytes copied.  The current position is
+     advanced by that amount, even if an exception happens part way.
+
+  -* sqlite3_blob_read
+*/
+static PyObject *
+APSWBlob_copy_to(APSWBlob *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[]={"dest", "length", "chunk", NULL};
+  PyObject *dest=NULL, *writemeth=NULL, *chunkbuf=NULL, *pyres=NULL, *result=NULL;
+  int length=-1, chunk=1024*1024, fd=-1, usefd, copied=0, amount, written, res;
+  char *buffer=NULL;
+
+  CHECK_USE(NULL);
+  CHECK_BLOB_CLOSED;
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|ii:copy_to(dest, length=remaining, chunk=1048576)", kwlist, &dest, &length, &chunk))
+    return NULL;
+
+  length=APSWBlob_copylength(self, length, chunk);
+  if(length<0)
+    return NULL;
+
+  usefd=PyIntLong_Check(dest);
+  if(usefd)
+    {
+      fd=PyIntLong_AsLong(dest);
+      if(PyErr_Occurred())
+        return NULL;
+      buffer=PyMem_Malloc(length<chunk?(length?length:1):chunk);
+      if(!buffer)
+        return PyErr_NoMemory();
+    }
+  else
+    {
+      writemeth=PyObject_GetAttrString(dest, "write");
+      if(!writemeth)
+        return NULL;
+    }
+
+  while(copied<length)
+    {
+      amount=length-copied<chunk?length-copied:chunk;
+      if(!usefd)
+        {
+          chunkbuf=PyBytes_FromStringAndSize(NULL, amount);
+          if(!chunkbuf)
+            goto finally;
+          buffer=PyBytes_AS_STRING(chunkbuf);
+        }
+
+      PYSQLITE_BLOB_CALL(res=sqlite3_blob_read(self->pBlob, buffer, amount, self->curoffset));
+      if(PyErr_Occurred())
+        goto finally;
+      if(res!=SQLITE_OK)
+        {
+          self->poolable=0;
+          SET_EXC(res, self->connection->db);
+          goto finally;
+        }
+
+      if(usefd)
+        {
+          if(APSWBlob_fdwriteall(self, fd, buffer, amount))
+            goto finally;
+        }
+      else
+        {
+          /* raw files can do partial writes returning how much they wrote */
+          for(written=0; written<amount;)
+            {
+              if(written)
+                {
+                  PyObject *rest=PyBytes_FromStringAndSize(buffer+written, amount-written);
+                  if(!rest)
+                    goto finally;
+                  Py_DECREF(chunkbuf);
+                  chunkbuf=rest;
+                  buffer=PyBytes_AS_STRING(chunkbuf);
+                  amount-=written;
+                  written=0;
+                }
+              pyres=PyObject_CallFunctionObjArgs(writemeth, chunkbuf, NULL);
+              if(!pyres)
+                goto finally;
+              written=amount;
+              if(PyIntLong_Check(pyres))
+                {
+                  long w=PyIntLong_AsLong(pyres);
+                  if(w>=0 && w<amount)
+                    written=(int)w;
+                }
+              Py_CLEAR(pyres);
+              /* the partial write is accounted for */
+              self->curoffset+=written;
+              copied+=written;
+              if(!self->pBlob)
+                {
+                  PyErr_Format(PyExc_ValueError, "I/O operation on closed blob");
+                  goto finally;
+                }
+              if(written==0)
+                {
+                  PyErr_Format(PyExc_IOError, "write wrote nothing");
+                  goto finally;
+                }
+            }
+          Py_CLEAR(chunkbuf);
+          continue;
+        }
+      self->curoffset+=amount;
+      copied+=amount;
+    }
+
+  result=PyInt_FromLong(copied);
+
+ finally:
+  if(PyErr_Occurred())
+    AddTraceBackHere(__FILE__, __LINE__, "blob.copy_to", "{s: O, s: i, s: i}", "dest", dest, "length", length, "copied", copied);
+  Py_XDECREF(chunkbuf);
+  Py_XDECREF(writemeth);
+  if(usefd)
+    PyMem_Free(buffer);
+  return result;
+}
+
+/** .. method:: copy_from(source[, length=remaining, chunk=1048576]) -> int
+
+  Copies from *source* into the blob starting at the current
+  position.  Copying stops when *length* bytes have been copied or the
+  end of *source* is reached.  You cannot increase the size of a blob
+  - see :meth:`~blob.write`.
+
+  :param source: Either an integer file descriptor, or a file like
+     object.  File descriptors are read directly with the GIL
+     released.  Objects with a ``readinto`` method have it called
+     with a reused buffer, otherwise ``read`` is called.
+  :param length: Maximum number of bytes to copy.  The default is up
+     to the end of the blob.
+  :param chunk: How many bytes are copied at a time.
+
+  :returns: The number of bytes copied.  The current position is
+     advanced by that amount, even if an exception happens part way.
+
+  :raises ValueError: If *length* goes beyond the end of the blob.
+
+  -* sqlite3_blob_write
+*/
+static PyObject *
+APSWBlob_copy_from(APSWBlob *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[]={"source", "length", "chunk", NULL};
+  PyObject *source=NULL, *readmeth=NULL, *chunkbuf=NULL, *pyres=NULL, *result=NULL;
+  int length=-1, chunk=1024*1024, fd=-1, usefd, usereadinto=0, copied=0, amount, got, res;
+  char *buffer=NULL;
+  const void *data;
+  Py_ssize_t size;
+
+  CHECK_USE(NULL);
+  CHECK_BLOB_CLOSED;
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|ii:copy_from(source, length=remaining, chunk=1048576)", kwlist, &source, &length, &chunk))
+    return NULL;
+
+  length=APSWBlob_copylength(self, length, chunk);
+  if(length<0)
+    return NULL;
+  if(chunk>length)
+    chunk=length?length:1;
+
+  usefd=PyIntLong_Check(source);
+  if(usefd)
+    {
+      fd=PyIntLong_AsLong(source);
+      if(PyErr_Occurred())
+        return NULL;
+      buffer=PyMem_Malloc(chunk);
+      if(!buffer)
+        return PyErr_NoMemory();
+    }
+  else
+    {
+      readmeth=PyObject_GetAttrString(source, "readinto");
+      if(readmeth)
+        {
+          usereadinto=1;
+          chunkbuf=PyByteArray_FromStringAndSize(NULL, chunk);
+          if(!chunkbuf)
+            goto finally;
+        }
+      else
+        {
+          PyErr_Clear();
+          readmeth=PyObject_GetAttrString(source, "read");
+          if(!readmeth)
+            return NULL;
+        }
+    }
+
+  while(copied<length)
+    {
+      amount=length-copied<chunk?length-copied:chunk;
+      if(usefd)
+        {
+          got=APSWBlob_fdread(self, fd, buffer, amount);
+          if(got<0)
+            goto finally;
+          data=buffer;
+        }
+      else
+        {
+          if(usereadinto)
+            {
+              /* only offer the space being copied */
+              if(PyByteArray_GET_SIZE(chunkbuf)!=amount && PyByteArray_Resize(chunkbuf, amount))
+                goto finally;
+              pyres=PyObject_CallFunctionObjArgs(readmeth, chunkbuf, NULL);
+            }
+          else
+            pyres=PyObject_CallFunction(readmeth, "i", amount);
+          if(!pyres)
+            goto finally;
+          if(!self->pBlob)
+            {
+              PyErr_Format(PyExc_ValueError, "I/O operation on closed blob");
+              goto finally;
+            }
+          if(usereadinto)
+            {
+              if(!PyIntLong_Check(pyres))
+                {
+                  PyErr_Format(PyExc_TypeError, "readinto should return the number of bytes read");
+                  goto finally;
+                }
+              size=PyIntLong_AsLong(pyres);
+              if(PyErr_Occurred())
+                goto finally;
+              data=PyByteArray_AS_STRING(chunkbuf);
+            }
+          else
+            {
+              if(PyUnicode_Check(pyres) || !PyObject_CheckReadBuffer(pyres))
+                {
+                  PyErr_Format(PyExc_TypeError, "read should return bytes/buffer/string");
+                  goto finally;
+                }
+              if(PyObject_AsReadBuffer(pyres, &data, &size))
+                goto finally;
+            }
+          if(size<0 || size>amount)
+            {
+              PyErr_Format(PyExc_ValueError, "Read %d bytes but asked for %d", (int)size, amount);
+              goto finally;
+            }
+          got=(int)size;
+        }
+
+      if(got==0)
+        break;
+
+      PYSQLITE_BLOB_CALL(res=sqlite3_blob_write(self->pBlob, data, got, self->curoffset));
+      Py_CLEAR(pyres);
+      if(PyErr_Occurred())
+        goto finally;
+      if(res!=SQLITE_OK)
+        {
+          self->poolable=0;
+          SET_EXC(res, self->connection->db);
+          goto finally;
+        }
+      self->curoffset+=got;
+      copied+=got;
+    }
+
+  result=PyInt_FromLong(copied);
+
+ finally:
+  if(PyErr_Occurred())
+    AddTraceBackHere(__FILE__, __LINE__, "blob.copy_from", "{s: O, s: i, s: i}", "source", source, "length", length, "copied", copied);
+  Py_XDECREF(pyres);
+  Py_XDECREF(chunkbuf);
+  Py_XDECREF(readmeth);
+  if(usefd)
+    PyMem_Free(buffer);
+  return result;
+}
+
 /** .. method:: close([force=False])
 
   Closes the blob.  Note that even if an error occurs the blob is
@@ -690,12 +1094,48 @@ APSWBlob_reopen(APSWBlob *self, PyObject *arg)
 
   if(res!=SQLITE_OK)
     {
+      self->poolable=0;
       SET_EXC(res, self->connection->db);
       return NULL;
     }
   Py_RETURN_NONE;
 }
 
+/* Returns the whole of the blob as bytes */
+static PyObject *
+APSWBlob_readall(APSWBlob *self)
+{
+  int length, res;
+  PyObject *buffy;
+
+  CHECK_USE(NULL);
+  CHECK_BLOB_CLOSED;
+
+  length=sqlite3_blob_bytes(self->pBlob);
+  buffy=PyBytes_FromStringAndSize(NULL, length);
+  if(!buffy)
+    return NULL;
+
+  if(length)
+    {
+      PYSQLITE_BLOB_CALL(res=sqlite3_blob_read(self->pBlob, PyBytes_AS_STRING(buffy), length, 0));
+      if(PyErr_Occurred())
+        {
+          Py_DECREF(buffy);
+          return NULL;
+        }
+      if(res!=SQLITE_OK)
+        {
+          Py_DECREF(buffy);
+          self->poolable=0;
+          SET_EXC(res, self->connection->db);
+          return NULL;
+        }
+    }
+  self->curoffset=length;
+  return buffy;
+}
+
 static PyMethodDef APSWBlob_methods[]={
   {"length", (PyCFunction)APSWBlob_length, METH_NOARGS,
    "Returns length in bytes of the blob"},
@@ -709,6 +1149,10 @@ static PyMethodDef APSWBlob_methods[]={
    "Returns current blob offset"},
   {"write", (PyCFunction)APSWBlob_write, METH_O,
    "Writes data to blob"},
+  {"copy_to", (PyCFunction)APSWBlob_copy_to, METH_VARARGS|METH_KEYWORDS,
+   "Copies the blob to a file"},
+  {"copy_from", (PyCFunction)APSWBlob_copy_from, METH_VARARGS|METH_KEYWORDS,
+   "Copies a file into the blob"},
   {"reopen", (PyCFunction)APSWBlob_reopen, METH_O,
    "Changes the blob to point to a different row"},
   {"close", (PyCFunction)APSWBlob_close, METH_VARARGS,
@@ -769,3 +1213,174 @@ static PyTypeObject APSWBlobType = {
     0                          /* tp_del */
     APSW_PYTYPE_VERSION
 };
+
+/* BLOB READ MANY - the iterator returned by Connection.blobreadmany */
+
+typedef struct {
+  PyObject_HEAD
+  Connection *connection;
+  char *dbname, *tablename, *column;
+  PyObject *rowids;               /* iterator of rowids, NULL once exhausted */
+  APSWBlob *blob;                 /* handle repositioned for each row */
+} APSWBlobReadMany;
+
+static PyTypeObject APSWBlobReadManyType;
+
+/* Takes ownership of the names which were allocated by PyArg_ParseTuple */
+static PyObject *
+APSWBlobReadMany_create(Connection *connection, char *dbname, char *tablename, char *column, PyObject *rowids)
+{
+  APSWBlobReadMany *self=0;
+  PyObject *iterator;
+
+  iterator=PyObject_GetIter(rowids);
+  if(iterator)
+    self=PyObject_New(APSWBlobReadMany, &APSWBlobReadManyType);
+  if(!self)
+    {
+      Py_XDECREF(iterator);
+      PyMem_Free(dbname);
+      PyMem_Free(tablename);
+      PyMem_Free(column);
+      return NULL;
+    }
+
+  Py_INCREF(connection);
+  self->connection=connection;
+  self->dbname=dbname;
+  self->tablename=tablename;
+  self->column=column;
+  self->rowids=iterator;
+  self->blob=0;
+  return (PyObject*)self;
+}
+
+static void
+APSWBlobReadMany_dealloc(APSWBlobReadMany *self)
+{
+  Py_CLEAR(self->blob);
+  Py_CLEAR(self->rowids);
+  Py_CLEAR(self->connection);
+  PyMem_Free(self->dbname);
+  PyMem_Free(self->tablename);
+  PyMem_Free(self->column);
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject *
+APSWBlobReadMany_next(APSWBlobReadMany *self)
+{
+  PyObject *item, *res;
+
+  if(!self->rowids)
+    return NULL;
+
+  CHECK_CLOSED(self->connection, NULL);
+
+  item=PyIter_Next(self->rowids);
+  if(!item)
+    {
+      if(PyErr_Occurred())
+        return NULL;
+      /* exhausted - release the handle now (parking it if pooling is
+         on) rather than whenever we get garbage collected */
+      Py_CLEAR(self->rowids);
+      if(self->blob)
+        APSWBlob_close_internal(self->blob, 2);
+      Py_CLEAR(self->blob);
+      return NULL;
+    }
+
+  if(!self->blob)
+    {
+      long long rowid;
+
+      if(!PyIntLong_Check(item))
+        {
+          Py_DECREF(item);
+          return PyErr_Format(PyExc_TypeError, "rowids must be integers");
+        }
+      rowid=PyLong_AsLongLong(item);
+      Py_DECREF(item);
+      if(PyErr_Occurred())
+        return NULL;
+      self->blob=(APSWBlob*)Connection_blobopen_internal(self->connection, self->dbname, self->tablename, self->column, rowid, 0);
+      if(!self->blob)
+        return NULL;
+    }
+  else
+    {
+      res=APSWBlob_reopen(self->blob, item);
+      Py_DECREF(item);
+      if(!res)
+        {
+          /* the handle can't be reused after a failed reopen */
+          Py_CLEAR(self->blob);
+          return NULL;
+        }
+      Py_DECREF(res);
+    }
+
+  return APSWBlob_readall(self->blob);
+}
+
+static PyObject *
+APSWBlobReadMany_iter(APSWBlobReadMany *self)
+{
+  Py_INCREF(self);
+  return (PyObject*)self;
+}
+
+static PyTypeObject APSWBlobReadManyType = {
+    APSW_PYTYPE_INIT
+    "apsw.blobreadmany",       /*tp_name*/
+    sizeof(APSWBlobReadMany),  /*tp_basicsize*/
+    0,                         /*tp_itemsize*/
+    (destructor)APSWBlobReadMany_dealloc, /*tp_dealloc*/
+    0,                         /*tp_print*/
+    0,                         /*tp_getattr*/
+    0,                         /*tp_setattr*/
+    0,                         /*tp_compare*/
+    0,                         /*tp_repr*/
+    0,                         /*tp_as_number*/
+    0,                         /*tp_as_sequence*/
+    0,                         /*tp_as_mapping*/
+    0,                         /*tp_hash */
+    0,                         /*tp_call*/
+    0,                         /*tp_str*/
+    0,                         /*tp_getattro*/
+    0,                         /*tp_setattro*/
+    0,                         /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_HAVE_VERSION_TAG
+#if PY_MAJOR_VERSION < 3
+ | Py_TPFLAGS_HAVE_ITER
+#endif
+    , /*tp_flags*/
+    "APSW blob read many iterator", /* tp_doc */
+    0,		               /* tp_traverse */
+    0,		               /* tp_clear */
+    0,		               /* tp_richcompare */
+    0,                         /* tp_weaklistoffset */
+    (getiterfunc)APSWBlobReadMany_iter, /* tp_iter */
+    (iternextfunc)APSWBlobReadMany_next, /* tp_iternext */
+    0,                         /* tp_methods */
+    0,                         /* tp_members */
+    0,                         /* tp_getset */
+    0,                         /* tp_base */
+    0,                         /* tp_dict */
+    0,                         /* tp_descr_get */
+    0,                         /* tp_descr_set */
+    0,                         /* tp_dictoffset */
+    0,                         /* tp_init */
+    0,                         /* tp_alloc */
+    0,                         /* tp_new */
+    0,                         /* tp_free */
+    0,                         /* tp_is_gc */
+    0,                         /* tp_bases */
+    0,                         /* tp_mro */
+    0,                         /* tp_cache */
+    0,                         /* tp_subclasses */
+    0,                         /* tp_weaklist */
+    0                          /* tp_del */
+    APSW_PYTYPE_VERSION
+};
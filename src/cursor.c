@@ -149,19 +149,58 @@ struct APSWCursor {
   PyObject *weakreflist;
 
   PyObject *description_cache[2];
+
+  /* row factory */
+  int rowfactory;                  /* ROWFACTORY_ value or -1 to use the connection's */
+  PyObject *rowfields;             /* tuple of column names for the current statement */
+  PyObject *rowindex;              /* dict of column name to position in rowfields */
+
+  /* column views */
+  unsigned rowgeneration;          /* changes whenever the statement moves so column views know they are stale */
+  int viewexports;                 /* buffers exported by column views, which pin the current row */
 };
 
 typedef struct APSWCursor APSWCursor;
 static PyTypeObject APSWCursorType;
 
+/* Direct access to the memory of a TEXT/BLOB column in the current row */
+typedef struct ColumnView {
+  PyObject_HEAD
+  APSWCursor *cursor;              /* cursor whose row this is */
+  unsigned rowgeneration;          /* the cursor rowgeneration when made */
+  const void *data;                /* the SQLite owned bytes */
+  Py_ssize_t length;               /* how many there are */
+} ColumnView;
+
+static PyTypeObject ColumnViewType;
+
+/* A row from the "row" row factory.  The column names are shared by
+   all the rows of a statement. */
+typedef struct APSWRow {
+  PyObject_VAR_HEAD
+  PyObject *fields;                /* tuple of column names */
+  PyObject *index;                 /* dict of column name to position */
+  PyObject *items[1];              /* the values */
+} APSWRow;
+
+static PyTypeObject APSWRowType;
+
 /* CURSOR CODE */
 
 /* Macro for getting a tracer.  If our tracer is NULL or None then return 0 else return connection tracer */
 
 #define ROWTRACE   ( (self->rowtrace && self->rowtrace!=Py_None) ? self->rowtrace : ( (self->rowtrace==Py_None) ? 0 : self->connection->rowtrace ) )
 
+#define ROWFACTORY ( (self->rowfactory>=0) ? self->rowfactory : self->connection->rowfactory )
+
 #define EXECTRACE  ( (self->exectrace && self->exectrace!=Py_None) ? self->exectrace : ( (self->exectrace==Py_None) ? 0 : self->connection->exectrace ) )
 
+/* Column views with exported buffers point into the current row so it can't be moved on from */
+#define CHECK_CURSOR_VIEWS(e)                                           \
+  do { if(self->viewexports)                                            \
+      { PyErr_Format(PyExc_BufferError, "A columnview still has its buffer exported (eg as a memoryview) so the row can't change"); return e; } \
+  } while(0)
+
 
 /* Do finalization and free resources.  Returns the SQLITE error code.  If force is 2 then don't raise any exceptions */
 static int
@@ -173,6 +212,9 @@ resetcursor(APSWCursor *self, int force)
 
   Py_CLEAR(self->description_cache[0]);
   Py_CLEAR(self->description_cache[1]);
+  Py_CLEAR(self->rowfields);
+  Py_CLEAR(self->rowindex);
+  self->rowgeneration++;
 
   if(force)
     PyErr_Fetch(&etype, &eval, &etb);
@@ -250,6 +292,8 @@ APSWCursor_close_internal(APSWCursor *self, int force)
 
   if(force==2)
     PyErr_Fetch(&err_type, &err_value, &err_traceback);
+  else if(!force)
+    CHECK_CURSOR_VIEWS(1);
 
   res=resetcursor(self, force);
 
@@ -282,6 +326,8 @@ APSWCursor_close_internal(APSWCursor *self, int force)
 
   Py_CLEAR(self->description_cache[0]);
   Py_CLEAR(self->description_cache[1]);
+  Py_CLEAR(self->rowfields);
+  Py_CLEAR(self->rowindex);
 
   return 0;
 }
@@ -312,6 +358,11 @@ APSWCursor_init(APSWCursor *self, Connection *connection)
   self->weakreflist=NULL;
   self->description_cache[0]=0;
   self->description_cache[1]=0;
+  self->rowfactory=-1;
+  self->rowfields=0;
+  self->rowindex=0;
+  self->rowgeneration=0;
+  self->viewexports=0;
 }
 
 static const char *description_formats[]={
@@ -351,7 +402,7 @@ APSWCursor_internal_getdescription(APSWCursor *self, int fmtnum)
       const char *colname;
       const char *coldesc;
 
-      PYSQLITE_VOID_CALL( (colname=sqlite3_column_name(self->statement->vdbestatement, i), coldesc=sqlite3_column_decltype(self->statement->vdbestatement, i)) );
+      INUSE_CALL(_PYSQLITE_CHEAP_CALL_V(self->connection->db, (colname=sqlite3_column_name(self->statement->vdbestatement, i), coldesc=sqlite3_column_decltype(self->statement->vdbestatement, i))));
       APSW_FAULT_INJECT(GetDescriptionFail,
       column=Py_BuildValue(description_formats[fmtnum],
 			 convertutf8string, colname,
@@ -463,26 +514,26 @@ APSWCursor_dobinding(APSWCursor *self, int arg, PyObject *obj)
   assert(!PyErr_Occurred());
 
   if(obj==Py_None)
-    PYSQLITE_CUR_CALL(res=sqlite3_bind_null(self->statement->vdbestatement, arg));
+    PYSQLITE_CUR_CHEAP_CALL(res=sqlite3_bind_null(self->statement->vdbestatement, arg));
   /* Python uses a 'long' for storage of PyInt.  This could
      be a 32bit or 64bit quantity depending on the platform. */
 #if PY_MAJOR_VERSION < 3
   else if(PyInt_Check(obj))
     {
       long v=PyInt_AS_LONG(obj);
-      PYSQLITE_CUR_CALL(res=sqlite3_bind_int64(self->statement->vdbestatement, arg, v));
+      PYSQLITE_CUR_CHEAP_CALL(res=sqlite3_bind_int64(self->statement->vdbestatement, arg, v));
     }
 #endif
   else if (PyLong_Check(obj))
     {
       /* nb: PyLong_AsLongLong can cause Python level error */
       long long v=PyLong_AsLongLong(obj);
-      PYSQLITE_CUR_CALL(res=sqlite3_bind_int64(self->statement->vdbestatement, arg, v));
+      PYSQLITE_CUR_CHEAP_CALL(res=sqlite3_bind_int64(self->statement->vdbestatement, arg, v));
     }
   else if (PyFloat_Check(obj))
     {
       double v=PyFloat_AS_DOUBLE(obj);
-      PYSQLITE_CUR_CALL(res=sqlite3_bind_double(self->statement->vdbestatement, arg, v));
+      PYSQLITE_CUR_CHEAP_CALL(res=sqlite3_bind_double(self->statement->vdbestatement, arg, v));
     }
   else if (PyUnicode_Check(obj))
     {
@@ -500,7 +551,7 @@ APSWCursor_dobinding(APSWCursor *self, int arg, PyObject *obj)
                 SET_EXC(SQLITE_TOOBIG, NULL);
 	      }
 	    else
-              PYSQLITE_CUR_CALL(res=USE16(sqlite3_bind_text)(self->statement->vdbestatement, arg, strdata, strbytes, SQLITE_TRANSIENT));
+              PYSQLITE_CUR_CHEAP_CALL(res=USE16(sqlite3_bind_text)(self->statement->vdbestatement, arg, strdata, strbytes, SQLITE_TRANSIENT));
           }
       UNIDATAEND(obj);
       if(!badptr)
@@ -538,7 +589,7 @@ APSWCursor_dobinding(APSWCursor *self, int arg, PyObject *obj)
                     res=SQLITE_TOOBIG;
 		  }
 		else
-                  PYSQLITE_CUR_CALL(res=USE16(sqlite3_bind_text)(self->statement->vdbestatement, arg, strdata, strbytes, SQLITE_TRANSIENT));
+                  PYSQLITE_CUR_CHEAP_CALL(res=USE16(sqlite3_bind_text)(self->statement->vdbestatement, arg, strdata, strbytes, SQLITE_TRANSIENT));
               }
           UNIDATAEND(str2);
           Py_DECREF(str2);
@@ -551,7 +602,7 @@ APSWCursor_dobinding(APSWCursor *self, int arg, PyObject *obj)
       else
 	{
 	  assert(lenval<APSW_INT32_MAX);
-	  PYSQLITE_CUR_CALL(res=sqlite3_bind_text(self->statement->vdbestatement, arg, val, lenval, SQLITE_TRANSIENT));
+	  PYSQLITE_CUR_CHEAP_CALL(res=sqlite3_bind_text(self->statement->vdbestatement, arg, val, lenval, SQLITE_TRANSIENT));
 	}
     }
 #endif
@@ -570,11 +621,11 @@ APSWCursor_dobinding(APSWCursor *self, int arg, PyObject *obj)
           SET_EXC(SQLITE_TOOBIG, NULL);
 	  return -1;
 	}
-      PYSQLITE_CUR_CALL(res=sqlite3_bind_blob(self->statement->vdbestatement, arg, buffer, buflen, SQLITE_TRANSIENT));
+      PYSQLITE_CUR_CHEAP_CALL(res=sqlite3_bind_blob(self->statement->vdbestatement, arg, buffer, buflen, SQLITE_TRANSIENT));
     }
   else if(PyObject_TypeCheck(obj, &ZeroBlobBindType)==1)
     {
-      PYSQLITE_CUR_CALL(res=sqlite3_bind_zeroblob(self->statement->vdbestatement, arg, ((ZeroBlobBind*)obj)->blobsize));
+      PYSQLITE_CUR_CHEAP_CALL(res=sqlite3_bind_zeroblob(self->statement->vdbestatement, arg, ((ZeroBlobBind*)obj)->blobsize));
     }
   else
     {
@@ -764,22 +815,30 @@ APSWCursor_dorowtrace(APSWCursor *self, PyObject *retval)
   return PyObject_CallFunction(rowtrace, "OO", self, retval);
 }
 
-/* Returns a borrowed reference to self if all is ok, else NULL on error */
+/* Returns a borrowed reference to self if all is ok, else NULL on
+   error.  If stepped is non-zero then sqlite3_step has already been
+   called on the current statement and res is what it returned. */
 static PyObject *
-APSWCursor_step(APSWCursor *self)
+APSWCursor_internal_step(APSWCursor *self, int stepped, int res)
 {
-  int res;
   int savedbindingsoffset=0; /* initialised to stop stupid compiler from whining */
 
   for(;;)
     {
-      assert(!PyErr_Occurred());
-      PYSQLITE_CUR_CALL(res=(self->statement->vdbestatement)?(sqlite3_step(self->statement->vdbestatement)):(SQLITE_DONE));
+      self->rowgeneration++;
+      if(stepped)
+        stepped=0;
+      else
+        {
+          assert(!PyErr_Occurred());
+          PYSQLITE_CUR_CALL(res=(self->statement->vdbestatement)?(sqlite3_step(self->statement->vdbestatement)):(SQLITE_DONE));
+        }
 
       switch(res&0xff)
         {
 	case SQLITE_ROW:
           self->status=C_ROW;
+          self->statement->qs_rows++;
           return (PyErr_Occurred())?(NULL):((PyObject*)self);
 
         case SQLITE_DONE:
@@ -891,6 +950,8 @@ APSWCursor_step(APSWCursor *self)
 
       Py_CLEAR(self->description_cache[0]);
       Py_CLEAR(self->description_cache[1]);
+      Py_CLEAR(self->rowfields);
+      Py_CLEAR(self->rowindex);
 
       if(APSWCursor_dobindings(self))
         {
@@ -916,6 +977,13 @@ APSWCursor_step(APSWCursor *self)
   return NULL;
 }
 
+/* Returns a borrowed reference to self if all is ok, else NULL on error */
+static PyObject *
+APSWCursor_step(APSWCursor *self)
+{
+  return APSWCursor_internal_step(self, 0, 0);
+}
+
 /** .. method:: execute(statements[, bindings]) -> iterator
 
     Executes the statements using the supplied bindings.  Execution
@@ -980,6 +1048,7 @@ APSWCursor_execute(APSWCursor *self, PyObject *args)
 
   CHECK_USE(NULL);
   CHECK_CURSOR_CLOSED(NULL);
+  CHECK_CURSOR_VIEWS(NULL);
 
   res=resetcursor(self, /* force= */ 0);
   if(res!=SQLITE_OK)
@@ -1087,6 +1156,7 @@ APSWCursor_executemany(APSWCursor *self, PyObject *args)
 
   CHECK_USE(NULL);
   CHECK_CURSOR_CLOSED(NULL);
+  CHECK_CURSOR_VIEWS(NULL);
 
   res=resetcursor(self, /* force= */ 0);
   if(res!=SQLITE_OK)
@@ -1140,7 +1210,8 @@ APSWCursor_executemany(APSWCursor *self, PyObject *args)
     }
   assert(!PyErr_Occurred());
 
-  self->emoriginalquery=self->statement->utf8;
+  /* a pinned statement is used directly for each set of bindings */
+  self->emoriginalquery=self->statement->pinned?(PyObject*)self->statement:self->statement->utf8;
   Py_INCREF(self->emoriginalquery);
 
   self->bindingsoffset=0;
@@ -1215,16 +1286,127 @@ APSWCursor_close(APSWCursor *self, PyObject *args)
   Py_RETURN_NONE;
 }
 
+/* Fills in rowfields and rowindex for the current statement */
+static int
+APSWCursor_rowfields(APSWCursor *self)
+{
+  int ncols, i;
+  PyObject *fields=NULL, *index=NULL, *name, *pos;
+
+  if(self->rowfields)
+    return 0;
+
+  ncols=sqlite3_column_count(self->statement->vdbestatement);
+  fields=PyTuple_New(ncols);
+  index=PyDict_New();
+  if(!fields || !index) goto error;
+
+  for(i=0;i<ncols;i++)
+    {
+      const char *colname;
+
+      INUSE_CALL(_PYSQLITE_CHEAP_CALL_V(self->connection->db, colname=sqlite3_column_name(self->statement->vdbestatement, i)));
+      name=convertutf8string(colname);
+      if(!name) goto error;
+      PyTuple_SET_ITEM(fields, i, name);
+      /* the first column of a name wins */
+      if(PyDict_GetItem(index, name))
+        continue;
+      pos=PyInt_FromLong(i);
+      if(!pos || PyDict_SetItem(index, name, pos))
+        {
+          Py_XDECREF(pos);
+          goto error;
+        }
+      Py_DECREF(pos);
+    }
+
+  self->rowfields=fields;
+  self->rowindex=index;
+  return 0;
+
+ error:
+  Py_XDECREF(fields);
+  Py_XDECREF(index);
+  return -1;
+}
+
+/* Makes a row of the kind chosen by the row factory from ncols
+   values, taking ownership of the values even on failure.  fields
+   and index are from APSWCursor_rowfields for the dict and row
+   factories.  They are passed in because batched rows are made after
+   the statement may have moved on. */
+static PyObject *
+APSWCursor_makerow(APSWCursor *self, PyObject **items, int ncols, PyObject *fields, PyObject *index)
+{
+  PyObject *row=NULL;
+  int i;
+
+  switch(ROWFACTORY)
+    {
+    case ROWFACTORY_TUPLE:
+      row=PyTuple_New(ncols);
+      if(!row) goto error;
+      for(i=0;i<ncols;i++)
+        PyTuple_SET_ITEM(row, i, items[i]);
+      return row;
+
+    case ROWFACTORY_SCALAR:
+      if(ncols!=1)
+        {
+          PyErr_Format(PyExc_ValueError, "The scalar row factory needs exactly one column in the results, not %d", ncols);
+          goto error;
+        }
+      return items[0];
+
+    case ROWFACTORY_DICT:
+      assert(fields);
+      row=PyDict_New();
+      if(!row) goto error;
+      /* backwards so the first column of a name wins */
+      for(i=ncols-1;i>=0;i--)
+        if(PyDict_SetItem(row, PyTuple_GET_ITEM(fields, i), items[i]))
+          goto error;
+      for(i=0;i<ncols;i++)
+        Py_DECREF(items[i]);
+      return row;
+
+    case ROWFACTORY_ROW:
+      {
+        APSWRow *r;
+        assert(fields && index);
+        r=PyObject_NewVar(APSWRow, &APSWRowType, ncols);
+        if(!r) goto error;
+        Py_INCREF(fields);
+        r->fields=fields;
+        Py_INCREF(index);
+        r->index=index;
+        for(i=0;i<ncols;i++)
+          r->items[i]=items[i];
+        return (PyObject*)r;
+      }
+    }
+
+  assert(0);
+ error:
+  Py_XDECREF(row);
+  for(i=0;i<ncols;i++)
+    Py_DECREF(items[i]);
+  return NULL;
+}
+
 static PyObject *
 APSWCursor_next(APSWCursor *self)
 {
   PyObject *retval;
-  PyObject *item;
+  PyObject *stackitems[16];
+  PyObject **items=stackitems;
   int numcols=-1;
   int i;
 
   CHECK_USE(NULL);
   CHECK_CURSOR_CLOSED(NULL);
+  CHECK_CURSOR_VIEWS(NULL);
 
  again:
   if(self->status==C_BEGIN)
@@ -1241,16 +1423,35 @@ APSWCursor_next(APSWCursor *self)
   self->status=C_BEGIN;
 
   /* return the row of data */
+  if(ROWFACTORY==ROWFACTORY_DICT || ROWFACTORY==ROWFACTORY_ROW)
+    if(APSWCursor_rowfields(self))
+      return NULL;
   numcols=sqlite3_data_count(self->statement->vdbestatement);
-  retval=PyTuple_New(numcols);
-  if(!retval) goto error;
+  if(numcols>(int)(sizeof(stackitems)/sizeof(stackitems[0])))
+    {
+      items=PyMem_Malloc(sizeof(PyObject*)*numcols);
+      if(!items)
+        return PyErr_NoMemory();
+    }
 
   for(i=0;i<numcols;i++)
     {
-      INUSE_CALL(item=convert_column_to_pyobject(self->statement->vdbestatement, i));
-      if(!item) goto error;
-      PyTuple_SET_ITEM(retval, i, item);
+      INUSE_CALL(items[i]=convert_column_to_pyobject(self->statement->vdbestatement, i));
+      if(!items[i])
+        {
+          while(i--)
+            Py_DECREF(items[i]);
+          retval=NULL;
+          goto finally;
+        }
     }
+  retval=APSWCursor_makerow(self, items, numcols, self->rowfields, self->rowindex);
+ finally:
+  if(items!=stackitems)
+    PyMem_Free(items);
+  if(!retval)
+    return NULL;
+
   if(ROWTRACE)
     {
       PyObject *r2=APSWCursor_dorowtrace(self, retval);
@@ -1260,14 +1461,12 @@ APSWCursor_next(APSWCursor *self)
       if (r2==Py_None)
         {
           Py_DECREF(r2);
+          items=stackitems;
           goto again;
         }
       return r2;
     }
   return retval;
- error:
-  Py_XDECREF(retval);
-  return NULL;
 }
 
 static PyObject *
@@ -1392,6 +1591,49 @@ APSWCursor_getrowtrace(APSWCursor *self)
   return ret;
 }
 
+/** .. method:: setrowfactory(factory) -> None
+
+  Chooses the type of the rows returned by this cursor - ``"tuple"``,
+  ``"dict"``, ``"row"`` (a :class:`row`) or ``"scalar"``.  See
+  :meth:`Connection.setrowfactory` for the details.  :const:`None`
+  uses the connection's row factory, which is the default.
+
+  A :meth:`row tracer <setrowtrace>` is called with the row made by
+  the factory.
+*/
+static PyObject *
+APSWCursor_setrowfactory(APSWCursor *self, PyObject *factory)
+{
+  int res;
+
+  CHECK_USE(NULL);
+  CHECK_CURSOR_CLOSED(NULL);
+
+  res=(factory==Py_None)?-1:rowfactory_fromname(factory);
+  if(res<0 && factory!=Py_None)
+    return NULL;
+  self->rowfactory=res;
+
+  Py_RETURN_NONE;
+}
+
+/** .. method:: getrowfactory() -> str or None
+
+  Returns the row factory installed via
+  :meth:`~Cursor.setrowfactory`, or :const:`None` if the connection's
+  is used.
+*/
+static PyObject *
+APSWCursor_getrowfactory(APSWCursor *self)
+{
+  CHECK_USE(NULL);
+  CHECK_CURSOR_CLOSED(NULL);
+
+  if(self->rowfactory<0)
+    Py_RETURN_NONE;
+  return MAKESTR(rowfactory_names[self->rowfactory]);
+}
+
 /** .. method:: getconnection() -> Connection
 
   Returns the :class:`Connection` this cursor belongs to.  An example usage is to get another cursor::
@@ -1413,10 +1655,334 @@ APSWCursor_getconnection(APSWCursor *self)
   return (PyObject*)self->connection;
 }
 
+/* BATCHED ROW FETCHING
+
+   Getting a row one column at a time releases and reacquires the GIL
+   several times per column.  fetchmany and fetchall instead step and
+   copy out the raw values of a batch of rows with the GIL released
+   once, and then make all the Python objects in one pass.  TEXT and
+   BLOB values have to be copied since SQLite's memory for them is
+   only valid until the next step. */
+
+/* Maximum number of rows in a batch */
+#define FETCH_BATCH_ROWS 64
+
+/* Maximum bytes of TEXT/BLOB data copied per batch.  A row that would
+   go over is left as the current row so the values get converted
+   straight from SQLite's memory instead (ie large values are not
+   copied twice) */
+#define FETCH_BATCH_MAXBYTES 262144
+
+typedef struct fetchcell {
+  int coltype;                      /* SQLITE_INTEGER etc */
+  int len;                          /* bytes for TEXT/BLOB */
+  union {
+    sqlite3_int64 i;
+    double d;
+    const void *ptr;                /* TEXT/BLOB in SQLite before copying */
+    size_t offset;                  /* TEXT/BLOB offset in data after copying */
+  } u;
+} fetchcell;
+
+typedef struct fetchbatch {
+  int ncols;                        /* columns per row */
+  int maxcells;                     /* allocated size of cells */
+  int nrows;                        /* how many rows are in cells */
+  int pending;                      /* current row was not copied and is available to be read */
+  fetchcell *cells;                 /* row after row of values */
+  char *data;                       /* TEXT/BLOB bytes */
+  size_t datalen;                   /* bytes in use in data */
+  size_t dataalloc;                 /* allocated size of data */
+} fetchbatch;
+
+/* Copies up to maxrows rows into batch, stepping first if needstep is
+   set (a current row is copied otherwise).  This is called with the
+   GIL released and the db mutex held and so must not use any Python
+   APIs.  Returns the sqlite3_step result code that ended the batch -
+   SQLITE_ROW if maxrows were copied or the current row was left
+   pending. */
+static int
+fetchbatch_fill(fetchbatch *batch, sqlite3_stmt *stmt, int needstep, int maxrows)
+{
+  int res=SQLITE_ROW, col;
+
+  batch->nrows=0;
+  batch->pending=0;
+  batch->datalen=0;
+
+  while(batch->nrows<maxrows)
+    {
+      fetchcell *cell=batch->cells+batch->nrows*batch->ncols;
+      size_t rowbytes=0;
+
+      if(needstep)
+        {
+          res=sqlite3_step(stmt); /* PYSQLITE_CALL - GIL was released by caller */
+          if(res!=SQLITE_ROW)
+            return res;
+        }
+      needstep=1;
+
+      for(col=0;col<batch->ncols;col++)
+        {
+          cell[col].coltype=sqlite3_column_type(stmt, col); /* PYSQLITE_CALL */
+          switch(cell[col].coltype)
+            {
+            case SQLITE_INTEGER:
+              cell[col].u.i=sqlite3_column_int64(stmt, col); /* PYSQLITE_CALL */
+              break;
+            case SQLITE_FLOAT:
+              cell[col].u.d=sqlite3_column_double(stmt, col); /* PYSQLITE_CALL */
+              break;
+            case SQLITE_TEXT:
+              /* text must be asked for before bytes */
+              cell[col].u.ptr=sqlite3_column_text(stmt, col); /* PYSQLITE_CALL */
+              cell[col].len=sqlite3_column_bytes(stmt, col); /* PYSQLITE_CALL */
+              rowbytes+=cell[col].len;
+              break;
+            case SQLITE_BLOB:
+              cell[col].u.ptr=sqlite3_column_blob(stmt, col); /* PYSQLITE_CALL */
+              cell[col].len=sqlite3_column_bytes(stmt, col); /* PYSQLITE_CALL */
+              rowbytes+=cell[col].len;
+              break;
+            default:
+              break;
+            }
+        }
+
+      if(rowbytes)
+        {
+          if(batch->datalen+rowbytes>FETCH_BATCH_MAXBYTES)
+            {
+              batch->pending=1;
+              return SQLITE_ROW;
+            }
+          if(batch->datalen+rowbytes>batch->dataalloc)
+            {
+              size_t newalloc=batch->dataalloc?batch->dataalloc*2:16384;
+              char *newdata;
+              while(newalloc<batch->datalen+rowbytes)
+                newalloc*=2;
+              newdata=sqlite3_realloc64(batch->data, newalloc); /* PYSQLITE_CALL */
+              if(!newdata)
+                {
+                  /* not fatal - the row just gets converted directly */
+                  batch->pending=1;
+                  return SQLITE_ROW;
+                }
+              batch->data=newdata;
+              batch->dataalloc=newalloc;
+            }
+          for(col=0;col<batch->ncols;col++)
+            if(cell[col].coltype==SQLITE_TEXT || cell[col].coltype==SQLITE_BLOB)
+              {
+                const void *ptr=cell[col].u.ptr;
+                if(cell[col].len)
+                  memcpy(batch->data+batch->datalen, ptr, cell[col].len);
+                cell[col].u.offset=batch->datalen;
+                batch->datalen+=cell[col].len;
+              }
+        }
+      else
+        for(col=0;col<batch->ncols;col++)
+          if(cell[col].coltype==SQLITE_TEXT || cell[col].coltype==SQLITE_BLOB)
+            cell[col].u.offset=0;
+
+      batch->nrows++;
+    }
+  return res;
+}
+
+/* Converts a copied value to PyObject.  Returns a new reference.
+   DUPLICATE(ish) code: this is substantially similar to
+   convert_column_to_pyobject.  If you fix anything here then do it
+   there as well. */
+static PyObject *
+fetchbatch_convert(fetchbatch *batch, fetchcell *cell)
+{
+  switch(cell->coltype)
+    {
+    case SQLITE_INTEGER:
+#if PY_MAJOR_VERSION<3
+      if (cell->u.i>=LONG_MIN && cell->u.i<=LONG_MAX)
+        return PyInt_FromLong((long)cell->u.i);
+#endif
+      return PyLong_FromLongLong(cell->u.i);
+
+    case SQLITE_FLOAT:
+      return PyFloat_FromDouble(cell->u.d);
+
+    case SQLITE_TEXT:
+      return convertutf8stringsize(cell->len?batch->data+cell->u.offset:"", cell->len);
+
+    case SQLITE_NULL:
+      Py_RETURN_NONE;
+
+    case SQLITE_BLOB:
+      return converttobytes(cell->len?batch->data+cell->u.offset:"", cell->len);
+
+    default:
+      return PyErr_Format(APSWException, "Unknown sqlite column type %d!", cell->coltype);
+    }
+  /* can't get here */
+  assert(0);
+  return NULL;
+}
+
+/* Returns a list of up to maxrows rows (all remaining if maxrows is
+   negative) using batches */
+static PyObject *
+APSWCursor_internal_fetch(APSWCursor *self, Py_ssize_t maxrows)
+{
+  PyObject *result=NULL, *row=NULL;
+  PyObject **items=NULL, *fields=NULL, *index=NULL;
+  int maxitems=0;
+  fetchbatch batch;
+  int res, i, col, needstep;
+
+  CHECK_USE(NULL);
+  CHECK_CURSOR_CLOSED(NULL);
+  CHECK_CURSOR_VIEWS(NULL);
+
+  memset(&batch, 0, sizeof(batch));
+
+  result=PyList_New(0);
+  if(!result) goto error;
+
+  while((maxrows<0 || PyList_GET_SIZE(result)<maxrows) && self->status!=C_DONE)
+    {
+      int want=FETCH_BATCH_ROWS;
+
+      /* Row tracers expect the row they are given to be the current
+         one (eg they call getdescription) so there is no batching.
+         Empty statements have no vdbe to batch. */
+      if(ROWTRACE || !self->statement->vdbestatement)
+        {
+          row=APSWCursor_next(self);
+          if(!row)
+            {
+              if(PyErr_Occurred()) goto error;
+              break;
+            }
+          if(PyList_Append(result, row)) goto error;
+          Py_CLEAR(row);
+          continue;
+        }
+
+      if(maxrows>=0 && maxrows-PyList_GET_SIZE(result)<want)
+        want=(int)(maxrows-PyList_GET_SIZE(result));
+
+      batch.ncols=sqlite3_column_count(self->statement->vdbestatement);
+      if(batch.ncols*FETCH_BATCH_ROWS>batch.maxcells || !batch.cells)
+        {
+          PyMem_Free(batch.cells);
+          batch.maxcells=batch.ncols*FETCH_BATCH_ROWS;
+          batch.cells=PyMem_Malloc(sizeof(fetchcell)*(batch.maxcells?batch.maxcells:1));
+          if(!batch.cells)
+            {
+              PyErr_NoMemory();
+              goto error;
+            }
+        }
+
+      Py_CLEAR(fields);
+      Py_CLEAR(index);
+      if(ROWFACTORY==ROWFACTORY_DICT || ROWFACTORY==ROWFACTORY_ROW)
+        {
+          if(APSWCursor_rowfields(self)) goto error;
+          fields=self->rowfields;
+          Py_INCREF(fields);
+          index=self->rowindex;
+          Py_INCREF(index);
+        }
+
+      self->rowgeneration++;
+      needstep=(self->status==C_BEGIN);
+      PYSQLITE_CUR_CALL(res=fetchbatch_fill(&batch, self->statement->vdbestatement, needstep, want));
+      /* a row that was already current was counted when stepped to */
+      self->statement->qs_rows+=batch.nrows+batch.pending-!needstep;
+
+      if(res==SQLITE_ROW)
+        {
+          self->status=C_ROW;
+          if(PyErr_Occurred())
+            goto error;
+          if(!batch.pending)
+            self->status=C_BEGIN;
+        }
+      else if(!APSWCursor_internal_step(self, 1, res))
+        /* statement completed or had an error.  The copied values
+           are still fine even if we have moved on to the next
+           statement */
+        goto error;
+
+      if(batch.ncols>maxitems)
+        {
+          PyMem_Free(items);
+          maxitems=batch.ncols;
+          items=PyMem_Malloc(sizeof(PyObject*)*maxitems);
+          if(!items)
+            {
+              PyErr_NoMemory();
+              goto error;
+            }
+        }
+
+      for(i=0;i<batch.nrows;i++)
+        {
+          for(col=0;col<batch.ncols;col++)
+            {
+              items[col]=fetchbatch_convert(&batch, batch.cells+i*batch.ncols+col);
+              if(!items[col])
+                {
+                  while(col--)
+                    Py_DECREF(items[col]);
+                  goto error;
+                }
+            }
+          row=APSWCursor_makerow(self, items, batch.ncols, fields, index);
+          if(!row) goto error;
+          if(PyList_Append(result, row)) goto error;
+          Py_CLEAR(row);
+        }
+
+      if(batch.pending)
+        {
+          assert(self->status==C_ROW);
+          row=APSWCursor_next(self);
+          if(!row)
+            {
+              if(PyErr_Occurred()) goto error;
+              break;
+            }
+          if(PyList_Append(result, row)) goto error;
+          Py_CLEAR(row);
+        }
+    }
+
+  PyMem_Free(batch.cells);
+  sqlite3_free(batch.data);
+  PyMem_Free(items);
+  Py_XDECREF(fields);
+  Py_XDECREF(index);
+  return result;
+
+ error:
+  PyMem_Free(batch.cells);
+  sqlite3_free(batch.data);
+  PyMem_Free(items);
+  Py_XDECREF(fields);
+  Py_XDECREF(index);
+  Py_XDECREF(row);
+  Py_XDECREF(result);
+  return NULL;
+}
+
 /** .. method:: fetchall() -> list
 
   Returns all remaining result rows as a list.  This method is defined
-  in DBAPI.  It is a longer way of doing ``list(cursor)``.
+  in DBAPI.  It gives the same results as ``list(cursor)`` but is
+  faster since rows are retrieved from SQLite in batches.
 */
 static PyObject *
 APSWCursor_fetchall(APSWCursor *self)
@@ -1424,71 +1990,1740 @@ APSWCursor_fetchall(APSWCursor *self)
   CHECK_USE(NULL);
   CHECK_CURSOR_CLOSED(NULL);
 
-  return PySequence_List((PyObject*)self);
+  return APSWCursor_internal_fetch(self, -1);
 }
 
-/** .. method:: fetchone() -> row or None
+/** .. method:: fetchmany(size=1) -> list
 
-  Returns the next row of data or None if there are no more rows.
-*/
+  Returns a list of up to *size* rows, with fewer (or an empty list)
+  returned when there are no more rows.  This method is defined in
+  DBAPI.
 
+  Rows are retrieved from SQLite in batches with the values of many
+  rows being read while the GIL is released once, and then all
+  converted to Python objects together.  This is considerably faster
+  than getting rows one at a time, especially for rows with many
+  columns.  (A :meth:`row tracer <setrowtrace>` is called with each
+  row while it is still the current one, so batches aren't used when
+  there is a row tracer.)
+*/
 static PyObject *
-APSWCursor_fetchone(APSWCursor *self)
+APSWCursor_fetchmany(APSWCursor *self, PyObject *args, PyObject *kwargs)
 {
-    PyObject *res;
+  static char *kwlist[]={"size", NULL};
+  Py_ssize_t size=1;
 
-    CHECK_USE(NULL);
-    CHECK_CURSOR_CLOSED(NULL);
+  CHECK_USE(NULL);
+  CHECK_CURSOR_CLOSED(NULL);
 
-    res=APSWCursor_next(self);
+  if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|n:fetchmany(size=1)", kwlist, &size))
+    return NULL;
 
-    if(res==NULL && !PyErr_Occurred())
-        Py_RETURN_NONE;
+  if(size<0)
+    return PyErr_Format(PyExc_ValueError, "size must be zero or greater");
 
-    return res;
+  return APSWCursor_internal_fetch(self, size);
 }
 
+/* COLUMNAR BUFFERS - used by fetchinto and executemanycolumns */
 
+typedef struct columnbuffer {
+  char coltype;                     /* one of the type characters or '-' to skip */
+  char *values;                     /* int64, double or (text/blob) int64 offsets */
+  Py_ssize_t valuessize;            /* bytes in values */
+  char *data;                       /* text/blob bytes */
+  Py_ssize_t datasize;              /* bytes in data */
+  Py_buffer valuesview, dataview;   /* held until columnbuffers_release so the buffers can't be resized */
+} columnbuffer;
 
-static PyMethodDef APSWCursor_methods[] = {
-  {"execute", (PyCFunction)APSWCursor_execute, METH_VARARGS,
-   "Executes one or more statements" },
-  {"executemany", (PyCFunction)APSWCursor_executemany, METH_VARARGS,
-   "Repeatedly executes statements on sequence" },
-  {"setexectrace", (PyCFunction)APSWCursor_setexectrace, METH_O,
-   "Installs a function called for every statement executed"},
-  {"setrowtrace", (PyCFunction)APSWCursor_setrowtrace, METH_O,
-   "Installs a function called for every row returned"},
-  {"getexectrace", (PyCFunction)APSWCursor_getexectrace, METH_NOARGS,
-   "Returns the current exec tracer function"},
-  {"getrowtrace", (PyCFunction)APSWCursor_getrowtrace, METH_NOARGS,
-   "Returns the current row tracer function"},
-  {"getconnection", (PyCFunction)APSWCursor_getconnection, METH_NOARGS,
-   "Returns the connection object for this cursor"},
-  {"getdescription", (PyCFunction)APSWCursor_getdescription, METH_NOARGS,
-   "Returns the description for the current row"},
-  {"close", (PyCFunction)APSWCursor_close, METH_VARARGS,
-   "Closes the cursor" },
-  {"fetchall", (PyCFunction)APSWCursor_fetchall, METH_NOARGS,
-   "Fetches all result rows" },
-  {"fetchone", (PyCFunction)APSWCursor_fetchone, METH_NOARGS,
-   "Fetches next result row" },
+/* Gets a view of a buffer object.  Python 2 objects with only the old
+   buffer interface (eg array.array) can't be held so view->obj is
+   left as NULL for them. */
+static int
+columnbuffer_view(PyObject *obj, Py_buffer *view, int writable)
+{
+#if PY_MAJOR_VERSION < 3
+  if(!PyObject_CheckBuffer(obj))
+    {
+      void *buffer;
+      Py_ssize_t buflen;
 
-  {0, 0, 0, 0}  /* Sentinel */
-};
+      if(writable?
+         PyObject_AsWriteBuffer(obj, &buffer, &buflen):
+         PyObject_AsReadBuffer(obj, (const void**)&buffer, &buflen))
+        return -1;
+      memset(view, 0, sizeof(Py_buffer));
+      view->buf=buffer;
+      view->len=buflen;
+      return 0;
+    }
+#endif
+  return PyObject_GetBuffer(obj, view, writable?PyBUF_WRITABLE:PyBUF_SIMPLE);
+}
 
+/* Releases the views of the first ncols columns.  This must be done
+   whether columnbuffers_get succeeded or not. */
+static void
+columnbuffers_release(columnbuffer *columns, int ncols)
+{
+  int col;
 
-static PyGetSetDef APSWCursor_getset[] = {
-  {"description", (getter)APSWCursor_getdescription_dbapi, NULL,  "Subset of DB-API description attribute", NULL},
-  {NULL, NULL, NULL, NULL, NULL}
-};
+  for(col=0;col<ncols;col++)
+    {
+      PyBuffer_Release(&columns[col].valuesview);
+      PyBuffer_Release(&columns[col].dataview);
+    }
+}
 
-static PyTypeObject APSWCursorType = {
-    APSW_PYTYPE_INIT
-    "apsw.Cursor",             /*tp_name*/
-    sizeof(APSWCursor),            /*tp_basicsize*/
-    0,                         /*tp_itemsize*/
-    (destructor)APSWCursor_dealloc, /*tp_dealloc*/
+/* Fills in columns (which has ncols entries) from the types string
+   and sequence of buffers.  The buffers are writable for fetching
+   and only need to be readable for binding.  Their views are held so
+   they can be used with the GIL released.  *maxrows is set to how
+   many rows the smallest buffer has room for.  Returns 0 on success
+   or -1 with an exception set. */
+static int
+columnbuffers_get(columnbuffer *columns, int ncols, const char *types, PyObject *fastbuffers, int writable, Py_ssize_t *maxrows)
+{
+  int col;
+  Py_ssize_t bufnum;
+
+  memset(columns, 0, sizeof(columnbuffer)*ncols);
+
+  *maxrows=PY_SSIZE_T_MAX;
+  for(col=0, bufnum=0;col<ncols;col++)
+    {
+      PyObject *item, *values, *data=NULL;
+      Py_ssize_t buflen;
+
+      columns[col].coltype=types[col];
+      if(types[col]=='-' && writable)
+        continue;
+      if(types[col]!='i' && types[col]!='f' && types[col]!='t' && types[col]!='b')
+        {
+          PyErr_Format(PyExc_ValueError, "Unknown type '%c' for column %d", types[col], col);
+          return -1;
+        }
+
+      if(bufnum>=PySequence_Fast_GET_SIZE(fastbuffers))
+        {
+          PyErr_Format(PyExc_ValueError, "Not enough buffers supplied for the types");
+          return -1;
+        }
+      item=values=PySequence_Fast_GET_ITEM(fastbuffers, bufnum);
+      bufnum++;
+
+      if(types[col]=='t' || types[col]=='b')
+        {
+          if(!PyTuple_Check(item) || PyTuple_GET_SIZE(item)!=2)
+            {
+              PyErr_Format(PyExc_TypeError, "Buffer for text/blob column %d must be a tuple of (offsets, data)", col);
+              return -1;
+            }
+          values=PyTuple_GET_ITEM(item, 0);
+          data=PyTuple_GET_ITEM(item, 1);
+        }
+
+      if(columnbuffer_view(values, &columns[col].valuesview, writable))
+        return -1;
+      columns[col].values=columns[col].valuesview.buf;
+      columns[col].valuessize=columns[col].valuesview.len;
+      if(data)
+        {
+          if(columnbuffer_view(data, &columns[col].dataview, writable))
+            return -1;
+          columns[col].data=columns[col].dataview.buf;
+          columns[col].datasize=columns[col].dataview.len;
+          /* room for the extra offset */
+          buflen=columns[col].valuessize/(Py_ssize_t)sizeof(sqlite3_int64)-1;
+        }
+      else
+        buflen=columns[col].valuessize/(Py_ssize_t)sizeof(sqlite3_int64);
+      if(buflen<*maxrows)
+        *maxrows=buflen;
+    }
+
+  if(bufnum!=PySequence_Fast_GET_SIZE(fastbuffers))
+    {
+      PyErr_Format(PyExc_ValueError, "%d buffers were supplied but types needs %d", (int)PySequence_Fast_GET_SIZE(fastbuffers), (int)bufnum);
+      return -1;
+    }
+
+  if(*maxrows==PY_SSIZE_T_MAX)
+    *maxrows=0;
+  return 0;
+}
+
+/* Copies up to maxrows rows into the column buffers.  Like
+   fetchbatch_fill this is called with the GIL released and db mutex
+   held so no Python APIs can be used.  *nrows is set to how many rows
+   were copied and *pending if the current row did not fit in the
+   text/blob data buffers. */
+static int
+fetchinto_fill(columnbuffer *columns, int ncols, sqlite3_stmt *stmt, int needstep, Py_ssize_t maxrows, Py_ssize_t *nrows, int *pending)
+{
+  int res=SQLITE_ROW, col;
+  sqlite3_int64 offset;
+
+  *nrows=0;
+  *pending=0;
+
+  for(col=0;col<ncols;col++)
+    if(columns[col].coltype=='t' || columns[col].coltype=='b')
+      {
+        offset=0;
+        memcpy(columns[col].values, &offset, sizeof(offset));
+      }
+
+  while(*nrows<maxrows)
+    {
+      if(needstep)
+        {
+          res=sqlite3_step(stmt); /* PYSQLITE_CALL - GIL was released by caller */
+          if(res!=SQLITE_ROW)
+            return res;
+        }
+      needstep=1;
+
+      /* check text and blobs fit first */
+      for(col=0;col<ncols;col++)
+        {
+          int len;
+          switch(columns[col].coltype)
+            {
+            case 't':
+              sqlite3_column_text(stmt, col); /* PYSQLITE_CALL */
+              break;
+            case 'b':
+              sqlite3_column_blob(stmt, col); /* PYSQLITE_CALL */
+              break;
+            default:
+              continue;
+            }
+          len=sqlite3_column_bytes(stmt, col); /* PYSQLITE_CALL */
+          memcpy(&offset, columns[col].values+*nrows*sizeof(offset), sizeof(offset));
+          if(offset+len>columns[col].datasize)
+            {
+              *pending=1;
+              return SQLITE_ROW;
+            }
+        }
+
+      for(col=0;col<ncols;col++)
+        {
+          char *dest=columns[col].values+*nrows*sizeof(sqlite3_int64);
+          switch(columns[col].coltype)
+            {
+            case 'i':
+              {
+                sqlite3_int64 v=sqlite3_column_int64(stmt, col); /* PYSQLITE_CALL */
+                memcpy(dest, &v, sizeof(v));
+                break;
+              }
+            case 'f':
+              {
+                double v=sqlite3_column_double(stmt, col); /* PYSQLITE_CALL */
+                memcpy(dest, &v, sizeof(v));
+                break;
+              }
+            case 't':
+            case 'b':
+              {
+                const void *ptr=(columns[col].coltype=='t')?
+                  (const void*)sqlite3_column_text(stmt, col):   /* PYSQLITE_CALL */
+                  sqlite3_column_blob(stmt, col);                /* PYSQLITE_CALL */
+                int len=sqlite3_column_bytes(stmt, col); /* PYSQLITE_CALL */
+                memcpy(&offset, dest, sizeof(offset));
+                if(len)
+                  memcpy(columns[col].data+offset, ptr, len);
+                offset+=len;
+                memcpy(dest+sizeof(offset), &offset, sizeof(offset));
+                break;
+              }
+            default:
+              break;
+            }
+        }
+      (*nrows)++;
+    }
+  return res;
+}
+
+/** .. method:: fetchinto(types, buffers) -> int
+
+  Copies result rows directly into buffers you provide, one per
+  column, without making any Python objects for the values.  This is
+  intended for analytics and export where data is going into arrays,
+  and avoids a tuple plus an object for every value.  Call it
+  repeatedly until zero is returned::
+
+    ids=array.array('q', [0]*4096)
+    prices=array.array('d', [0]*4096)
+    nameoffsets=array.array('q', [0]*4097)
+    names=bytearray(65536)
+
+    cursor.execute("select id, price, name from items")
+    while True:
+       n=cursor.fetchinto("ift", [ids, prices, (nameoffsets, names)])
+       if not n:
+          break
+       # process the n rows
+       first_name=names[nameoffsets[0]:nameoffsets[1]].decode("utf8")
+
+  :param types: A string with one character for each result column
+
+    ====== ========================================================
+    ``i``  64 bit signed integer (eg array typecode ``q``)
+    ``f``  64 bit floating point (eg array typecode ``d``)
+    ``t``  Text as UTF-8 bytes
+    ``b``  Blob bytes
+    ``-``  This column is skipped
+    ====== ========================================================
+
+  :param buffers: A sequence with an item for each column not being
+    skipped.  For ``i`` and ``f`` it is a writable buffer such as
+    :class:`array.array`, a numpy array or :class:`bytearray`.  For
+    ``t`` and ``b`` it is a tuple of two writable buffers.  The first
+    receives 64 bit integer offsets into the second which receives
+    the bytes.  The value for row *n* is from offset *n* up to offset
+    *n+1* so this buffer needs room for one more offset than rows.
+
+  :returns: How many rows were copied.  This is limited by the
+    smallest number buffer, and by the text/blob data buffers filling
+    up.  Zero means there are no more rows.
+
+  Values are converted using SQLite's rules, so the column types do
+  not have to match exactly.  For example a null is zero in an
+  integer column, and an integer in a text column becomes its digits.
+  Each call only returns rows from one statement so you can change
+  *types* between calls as multiple statements are executed.  Row
+  tracers are not called.  The buffers can't be resized while this
+  is running, such as from functions called by the query.
+
+  :raises ValueError: *types* doesn't have the same number of
+    characters as the current statement has columns, a buffer is too
+    small for any rows, or a text/blob value is too large for its
+    data buffer.  In the last case the row is still available so you
+    can call again with a bigger buffer.
+
+  -* sqlite3_column_int64 sqlite3_column_double sqlite3_column_text sqlite3_column_blob sqlite3_column_bytes
+*/
+static PyObject *
+APSWCursor_fetchinto(APSWCursor *self, PyObject *args)
+{
+  const char *types=NULL;
+  PyObject *buffers=NULL, *fastbuffers=NULL;
+  columnbuffer *columns=NULL;
+  Py_ssize_t nrows=0, maxrows;
+  int ncols, ncolumns=0, res, pending=0, needstep;
+
+  CHECK_USE(NULL);
+  CHECK_CURSOR_CLOSED(NULL);
+  CHECK_CURSOR_VIEWS(NULL);
+
+  if(!PyArg_ParseTuple(args, "sO:fetchinto(types, buffers)", &types, &buffers))
+    return NULL;
+
+  fastbuffers=PySequence_Fast(buffers, "buffers must be a sequence");
+  if(!fastbuffers)
+    return NULL;
+
+ again:
+  if(self->status==C_DONE)
+    goto finally;
+
+  if(self->status==C_BEGIN && !self->statement->vdbestatement)
+    {
+      /* empty statement */
+      if(!APSWCursor_step(self))
+        goto error;
+      goto again;
+    }
+
+  ncols=sqlite3_column_count(self->statement->vdbestatement);
+  if(strlen(types)!=(size_t)ncols)
+    {
+      PyErr_Format(PyExc_ValueError, "types has %d characters but the statement has %d columns", (int)strlen(types), ncols);
+      goto error;
+    }
+
+  columnbuffers_release(columns, ncolumns);
+  PyMem_Free(columns);
+  ncolumns=0;
+  columns=PyMem_Malloc(sizeof(columnbuffer)*(ncols?ncols:1));
+  if(!columns)
+    {
+      PyErr_NoMemory();
+      goto error;
+    }
+  ncolumns=ncols;
+
+  if(columnbuffers_get(columns, ncols, types, fastbuffers, 1, &maxrows))
+    goto error;
+
+  if(maxrows<1)
+    {
+      PyErr_Format(PyExc_ValueError, "The buffers do not have room for any rows");
+      goto error;
+    }
+
+  self->rowgeneration++;
+  needstep=(self->status==C_BEGIN);
+  PYSQLITE_CUR_CALL(res=fetchinto_fill(columns, ncols, self->statement->vdbestatement, needstep, maxrows, &nrows, &pending));
+  /* a row that was already current was counted when stepped to */
+  self->statement->qs_rows+=nrows+pending-!needstep;
+
+  if(res==SQLITE_ROW)
+    {
+      self->status=C_ROW;
+      if(PyErr_Occurred())
+        goto error;
+      if(!pending)
+        self->status=C_BEGIN;
+      else if(!nrows)
+        {
+          PyErr_Format(PyExc_ValueError, "A text or blob value is too large for its data buffer");
+          goto error;
+        }
+    }
+  else
+    {
+      if(!APSWCursor_internal_step(self, 1, res))
+        goto error;
+      /* statement had no (more) rows but there may be another one */
+      if(!nrows)
+        goto again;
+    }
+
+ finally:
+  columnbuffers_release(columns, ncolumns);
+  PyMem_Free(columns);
+  Py_DECREF(fastbuffers);
+  return PyLong_FromSsize_t(nrows);
+
+ error:
+  columnbuffers_release(columns, ncolumns);
+  PyMem_Free(columns);
+  Py_DECREF(fastbuffers);
+  return NULL;
+}
+
+/* SQL TEXT - used by fetchinserts */
+
+/* Growable output buffer used without the GIL so memory comes from
+   SQLite */
+typedef struct
+{
+  char *data;
+  sqlite3_int64 len, alloc;
+} sqltextbuffer;
+
+static int
+sqltext_reserve(sqltextbuffer *out, sqlite3_int64 amount)
+{
+  if(out->len+amount>out->alloc)
+    {
+      sqlite3_int64 newalloc=out->alloc?out->alloc:65536;
+      char *newdata;
+      while(newalloc<out->len+amount)
+        newalloc*=2;
+      if(out->data)
+        APSW_FAULT_INJECT(SQLTextGrowFails, newdata=sqlite3_realloc64(out->data, newalloc), newdata=NULL); /* PYSQLITE_CALL */
+      else
+        newdata=sqlite3_malloc64(newalloc); /* PYSQLITE_CALL */
+      if(!newdata)
+        return SQLITE_NOMEM;
+      out->data=newdata;
+      out->alloc=newalloc;
+    }
+  return SQLITE_OK;
+}
+
+static int
+sqltext_append(sqltextbuffer *out, const char *text, sqlite3_int64 len)
+{
+  if(sqltext_reserve(out, len))
+    return SQLITE_NOMEM;
+  memcpy(out->data+out->len, text, len);
+  out->len+=len;
+  return SQLITE_OK;
+}
+
+/* Formats a double like Python's repr() which is what
+   format_sql_value uses.  That is the fewest digits that read back as
+   the same value, in fixed notation for exponents -4 through 15 and
+   scientific otherwise.  out needs room for 32 characters and the
+   length is returned. */
+static int
+sqltext_double(char *out, double v)
+{
+  char digits[32], *p=out;
+  const char *s;
+  int prec, exp, ndigits=0, i;
+  char mantissa[20];
+
+  if(Py_IS_NAN(v))
+    return PyOS_snprintf(out, 32, "nan");
+  if(Py_IS_INFINITY(v))
+    return PyOS_snprintf(out, 32, v<0?"-inf":"inf");
+
+  /* Any value that has a representation of 15 or fewer digits comes
+     out as that followed by zeros, so there is no need to try
+     shorter.  Subnormals have less precision so that doesn't apply
+     to them. */
+  for(prec=(v>-DBL_MIN && v<DBL_MIN)?1:15; prec<17; prec++)
+    {
+      PyOS_snprintf(digits, sizeof(digits), "%.*e", prec-1, v);
+      if(strtod(digits, NULL)==v)
+        break;
+    }
+  if(prec==17)
+    PyOS_snprintf(digits, sizeof(digits), "%.16e", v);
+
+  /* digits is now [-]d[.ddd]e(+|-)dd where the decimal point comes
+     from LC_NUMERIC and may not be '.' (or even a single character)
+     so only the digits are kept.  strtod above uses the same locale
+     so the round trip check is still valid. */
+  s=digits;
+  if(*s=='-')
+    {
+      *p++='-';
+      s++;
+    }
+  for(; *s!='e'; s++)
+    if(*s>='0' && *s<='9')
+      mantissa[ndigits++]=*s;
+  exp=atoi(s+1);
+  while(ndigits>1 && mantissa[ndigits-1]=='0')
+    ndigits--;
+
+  if(exp<-4 || exp>=16)
+    {
+      *p++=mantissa[0];
+      if(ndigits>1)
+        {
+          *p++='.';
+          for(i=1; i<ndigits; i++)
+            *p++=mantissa[i];
+        }
+      p+=PyOS_snprintf(p, 8, "e%c%02d", exp<0?'-':'+', exp<0?-exp:exp);
+    }
+  else if(exp<0)
+    {
+      *p++='0';
+      *p++='.';
+      for(i=-1; i>exp; i--)
+        *p++='0';
+      for(i=0; i<ndigits; i++)
+        *p++=mantissa[i];
+    }
+  else
+    {
+      for(i=0; i<=exp; i++)
+        *p++=(i<ndigits)?mantissa[i]:'0';
+      *p++='.';
+      if(ndigits<=exp+1)
+        *p++='0';
+      for(; i<ndigits; i++)
+        *p++=mantissa[i];
+    }
+  *p=0;
+  return (int)(p-out);
+}
+
+/* Appends a column value in SQL syntax with the same rules as
+   format_sql_value */
+static int
+sqltext_value(sqltextbuffer *out, sqlite3_stmt *stmt, int col)
+{
+  char num[32];
+
+  switch(sqlite3_column_type(stmt, col)) /* PYSQLITE_CALL */
+    {
+    case SQLITE_NULL:
+      return sqltext_append(out, "NULL", 4);
+
+    case SQLITE_INTEGER:
+      sqlite3_snprintf(sizeof(num), num, "%lld", sqlite3_column_int64(stmt, col)); /* PYSQLITE_CALL */
+      return sqltext_append(out, num, strlen(num));
+
+    case SQLITE_FLOAT:
+      return sqltext_append(out, num, sqltext_double(num, sqlite3_column_double(stmt, col))); /* PYSQLITE_CALL */
+
+    case SQLITE_TEXT:
+      {
+        const char *text=(const char*)sqlite3_column_text(stmt, col); /* PYSQLITE_CALL */
+        sqlite3_int64 len=sqlite3_column_bytes(stmt, col), i, start; /* PYSQLITE_CALL */
+        if(!text && len)
+          return SQLITE_NOMEM;
+        if(sqltext_append(out, "'", 1))
+          return SQLITE_NOMEM;
+        /* quotes are doubled and nulls have to be done as a blob */
+        for(start=i=0; i<len; i++)
+          {
+            if(text[i]=='\'' || text[i]==0)
+              {
+                if(sqltext_append(out, text+start, i-start))
+                  return SQLITE_NOMEM;
+                if(text[i]=='\'')
+                  {
+                    if(sqltext_append(out, "'", 1))
+                      return SQLITE_NOMEM;
+                    start=i;
+                  }
+                else
+                  {
+                    if(sqltext_append(out, "'||X'00'||'", 11))
+                      return SQLITE_NOMEM;
+                    start=i+1;
+                  }
+              }
+          }
+        if(sqltext_append(out, text+start, len-start) || sqltext_append(out, "'", 1))
+          return SQLITE_NOMEM;
+        return SQLITE_OK;
+      }
+
+    default: /* SQLITE_BLOB */
+      {
+        const unsigned char *blob=sqlite3_column_blob(stmt, col); /* PYSQLITE_CALL */
+        sqlite3_int64 len=sqlite3_column_bytes(stmt, col), i; /* PYSQLITE_CALL */
+        char *dest;
+        if(!blob && len)
+          return SQLITE_NOMEM;
+        if(sqltext_reserve(out, len*2+3))
+          return SQLITE_NOMEM;
+        dest=out->data+out->len;
+        *dest++='X';
+        *dest++='\'';
+        for(i=0; i<len; i++)
+          {
+            *dest++="0123456789ABCDEF"[blob[i]>>4];
+            *dest++="0123456789ABCDEF"[blob[i]&0x0f];
+          }
+        *dest++='\'';
+        out->len+=len*2+3;
+        return SQLITE_OK;
+      }
+    }
+}
+
+/* Formats rows as INSERT statements until at least maxbytes have been
+   output.  Called with the GIL released and db mutex held.  *nrows
+   is set to how many rows were formatted.  SQLITE_ROW is returned if
+   there may be more rows.  If memory runs out then out is cut back to
+   the rows that were completed and *pending is set because the
+   current row has not been consumed. */
+static int
+fetchinserts_fill(sqltextbuffer *out, const char *table, sqlite3_stmt *stmt, int needstep, Py_ssize_t maxbytes, Py_ssize_t *nrows, int *pending)
+{
+  int res=SQLITE_ROW, col, ncols=sqlite3_column_count(stmt); /* PYSQLITE_CALL */
+  size_t tablelen=strlen(table);
+  sqlite3_int64 complete;
+
+  *nrows=0;
+  *pending=0;
+  while(out->len<maxbytes)
+    {
+      if(needstep)
+        {
+          res=sqlite3_step(stmt); /* PYSQLITE_CALL - GIL was released by caller */
+          if(res!=SQLITE_ROW)
+            return res;
+        }
+      needstep=1;
+      complete=out->len;
+
+      if(sqltext_append(out, "INSERT INTO ", 12) || sqltext_append(out, table, tablelen) || sqltext_append(out, " VALUES(", 8))
+        goto nomem;
+      for(col=0; col<ncols; col++)
+        {
+          if(col && sqltext_append(out, ",", 1))
+            goto nomem;
+          if(sqltext_value(out, stmt, col))
+            goto nomem;
+        }
+      if(sqltext_append(out, ");\n", 3))
+        goto nomem;
+      (*nrows)++;
+    }
+  return res;
+
+ nomem:
+  out->len=complete;
+  *pending=1;
+  return SQLITE_ROW;
+}
+
+/** .. method:: fetchinserts(table[, maxbytes=1048576]) -> str
+
+  Returns the next result rows as SQL INSERT statements, one per line,
+  for writing out as a dump.  The values are formatted directly from
+  SQLite with the same rules as :meth:`apsw.format_sql_value` and the
+  rows are done with the GIL released once per call, so no Python
+  objects are made for each row or value.  Call it repeatedly until
+  an empty string is returned::
+
+    cursor.execute("select * from items")
+    while True:
+       text=cursor.fetchinserts('"items"')
+       if not text:
+          break
+       out.write(text)
+
+  :param table: Used as is after INSERT INTO so it must already be
+    quoted if needed.
+  :param maxbytes: Rows are added until the text is at least this
+    long (in UTF-8 bytes), so you get fewer bigger strings by making
+    it larger.
+
+  Each call only returns rows from one statement.  Row tracers are not
+  called.  If memory runs out part way through then the rows that were
+  completed are returned and the next call carries on from the row
+  that could not be done.  :exc:`MemoryError` is only raised if not
+  even one row could be done, and the cursor is left on that row.
+
+  -* sqlite3_column_type sqlite3_column_int64 sqlite3_column_double sqlite3_column_text sqlite3_column_blob sqlite3_column_bytes
+*/
+static PyObject *
+APSWCursor_fetchinserts(APSWCursor *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[]={"table", "maxbytes", NULL};
+  char *table=NULL;
+  Py_ssize_t maxbytes=1024*1024, nrows=0;
+  sqltextbuffer out={NULL, 0, 0};
+  PyObject *result=NULL;
+  int res, needstep, pending=0;
+
+  CHECK_USE(NULL);
+  CHECK_CURSOR_CLOSED(NULL);
+  CHECK_CURSOR_VIEWS(NULL);
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "es|n:fetchinserts(table, maxbytes=1048576)", kwlist, STRENCODING, &table, &maxbytes))
+    return NULL;
+
+  if(maxbytes<1)
+    {
+      PyErr_Format(PyExc_ValueError, "maxbytes must be at least 1");
+      goto finally;
+    }
+
+ again:
+  if(self->status==C_DONE)
+    {
+      result=convertutf8stringsize("", 0);
+      goto finally;
+    }
+
+  if(self->status==C_BEGIN && !self->statement->vdbestatement)
+    {
+      /* empty statement */
+      if(!APSWCursor_step(self))
+        goto finally;
+      goto again;
+    }
+
+  self->rowgeneration++;
+  needstep=(self->status==C_BEGIN);
+  PYSQLITE_CUR_CALL(res=fetchinserts_fill(&out, table, self->statement->vdbestatement, needstep, maxbytes, &nrows, &pending));
+  /* a row that was already current was counted when stepped to */
+  self->statement->qs_rows+=nrows+pending-!needstep;
+
+  if(res==SQLITE_ROW)
+    {
+      /* the rows that were completed are returned and an unfinished
+         one stays current for the next call */
+      self->status=pending?C_ROW:C_BEGIN;
+      if(pending && !nrows)
+        {
+          PyErr_NoMemory();
+          goto finally;
+        }
+    }
+  else
+    {
+      if(!APSWCursor_internal_step(self, 1, res))
+        goto finally;
+      /* statement had no (more) rows but there may be another one */
+      if(!nrows)
+        goto again;
+    }
+
+  result=convertutf8stringsize(out.len?out.data:"", out.len);
+
+ finally:
+  sqlite3_free(out.data);
+  PyMem_Free(table);
+  return result;
+}
+
+/* Binds and executes nrows rows from the column buffers.  Called
+   with the GIL released and db mutex held.  The buffers will not go
+   away during the call so the values are bound SQLITE_STATIC.
+   *done is set to the number of rows successfully executed. */
+static int
+executemanycolumns_run(columnbuffer *columns, int ncols, sqlite3_stmt *stmt, Py_ssize_t nrows, Py_ssize_t *done)
+{
+  int res=SQLITE_DONE, col;
+
+  for(*done=0; *done<nrows; (*done)++)
+    {
+      for(col=0; col<ncols; col++)
+        {
+          const char *src=columns[col].values+*done*sizeof(sqlite3_int64);
+          switch(columns[col].coltype)
+            {
+            case 'i':
+              {
+                sqlite3_int64 v;
+                memcpy(&v, src, sizeof(v));
+                res=sqlite3_bind_int64(stmt, col+1, v); /* PYSQLITE_CALL */
+                break;
+              }
+            case 'f':
+              {
+                double v;
+                memcpy(&v, src, sizeof(v));
+                res=sqlite3_bind_double(stmt, col+1, v); /* PYSQLITE_CALL */
+                break;
+              }
+            default: /* text and blob */
+              {
+                sqlite3_int64 start, end;
+                const char *ptr;
+                memcpy(&start, src, sizeof(start));
+                memcpy(&end, src+sizeof(end), sizeof(end));
+                /* they were checked but could have been changed since */
+                if(start<0 || end<start || end>columns[col].datasize || end-start>APSW_INT32_MAX)
+                  {
+                    res=SQLITE_RANGE;
+                    goto end;
+                  }
+                ptr=(end>start)?columns[col].data+start:"";
+                if(columns[col].coltype=='t')
+                  res=sqlite3_bind_text(stmt, col+1, ptr, (int)(end-start), SQLITE_STATIC); /* PYSQLITE_CALL */
+                else
+                  res=sqlite3_bind_blob(stmt, col+1, ptr, (int)(end-start), SQLITE_STATIC); /* PYSQLITE_CALL */
+                break;
+              }
+            }
+          if(res!=SQLITE_OK)
+            goto end;
+        }
+
+      /* any result rows are discarded */
+      do
+        res=sqlite3_step(stmt); /* PYSQLITE_CALL */
+      while(res==SQLITE_ROW);
+
+      if(res!=SQLITE_DONE)
+        goto end;
+      res=sqlite3_reset(stmt); /* PYSQLITE_CALL */
+      if(res!=SQLITE_OK)
+        goto end;
+      res=SQLITE_DONE;
+    }
+
+ end:
+  /* don't leave pointers to the buffers in the statement */
+  sqlite3_clear_bindings(stmt); /* PYSQLITE_CALL */
+  return res;
+}
+
+/** .. method:: executemanycolumns(statement, types, buffers) -> int
+
+  Executes *statement* once for each row of values in *buffers*.
+  This is the reverse of :meth:`~Cursor.fetchinto` and uses the same
+  *types* and *buffers* layout, with one type character for each
+  binding in the statement.  The values are bound directly from the
+  buffers and all the rows are executed with the GIL released once,
+  so no Python objects are made for each row or value.  This makes it
+  considerably faster than :meth:`~Cursor.executemany` for bulk
+  loading::
+
+    ids=array.array('q', range(100000))
+    prices=array.array('d', ...)
+
+    with connection:
+       cursor.executemanycolumns("insert into items(id, price) values(?,?)", "if", [ids, prices])
+
+  :param statement: A single SQL statement.  Any rows it returns are
+    discarded.
+  :param types: As for :meth:`~Cursor.fetchinto` except skipping
+    (``-``) is not allowed.  Text must be valid UTF-8.
+  :param buffers: As for :meth:`~Cursor.fetchinto` except they only
+    need to be readable so :class:`bytes` can be used.  The number of
+    rows executed is that of the smallest buffer.
+
+  :returns: The number of rows executed.
+
+  Each row is executed in the same way as :meth:`~Cursor.execute` so
+  you should wrap the call in a transaction for speed.  If an
+  exception occurs, the rows before the failing one will have been
+  executed.  Execution tracers are not called.  The buffers can't be
+  resized while this is running, and you must not change their
+  contents from other threads.
+
+  -* sqlite3_bind_int64 sqlite3_bind_double sqlite3_bind_text sqlite3_bind_blob sqlite3_step sqlite3_reset sqlite3_clear_bindings
+*/
+static PyObject *
+APSWCursor_executemanycolumns(APSWCursor *self, PyObject *args)
+{
+  const char *types=NULL;
+  PyObject *query=NULL, *buffers=NULL, *fastbuffers=NULL;
+  columnbuffer *columns=NULL;
+  Py_ssize_t nrows=0, done=0, row;
+  int nparams, ncolumns=0, col, res;
+
+  CHECK_USE(NULL);
+  CHECK_CURSOR_CLOSED(NULL);
+  CHECK_CURSOR_VIEWS(NULL);
+
+  res=resetcursor(self, /* force= */ 0);
+  if(res!=SQLITE_OK)
+    {
+      assert(PyErr_Occurred());
+      return NULL;
+    }
+
+  if(!PyArg_ParseTuple(args, "OsO:executemanycolumns(statement, types, buffers)", &query, &types, &buffers))
+    return NULL;
+
+  fastbuffers=PySequence_Fast(buffers, "buffers must be a sequence");
+  if(!fastbuffers)
+    return NULL;
+
+  assert(!self->statement);
+  INUSE_CALL(self->statement=statementcache_prepare(self->connection->stmtcache, query, 1));
+  if (!self->statement)
+    {
+      AddTraceBackHere(__FILE__, __LINE__, "APSWCursor_executemanycolumns.sqlite3_prepare", "{s: O, s: O}",
+		       "Connection", self->connection,
+		       "statement", query);
+      goto error;
+    }
+
+  if(self->statement->next)
+    {
+      PyErr_Format(PyExc_ValueError, "Only one statement can be used with executemanycolumns");
+      goto error;
+    }
+
+  /* empty statement */
+  if(!self->statement->vdbestatement)
+    goto finally;
+
+  nparams=sqlite3_bind_parameter_count(self->statement->vdbestatement);
+  if(strlen(types)!=(size_t)nparams)
+    {
+      PyErr_Format(PyExc_ValueError, "types has %d characters but the statement has %d bindings", (int)strlen(types), nparams);
+      goto error;
+    }
+
+  columns=PyMem_Malloc(sizeof(columnbuffer)*(nparams?nparams:1));
+  if(!columns)
+    {
+      PyErr_NoMemory();
+      goto error;
+    }
+  ncolumns=nparams;
+
+  if(columnbuffers_get(columns, nparams, types, fastbuffers, 0, &nrows))
+    goto error;
+
+  /* check offsets before using them without the GIL */
+  for(col=0; col<nparams; col++)
+    {
+      sqlite3_int64 start, end;
+      if(columns[col].coltype!='t' && columns[col].coltype!='b')
+        continue;
+      for(row=0; row<nrows; row++)
+        {
+          memcpy(&start, columns[col].values+row*sizeof(sqlite3_int64), sizeof(start));
+          memcpy(&end, columns[col].values+(row+1)*sizeof(sqlite3_int64), sizeof(end));
+          if(start<0 || end<start || end>columns[col].datasize || end-start>APSW_INT32_MAX)
+            {
+              PyErr_Format(PyExc_ValueError, "Offsets for column %d row %d are not valid for the data buffer", col, (int)row);
+              goto error;
+            }
+        }
+    }
+
+  if(nrows)
+    {
+      PYSQLITE_CUR_CALL(res=executemanycolumns_run(columns, nparams, self->statement->vdbestatement, nrows, &done));
+      if(PyErr_Occurred())
+        goto error;
+      if(res!=SQLITE_DONE)
+        {
+          SET_EXC(res, self->connection->db);
+          AddTraceBackHere(__FILE__, __LINE__, "APSWCursor_executemanycolumns", "{s: O, s: i}",
+                           "statement", query, "row", (int)done);
+          goto error;
+        }
+    }
+
+ finally:
+  /* the statement is reset before the buffers bound to it are released */
+  res=resetcursor(self, /* force= */ 0);
+  columnbuffers_release(columns, ncolumns);
+  PyMem_Free(columns);
+  Py_DECREF(fastbuffers);
+  if(res!=SQLITE_OK)
+    return NULL;
+  return PyLong_FromSsize_t(done);
+
+ error:
+  resetcursor(self, /* force= */ 1);
+  columnbuffers_release(columns, ncolumns);
+  PyMem_Free(columns);
+  Py_DECREF(fastbuffers);
+  return NULL;
+}
+
+/* CSV IMPORT - used by importcsv */
+
+/* how much is read from the source each time */
+#define IMPORTCSV_CHUNK (1024*1024)
+
+enum { CSV_START_RECORD, CSV_START_FIELD, CSV_FIELD, CSV_QUOTED, CSV_QUOTE_IN_QUOTED };
+
+typedef struct
+{
+  char delimiter;
+  int quoting;
+  int ncols;
+
+  /* parse state carried over between chunks */
+  int state;
+  int skiplf;                   /* previous character ended a record with \r */
+  Py_ssize_t fieldstart;        /* offset in data of the current field */
+  Py_ssize_t recordstart;       /* offset in data of the current record */
+
+  /* the unquoted values of complete records followed by those of the
+     current partial record */
+  char *data;
+  Py_ssize_t datalen, dataalloc;
+
+  /* start and length pairs for each field, with ncols fields for
+     each complete record */
+  Py_ssize_t *fields;
+  Py_ssize_t nfields, fieldsalloc;
+
+  Py_ssize_t nrecords;          /* complete records in data */
+  Py_ssize_t skip;              /* records still to be skipped */
+  Py_ssize_t recordnum;         /* records seen so far for error messages */
+} csvparser;
+
+static int
+csvparser_append(csvparser *p, char c)
+{
+  if(p->datalen==p->dataalloc)
+    {
+      Py_ssize_t newalloc=p->dataalloc?p->dataalloc*2:65536;
+      char *newdata=PyMem_Realloc(p->data, newalloc);
+      if(!newdata)
+        {
+          PyErr_NoMemory();
+          return -1;
+        }
+      p->data=newdata;
+      p->dataalloc=newalloc;
+    }
+  p->data[p->datalen++]=c;
+  return 0;
+}
+
+static int
+csvparser_endfield(csvparser *p)
+{
+  if(p->datalen-p->fieldstart>APSW_INT32_MAX)
+    {
+      SET_EXC(SQLITE_TOOBIG, NULL);
+      return -1;
+    }
+  if(p->nfields*2+2>p->fieldsalloc)
+    {
+      Py_ssize_t newalloc=p->fieldsalloc?p->fieldsalloc*2:1024;
+      Py_ssize_t *newfields=PyMem_Realloc(p->fields, newalloc*sizeof(Py_ssize_t));
+      if(!newfields)
+        {
+          PyErr_NoMemory();
+          return -1;
+        }
+      p->fields=newfields;
+      p->fieldsalloc=newalloc;
+    }
+  p->fields[p->nfields*2]=p->fieldstart;
+  p->fields[p->nfields*2+1]=p->datalen-p->fieldstart;
+  p->nfields++;
+  p->fieldstart=p->datalen;
+  return 0;
+}
+
+static int
+csvparser_endrecord(csvparser *p)
+{
+  Py_ssize_t nfields=p->nfields-p->nrecords*p->ncols;
+
+  p->recordnum++;
+  p->state=CSV_START_RECORD;
+
+  if(p->skip)
+    {
+      p->skip--;
+      p->nfields=p->nrecords*p->ncols;
+      p->datalen=p->fieldstart=p->recordstart;
+      return 0;
+    }
+  if(nfields!=p->ncols)
+    {
+      PyErr_Format(PyExc_ValueError, "row %d has %d columns but should have %d", (int)p->recordnum, (int)nfields, p->ncols);
+      return -1;
+    }
+  p->nrecords++;
+  p->recordstart=p->fieldstart=p->datalen;
+  return 0;
+}
+
+/* Parses the bytes adding complete records.  The rules are the same
+   as Python's csv module using the excel dialect (or QUOTE_NONE if
+   quoting is off) except that blank lines are skipped. */
+static int
+csvparser_parse(csvparser *p, const char *buf, Py_ssize_t len)
+{
+  Py_ssize_t i;
+
+  for(i=0; i<len; i++)
+    {
+      char c=buf[i];
+
+      if(p->skiplf)
+        {
+          p->skiplf=0;
+          if(c=='\n')
+            continue;
+        }
+
+      switch(p->state)
+        {
+        case CSV_START_RECORD:
+          if(c=='\r' || c=='\n')
+            {
+              p->skiplf=(c=='\r');
+              continue;
+            }
+          /* fall through */
+        case CSV_START_FIELD:
+          if(p->quoting && c=='"')
+            {
+              p->state=CSV_QUOTED;
+              continue;
+            }
+          /* fall through */
+        case CSV_FIELD:
+          if(c==p->delimiter)
+            {
+              if(csvparser_endfield(p)) return -1;
+              p->state=CSV_START_FIELD;
+            }
+          else if(c=='\r' || c=='\n')
+            {
+              p->skiplf=(c=='\r');
+              if(csvparser_endfield(p) || csvparser_endrecord(p)) return -1;
+            }
+          else
+            {
+              if(csvparser_append(p, c)) return -1;
+              p->state=CSV_FIELD;
+            }
+          continue;
+
+        case CSV_QUOTED:
+          if(c=='"')
+            p->state=CSV_QUOTE_IN_QUOTED;
+          else if(csvparser_append(p, c))
+            return -1;
+          continue;
+
+        case CSV_QUOTE_IN_QUOTED:
+          if(c=='"')
+            {
+              if(csvparser_append(p, c)) return -1;
+              p->state=CSV_QUOTED;
+            }
+          else
+            {
+              /* as the csv module does, anything after the closing
+                 quote is part of the value */
+              p->state=CSV_FIELD;
+              i--;
+            }
+          continue;
+        }
+    }
+  return 0;
+}
+
+/* end of the input */
+static int
+csvparser_finish(csvparser *p)
+{
+  if(p->state==CSV_START_RECORD)
+    return 0;
+  if(csvparser_endfield(p) || csvparser_endrecord(p))
+    return -1;
+  return 0;
+}
+
+/* discards complete records that have been executed, moving the
+   partial record to the beginning */
+static void
+csvparser_compact(csvparser *p)
+{
+  Py_ssize_t i, first=p->nrecords*p->ncols;
+
+  for(i=first; i<p->nfields; i++)
+    {
+      p->fields[(i-first)*2]=p->fields[i*2]-p->recordstart;
+      p->fields[(i-first)*2+1]=p->fields[i*2+1];
+    }
+  p->nfields-=first;
+  memmove(p->data, p->data+p->recordstart, p->datalen-p->recordstart);
+  p->datalen-=p->recordstart;
+  p->fieldstart-=p->recordstart;
+  p->recordstart=0;
+  p->nrecords=0;
+}
+
+/* Binds and executes records first up to last.  Called with the GIL
+   released and db mutex held.  Columns with a non-zero entry in
+   converted have already been bound by the caller.  *done is
+   incremented for each row successfully executed. */
+static int
+importcsv_run(csvparser *p, sqlite3_stmt *stmt, int nullempty, const char *converted, Py_ssize_t first, Py_ssize_t last, Py_ssize_t *done)
+{
+  int res=SQLITE_DONE, col;
+  Py_ssize_t row;
+
+  for(row=first; row<last; row++)
+    {
+      for(col=0; col<p->ncols; col++)
+        {
+          const Py_ssize_t *field=p->fields+(row*p->ncols+col)*2;
+          if(converted && converted[col])
+            continue;
+          if(!field[1] && nullempty)
+            res=sqlite3_bind_null(stmt, col+1); /* PYSQLITE_CALL */
+          else
+            res=sqlite3_bind_text(stmt, col+1, field[1]?p->data+field[0]:"", (int)field[1], SQLITE_STATIC); /* PYSQLITE_CALL */
+          if(res!=SQLITE_OK)
+            goto end;
+        }
+
+      /* any result rows are discarded */
+      do
+        res=sqlite3_step(stmt); /* PYSQLITE_CALL */
+      while(res==SQLITE_ROW);
+
+      if(res!=SQLITE_DONE)
+        goto end;
+      res=sqlite3_reset(stmt); /* PYSQLITE_CALL */
+      if(res!=SQLITE_OK)
+        goto end;
+      res=SQLITE_DONE;
+      (*done)++;
+    }
+
+ end:
+  /* don't leave pointers to the parser data in the statement */
+  sqlite3_clear_bindings(stmt); /* PYSQLITE_CALL */
+  return res;
+}
+
+/* Binds the values of converted columns for one record */
+static int
+APSWCursor_importcsv_convert(APSWCursor *self, csvparser *p, PyObject *converters, int nullempty, Py_ssize_t row)
+{
+  int col;
+
+  for(col=0; col<p->ncols; col++)
+    {
+      const Py_ssize_t *field=p->fields+(row*p->ncols+col)*2;
+      PyObject *converter=PySequence_Fast_GET_ITEM(converters, col), *value, *text;
+      int res;
+
+      if(converter==Py_None)
+        continue;
+      if(!field[1] && nullempty)
+        {
+          value=Py_None;
+          Py_INCREF(value);
+        }
+      else
+        {
+          text=convertutf8stringsize(p->data+field[0], field[1]);
+          if(!text)
+            return -1;
+          value=PyObject_CallFunctionObjArgs(converter, text, NULL);
+          Py_DECREF(text);
+          if(!value)
+            {
+              AddTraceBackHere(__FILE__, __LINE__, "APSWCursor_importcsv.converter", "{s: i, s: i}",
+                               "row", (int)(p->recordnum-p->nrecords+row+1), "column", col);
+              return -1;
+            }
+        }
+      res=APSWCursor_dobinding(self, col+1, value);
+      Py_DECREF(value);
+      if(res!=SQLITE_OK)
+        {
+          assert(PyErr_Occurred());
+          return -1;
+        }
+    }
+  return 0;
+}
+
+/* BEGIN, COMMIT or ROLLBACK for importcsv's own transactions */
+static int
+APSWCursor_importcsv_transaction(APSWCursor *self, const char *sql)
+{
+  int res;
+
+  PYSQLITE_CUR_CALL(res=sqlite3_exec(self->connection->db, sql, NULL, NULL, NULL));
+  if(res!=SQLITE_OK)
+    {
+      if(!PyErr_Occurred())
+        SET_EXC(res, self->connection->db);
+      return -1;
+    }
+  return 0;
+}
+
+/** .. method:: importcsv(source, statement, delimiter=",", quoting=True, converters=None, nullempty=False, skip=0, batch=10000) -> int
+
+  Reads delimited text (eg CSV) from *source* and executes
+  *statement* for each record, with the fields bound in order.  The
+  source is parsed and the rows executed in large chunks with the GIL
+  released, binding directly from the parsed text without making
+  Python objects, which makes this far faster than reading with the
+  :mod:`csv` module and calling :meth:`~Cursor.execute` for each row::
+
+    with open("data.csv", "rb") as f:
+       cursor.importcsv(f, "insert into items values(?,?,?)")
+
+  :param source: An object with a *read(size)* method such as a
+    file.  It can return bytes (which must be UTF-8) or strings, with
+    an empty result meaning the end of the data.
+  :param statement: A single SQL statement with one binding for each
+    field.  Any rows it returns are discarded.
+  :param delimiter: A single character between fields.
+  :param quoting: If true then fields can be quoted with double
+    quotes as for the excel dialect of the :mod:`csv` module.  If
+    false then quote characters are treated like any other (csv
+    QUOTE_NONE).  Records end with any of \\r\\n, \\n or \\r.  Blank
+    lines are skipped.
+  :param converters: None or a sequence with an item for each field.
+    An item of None means the text is bound as is, otherwise it is
+    called with the text and the result is bound.  Columns with
+    converters need the GIL for each row.
+  :param nullempty: If true then empty fields are bound as null (and
+    converters are not called for them).
+  :param skip: How many records to skip at the start, such as a
+    header.
+  :param batch: If the connection is not in a transaction then the
+    rows are executed in transactions of this many rows.  Zero means
+    no transactions are started.  If the connection is already in a
+    transaction then it is used.
+
+  :returns: The number of rows executed.
+
+  ValueError is raised if a record has the wrong number of fields.
+  If an exception occurs then rows in already committed batches (or
+  the rows before the failing one if you are managing the
+  transaction) will have been executed.  Execution tracers are not
+  called.
+
+  -* sqlite3_bind_text sqlite3_bind_null sqlite3_step sqlite3_reset sqlite3_clear_bindings sqlite3_exec
+*/
+static PyObject *
+APSWCursor_importcsv(APSWCursor *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[]={"source", "statement", "delimiter", "quoting", "converters", "nullempty", "skip", "batch", NULL};
+  PyObject *source=NULL, *query=NULL, *quoting=Py_True, *converters=Py_None, *nullempty=Py_False, *fastconverters=NULL, *chunk=NULL;
+  const char *delimiter=",";
+  char *converted=NULL;
+  Py_ssize_t skip=0, batch=10000, done=0, before, row, intxn=0;
+  int res, col, nempty, eof=0, owntxn=0, txnopen=0;
+  csvparser p;
+
+  CHECK_USE(NULL);
+  CHECK_CURSOR_CLOSED(NULL);
+  CHECK_CURSOR_VIEWS(NULL);
+
+  res=resetcursor(self, /* force= */ 0);
+  if(res!=SQLITE_OK)
+    {
+      assert(PyErr_Occurred());
+      return NULL;
+    }
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "OO|sOOOnn:importcsv(source, statement, delimiter=\",\", quoting=True, converters=None, nullempty=False, skip=0, batch=10000)",
+                                  kwlist, &source, &query, &delimiter, &quoting, &converters, &nullempty, &skip, &batch))
+    return NULL;
+
+  if(strlen(delimiter)!=1 || (unsigned char)delimiter[0]>127 || delimiter[0]=='\r' || delimiter[0]=='\n')
+    return PyErr_Format(PyExc_ValueError, "delimiter must be a single ASCII character other than a line ending");
+  if(skip<0 || batch<0)
+    return PyErr_Format(PyExc_ValueError, "skip and batch must not be negative");
+
+  memset(&p, 0, sizeof(p));
+  p.delimiter=delimiter[0];
+  p.quoting=PyObject_IsTrue(quoting);
+  nempty=PyObject_IsTrue(nullempty);
+  if(p.quoting<0 || nempty<0)
+    return NULL;
+  p.skip=skip;
+
+  assert(!self->statement);
+  INUSE_CALL(self->statement=statementcache_prepare(self->connection->stmtcache, query, 1));
+  if (!self->statement)
+    {
+      AddTraceBackHere(__FILE__, __LINE__, "APSWCursor_importcsv.sqlite3_prepare", "{s: O, s: O}",
+		       "Connection", self->connection,
+		       "statement", query);
+      goto error;
+    }
+
+  if(self->statement->next)
+    {
+      PyErr_Format(PyExc_ValueError, "Only one statement can be used with importcsv");
+      goto error;
+    }
+
+  /* empty statement */
+  if(!self->statement->vdbestatement)
+    goto finally;
+
+  p.ncols=sqlite3_bind_parameter_count(self->statement->vdbestatement);
+  if(p.ncols<1)
+    {
+      PyErr_Format(PyExc_ValueError, "The statement must have at least one binding");
+      goto error;
+    }
+
+  if(converters!=Py_None)
+    {
+      fastconverters=PySequence_Fast(converters, "converters must be None or a sequence");
+      if(!fastconverters)
+        goto error;
+      if(PySequence_Fast_GET_SIZE(fastconverters)!=p.ncols)
+        {
+          PyErr_Format(PyExc_ValueError, "converters has %d items but the statement has %d bindings", (int)PySequence_Fast_GET_SIZE(fastconverters), p.ncols);
+          goto error;
+        }
+      converted=PyMem_Malloc(p.ncols);
+      if(!converted)
+        {
+          PyErr_NoMemory();
+          goto error;
+        }
+      for(col=0; col<p.ncols; col++)
+        {
+          PyObject *converter=PySequence_Fast_GET_ITEM(fastconverters, col);
+          if(converter!=Py_None && !PyCallable_Check(converter))
+            {
+              PyErr_Format(PyExc_TypeError, "converter for column %d must be None or callable", col);
+              goto error;
+            }
+          converted[col]=(converter!=Py_None);
+        }
+      /* all None is the same as no converters */
+      for(col=0; col<p.ncols && !converted[col]; col++);
+      if(col==p.ncols)
+        {
+          PyMem_Free(converted);
+          converted=NULL;
+        }
+    }
+
+  owntxn=batch && sqlite3_get_autocommit(self->connection->db);
+
+  while(!eof)
+    {
+      chunk=PyObject_CallMethod(source, "read", "i", IMPORTCSV_CHUNK);
+      if(!chunk)
+        goto error;
+      if(PyUnicode_Check(chunk))
+        {
+          PyObject *utf8=PyUnicode_AsUTF8String(chunk);
+          Py_DECREF(chunk);
+          chunk=utf8;
+          if(!chunk)
+            goto error;
+        }
+      if(!PyBytes_Check(chunk))
+        {
+          PyErr_Format(PyExc_TypeError, "read must return bytes or str not %s", Py_TYPE(chunk)->tp_name);
+          goto error;
+        }
+      if(PyBytes_GET_SIZE(chunk))
+        res=csvparser_parse(&p, PyBytes_AS_STRING(chunk), PyBytes_GET_SIZE(chunk));
+      else
+        {
+          eof=1;
+          res=csvparser_finish(&p);
+        }
+      Py_CLEAR(chunk);
+      if(res)
+        goto error;
+
+      row=0;
+      while(row<p.nrecords)
+        {
+          Py_ssize_t n=p.nrecords-row;
+
+          if(owntxn && !txnopen)
+            {
+              if(APSWCursor_importcsv_transaction(self, "BEGIN"))
+                goto error;
+              txnopen=1;
+              intxn=0;
+            }
+          if(owntxn && n>batch-intxn)
+            n=batch-intxn;
+          if(converted)
+            {
+              n=1;
+              if(APSWCursor_importcsv_convert(self, &p, fastconverters, nempty, row))
+                goto error;
+            }
+
+          before=done;
+          PYSQLITE_CUR_CALL(res=importcsv_run(&p, self->statement->vdbestatement, nempty, converted, row, row+n, &done));
+          if(PyErr_Occurred())
+            goto error;
+          if(res!=SQLITE_DONE)
+            {
+              SET_EXC(res, self->connection->db);
+              AddTraceBackHere(__FILE__, __LINE__, "APSWCursor_importcsv", "{s: O, s: i}",
+                               "statement", query, "row", (int)(p.recordnum-p.nrecords+row+(done-before)+1));
+              goto error;
+            }
+          row+=n;
+          intxn+=n;
+          if(txnopen && intxn>=batch)
+            {
+              txnopen=0;
+              if(APSWCursor_importcsv_transaction(self, "COMMIT"))
+                goto error;
+            }
+        }
+      csvparser_compact(&p);
+    }
+
+  if(txnopen)
+    {
+      txnopen=0;
+      if(APSWCursor_importcsv_transaction(self, "COMMIT"))
+        goto error;
+    }
+
+ finally:
+  PyMem_Free(p.data);
+  PyMem_Free(p.fields);
+  PyMem_Free(converted);
+  Py_XDECREF(fastconverters);
+  if(resetcursor(self, /* force= */ 0)!=SQLITE_OK)
+    return NULL;
+  return PyLong_FromSsize_t(done);
+
+ error:
+  assert(PyErr_Occurred());
+  Py_XDECREF(chunk);
+  if(txnopen)
+    {
+      PyObject *etype, *evalue, *etb;
+      PyErr_Fetch(&etype, &evalue, &etb);
+      if(APSWCursor_importcsv_transaction(self, "ROLLBACK"))
+        PyErr_Clear();
+      PyErr_Restore(etype, evalue, etb);
+    }
+  PyMem_Free(p.data);
+  PyMem_Free(p.fields);
+  PyMem_Free(converted);
+  Py_XDECREF(fastconverters);
+  resetcursor(self, /* force= */ 1);
+  return NULL;
+}
+
+/** .. method:: fetchone() -> row or None
+
+  Returns the next row of data or None if there are no more rows.
+*/
+
+static PyObject *
+APSWCursor_fetchone(APSWCursor *self)
+{
+    PyObject *res;
+
+    CHECK_USE(NULL);
+    CHECK_CURSOR_CLOSED(NULL);
+
+    res=APSWCursor_next(self);
+
+    if(res==NULL && !PyErr_Occurred())
+        Py_RETURN_NONE;
+
+    return res;
+}
+
+/* Gets the type and memory of a column.  This is called with the GIL
+   released and so must not use any Python APIs. */
+static void
+columnview_fill(sqlite3_stmt *stmt, int column, int *coltype, const void **data, Py_ssize_t *length)
+{
+  *coltype=sqlite3_column_type(stmt, column); /* PYSQLITE_CALL - GIL was released by caller */
+  /* text must be asked for before bytes */
+  if(*coltype==SQLITE_TEXT)
+    *data=sqlite3_column_text(stmt, column); /* PYSQLITE_CALL */
+  else if(*coltype==SQLITE_BLOB)
+    *data=sqlite3_column_blob(stmt, column); /* PYSQLITE_CALL */
+  else
+    return;
+  *length=sqlite3_column_bytes(stmt, column); /* PYSQLITE_CALL */
+}
+
+/** .. method:: columnview(column) -> columnview or None
+
+  Returns a :class:`columnview` that gives access to the bytes of a
+  TEXT (as UTF-8) or BLOB *column* in the row most recently returned
+  (for example by iterating or :meth:`~Cursor.fetchone`) without
+  copying them.  This is useful for large values that are only going
+  to be hashed, written out or similar::
+
+    for rowid, in cursor.execute("select rowid, data from files"):
+        hasher.update(cursor.columnview(1))
+
+  None is returned if the value is null, and :exc:`TypeError` is
+  raised for integers and floats.
+
+  The memory belongs to SQLite and is only valid until the cursor
+  moves to another row.  After that the :class:`columnview` raises
+  :exc:`ValueError` if it is used.  While a buffer is exported from
+  it (eg a :class:`memoryview` made from it that hasn't been
+  released) the cursor won't move to another row and raises
+  :exc:`BufferError` if you try.  Closing the cursor or connection
+  with *force* ignores exports which leaves them pointing at freed
+  memory.
+
+  -* sqlite3_column_blob sqlite3_column_text sqlite3_column_bytes
+*/
+static PyObject *
+APSWCursor_columnview(APSWCursor *self, PyObject *arg)
+{
+  ColumnView *view;
+  long column;
+  int coltype, ncols;
+  const void *data=NULL;
+  Py_ssize_t length=0;
+
+  CHECK_USE(NULL);
+  CHECK_CURSOR_CLOSED(NULL);
+
+  if(!PyIntLong_Check(arg))
+    return PyErr_Format(PyExc_TypeError, "column must be an integer");
+  column=PyIntLong_AsLong(arg);
+  if(PyErr_Occurred())
+    return NULL;
+
+  if(!self->statement || self->status==C_DONE)
+    return PyErr_Format(ExcComplete, "There is no current row as the statements have completed execution");
+  /* C_ROW means the next row has been stepped to but not returned yet */
+  if(self->status!=C_BEGIN || !self->statement->vdbestatement)
+    return PyErr_Format(PyExc_ValueError, "No row has been returned yet");
+
+  ncols=sqlite3_data_count(self->statement->vdbestatement);
+  if(column<0 || column>=ncols)
+    return PyErr_Format(PyExc_IndexError, "column %ld is out of range (there are %d)", column, ncols);
+
+  INUSE_CALL(_PYSQLITE_CALL_V(columnview_fill(self->statement->vdbestatement, (int)column, &coltype, &data, &length)));
+
+  if(coltype==SQLITE_NULL)
+    Py_RETURN_NONE;
+  if(coltype!=SQLITE_TEXT && coltype!=SQLITE_BLOB)
+    return PyErr_Format(PyExc_TypeError, "column %ld is not TEXT or BLOB", column);
+  /* zero length values can be a null pointer */
+  if(!data)
+    data="";
+
+  view=PyObject_New(ColumnView, &ColumnViewType);
+  if(!view)
+    return NULL;
+  Py_INCREF(self);
+  view->cursor=self;
+  view->rowgeneration=self->rowgeneration;
+  view->data=data;
+  view->length=length;
+  return (PyObject*)view;
+}
+
+
+static PyMethodDef APSWCursor_methods[] = {
+  {"execute", (PyCFunction)APSWCursor_execute, METH_VARARGS,
+   "Executes one or more statements" },
+  {"executemany", (PyCFunction)APSWCursor_executemany, METH_VARARGS,
+   "Repeatedly executes statements on sequence" },
+  {"setexectrace", (PyCFunction)APSWCursor_setexectrace, METH_O,
+   "Installs a function called for every statement executed"},
+  {"setrowtrace", (PyCFunction)APSWCursor_setrowtrace, METH_O,
+   "Installs a function called for every row returned"},
+  {"getexectrace", (PyCFunction)APSWCursor_getexectrace, METH_NOARGS,
+   "Returns the current exec tracer function"},
+  {"getrowtrace", (PyCFunction)APSWCursor_getrowtrace, METH_NOARGS,
+   "Returns the current row tracer function"},
+  {"setrowfactory", (PyCFunction)APSWCursor_setrowfactory, METH_O,
+   "Chooses the type of rows returned"},
+  {"getrowfactory", (PyCFunction)APSWCursor_getrowfactory, METH_NOARGS,
+   "Returns the row factory"},
+  {"getconnection", (PyCFunction)APSWCursor_getconnection, METH_NOARGS,
+   "Returns the connection object for this cursor"},
+  {"getdescription", (PyCFunction)APSWCursor_getdescription, METH_NOARGS,
+   "Returns the description for the current row"},
+  {"close", (PyCFunction)APSWCursor_close, METH_VARARGS,
+   "Closes the cursor" },
+  {"fetchall", (PyCFunction)APSWCursor_fetchall, METH_NOARGS,
+   "Fetches all result rows" },
+  {"fetchone", (PyCFunction)APSWCursor_fetchone, METH_NOARGS,
+   "Fetches next result row" },
+  {"fetchmany", (PyCFunction)APSWCursor_fetchmany, METH_VARARGS|METH_KEYWORDS,
+   "Fetches a list of result rows" },
+  {"fetchinto", (PyCFunction)APSWCursor_fetchinto, METH_VARARGS,
+   "Copies result rows into column buffers" },
+  {"fetchinserts", (PyCFunction)APSWCursor_fetchinserts, METH_VARARGS|METH_KEYWORDS,
+   "Returns result rows as SQL INSERT statements" },
+  {"executemanycolumns", (PyCFunction)APSWCursor_executemanycolumns, METH_VARARGS,
+   "Executes a statement binding values from column buffers" },
+  {"importcsv", (PyCFunction)APSWCursor_importcsv, METH_VARARGS|METH_KEYWORDS,
+   "Executes a statement for each record of delimited text" },
+  {"columnview", (PyCFunction)APSWCursor_columnview, METH_O,
+   "Returns direct access to the bytes of a column in the current row" },
+
+  {0, 0, 0, 0}  /* Sentinel */
+};
+
+
+static PyGetSetDef APSWCursor_getset[] = {
+  {"description", (getter)APSWCursor_getdescription_dbapi, NULL,  "Subset of DB-API description attribute", NULL},
+  {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyTypeObject APSWCursorType = {
+    APSW_PYTYPE_INIT
+    "apsw.Cursor",             /*tp_name*/
+    sizeof(APSWCursor),            /*tp_basicsize*/
+    0,                         /*tp_itemsize*/
+    (destructor)APSWCursor_dealloc, /*tp_dealloc*/
     0,                         /*tp_print*/
     0,                         /*tp_getattr*/
     0,                         /*tp_setattr*/
@@ -1536,3 +3771,479 @@ static PyTypeObject APSWCursorType = {
     0                          /* tp_del */
     APSW_PYTYPE_VERSION
 };
+
+
+/** .. class:: columnview
+
+  Returned by :meth:`Cursor.columnview`, this supports the buffer
+  protocol so it can be given directly to anything taking
+  :class:`bytes` like objects such as hashlib, file and socket writes
+  and :class:`memoryview`.  It is only valid until the cursor moves
+  to another row, after which :exc:`ValueError` is raised on use.
+*/
+
+/* Returns 0 if the view is still valid else sets an exception and returns -1 */
+static int
+ColumnView_check(ColumnView *self)
+{
+  if(self->rowgeneration!=self->cursor->rowgeneration)
+    {
+      PyErr_Format(PyExc_ValueError, "The cursor has moved on from the row this columnview is for");
+      return -1;
+    }
+  return 0;
+}
+
+static void
+ColumnView_dealloc(ColumnView *self)
+{
+  Py_CLEAR(self->cursor);
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static Py_ssize_t
+ColumnView_len(ColumnView *self)
+{
+  if(ColumnView_check(self))
+    return -1;
+  return self->length;
+}
+
+/** .. method:: tobytes() -> bytes
+
+  Returns a copy of the data.
+*/
+static PyObject *
+ColumnView_tobytes(ColumnView *self)
+{
+  if(ColumnView_check(self))
+    return NULL;
+  return PyBytes_FromStringAndSize(self->data, self->length);
+}
+
+static int
+ColumnView_getbuffer(ColumnView *self, Py_buffer *view, int flags)
+{
+  if(ColumnView_check(self))
+    {
+      view->obj=NULL;
+      return -1;
+    }
+  if(PyBuffer_FillInfo(view, (PyObject*)self, (void*)self->data, self->length, 1, flags))
+    return -1;
+  self->cursor->viewexports++;
+  return 0;
+}
+
+static void
+ColumnView_releasebuffer(ColumnView *self, Py_buffer *view)
+{
+  assert(self->cursor->viewexports>0);
+  self->cursor->viewexports--;
+}
+
+#if PY_MAJOR_VERSION < 3
+static Py_ssize_t
+ColumnView_getreadbuffer(ColumnView *self, Py_ssize_t segment, void **ptrptr)
+{
+  if(segment)
+    {
+      PyErr_Format(PyExc_SystemError, "Accessing non-existent columnview segment");
+      return -1;
+    }
+  if(ColumnView_check(self))
+    return -1;
+  *ptrptr=(void*)self->data;
+  return self->length;
+}
+
+static Py_ssize_t
+ColumnView_getsegcount(ColumnView *self, Py_ssize_t *lenp)
+{
+  if(lenp)
+    *lenp=self->length;
+  return 1;
+}
+#endif
+
+static PySequenceMethods ColumnView_as_sequence = {
+  (lenfunc)ColumnView_len,     /* sq_length */
+  0,                           /* sq_concat */
+  0,                           /* sq_repeat */
+  0,                           /* sq_item */
+  0,                           /* sq_slice */
+  0,                           /* sq_ass_item */
+  0,                           /* sq_ass_slice */
+  0,                           /* sq_contains */
+  0,                           /* sq_inplace_concat */
+  0,                           /* sq_inplace_repeat */
+};
+
+static PyBufferProcs ColumnView_as_buffer = {
+#if PY_MAJOR_VERSION < 3
+  (readbufferproc)ColumnView_getreadbuffer,  /* bf_getreadbuffer */
+  0,                                          /* bf_getwritebuffer */
+  (segcountproc)ColumnView_getsegcount,       /* bf_getsegcount */
+  0,                                          /* bf_getcharbuffer */
+#endif
+  (getbufferproc)ColumnView_getbuffer,        /* bf_getbuffer */
+  (releasebufferproc)ColumnView_releasebuffer /* bf_releasebuffer */
+};
+
+static PyMethodDef ColumnView_methods[] = {
+  {"tobytes", (PyCFunction)ColumnView_tobytes, METH_NOARGS,
+   "Returns a copy of the data"},
+  {0, 0, 0, 0}  /* Sentinel */
+};
+
+static PyTypeObject ColumnViewType = {
+    APSW_PYTYPE_INIT
+    "apsw.columnview",         /*tp_name*/
+    sizeof(ColumnView),        /*tp_basicsize*/
+    0,                         /*tp_itemsize*/
+    (destructor)ColumnView_dealloc, /*tp_dealloc*/
+    0,                         /*tp_print*/
+    0,                         /*tp_getattr*/
+    0,                         /*tp_setattr*/
+    0,                         /*tp_compare*/
+    0,                         /*tp_repr*/
+    0,                         /*tp_as_number*/
+    &ColumnView_as_sequence,   /*tp_as_sequence*/
+    0,                         /*tp_as_mapping*/
+    0,                         /*tp_hash */
+    0,                         /*tp_call*/
+    0,                         /*tp_str*/
+    0,                         /*tp_getattro*/
+    0,                         /*tp_setattro*/
+    &ColumnView_as_buffer,     /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG
+#if PY_MAJOR_VERSION < 3
+ | Py_TPFLAGS_HAVE_NEWBUFFER
+#endif
+ , /*tp_flags*/
+    "columnview object",       /* tp_doc */
+    0,		               /* tp_traverse */
+    0,		               /* tp_clear */
+    0,		               /* tp_richcompare */
+    0,		               /* tp_weaklistoffset */
+    0,		               /* tp_iter */
+    0,		               /* tp_iternext */
+    ColumnView_methods,        /* tp_methods */
+    0,                         /* tp_members */
+    0,                         /* tp_getset */
+    0,                         /* tp_base */
+    0,                         /* tp_dict */
+    0,                         /* tp_descr_get */
+    0,                         /* tp_descr_set */
+    0,                         /* tp_dictoffset */
+    0,                         /* tp_init */
+    0,                         /* tp_alloc */
+    0,                         /* tp_new */
+    0,                         /* tp_free */
+    0,                         /* tp_is_gc */
+    0,                         /* tp_bases */
+    0,                         /* tp_mro */
+    0,                         /* tp_cache */
+    0,                         /* tp_subclasses */
+    0,                         /* tp_weaklist */
+    0                          /* tp_del */
+    APSW_PYTYPE_VERSION
+};
+
+
+/** .. class:: row
+
+  Returned by a :class:`Cursor` when its :meth:`row factory
+  <Cursor.setrowfactory>` is ``"row"``.  It behaves like a
+  :class:`tuple` of the values, and they can also be got by column
+  name as attributes or keys::
+
+    for row in cursor.execute("select id, name from people"):
+        print(row.id, row["name"], row[1])
+
+  Rows compare equal to tuples with the same values.
+*/
+
+static void
+APSWRow_dealloc(APSWRow *self)
+{
+  Py_ssize_t i;
+
+  for(i=0;i<Py_SIZE(self);i++)
+    Py_DECREF(self->items[i]);
+  Py_CLEAR(self->fields);
+  Py_CLEAR(self->index);
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/* Returns the values as a tuple */
+static PyObject *
+APSWRow_astuple(APSWRow *self)
+{
+  PyObject *res;
+  Py_ssize_t i;
+
+  res=PyTuple_New(Py_SIZE(self));
+  if(!res)
+    return NULL;
+  for(i=0;i<Py_SIZE(self);i++)
+    {
+      Py_INCREF(self->items[i]);
+      PyTuple_SET_ITEM(res, i, self->items[i]);
+    }
+  return res;
+}
+
+static Py_ssize_t
+APSWRow_len(APSWRow *self)
+{
+  return Py_SIZE(self);
+}
+
+static PyObject *
+APSWRow_item(APSWRow *self, Py_ssize_t i)
+{
+  if(i<0 || i>=Py_SIZE(self))
+    return PyErr_Format(PyExc_IndexError, "row index out of range");
+  Py_INCREF(self->items[i]);
+  return self->items[i];
+}
+
+static PyObject *
+APSWRow_subscript(APSWRow *self, PyObject *key)
+{
+  PyObject *pos, *tuple, *res;
+
+  if(PyUnicode_Check(key)
+#if PY_MAJOR_VERSION < 3
+     || PyString_Check(key)
+#endif
+     )
+    {
+      pos=PyDict_GetItem(self->index, key);
+      if(!pos)
+        {
+          PyErr_SetObject(PyExc_KeyError, key);
+          return NULL;
+        }
+      return APSWRow_item(self, PyIntLong_AsLong(pos));
+    }
+
+  if(PyIndex_Check(key))
+    {
+      Py_ssize_t i=PyNumber_AsSsize_t(key, PyExc_IndexError);
+      if(i==-1 && PyErr_Occurred())
+        return NULL;
+      if(i<0)
+        i+=Py_SIZE(self);
+      return APSWRow_item(self, i);
+    }
+
+  /* slices and anything else behave as for a tuple */
+  tuple=APSWRow_astuple(self);
+  if(!tuple)
+    return NULL;
+  res=PyObject_GetItem(tuple, key);
+  Py_DECREF(tuple);
+  return res;
+}
+
+static PyObject *
+APSWRow_getattro(APSWRow *self, PyObject *name)
+{
+  PyObject *pos=PyDict_GetItem(self->index, name);
+
+  if(pos)
+    return APSWRow_item(self, PyIntLong_AsLong(pos));
+  return PyObject_GenericGetAttr((PyObject*)self, name);
+}
+
+static PyObject *
+APSWRow_richcompare(APSWRow *self, PyObject *other, int op)
+{
+  PyObject *mine=NULL, *theirs=NULL, *res=NULL;
+
+  mine=APSWRow_astuple(self);
+  if(!mine) goto finally;
+  if(Py_TYPE(other)==&APSWRowType)
+    {
+      theirs=APSWRow_astuple((APSWRow*)other);
+      if(!theirs) goto finally;
+    }
+  else
+    {
+      theirs=other;
+      Py_INCREF(theirs);
+    }
+  res=PyObject_RichCompare(mine, theirs, op);
+
+ finally:
+  Py_XDECREF(mine);
+  Py_XDECREF(theirs);
+  return res;
+}
+
+static Py_hash_t
+APSWRow_hash(APSWRow *self)
+{
+  Py_hash_t res;
+  PyObject *tuple=APSWRow_astuple(self);
+
+  if(!tuple)
+    return -1;
+  res=PyObject_Hash(tuple);
+  Py_DECREF(tuple);
+  return res;
+}
+
+static PyObject *
+APSWRow_repr(APSWRow *self)
+{
+  PyObject *parts=NULL, *sep=NULL, *joined=NULL, *res=NULL;
+  Py_ssize_t i;
+
+  parts=PyList_New(Py_SIZE(self));
+  if(!parts) goto finally;
+  for(i=0;i<Py_SIZE(self);i++)
+    {
+      PyObject *part=PyUnicode_FromFormat("%S=%R", PyTuple_GET_ITEM(self->fields, i), self->items[i]);
+      if(!part) goto finally;
+      PyList_SET_ITEM(parts, i, part);
+    }
+  sep=PyUnicode_FromString(", ");
+  if(!sep) goto finally;
+  joined=PyUnicode_Join(sep, parts);
+  if(!joined) goto finally;
+  res=PyUnicode_FromFormat("Row(%U)", joined);
+#if PY_MAJOR_VERSION < 3
+  if(res)
+    {
+      PyObject *str=PyUnicode_AsEncodedString(res, "ascii", "backslashreplace");
+      Py_DECREF(res);
+      res=str;
+    }
+#endif
+
+ finally:
+  Py_XDECREF(parts);
+  Py_XDECREF(sep);
+  Py_XDECREF(joined);
+  return res;
+}
+
+/** .. attribute:: _fields
+
+  A tuple of the column names, as for :func:`collections.namedtuple`.
+*/
+static PyObject *
+APSWRow_getfields(APSWRow *self, APSW_ARGUNUSED void *unused)
+{
+  Py_INCREF(self->fields);
+  return self->fields;
+}
+
+/** .. method:: _asdict() -> dict
+
+  Returns a :class:`dict` of column name to value.
+*/
+static PyObject *
+APSWRow_asdict(APSWRow *self)
+{
+  PyObject *res;
+  Py_ssize_t i;
+
+  res=PyDict_New();
+  if(!res)
+    return NULL;
+  for(i=Py_SIZE(self)-1;i>=0;i--)
+    if(PyDict_SetItem(res, PyTuple_GET_ITEM(self->fields, i), self->items[i]))
+      {
+        Py_DECREF(res);
+        return NULL;
+      }
+  return res;
+}
+
+static PySequenceMethods APSWRow_as_sequence = {
+  (lenfunc)APSWRow_len,        /* sq_length */
+  0,                           /* sq_concat */
+  0,                           /* sq_repeat */
+  (ssizeargfunc)APSWRow_item,  /* sq_item */
+  0,                           /* sq_slice */
+  0,                           /* sq_ass_item */
+  0,                           /* sq_ass_slice */
+  0,                           /* sq_contains */
+  0,                           /* sq_inplace_concat */
+  0,                           /* sq_inplace_repeat */
+};
+
+static PyMappingMethods APSWRow_as_mapping = {
+  (lenfunc)APSWRow_len,              /* mp_length */
+  (binaryfunc)APSWRow_subscript,     /* mp_subscript */
+  0,                                 /* mp_ass_subscript */
+};
+
+static PyMethodDef APSWRow_methods[] = {
+  {"_asdict", (PyCFunction)APSWRow_asdict, METH_NOARGS,
+   "Returns a dict of column name to value"},
+  {0, 0, 0, 0}  /* Sentinel */
+};
+
+static PyGetSetDef APSWRow_getset[] = {
+  {"_fields", (getter)APSWRow_getfields, NULL, "Column names", NULL},
+  {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyTypeObject APSWRowType = {
+    APSW_PYTYPE_INIT
+    "apsw.row",                /*tp_name*/
+    offsetof(APSWRow, items),  /*tp_basicsize*/
+    sizeof(PyObject*),         /*tp_itemsize*/
+    (destructor)APSWRow_dealloc, /*tp_dealloc*/
+    0,                         /*tp_print*/
+    0,                         /*tp_getattr*/
+    0,                         /*tp_setattr*/
+    0,                         /*tp_compare*/
+    (reprfunc)APSWRow_repr,    /*tp_repr*/
+    0,                         /*tp_as_number*/
+    &APSWRow_as_sequence,      /*tp_as_sequence*/
+    &APSWRow_as_mapping,       /*tp_as_mapping*/
+    (hashfunc)APSWRow_hash,    /*tp_hash */
+    0,                         /*tp_call*/
+    0,                         /*tp_str*/
+    (getattrofunc)APSWRow_getattro, /*tp_getattro*/
+    0,                         /*tp_setattro*/
+    0,                         /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG
+#if PY_MAJOR_VERSION < 3
+ | Py_TPFLAGS_HAVE_RICHCOMPARE
+#endif
+ , /*tp_flags*/
+    "row object",              /* tp_doc */
+    0,		               /* tp_traverse */
+    0,		               /* tp_clear */
+    (richcmpfunc)APSWRow_richcompare, /* tp_richcompare */
+    0,		               /* tp_weaklistoffset */
+    0,		               /* tp_iter */
+    0,		               /* tp_iternext */
+    APSWRow_methods,           /* tp_methods */
+    0,                         /* tp_members */
+    APSWRow_getset,            /* tp_getset */
+    0,                         /* tp_base */
+    0,                         /* tp_dict */
+    0,                         /* tp_descr_get */
+    0,                         /* tp_descr_set */
+    0,                         /* tp_dictoffset */
+    0,                         /* tp_init */
+    0,                         /* tp_alloc */
+    0,                         /* tp_new */
+    0,                         /* tp_free */
+    0,                         /* tp_is_gc */
+    0,                         /* tp_bases */
+    0,                         /* tp_mro */
+    0,                         /* tp_cache */
+    0,                         /* tp_subclasses */
+    0,                         /* tp_weaklist */
+    0                          /* tp_del */
+    APSW_PYTYPE_VERSION
+};
@@ -0,0 +1,742 @@
+/*
+  Another Python Sqlite Wrapper
+
+  Pool of connections to one database shared between threads
+
+  See the accompanying LICENSE file.
+*/
+
+/**
+
+.. _pool:
+
+Connection Pool
+***************
+
+A :class:`ConnectionPool` shares one database file between threads.
+Each thread gets its own read only :class:`Connection` so reads run
+concurrently, while all changes go through a single writer connection
+that only one thread at a time can use.  The database is put into `WAL
+mode <https://sqlite.org/wal.html>`_ so that readers and the writer do
+not block each other.
+
+:meth:`~ConnectionPool.execute` looks at the statements and routes
+them to the calling thread's reader or to the writer::
+
+  pool=apsw.ConnectionPool("app.db",
+                           prepare=["select name from item where id=?"])
+
+  # from any thread - reads use this thread's connection
+  for name, in pool.execute("select name from item where id=?", (7,)):
+      print name
+
+  # changes are run on the writer and committed
+  pool.execute("insert into item values(?,?)", (8, "eight"))
+
+Using the pool as a context manager holds the writer for the block,
+running it as a transaction in the same way as :meth:`Connection.__enter__`::
+
+  with pool as db:
+      db.cursor().execute("delete from item where id=?", (7,))
+      pool.execute("insert into item values(?,?)", (7, "seven"))
+
+Important details
+=================
+
+Statements are routed using `sqlite3_stmt_readonly
+<https://sqlite.org/c3ref/stmt_readonly.html>`_ and the answer is
+remembered for each query text.  Transaction control such as BEGIN
+counts as reading, so use **with** for transactions rather than
+executing BEGIN and COMMIT.
+
+While a thread is inside a **with** block all its
+:meth:`~ConnectionPool.execute` calls use the writer, so reads see
+the changes not yet committed.
+
+Reader connections are opened with :const:`SQLITE_OPEN_READONLY`
+and are kept per thread identifier.  They are reused by later threads
+given the same identifier, or you can call
+:meth:`~ConnectionPool.release` when a thread has finished.
+
+A ``:memory:`` filename gives every connection its own separate
+database so it is not useful with a pool.  :attr:`apsw.connection_hooks`
+are called for every connection opened by the pool.
+*/
+
+#define CHECK_POOL_CLOSED(e)                                            \
+do                                                                      \
+  {                                                                     \
+    if(!self->writer)                                                   \
+      {                                                                 \
+        PyErr_Format(ExcConnectionClosed, "The pool has been closed"); \
+        return e;                                                       \
+      }                                                                 \
+  } while(0)
+
+/* The routing cache is discarded when it reaches this many entries */
+#define POOL_ROUTING_MAX 1000
+
+/** .. class:: ConnectionPool(filename, flags=SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, vfs=None, statementcachesize=100, prepare=(), wal=True, busytimeout=5000)
+
+  Opens the writer connection to the named database.  Reader
+  connections are opened the first time each thread needs one.
+
+  :param filename: As for :meth:`Connection.__init__`
+  :param flags: Used for the writer.  The readers use the same flags
+    with :const:`SQLITE_OPEN_READWRITE` and :const:`SQLITE_OPEN_CREATE`
+    replaced by :const:`SQLITE_OPEN_READONLY`.
+  :param vfs: As for :meth:`Connection.__init__`
+  :param statementcachesize: As for :meth:`Connection.__init__`
+  :param prepare: A sequence of SQL texts.  Each connection
+    :meth:`prepares <Connection.prepare>` them when it is opened, and
+    :meth:`~ConnectionPool.execute` uses them when given the same text.
+  :param wal: Sets `journal_mode=WAL <https://sqlite.org/pragma.html#pragma_journal_mode>`_
+    on the database.
+  :param busytimeout: Passed to :meth:`Connection.setbusytimeout` for
+    every connection.
+*/
+
+struct APSWConnectionPool
+{
+  PyObject_HEAD
+  PyObject *readerargs;      /* Connection arguments for readers */
+  PyObject *prepare;         /* tuple of SQL each connection prepares */
+  int busytimeout;
+  Connection *writer;
+  PyObject *writerprepared;  /* dict of SQL to prepared statement */
+  PyThread_type_lock writelock;
+  unsigned long writerowner; /* thread holding writelock */
+  int writerdepth;           /* how many times the owner has entered */
+  PyObject *readers;         /* dict of thread id to (connection, prepared) */
+  PyObject *routing;         /* dict of SQL to True if read only */
+  PyObject *weakreflist;
+};
+
+typedef struct APSWConnectionPool APSWConnectionPool;
+
+static PyObject*
+APSWConnectionPool_new(PyTypeObject *type, APSW_ARGUNUSED PyObject *args, APSW_ARGUNUSED PyObject *kwds)
+{
+  APSWConnectionPool *self;
+
+  self=(APSWConnectionPool*)type->tp_alloc(type, 0);
+  if(self)
+    {
+      self->readerargs=0;
+      self->prepare=0;
+      self->busytimeout=0;
+      self->writer=0;
+      self->writerprepared=0;
+      self->writelock=0;
+      self->writerowner=0;
+      self->writerdepth=0;
+      self->readers=0;
+      self->routing=0;
+      self->weakreflist=0;
+    }
+  return (PyObject*)self;
+}
+
+/* Opens one of the pool's connections, sets its busy timeout and
+   prepares the shared statements into a new dict returned in
+   prepared */
+static Connection *
+APSWConnectionPool_open(APSWConnectionPool *self, PyObject *openargs, int wal, PyObject **prepared)
+{
+  Connection *conn;
+  PyObject *res=NULL, *cursor=NULL, *sql, *stmt;
+  Py_ssize_t i;
+
+  *prepared=NULL;
+  conn=(Connection*)PyObject_Call((PyObject*)&ConnectionType, openargs, NULL);
+  if(!conn)
+    return NULL;
+
+  res=PyObject_CallMethod((PyObject*)conn, "setbusytimeout", "i", self->busytimeout);
+  if(!res) goto error;
+  Py_DECREF(res);
+
+  if(wal)
+    {
+      cursor=Connection_cursor(conn);
+      if(!cursor) goto error;
+      res=PyObject_CallMethod(cursor, "execute", "s", "pragma journal_mode=wal");
+      Py_DECREF(cursor);
+      if(!res) goto error;
+      Py_DECREF(res);
+    }
+
+  *prepared=PyDict_New();
+  if(!*prepared) goto error;
+
+  for(i=0; i<PyTuple_GET_SIZE(self->prepare); i++)
+    {
+      sql=PyTuple_GET_ITEM(self->prepare, i);
+      stmt=Connection_prepare(conn, sql);
+      if(!stmt) goto error;
+      if(PyDict_SetItem(*prepared, sql, stmt))
+        {
+          Py_DECREF(stmt);
+          goto error;
+        }
+      Py_DECREF(stmt);
+    }
+
+  return conn;
+
+ error:
+  assert(PyErr_Occurred());
+  Py_CLEAR(*prepared);
+  Py_DECREF(conn);
+  return NULL;
+}
+
+static int
+APSWConnectionPool_init(APSWConnectionPool *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[]={"filename", "flags", "vfs", "statementcachesize", "prepare", "wal", "busytimeout", NULL};
+  PyObject *filename=NULL, *vfs=Py_None, *prepare=NULL, *openargs=NULL;
+  int flags=SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, readerflags;
+  int statementcachesize=100, wal=1, busytimeout=5000;
+
+  if(self->writer)
+    {
+      PyErr_Format(PyExc_ValueError, "The pool has already been opened");
+      return -1;
+    }
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|iOiOii:ConnectionPool(filename, flags=SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE, vfs=None, statementcachesize=100, prepare=(), wal=True, busytimeout=5000)",
+                                  kwlist, &filename, &flags, &vfs, &statementcachesize, &prepare, &wal, &busytimeout))
+    return -1;
+
+  readerflags=(flags & ~(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)) | SQLITE_OPEN_READONLY;
+
+  Py_CLEAR(self->readerargs);
+  Py_CLEAR(self->prepare);
+  Py_CLEAR(self->readers);
+  Py_CLEAR(self->routing);
+
+  openargs=Py_BuildValue("(OiOi)", filename, flags, vfs, statementcachesize);
+  self->readerargs=Py_BuildValue("(OiOi)", filename, readerflags, vfs, statementcachesize);
+  self->prepare=prepare?PySequence_Tuple(prepare):PyTuple_New(0);
+  self->readers=PyDict_New();
+  self->routing=PyDict_New();
+  if(!openargs || !self->readerargs || !self->prepare || !self->readers || !self->routing)
+    goto error;
+
+  self->busytimeout=busytimeout;
+
+  if(!self->writelock)
+    {
+      self->writelock=PyThread_allocate_lock();
+      if(!self->writelock)
+        {
+          PyErr_NoMemory();
+          goto error;
+        }
+    }
+
+  self->writer=APSWConnectionPool_open(self, openargs, wal, &self->writerprepared);
+  if(!self->writer)
+    goto error;
+
+  Py_DECREF(openargs);
+  return 0;
+
+ error:
+  assert(PyErr_Occurred());
+  Py_XDECREF(openargs);
+  AddTraceBackHere(__FILE__, __LINE__, "ConnectionPool.__init__", "{s: O, s: i}", "filename", filename, "flags", flags);
+  return -1;
+}
+
+static void
+APSWConnectionPool_dealloc(APSWConnectionPool *self)
+{
+  APSW_CLEAR_WEAKREFS;
+
+  /* prepared statements go before their connections */
+  Py_CLEAR(self->writerprepared);
+  Py_CLEAR(self->writer);
+  Py_CLEAR(self->readers);
+  Py_CLEAR(self->routing);
+  Py_CLEAR(self->prepare);
+  Py_CLEAR(self->readerargs);
+
+  if(self->writelock)
+    PyThread_free_lock(self->writelock);
+  self->writelock=0;
+
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/* Takes the writer lock, waiting with the GIL released if another
+   thread has it.  The owning thread can take it again. */
+static void
+APSWConnectionPool_writer_lock(APSWConnectionPool *self)
+{
+  unsigned long me=PyThread_get_thread_ident();
+
+  if(self->writerdepth && self->writerowner==me)
+    {
+      self->writerdepth++;
+      return;
+    }
+
+  if(!PyThread_acquire_lock(self->writelock, NOWAIT_LOCK))
+    {
+      Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(self->writelock, WAIT_LOCK);
+      Py_END_ALLOW_THREADS;
+    }
+
+  assert(self->writerdepth==0);
+  self->writerowner=me;
+  self->writerdepth=1;
+}
+
+static void
+APSWConnectionPool_writer_unlock(APSWConnectionPool *self)
+{
+  assert(self->writerdepth>0 && self->writerowner==PyThread_get_thread_ident());
+
+  self->writerdepth--;
+  if(!self->writerdepth)
+    PyThread_release_lock(self->writelock);
+}
+
+/* Returns a new reference to this thread's (connection, prepared)
+   reader entry, opening the connection if needed */
+static PyObject *
+APSWConnectionPool_reader_entry(APSWConnectionPool *self)
+{
+  PyObject *key, *entry, *prepared=NULL;
+  Connection *conn;
+
+  key=PyLong_FromUnsignedLong(PyThread_get_thread_ident());
+  if(!key)
+    return NULL;
+
+  entry=PyDict_GetItem(self->readers, key);
+  /* the connection could have been closed directly */
+  if(entry && ((Connection*)PyTuple_GET_ITEM(entry, 0))->db)
+    {
+      Py_INCREF(entry);
+      goto finally;
+    }
+
+  entry=NULL;
+  conn=APSWConnectionPool_open(self, self->readerargs, 0, &prepared);
+  if(!conn)
+    goto finally;
+
+  entry=Py_BuildValue("(NN)", conn, prepared);
+  if(!entry)
+    goto finally;
+
+  /* the pool could have been closed while the connection was opened */
+  if(!self->writer)
+    {
+      PyErr_Format(ExcConnectionClosed, "The pool has been closed");
+      Py_CLEAR(entry);
+      goto finally;
+    }
+
+  if(PyDict_SetItem(self->readers, key, entry))
+    Py_CLEAR(entry);
+
+ finally:
+  Py_DECREF(key);
+  return entry;
+}
+
+/* Returns 1 if the statements only read, 0 if not and -1 on error */
+static int
+APSWConnectionPool_readonly(APSWConnectionPool *self, Connection *conn, PyObject *statements)
+{
+  PyObject *cached;
+  int readonly;
+
+  cached=PyDict_GetItem(self->routing, statements);
+  if(cached)
+    return cached==Py_True;
+
+  readonly=Connection_sql_readonly(conn, statements);
+  if(readonly<0)
+    return -1;
+
+  if(PyDict_Size(self->routing)>=POOL_ROUTING_MAX)
+    PyDict_Clear(self->routing);
+  if(PyDict_SetItem(self->routing, statements, readonly?Py_True:Py_False))
+    return -1;
+
+  return readonly;
+}
+
+/* Leaves the writer passing on any exception so the savepoint is
+   rolled back.  Returns 0 on success and -1 with an exception set.
+   The original exception is kept in preference to one from leaving. */
+static int
+APSWConnectionPool_leave(APSWConnectionPool *self)
+{
+  PyObject *etype=NULL, *evalue=NULL, *etb=NULL;
+  PyObject *exitargs, *res=NULL;
+
+  if(PyErr_Occurred())
+    {
+      PyErr_Fetch(&etype, &evalue, &etb);
+      PyErr_NormalizeException(&etype, &evalue, &etb);
+    }
+
+  exitargs=PyTuple_Pack(3, etype?etype:Py_None, evalue?evalue:Py_None, etb?etb:Py_None);
+  if(exitargs)
+    res=Connection_exit(self->writer, exitargs);
+  Py_XDECREF(exitargs);
+
+  APSWConnectionPool_writer_unlock(self);
+
+  if(etype)
+    {
+      Py_XDECREF(res);
+      PyErr_Restore(etype, evalue, etb);
+      return -1;
+    }
+  if(!res)
+    return -1;
+  Py_DECREF(res);
+  return 0;
+}
+
+/** .. method:: __enter__() -> Connection
+
+  Waits for and holds the writer connection, starting a savepoint on
+  it as :meth:`Connection.__enter__` does, and returns it.  The
+  thread can enter again while it holds the writer.
+
+  You can use the pool as a `context manager
+  <http://docs.python.org/reference/datamodel.html#with-statement-context-managers>`_
+  as defined in :pep:`0343`.
+*/
+static PyObject *
+APSWConnectionPool_enter(APSWConnectionPool *self)
+{
+  PyObject *res;
+
+  CHECK_POOL_CLOSED(NULL);
+
+  APSWConnectionPool_writer_lock(self);
+
+  /* the pool could have been closed while we waited */
+  if(!self->writer)
+    {
+      APSWConnectionPool_writer_unlock(self);
+      CHECK_POOL_CLOSED(NULL);
+    }
+
+  res=Connection_enter(self->writer);
+  if(!res)
+    APSWConnectionPool_writer_unlock(self);
+  return res;
+}
+
+/** .. method:: __exit__() -> False
+
+  Commits or rolls back the savepoint as :meth:`Connection.__exit__`
+  does, and lets other threads have the writer once this thread has
+  left every **with** block.
+*/
+static PyObject *
+APSWConnectionPool_exit(APSWConnectionPool *self, PyObject *args)
+{
+  PyObject *res;
+
+  CHECK_POOL_CLOSED(NULL);
+
+  if(!self->writerdepth || self->writerowner!=PyThread_get_thread_ident())
+    return PyErr_Format(PyExc_ValueError, "The writer is not held by this thread");
+
+  res=Connection_exit(self->writer, args);
+  APSWConnectionPool_writer_unlock(self);
+  return res;
+}
+
+/** .. method:: execute(statements, bindings=None) -> list
+
+  Runs the statements returning all the result rows as a list.
+  Statements that only read the database use the calling thread's
+  reader connection, while anything that could make a change runs on
+  the writer inside a savepoint, waiting for other threads to finish
+  with it.  Texts given in *prepare* when the pool was created use
+  the already prepared statements.
+
+  .. seealso::
+
+    * :meth:`Cursor.execute`
+*/
+static PyObject *
+APSWConnectionPool_execute(APSWConnectionPool *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[]={"statements", "bindings", NULL};
+  PyObject *statements, *bindings=NULL;
+  PyObject *entry=NULL, *prepared, *query, *cursor=NULL, *cargs=NULL, *res=NULL, *rows=NULL;
+  Connection *conn;
+  int writing, readonly;
+
+  CHECK_POOL_CLOSED(NULL);
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O:execute(statements, bindings=None)", kwlist, &statements, &bindings))
+    return NULL;
+
+  writing=self->writerdepth && self->writerowner==PyThread_get_thread_ident();
+
+  if(!writing)
+    {
+      entry=APSWConnectionPool_reader_entry(self);
+      if(!entry)
+        return NULL;
+
+      readonly=APSWConnectionPool_readonly(self, (Connection*)PyTuple_GET_ITEM(entry, 0), statements);
+      if(readonly<0)
+        goto finally;
+      if(!readonly)
+        Py_CLEAR(entry);
+      writing=!readonly;
+    }
+
+  if(writing)
+    {
+      res=APSWConnectionPool_enter(self);
+      if(!res)
+        goto finally;
+      Py_CLEAR(res);
+      conn=self->writer;
+      prepared=self->writerprepared;
+    }
+  else
+    {
+      conn=(Connection*)PyTuple_GET_ITEM(entry, 0);
+      prepared=PyTuple_GET_ITEM(entry, 1);
+    }
+
+  query=PyDict_GetItem(prepared, statements);
+  if(!query)
+    query=statements;
+
+  cursor=Connection_cursor(conn);
+  if(cursor)
+    cargs=bindings?PyTuple_Pack(2, query, bindings):PyTuple_Pack(1, query);
+  if(cargs)
+    res=APSWCursor_execute((APSWCursor*)cursor, cargs);
+  if(res)
+    rows=APSWCursor_fetchall((APSWCursor*)cursor);
+  Py_XDECREF(res);
+  Py_XDECREF(cargs);
+  Py_XDECREF(cursor);
+
+  if(writing && APSWConnectionPool_leave(self))
+    Py_CLEAR(rows);
+
+ finally:
+  Py_XDECREF(entry);
+  assert((rows && !PyErr_Occurred()) || (!rows && PyErr_Occurred()));
+  return rows;
+}
+
+/** .. method:: reader() -> Connection
+
+  Returns the calling thread's read only connection, opening it if
+  needed.  Use it when you want a cursor to iterate over rather than
+  the list from :meth:`~ConnectionPool.execute`.
+*/
+static PyObject *
+APSWConnectionPool_reader(APSWConnectionPool *self)
+{
+  PyObject *entry, *conn;
+
+  CHECK_POOL_CLOSED(NULL);
+
+  entry=APSWConnectionPool_reader_entry(self);
+  if(!entry)
+    return NULL;
+
+  conn=PyTuple_GET_ITEM(entry, 0);
+  Py_INCREF(conn);
+  Py_DECREF(entry);
+  return conn;
+}
+
+/** .. method:: release()
+
+  Closes the calling thread's reader connection if it has one.  Call
+  this when a thread that used the pool is finishing.  A new
+  connection is opened if the thread uses the pool again.
+*/
+static PyObject *
+APSWConnectionPool_release(APSWConnectionPool *self)
+{
+  PyObject *key, *entry, *res;
+
+  CHECK_POOL_CLOSED(NULL);
+
+  key=PyLong_FromUnsignedLong(PyThread_get_thread_ident());
+  if(!key)
+    return NULL;
+
+  entry=PyDict_GetItem(self->readers, key);
+  if(!entry)
+    {
+      Py_DECREF(key);
+      Py_RETURN_NONE;
+    }
+
+  Py_INCREF(entry);
+  res=PyDict_DelItem(self->readers, key)?NULL:PyObject_CallMethod(PyTuple_GET_ITEM(entry, 0), "close", NULL);
+  Py_DECREF(entry);
+  Py_DECREF(key);
+  if(!res)
+    return NULL;
+  Py_DECREF(res);
+  Py_RETURN_NONE;
+}
+
+/** .. method:: close()
+
+  Closes all the connections in the pool, waiting for any thread
+  using the writer to finish with it.  It is not an error to close a
+  pool more than once.  A reader connection being used at the same
+  time by another thread gives a :exc:`ThreadingViolationError`.
+*/
+static PyObject *
+APSWConnectionPool_close(APSWConnectionPool *self)
+{
+  PyObject *readers, *writerprepared, *key, *entry, *res;
+  PyObject *etype=NULL, *evalue=NULL, *etb=NULL;
+  Connection *writer;
+  Py_ssize_t pos=0;
+
+  if(!self->writer)
+    Py_RETURN_NONE;
+
+  if(self->writerdepth && self->writerowner==PyThread_get_thread_ident())
+    return PyErr_Format(PyExc_ValueError, "The pool can't be closed while this thread is using the writer");
+
+  APSWConnectionPool_writer_lock(self);
+
+  /* someone else closed it while we waited */
+  if(!self->writer)
+    {
+      APSWConnectionPool_writer_unlock(self);
+      Py_RETURN_NONE;
+    }
+
+  /* the connections are detached from the pool before closing since
+     that releases the GIL */
+  writer=self->writer;
+  writerprepared=self->writerprepared;
+  readers=self->readers;
+  self->writer=0;
+  self->writerprepared=0;
+  self->readers=PyDict_New();
+
+  while(PyDict_Next(readers, &pos, &key, &entry))
+    {
+      res=PyObject_CallMethod(PyTuple_GET_ITEM(entry, 0), "close", NULL);
+      Py_XDECREF(res);
+      if(!res)
+        {
+          if(etype || evalue || etb)
+            PyErr_Clear();
+          else
+            PyErr_Fetch(&etype, &evalue, &etb);
+        }
+    }
+
+  Py_XDECREF(writerprepared);
+  res=PyObject_CallMethod((PyObject*)writer, "close", NULL);
+  Py_XDECREF(res);
+  if(!res && (etype || evalue || etb))
+    PyErr_Clear();
+
+  Py_DECREF(readers);
+  Py_DECREF(writer);
+
+  APSWConnectionPool_writer_unlock(self);
+
+  if(etype || evalue || etb)
+    PyErr_Restore(etype, evalue, etb);
+
+  if(PyErr_Occurred() || !self->readers)
+    {
+      if(!PyErr_Occurred())
+        PyErr_NoMemory();
+      return NULL;
+    }
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef pool_methods[] = {
+  {"__enter__", (PyCFunction)APSWConnectionPool_enter, METH_NOARGS,
+   "Context manager entry holding the writer"},
+  {"__exit__", (PyCFunction)APSWConnectionPool_exit, METH_VARARGS,
+   "Context manager exit releasing the writer"},
+  {"execute", (PyCFunction)APSWConnectionPool_execute, METH_VARARGS|METH_KEYWORDS,
+   "Runs statements on a reader or the writer"},
+  {"reader", (PyCFunction)APSWConnectionPool_reader, METH_NOARGS,
+   "Returns this thread's reader connection"},
+  {"release", (PyCFunction)APSWConnectionPool_release, METH_NOARGS,
+   "Closes this thread's reader connection"},
+  {"close", (PyCFunction)APSWConnectionPool_close, METH_NOARGS,
+   "Closes all connections"},
+  {0,0,0,0}
+};
+
+static PyTypeObject APSWConnectionPoolType =
+  {
+    APSW_PYTYPE_INIT
+    "apsw.ConnectionPool",     /*tp_name*/
+    sizeof(APSWConnectionPool), /*tp_basicsize*/
+    0,                         /*tp_itemsize*/
+    (destructor)APSWConnectionPool_dealloc, /*tp_dealloc*/
+    0,                         /*tp_print*/
+    0,                         /*tp_getattr*/
+    0,                         /*tp_setattr*/
+    0,                         /*tp_compare*/
+    0,                         /*tp_repr*/
+    0,                         /*tp_as_number*/
+    0,                         /*tp_as_sequence*/
+    0,                         /*tp_as_mapping*/
+    0,                         /*tp_hash */
+    0,                         /*tp_call*/
+    0,                         /*tp_str*/
+    0,                         /*tp_getattro*/
+    0,                         /*tp_setattro*/
+    0,                         /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_VERSION_TAG, /*tp_flags*/
+    "Connection pool",         /* tp_doc */
+    0,		               /* tp_traverse */
+    0,		               /* tp_clear */
+    0,		               /* tp_richcompare */
+    offsetof(APSWConnectionPool,weakreflist), /* tp_weaklistoffset */
+    0,		               /* tp_iter */
+    0,		               /* tp_iternext */
+    pool_methods,              /* tp_methods */
+    0,                         /* tp_members */
+    0,                         /* tp_getset */
+    0,                         /* tp_base */
+    0,                         /* tp_dict */
+    0,                         /* tp_descr_get */
+    0,                         /* tp_descr_set */
+    0,                         /* tp_dictoffset */
+    (initproc)APSWConnectionPool_init, /* tp_init */
+    0,                         /* tp_alloc */
+    APSWConnectionPool_new,    /* tp_new */
+    0,                         /* tp_free */
+    0,                         /* tp_is_gc */
+    0,                         /* tp_bases */
+    0,                         /* tp_mro */
+    0,                         /* tp_cache */
+    0,                         /* tp_subclasses */
+    0,                         /* tp_weaklist */
+    0                          /* tp_del */
+    APSW_PYTYPE_VERSION
+};
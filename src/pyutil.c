@@ -109,6 +109,15 @@ typedef unsigned long Py_uhash_t;
 #define PyObject_Unicode          PyObject_Str
 #endif
 
+/* Calling without making an argument tuple */
+#if PY_VERSION_HEX >= 0x03090000
+#define APSW_HAVE_VECTORCALL
+#define APSW_Vectorcall PyObject_Vectorcall
+#elif PY_VERSION_HEX >= 0x03080000
+#define APSW_HAVE_VECTORCALL
+#define APSW_Vectorcall _PyObject_Vectorcall
+#endif
+
 /* we clear weakref lists when close is called on a blob/cursor as
    well as when it is deallocated */
 #define APSW_CLEAR_WEAKREFS                             \
@@ -129,9 +138,112 @@ static int PyDict_Contains(PyObject *dict, PyObject *key)
 }
 #endif
 
-/* Calls the named method of object with the provided args */
+/* Frequently called methods (eg VFS file xRead or virtual table
+   cursor Column) can have the bound method cached rather than looked
+   up on every call.  The cache is only used while the type's version
+   tag is unchanged (any change to the class or its bases alters the
+   tag) and the instance can't have an attribute of the same name, so
+   assigning a different method is still noticed. */
+typedef struct
+{
+  PyObject *name;          /* interned method name */
+  PyObject *method;        /* bound method, or NULL if not cached */
+  unsigned int version;    /* type version tag when method was cached */
+} APSWMethodCache;
+
+#define APSWMethodCache_clear(mc) \
+  do { Py_CLEAR((mc)->name); Py_CLEAR((mc)->method); } while(0)
+
+/* Returns true if looking up name on obj may not find what its type
+   has.  That is if the instance dictionary contains name, and also
+   for types with their own attribute lookup (eg __getattribute__ or
+   __getattr__) or without an instance dictionary (eg __slots__) since
+   what they do can't be known. */
+static int
+instance_may_override(PyObject *obj, PyObject *name)
+{
+  PyTypeObject *type=Py_TYPE(obj);
+  PyObject *dict;
+  int res;
+
+  if(type->tp_getattro!=PyObject_GenericGetAttr || !type->tp_dictoffset)
+    return 1;
+#if PY_VERSION_HEX >= 0x03030000
+  dict=PyObject_GenericGetDict(obj, NULL);
+  if(!dict)
+    {
+      PyErr_Clear();
+      return 1;
+    }
+  res=!!PyDict_GetItem(dict, name);
+  Py_DECREF(dict);
+#else
+  {
+    PyObject **dictptr=_PyObject_GetDictPtr(obj);
+    dict=dictptr?*dictptr:NULL;
+    res=dict && PyDict_GetItem(dict, name);
+  }
+#endif
+  return res;
+}
+
+/* Returns the interned name (borrowed reference) for the cache entry */
+static PyObject *
+methodcache_name(APSWMethodCache *mc, const char *methodname)
+{
+  if(!mc->name)
+    {
+#if PY_MAJOR_VERSION < 3
+      mc->name=PyString_InternFromString(methodname);
+#else
+      mc->name=PyUnicode_InternFromString(methodname);
+#endif
+    }
+  return mc->name;
+}
+
+/* Returns a new reference to the named method, using and updating
+   the cache */
+static PyObject *
+methodcache_get(PyObject *obj, APSWMethodCache *mc, const char *methodname)
+{
+  PyObject *method;
+  PyTypeObject *type=Py_TYPE(obj);
+
+  if(!methodcache_name(mc, methodname))
+    return NULL;
+
+#ifdef Py_TPFLAGS_VALID_VERSION_TAG
+  if(mc->method && PyType_HasFeature(type, Py_TPFLAGS_VALID_VERSION_TAG) && type->tp_version_tag==mc->version
+     && !instance_may_override(obj, mc->name))
+    {
+      Py_INCREF(mc->method);
+      return mc->method;
+    }
+#endif
+  Py_CLEAR(mc->method);
+
+  method=PyObject_GetAttr(obj, mc->name);
+  if(!method)
+    return NULL;
+
+#ifdef Py_TPFLAGS_VALID_VERSION_TAG
+  /* only cache regular methods of heap (Python defined) types found via the type */
+  if(PyMethod_Check(method) && PyMethod_GET_SELF(method)==obj && PyType_HasFeature(type, Py_TPFLAGS_HEAPTYPE)
+     && PyType_HasFeature(type, Py_TPFLAGS_VALID_VERSION_TAG) && !instance_may_override(obj, mc->name))
+    {
+      mc->version=type->tp_version_tag;
+      mc->method=method;
+      Py_INCREF(method);
+    }
+#endif
+  return method;
+}
+
+/* Calls the named method of object with the provided args.  mc is
+   the method cache to use and can be NULL */
 static PyObject*
-Call_PythonMethod(PyObject *obj, const char *methodname, int mandatory, PyObject *args)
+Call_PythonMethodCached(PyObject *obj, APSWMethodCache *mc, const char *methodname, int mandatory, PyObject *args)
 {
   PyObject *method=NULL;
   PyObject *res=NULL;
@@ -145,14 +257,18 @@ Call_PythonMethod(PyObject *obj, const char *methodname, int mandatory, PyObject
   if(pyerralreadyoccurred)
     PyErr_Fetch(&etype, &evalue, &etraceback);
 
-
-  /* we should only be called with ascii methodnames so no need to do
-     character set conversions etc */
+  if(mc)
+    method=methodcache_get(obj, mc, methodname);
+  else
+    {
+      /* we should only be called with ascii methodnames so no need to do
+         character set conversions etc */
 #if PY_VERSION_HEX < 0x02050000
-  method=PyObject_GetAttrString(obj, (char*)methodname);
+      method=PyObject_GetAttrString(obj, (char*)methodname);
 #else
-  method=PyObject_GetAttrString(obj, methodname);
+      method=PyObject_GetAttrString(obj, methodname);
 #endif
+    }
   assert(method!=obj);
   if (!method)
     {
@@ -181,6 +297,28 @@ Call_PythonMethod(PyObject *obj, const char *methodname, int mandatory, PyObject
   return res;
 }
 
+static PyObject *
+Call_PythonMethodCachedV(PyObject *obj, APSWMethodCache *mc, const char *methodname, int mandatory, const char *format, ...)
+{
+  PyObject *args=NULL, *result=NULL;
+  va_list list;
+  va_start (list, format);
+  args=Py_VaBuildValue(format, list);
+  va_end(list);
+
+  if (args)
+    result=Call_PythonMethodCached(obj, mc, methodname, mandatory, args);
+
+  Py_XDECREF(args);
+  return result;
+}
+
+static PyObject*
+Call_PythonMethod(PyObject *obj, const char *methodname, int mandatory, PyObject *args)
+{
+  return Call_PythonMethodCached(obj, NULL, methodname, mandatory, args);
+}
+
 static PyObject *
 Call_PythonMethodV(PyObject *obj, const char *methodname, int mandatory, const char *format, ...)
 {
@@ -16,7 +16,17 @@
    - The utf8 of the original text (APSWBuffer)
    - The utf8 of the first statement (APSWBuffer)
 
-   Currently only the first two are implemented.
+   The last is used when there are multiple statements in the text so
+   that the same first statement can be found no matter what follows
+   it, and so that large scripts don't miss the cache.  Looking it up
+   requires finding where the first statement ends which is done by
+   scanning for a semicolon outside of quotes and comments.
+
+   Statements made by Connection.prepare are pinned.  They are never
+   in the cache, and are instead kept on a separate list so they can
+   be finalized when the connection is closed.  The lru pointers are
+   used for that list since pinned statements are never in the lru
+   list.
 
  */
 
@@ -27,12 +37,42 @@
    the interpreter gc intervals. */
 #define SC_NRECYCLE 32
 
-/* The maximum length of something in bytes that we would consider putting in the statement cache */
+/* The maximum length of something in bytes that we would consider
+   putting in the statement cache.  This doesn't apply when there is a
+   byte budget. */
 #define SC_MAXSIZE 16384
 
-/* Define to do statement cache statistics */
+/* How many extra prepared copies of a cached statement are kept by
+   default for when the cached one is already in use */
+#define SC_POOLDEPTH 2
+
+/* Define to print statement cache statistics when the cache is freed */
 /* #define SC_STATS */
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Aggregated statistics for one statement text - see Connection.query_stats */
+typedef struct QueryStat {
+  sqlite3_uint64 count;             /* times executed */
+  sqlite3_uint64 rows;              /* result rows */
+  sqlite3_uint64 nanoseconds;       /* wall time from cache lookup until reset */
+  sqlite3_uint64 vmsteps;           /* SQLITE_STMTSTATUS_VM_STEP */
+  sqlite3_uint64 sorts;             /* SQLITE_STMTSTATUS_SORT */
+  sqlite3_uint64 autoindexes;       /* SQLITE_STMTSTATUS_AUTOINDEX */
+  sqlite3_uint64 fullscansteps;     /* SQLITE_STMTSTATUS_FULLSCAN_STEP */
+} QueryStat;
+
+/* A spare prepared copy of a cached statement and the memory it is
+   counted as in the cache bytes */
+typedef struct {
+  sqlite3_stmt *vdbe;
+  Py_ssize_t bytes;
+} APSWSpare;
+
 typedef struct APSWStatement {
   PyObject_HEAD
   sqlite3_stmt *vdbestatement;      /* the sqlite level vdbe code */
@@ -42,8 +82,20 @@ typedef struct APSWStatement {
   PyObject *next;                   /* If not null, the utf8 text of the remaining statements in multi statement queries. */
   Py_ssize_t querylen;              /* How many bytes of utf8 made up the query (used for exectrace) */
   PyObject *origquery;              /* The original query object, also a key in the cache pointing to this same statement - could be NULL */
+  PyObject *key;                    /* When in cache the utf8 key - either the same object as utf8 or the first statement of it */
+  APSWSpare *spares;                /* When in cache, extra prepared copies for use while this one is inuse */
+  unsigned nspares;                 /* how many spares there are */
+  unsigned sparesalloc;             /* how many spares there is space for */
+  Py_ssize_t cachebytes;            /* When in cache, the size of key plus vdbe memory (including spares) counted in the cache bytes */
+  unsigned pinned;                  /* made by Connection.prepare and never goes in the cache */
+  struct StatementCache *pinnedcache; /* When pinned, the cache whose pinned list this is on, or NULL once that is freed */
   struct APSWStatement *lru_prev;   /* previous item in lru list (ie more recently used than this one) */
   struct APSWStatement *lru_next;   /* next item in lru list (ie less recently used than this one) */
+  int qs_entry;                     /* position in the cache qs_entries for this statement text */
+  unsigned qs_generation;           /* qs_entry is only valid if this matches the cache qs_generation */
+  sqlite3_uint64 qs_rows;           /* rows returned this execution */
+  sqlite3_uint64 qs_start;          /* when this execution started */
+  unsigned qs_begun;                /* cache qs_generation when this execution started, zero if statistics weren't being kept */
 } APSWStatement;
 
 static PyTypeObject APSWStatementType;
@@ -55,13 +107,25 @@ typedef struct StatementCache {
   unsigned numentries;              /* how many APSWStatement entries
                                        we have in cache */
   unsigned maxentries;              /* maximum number of entries */
+  unsigned pooldepth;               /* maximum spares for each entry */
+  Py_ssize_t maxbytes;              /* if non-zero then the cache is limited to this many bytes rather than maxentries */
+  Py_ssize_t maxsize;               /* largest query that will be cached - SC_MAXSIZE or maxbytes */
   APSWStatement *mru;               /* most recently used entry (head of the list) */
   APSWStatement *lru;               /* least recently used entry (tail of the list) */
-#ifdef SC_STATS
-  unsigned st_cachemiss;            /* entry was not in cache */
-  unsigned st_cachehit;             /* entry was in cache */
-  unsigned st_hitinuse;             /* was a hit but was inuse */
-#endif
+  APSWStatement *pinned;            /* list of pinned statements */
+  Py_ssize_t bytes;                 /* total cachebytes of entries in cache */
+  sqlite3_uint64 st_cachemiss;      /* entry was not in cache (or was inuse) */
+  sqlite3_uint64 st_cachehit;       /* entry was in cache */
+  sqlite3_uint64 st_hitinuse;       /* was in cache but was inuse */
+  sqlite3_uint64 st_firsthit;       /* cache hits found via first statement */
+  sqlite3_uint64 st_poolhit;        /* cache hits using a spare because entry was inuse */
+  sqlite3_uint64 st_evictions;      /* entries removed to make space */
+  sqlite3_uint64 st_reprepares;     /* statements reprepared due to SQLITE_SCHEMA */
+  unsigned qs_max;                  /* most statement texts to keep statistics for - zero if disabled */
+  unsigned qs_count;                /* how many there are */
+  unsigned qs_generation;           /* changed when the statistics are discarded */
+  PyObject *qs_index;               /* dict of statement text to position in qs_entries */
+  QueryStat *qs_entries;
 #if SC_NRECYCLE > 0
   APSWStatement* recyclelist[SC_NRECYCLE];   /* recycle these rather than go through repeated malloc/free */
   unsigned nrecycle;                /* index of last entry in recycle list */
@@ -169,6 +233,109 @@ static void assert_not_in_dict(PyObject *dict, PyObject *check)
 #endif
 
 
+/* A monotonic clock in nanoseconds for timing queries */
+static sqlite3_uint64
+querystat_now(void)
+{
+#ifdef _WIN32
+  static LARGE_INTEGER frequency;
+  LARGE_INTEGER now;
+
+  if(!frequency.QuadPart)
+    QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&now);
+  return (sqlite3_uint64)((double)now.QuadPart*1e9/(double)frequency.QuadPart);
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (sqlite3_uint64)ts.tv_sec*1000000000u+(sqlite3_uint64)ts.tv_nsec;
+#endif
+}
+
+/* Marks the start of an execution of stmt.  Only executions begun
+   while the current statistics were being kept are recorded. */
+#define querystat_begin(sc, stmt)               \
+  do {                                          \
+    if((sc)->qs_max)                            \
+      {                                         \
+        (stmt)->qs_rows=0;                      \
+        (stmt)->qs_start=querystat_now();       \
+        (stmt)->qs_begun=(sc)->qs_generation;   \
+      }                                         \
+    else                                        \
+      (stmt)->qs_begun=0;                       \
+  } while(0)
+
+/* Reads and resets the status counters of vdbe.  This is called with
+   the GIL released and the db mutex held. */
+static void
+querystat_read(sqlite3_stmt *vdbe, int *counters)
+{
+#ifdef SQLITE_STMTSTATUS_VM_STEP
+  counters[0]=sqlite3_stmt_status(vdbe, SQLITE_STMTSTATUS_VM_STEP, 1); /* PYSQLITE_CALL */
+#else
+  counters[0]=0;
+#endif
+  counters[1]=sqlite3_stmt_status(vdbe, SQLITE_STMTSTATUS_SORT, 1); /* PYSQLITE_CALL */
+  counters[2]=sqlite3_stmt_status(vdbe, SQLITE_STMTSTATUS_AUTOINDEX, 1); /* PYSQLITE_CALL */
+  counters[3]=sqlite3_stmt_status(vdbe, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1); /* PYSQLITE_CALL */
+}
+
+/* Adds an execution of stmt to its statistics.  The entry for the
+   statement text is found once and then remembered on the statement.
+   Failures (eg memory) just mean the execution isn't counted. */
+static void
+querystat_record(StatementCache *sc, APSWStatement *stmt, const int *counters, sqlite3_uint64 finished)
+{
+  QueryStat *qs;
+
+  if(stmt->qs_generation!=sc->qs_generation)
+    {
+      PyObject *sql, *pos;
+
+      sql=convertutf8stringsize(APSWBuffer_AS_STRING(stmt->utf8), stmt->querylen);
+      if(!sql)
+        goto error;
+      pos=PyDict_GetItem(sc->qs_index, sql);
+      if(pos)
+        stmt->qs_entry=(int)PyIntLong_AsLong(pos);
+      else
+        {
+          if(sc->qs_count>=sc->qs_max)
+            {
+              Py_DECREF(sql);
+              return;
+            }
+          pos=PyInt_FromLong(sc->qs_count);
+          if(!pos || PyDict_SetItem(sc->qs_index, sql, pos))
+            {
+              Py_XDECREF(pos);
+              Py_DECREF(sql);
+              goto error;
+            }
+          Py_DECREF(pos);
+          memset(&sc->qs_entries[sc->qs_count], 0, sizeof(QueryStat));
+          stmt->qs_entry=sc->qs_count++;
+        }
+      Py_DECREF(sql);
+      stmt->qs_generation=sc->qs_generation;
+    }
+
+  qs=&sc->qs_entries[stmt->qs_entry];
+  qs->count++;
+  qs->rows+=stmt->qs_rows;
+  qs->nanoseconds+=finished-stmt->qs_start;
+  qs->vmsteps+=counters[0];
+  qs->sorts+=counters[1];
+  qs->autoindexes+=counters[2];
+  qs->fullscansteps+=counters[3];
+  return;
+
+ error:
+  PyErr_Clear();
+}
+
 /* re-prepare for SQLITE_SCHEMA */
 static int
 statementcache_reprepare(StatementCache *sc, APSWStatement *statement)
@@ -202,6 +369,7 @@ statementcache_reprepare(StatementCache *sc, APSWStatement *statement)
 
   PYSQLITE_SC_CALL(sqlite3_finalize(statement->vdbestatement));
   statement->vdbestatement=newvdbe;
+  sc->st_reprepares++;
   return SQLITE_OK;
 
  error:
@@ -216,9 +384,118 @@ statementcache_reprepare(StatementCache *sc, APSWStatement *statement)
   return res2;
 }
 
-/* Internal prepare routine after doing utf8 conversion.  Returns a new reference. Must be reentrant */
+/* Finalizes spares of statement beyond keep.  Their memory is taken
+   off the cache bytes if sc is not NULL and statement is in it. */
+static void
+statementcache_trimspares(StatementCache *sc, APSWStatement *statement, unsigned keep)
+{
+  while(statement->nspares>keep)
+    {
+      APSWSpare spare=statement->spares[--statement->nspares];
+      statement->cachebytes-=spare.bytes;
+      if(sc && statement->key)
+        sc->bytes-=spare.bytes;
+      _PYSQLITE_CALL_V(sqlite3_finalize(spare.vdbe));
+    }
+  if(!statement->nspares)
+    {
+      PyMem_Free(statement->spares);
+      statement->spares=NULL;
+      statement->sparesalloc=0;
+    }
+}
+
+/* Sets statement->next to the remaining text of utf8 after the first
+   statement (ignoring semicolons and white space) or NULL if there
+   isn't any.  Returns 0 on success or -1 on memory error. */
+static int
+statementcache_setnext(APSWStatement *statement, PyObject *utf8)
+{
+  const char *buffer=APSWBuffer_AS_STRING(utf8);
+  Py_ssize_t buflen=APSWBuffer_GET_SIZE(utf8), pos=statement->querylen;
+
+  while( (pos<buflen) && (buffer[pos]==' ' || buffer[pos]=='\t' || buffer[pos]==';' || buffer[pos]=='\r' || buffer[pos]=='\n') )
+    pos++;
+  statement->next=NULL;
+  if(pos<buflen)
+    {
+      /* there are more statements */
+      statement->next=APSWBuffer_FromObject(utf8, pos, buflen-pos);
+      if(!statement->next)
+        return -1;
+    }
+  return 0;
+}
+
+/* Returns how many bytes make up the first statement in buffer, but
+   only when there are further statements after it and the first
+   statement is shorter than maxsize.  Otherwise returns zero.  This
+   is done for each statement of a script so it is a single scan in
+   place.  Semicolons inside a trigger body don't end the statement,
+   so anything mentioning a trigger is left to be prepared (which
+   finds the end properly) rather than being looked up. */
+static Py_ssize_t
+statementcache_firstlength(const char *buffer, Py_ssize_t buflen, Py_ssize_t maxsize)
+{
+  Py_ssize_t i, limit=(buflen<maxsize)?buflen:maxsize, res=0;
+
+  if(!memchr(buffer, ';', limit))
+    return 0;
+
+  for(i=0;i<limit && !res;i++)
+    switch(buffer[i])
+      {
+      case ';':
+        res=i+1;
+        break;
+      case '\'': case '"': case '`': case '[':
+        {
+          /* a doubled quote is just the end and start of another */
+          char end=(buffer[i]=='[')?']':buffer[i];
+          for(i++; i<limit && buffer[i]!=end; i++);
+          if(i==limit)
+            return 0;
+          break;
+        }
+      case '-':
+        if(i+1<limit && buffer[i+1]=='-')
+          {
+            for(i+=2; i<limit && buffer[i]!='\n'; i++);
+            if(i==limit)
+              return 0;
+          }
+        break;
+      case '/':
+        if(i+1<limit && buffer[i+1]=='*')
+          {
+            for(i+=2; i+1<limit && !(buffer[i]=='*' && buffer[i+1]=='/'); i++);
+            if(i+1>=limit)
+              return 0;
+            i++;
+          }
+        break;
+      case 't': case 'T':
+        if(i+7<=limit && (buffer[i+1]|0x20)=='r' && (buffer[i+2]|0x20)=='i' && (buffer[i+3]|0x20)=='g'
+           && (buffer[i+4]|0x20)=='g' && (buffer[i+5]|0x20)=='e' && (buffer[i+6]|0x20)=='r')
+          return 0;
+        break;
+      }
+
+  if(!res)
+    return 0;
+
+  for(i=res; i<buflen && (buffer[i]==' ' || buffer[i]=='\t' || buffer[i]==';' || buffer[i]=='\r' || buffer[i]=='\n'); i++);
+
+  return (i<buflen)?res:0;
+}
+
+static int statementcache_finalize(StatementCache *sc, APSWStatement *stmt, int reprepare_on_schema);
+
+/* Internal prepare routine after doing utf8 conversion.  Returns a
+   new reference. Must be reentrant.  The cache is only looked in if
+   usecache is non-zero. */
 static APSWStatement*
-statementcache_prepare(StatementCache *sc, PyObject *query, int usepreparev2)
+statementcache_prepare_internal(StatementCache *sc, PyObject *query, int usepreparev2, int usecache)
 {
   APSWStatement *val=NULL;
   const char *buffer;
@@ -226,21 +503,23 @@ statementcache_prepare(StatementCache *sc, PyObject *query, int usepreparev2)
   Py_ssize_t buflen;
   int res;
   PyObject *utf8=NULL;
+  sqlite3_stmt *spare=NULL;
+  Py_ssize_t sparequerylen=0;
 
   if(!APSWBuffer_Check(query))
     {
       /* Check to see if query is already in cache.  The size checks are to
          avoid calculating hashes on long strings */
-      if( sc->cache && sc->numentries && ((PyUnicode_CheckExact(query) && PyUnicode_GET_DATA_SIZE(query) < SC_MAXSIZE)
+      if( usecache && sc->cache && sc->numentries && ((PyUnicode_CheckExact(query) && PyUnicode_GET_DATA_SIZE(query) < sc->maxsize)
 #if PY_MAJOR_VERSION < 3
-          || (PyString_CheckExact(query) && PyString_GET_SIZE(query) < SC_MAXSIZE)
+          || (PyString_CheckExact(query) && PyString_GET_SIZE(query) < sc->maxsize)
 #endif
                         ))
         {
           val=(APSWStatement*)PyDict_GetItem(sc->cache, query);
           if(val)
             {
-              utf8=val->utf8;
+              utf8=val->key;
               Py_INCREF(utf8);
               goto cachehit;
             }
@@ -269,26 +548,43 @@ statementcache_prepare(StatementCache *sc, PyObject *query, int usepreparev2)
   assert(APSWBuffer_Check(utf8));
 
   /* if we have cache and utf8 is reasonable size? */
-  if(sc->cache && sc->numentries && APSWBuffer_GET_SIZE(utf8) < SC_MAXSIZE)
+  if(usecache && sc->cache && sc->numentries && APSWBuffer_GET_SIZE(utf8) < sc->maxsize)
     {
       /* then is it in the cache? */
       val=(APSWStatement*)PyDict_GetItem(sc->cache, utf8);
     }
 
+  /* try the first statement */
+  if(!val && usecache && sc->cache && sc->numentries)
+    {
+      Py_ssize_t firstlen=statementcache_firstlength(APSWBuffer_AS_STRING(utf8), APSWBuffer_GET_SIZE(utf8), sc->maxsize);
+      if(firstlen)
+        {
+          PyObject *key=APSWBuffer_FromObject(utf8, 0, firstlen);
+          if(!key)
+            {
+              APSWBuffer_XDECREF_unlikely(utf8);
+              return NULL;
+            }
+          val=(APSWStatement*)PyDict_GetItem(sc->cache, key);
+          APSWBuffer_XDECREF_unlikely(key);
+        }
+    }
+
   /* by this point we have created utf8 or added a reference to it */
  cachehit:
   assert(APSWBuffer_Check(utf8));
 
-#ifdef SC_STATS
-  if(val)
+  if(!usecache)
+    ;
+  else if(val && (!val->inuse || val->nspares))
+    sc->st_cachehit++;
+  else
     {
-      sc->st_cachehit++;
-      if(val->inuse)
+      sc->st_cachemiss++;
+      if(val)
         sc->st_hitinuse++;
     }
-  else
-    sc->st_cachemiss++;
-#endif
 
 
   if(val)
@@ -320,11 +616,41 @@ statementcache_prepare(StatementCache *sc, PyObject *query, int usepreparev2)
 
           _PYSQLITE_CALL_V(sqlite3_clear_bindings(val->vdbestatement));
           Py_INCREF( (PyObject*)val);
+
+          if(val->key!=val->utf8 || APSWBuffer_GET_SIZE(val->utf8)!=APSWBuffer_GET_SIZE(utf8))
+            {
+              /* found by first statement so the rest of the text is
+                 from this query */
+              APSWBuffer_XDECREF_unlikely(val->next);
+              APSWBuffer_XDECREF_likely(val->utf8);
+              val->utf8=utf8;
+              if(statementcache_setnext(val, utf8))
+                {
+                  PyObject *etype, *evalue, *etb;
+                  PyErr_Fetch(&etype, &evalue, &etb);
+                  statementcache_finalize(sc, val, 0); /* INUSE_CALL not needed here */
+                  PyErr_Restore(etype, evalue, etb);
+                  return NULL;
+                }
+              if(val->next)
+                sc->st_firsthit++;
+              return val;
+            }
+
           assert(PyObject_RichCompareBool(utf8, val->utf8, Py_EQ)==1);
           APSWBuffer_XDECREF_unlikely(utf8);
           return val;
         }
-      /* someone else is using it so we can't */
+      /* someone else is using it so we can't, but we can use a spare */
+      if(val->nspares)
+        {
+          val->nspares--;
+          spare=val->spares[val->nspares].vdbe;
+          val->cachebytes-=val->spares[val->nspares].bytes;
+          sc->bytes-=val->spares[val->nspares].bytes;
+          sparequerylen=val->querylen;
+          sc->st_poolhit++;
+        }
       val=NULL;
     }
 
@@ -340,6 +666,8 @@ statementcache_prepare(StatementCache *sc, PyObject *query, int usepreparev2)
       APSWBuffer_XDECREF_likely(val->utf8);
       APSWBuffer_XDECREF_unlikely(val->next);
       Py_XDECREF(val->origquery);
+      assert(!val->key);
+      assert(!val->nspares);
       val->lru_prev=val->lru_next=0;
       statementcache_sanity_check(sc);
     }
@@ -354,6 +682,12 @@ statementcache_prepare(StatementCache *sc, PyObject *query, int usepreparev2)
       if(!val) goto error;
       /* zero it - other fields are set below */
       val->incache=0;
+      val->key=NULL;
+      val->spares=NULL;
+      val->nspares=0;
+      val->sparesalloc=0;
+      val->pinned=0;
+      val->pinnedcache=NULL;
       val->lru_prev=0;
       val->lru_next=0;
     }
@@ -364,9 +698,24 @@ statementcache_prepare(StatementCache *sc, PyObject *query, int usepreparev2)
   val->next=NULL;
   val->vdbestatement=NULL;
   val->inuse=1;
+  val->qs_generation=0;
+  val->qs_rows=0;
+  val->qs_start=0;
+  val->qs_begun=0;
   Py_XINCREF(query);
   val->origquery=query;
 
+  if(spare)
+    {
+      /* no need to prepare */
+      val->vdbestatement=spare;
+      val->querylen=sparequerylen;
+      spare=NULL;
+      if(statementcache_setnext(val, utf8))
+        goto error;
+      return val;
+    }
+
   buffer=APSWBuffer_AS_STRING(utf8);
   buflen=APSWBuffer_GET_SIZE(utf8);
 
@@ -388,18 +737,14 @@ statementcache_prepare(StatementCache *sc, PyObject *query, int usepreparev2)
     }
 
   val->querylen=tail-buffer;
-  /* is there a next statement (ignore semicolons and white space) */
-  while( (tail-buffer<buflen) && (*tail==' ' || *tail=='\t' || *tail==';' || *tail=='\r' || *tail=='\n') )
-    tail++;
-  if(tail-buffer<buflen)
-    {
-      /* there are more statements */
-      val->next=APSWBuffer_FromObject(utf8, tail-buffer, buflen-(tail-buffer));
-      if(!val->next) goto error;
-    }
+  /* is there a next statement */
+  if(statementcache_setnext(val, utf8))
+    goto error;
   return val;
 
  error:
+  if(spare)
+    _PYSQLITE_CALL_V(sqlite3_finalize(spare));
   if(val)
     {
       val->inuse=0;
@@ -420,6 +765,148 @@ statementcache_prepare(StatementCache *sc, PyObject *query, int usepreparev2)
   return NULL;
 }
 
+/* Returns a new reference to a statement for query, which can also be
+   a pinned statement.  Must be reentrant */
+static APSWStatement*
+statementcache_prepare(StatementCache *sc, PyObject *query, int usepreparev2)
+{
+  APSWStatement *stmt;
+
+  if(Py_TYPE(query)==&APSWStatementType)
+    {
+      APSWStatement *pinned=(APSWStatement*)query;
+
+      assert(pinned->pinned);
+      if(pinned->pinnedcache!=sc)
+        {
+          PyErr_Format(PyExc_ValueError, "The prepared statement belongs to a different or closed Connection");
+          return NULL;
+        }
+      if(!pinned->inuse)
+        {
+          pinned->inuse=1;
+          Py_INCREF((PyObject*)pinned);
+          if(pinned->vdbestatement)
+            _PYSQLITE_CALL_V(sqlite3_clear_bindings(pinned->vdbestatement));
+          querystat_begin(sc, pinned);
+          return pinned;
+        }
+      /* someone else is using it (eg nested use) so do it the normal way */
+      query=pinned->utf8;
+    }
+  stmt=statementcache_prepare_internal(sc, query, usepreparev2, 1);
+  if(stmt)
+    querystat_begin(sc, stmt);
+  return stmt;
+}
+
+/* Makes a pinned statement for query.  Returns a new reference */
+static APSWStatement*
+statementcache_pin(StatementCache *sc, PyObject *query)
+{
+  APSWStatement *val;
+
+  if(Py_TYPE(query)==&APSWStatementType)
+    {
+      PyErr_Format(PyExc_TypeError, "The query is already a prepared statement");
+      return NULL;
+    }
+
+  val=statementcache_prepare_internal(sc, query, 1, 0);
+  if(!val)
+    return NULL;
+
+  assert(val->inuse && !val->incache && !val->key);
+  Py_CLEAR(val->origquery);
+  val->inuse=0;
+  val->pinned=1;
+  val->pinnedcache=sc;
+  val->lru_prev=NULL;
+  val->lru_next=sc->pinned;
+  if(sc->pinned)
+    sc->pinned->lru_prev=val;
+  sc->pinned=val;
+  return val;
+}
+
+
+/* Removes least recently used entries until the cache is within its
+   limits.  Entries that are inuse are not on the lru list and so are
+   never evicted. */
+static void
+statementcache_evict(StatementCache *sc)
+{
+  while(sc->maxbytes ? (sc->bytes > sc->maxbytes) : (sc->numentries > sc->maxentries))
+    {
+      APSWStatement *evictee=sc->lru;
+      statementcache_sanity_check(sc);
+
+      /* no possibles to evict? */
+      if(!sc->lru)
+        break;
+
+      /* only entry? */
+      if(!evictee->lru_prev)
+        {
+          assert(sc->mru==evictee);   /* points to sole entry */
+          assert(sc->lru==evictee);   /* points to sole entry */
+          assert(!evictee->lru_prev); /* should be anyone before */
+          assert(!evictee->lru_next); /* or after */
+          sc->mru=NULL;
+          sc->lru=NULL;
+          goto delevictee;
+        }
+      /* take out lru member */
+      sc->lru=evictee->lru_prev;
+      assert(sc->lru->lru_next==evictee);
+      sc->lru->lru_next=NULL;
+
+    delevictee:
+      assert(!evictee->inuse);
+      assert(evictee->incache);
+      statementcache_sanity_check(sc);
+
+      /* only references should be the dict */
+      assert(Py_REFCNT(evictee)==1+!!evictee->origquery);
+
+#if SC_NRECYCLE > 0
+      /* we don't gc to run on object */
+      Py_INCREF(evictee);
+#endif
+      if(evictee->origquery)
+        {
+          assert(evictee==(APSWStatement*)PyDict_GetItem(sc->cache, evictee->origquery));
+          PyDict_DelItem(sc->cache, evictee->origquery);
+          Py_DECREF(evictee->origquery);
+          evictee->origquery=NULL;
+        }
+      assert(evictee==(APSWStatement*)PyDict_GetItem(sc->cache, evictee->key));
+      sc->bytes -= evictee->cachebytes;
+      PyDict_DelItem(sc->cache, evictee->key);
+      APSWBuffer_XDECREF_likely(evictee->key);
+      evictee->key=NULL;
+      assert_not_in_dict(sc->cache, (PyObject*)evictee);
+      assert(!PyErr_Occurred());
+      /* this releases the GIL so must be done once no one else can find evictee */
+      statementcache_trimspares(sc, evictee, 0);
+
+#if SC_NRECYCLE > 0
+      if(sc->nrecycle<SC_NRECYCLE)
+        {
+          assert(Py_REFCNT(evictee)==1);
+          sc->recyclelist[sc->nrecycle++]=evictee;
+          evictee->incache=0;
+        }
+      else
+        {
+          Py_DECREF(evictee);
+        }
+#endif
+      sc->numentries -= 1;
+      sc->st_evictions++;
+      statementcache_sanity_check(sc);
+    }
+}
 
 /* Consumes reference on stmt.  This routine must be reentrant.
    If reprepare_on_schema then if SQLITE_SCHEMA is the error, we reprepare
@@ -442,7 +929,18 @@ statementcache_finalize(StatementCache *sc, APSWStatement *stmt, int reprepare_o
      otherwise another thread could enter and reuse what we are in the
      middle of disposing of */
 
-  PYSQLITE_SC_CALL(res=sqlite3_reset(stmt->vdbestatement));
+  if(sc->qs_max && stmt->vdbestatement)
+    {
+      int counters[4];
+      sqlite3_uint64 finished=querystat_now();
+
+      /* the counters are still read so they start again from zero */
+      PYSQLITE_SC_CALL((querystat_read(stmt->vdbestatement, counters), res=sqlite3_reset(stmt->vdbestatement)));
+      if(stmt->qs_begun==sc->qs_generation)
+        querystat_record(sc, stmt, counters, finished);
+    }
+  else
+    PYSQLITE_SC_CALL(res=sqlite3_reset(stmt->vdbestatement));
   if(res==SQLITE_SCHEMA && reprepare_on_schema)
     {
       res=statementcache_reprepare(sc, stmt);
@@ -450,93 +948,107 @@ statementcache_finalize(StatementCache *sc, APSWStatement *stmt, int reprepare_o
         return SQLITE_SCHEMA;
     }
 
+  /* pinned statements just become available again */
+  if(stmt->pinned)
+    {
+      stmt->inuse=0;
+      Py_DECREF(stmt);
+      return res;
+    }
+
+  /* work out what the key would be.  Multiple statements are keyed by
+     the first statement */
+  if(!stmt->incache && sc->cache && stmt->vdbestatement)
+    {
+      assert(!stmt->key);
+      stmt->cachebytes=0;
+#ifdef SQLITE_STMTSTATUS_MEMUSED
+      /* this takes the db mutex so the GIL has to be released, which
+         is why it is done before looking at the cache */
+      _PYSQLITE_CALL_V(stmt->cachebytes=sqlite3_stmt_status(stmt->vdbestatement, SQLITE_STMTSTATUS_MEMUSED, 0));
+#endif
+      if(stmt->next && stmt->querylen < sc->maxsize)
+        {
+          stmt->key=APSWBuffer_FromObject(stmt->utf8, 0, stmt->querylen);
+          /* a memory error just means we don't cache */
+          if(!stmt->key)
+            PyErr_Clear();
+        }
+      else if(APSWBuffer_GET_SIZE(stmt->utf8) < sc->maxsize)
+        {
+          stmt->key=stmt->utf8;
+          Py_INCREF(stmt->key);
+        }
+      if(stmt->key && PyDict_Contains(sc->cache, stmt->key))
+        {
+          /* already cached, so keep the vdbe as a spare if there is
+             room.  The bindings are cleared first as that releases
+             the GIL and the owner could change meanwhile. */
+          APSWStatement *owner;
+          int addedspare=0;
+          if(res==SQLITE_OK && sc->pooldepth)
+            _PYSQLITE_CALL_V(sqlite3_clear_bindings(stmt->vdbestatement));
+          owner=(APSWStatement*)PyDict_GetItem(sc->cache, stmt->key);
+          if(owner && res==SQLITE_OK && owner->nspares<sc->pooldepth)
+            {
+              if(owner->nspares==owner->sparesalloc)
+                {
+                  APSWSpare *newspares=PyMem_Realloc(owner->spares, sizeof(APSWSpare)*sc->pooldepth);
+                  if(newspares)
+                    {
+                      owner->spares=newspares;
+                      owner->sparesalloc=sc->pooldepth;
+                    }
+                }
+              if(owner->nspares<owner->sparesalloc)
+                {
+                  /* the spare uses as much memory as the owner so it
+                     counts against the budget too */
+                  owner->spares[owner->nspares].vdbe=stmt->vdbestatement;
+                  owner->spares[owner->nspares].bytes=stmt->cachebytes;
+                  owner->nspares++;
+                  owner->cachebytes+=stmt->cachebytes;
+                  sc->bytes+=stmt->cachebytes;
+                  stmt->vdbestatement=NULL;
+                  addedspare=1;
+                }
+            }
+          APSWBuffer_XDECREF_likely(stmt->key);
+          stmt->key=NULL;
+          if(addedspare)
+            statementcache_evict(sc);
+        }
+    }
+
   /* is it going to be put in cache? */
-  if(stmt->incache || (sc->cache && stmt->vdbestatement && APSWBuffer_GET_SIZE(stmt->utf8) < SC_MAXSIZE && !PyDict_Contains(sc->cache, stmt->utf8)))
+  if(stmt->incache || stmt->key)
     {
       /* add ourselves to cache */
       if(!stmt->incache)
         {
-          assert(!PyDict_Contains(sc->cache, stmt->utf8));
+          assert(!PyDict_Contains(sc->cache, stmt->key));
           assert_not_in_dict(sc->cache, (PyObject*)stmt);
-          PyDict_SetItem(sc->cache, stmt->utf8, (PyObject*)stmt);
-          if(stmt->origquery)
-            /* something equal to this query may already be in cache
-               which would cause an eviction of an unrelated item and
-               all sorts of grief */
-            if (!PyDict_Contains(sc->cache, stmt->origquery))
+          PyDict_SetItem(sc->cache, stmt->key, (PyObject*)stmt);
+          if(stmt->origquery && stmt->key==stmt->utf8)
+            {
+              /* something equal to this query may already be in cache
+                 which would cause an eviction of an unrelated item and
+                 all sorts of grief */
+              if (!PyDict_Contains(sc->cache, stmt->origquery))
                 PyDict_SetItem(sc->cache, stmt->origquery, (PyObject*)stmt);
+            }
+          else
+            Py_CLEAR(stmt->origquery);
           stmt->incache=1;
           sc->numentries += 1;
+          stmt->cachebytes+=APSWBuffer_GET_SIZE(stmt->key);
+          sc->bytes += stmt->cachebytes;
         }
 
-      assert(PyDict_Contains(sc->cache, stmt->utf8));
+      assert(PyDict_Contains(sc->cache, stmt->key));
 
       /* do we need to do an evict? */
-      while(sc->numentries > sc->maxentries)
-        {
-          APSWStatement *evictee=sc->lru;
-          statementcache_sanity_check(sc);
-          assert(evictee!=stmt);      /* we were inuse and so should not be on evict list */
-
-          /* no possibles to evict? */
-          if(!sc->lru)
-            break;
-
-          /* only entry? */
-          if(!evictee->lru_prev)
-            {
-              assert(sc->mru==evictee);   /* points to sole entry */
-              assert(sc->lru==evictee);   /* points to sole entry */
-              assert(!evictee->lru_prev); /* should be anyone before */
-              assert(!evictee->lru_next); /* or after */
-              sc->mru=NULL;
-              sc->lru=NULL;
-              goto delevictee;
-            }
-          /* take out lru member */
-          sc->lru=evictee->lru_prev;
-          assert(sc->lru->lru_next==evictee);
-          sc->lru->lru_next=NULL;
-
-        delevictee:
-          assert(!evictee->inuse);
-          assert(evictee->incache);
-          statementcache_sanity_check(sc);
-
-          /* only references should be the dict */
-          assert(Py_REFCNT(evictee)==1+!!evictee->origquery);
-
-#if SC_NRECYCLE > 0
-          /* we don't gc to run on object */
-          Py_INCREF(evictee);
-#endif
-          if(evictee->origquery)
-            {
-              assert(evictee==(APSWStatement*)PyDict_GetItem(sc->cache, evictee->origquery));
-              PyDict_DelItem(sc->cache, evictee->origquery);
-              Py_DECREF(evictee->origquery);
-              evictee->origquery=NULL;
-            }
-          assert(evictee==(APSWStatement*)PyDict_GetItem(sc->cache, evictee->utf8));
-          PyDict_DelItem(sc->cache, evictee->utf8);
-          assert_not_in_dict(sc->cache, (PyObject*)evictee);
-          assert(!PyErr_Occurred());
-
-#if SC_NRECYCLE > 0
-          if(sc->nrecycle<SC_NRECYCLE)
-            {
-              assert(Py_REFCNT(evictee)==1);
-              sc->recyclelist[sc->nrecycle++]=evictee;
-              evictee->incache=0;
-            }
-          else
-            {
-              Py_DECREF(evictee);
-            }
-#endif
-          sc->numentries -= 1;
-          statementcache_sanity_check(sc);
-        }
+      statementcache_evict(sc);
 
       statementcache_sanity_check(sc);
 
@@ -623,6 +1135,10 @@ statementcache_init(sqlite3 *db, unsigned nentries)
         }
     }
   sc->maxentries=nentries;
+  sc->pooldepth=SC_POOLDEPTH;
+  sc->qs_generation=1;
+  sc->maxbytes=0;
+  sc->maxsize=SC_MAXSIZE;
   sc->mru=NULL;
   sc->lru=NULL;
 #if SC_NRECYCLE > 0
@@ -631,9 +1147,129 @@ statementcache_init(sqlite3 *db, unsigned nentries)
   return sc;
 }
 
+/* Changes to limiting the cache by bytes, or by entries if maxbytes is zero */
+static void
+statementcache_setbudget(StatementCache *sc, Py_ssize_t maxbytes)
+{
+  sc->maxbytes=maxbytes;
+  sc->maxsize=maxbytes?maxbytes:SC_MAXSIZE;
+  if(sc->cache)
+    statementcache_evict(sc);
+}
+
+/* Changes how many spares each entry can have, discarding any extra */
+static int
+statementcache_setpooldepth(StatementCache *sc, unsigned depth)
+{
+  PyObject *values;
+  Py_ssize_t i;
+
+  sc->pooldepth=depth;
+  if(!sc->cache)
+    return 0;
+
+  /* trimming releases the GIL so the dict could change */
+  values=PyDict_Values(sc->cache);
+  if(!values)
+    return -1;
+  for(i=0;i<PyList_GET_SIZE(values);i++)
+    statementcache_trimspares(sc, (APSWStatement*)PyList_GET_ITEM(values, i), depth);
+  Py_DECREF(values);
+  return 0;
+}
+
+/* Changes how many statement texts have statistics kept, discarding
+   the existing statistics.  Zero disables collection. */
+static int
+statementcache_setquerystats(StatementCache *sc, unsigned maxentries)
+{
+  QueryStat *entries=NULL;
+  PyObject *index=NULL;
+
+  if(maxentries)
+    {
+      entries=PyMem_Malloc(sizeof(QueryStat)*maxentries);
+      index=PyDict_New();
+      if(!entries || !index)
+        {
+          PyMem_Free(entries);
+          Py_XDECREF(index);
+          PyErr_NoMemory();
+          return -1;
+        }
+    }
+
+  PyMem_Free(sc->qs_entries);
+  Py_CLEAR(sc->qs_index);
+  sc->qs_entries=entries;
+  sc->qs_index=index;
+  sc->qs_max=maxentries;
+  sc->qs_count=0;
+  sc->qs_generation++;
+  return 0;
+}
+
+/* Returns a dict of statement text to a dict of its statistics */
+static PyObject *
+statementcache_querystats(StatementCache *sc)
+{
+  PyObject *res, *key, *value, *item;
+  Py_ssize_t pos=0;
+
+  res=PyDict_New();
+  if(!res || !sc->qs_max)
+    return res;
+
+  while(PyDict_Next(sc->qs_index, &pos, &key, &value))
+    {
+      QueryStat *qs=&sc->qs_entries[PyIntLong_AsLong(value)];
+
+      item=Py_BuildValue("{s: K, s: K, s: d, s: K, s: K, s: K, s: K}",
+                         "count", (unsigned long long)qs->count,
+                         "rows", (unsigned long long)qs->rows,
+                         "time", qs->nanoseconds/1e9,
+                         "vm_steps", (unsigned long long)qs->vmsteps,
+                         "sorts", (unsigned long long)qs->sorts,
+                         "autoindexes", (unsigned long long)qs->autoindexes,
+                         "fullscan_steps", (unsigned long long)qs->fullscansteps);
+      if(!item || PyDict_SetItem(res, key, item))
+        {
+          Py_XDECREF(item);
+          Py_DECREF(res);
+          return NULL;
+        }
+      Py_DECREF(item);
+    }
+  return res;
+}
+
 static void
 statementcache_free(StatementCache *sc)
 {
+#ifdef SC_STATS
+  fprintf(stderr, "SC Miss: %llu Hit: %llu HitButInuse: %llu FirstHit: %llu PoolHit: %llu Evictions: %llu\n",
+          (unsigned long long)sc->st_cachemiss, (unsigned long long)sc->st_cachehit, (unsigned long long)sc->st_hitinuse,
+          (unsigned long long)sc->st_firsthit, (unsigned long long)sc->st_poolhit, (unsigned long long)sc->st_evictions);
+#endif
+
+  /* the statements may outlive us, but the vdbes can't outlive the
+     database */
+  while(sc->pinned)
+    {
+      APSWStatement *pinned=sc->pinned;
+      sqlite3_stmt *vdbe=pinned->vdbestatement;
+
+      assert(!pinned->inuse);
+      sc->pinned=pinned->lru_next;
+      if(sc->pinned)
+        sc->pinned->lru_prev=NULL;
+      pinned->lru_prev=pinned->lru_next=NULL;
+      pinned->pinnedcache=NULL;
+      pinned->vdbestatement=NULL;
+      if(vdbe)
+        _PYSQLITE_CALL_V(sqlite3_finalize(vdbe));
+    }
+
 #if SC_NRECYCLE>0
   while(sc->nrecycle)
     {
@@ -642,21 +1278,32 @@ statementcache_free(StatementCache *sc)
     }
 #endif
   Py_XDECREF(sc->cache);
+  Py_XDECREF(sc->qs_index);
+  PyMem_Free(sc->qs_entries);
   PyMem_Free(sc);
-
-#ifdef SC_STATS
-  fprintf(stderr, "SC Miss: %u Hit: %u HitButInuse: %u\n", sc->st_cachemiss, sc->st_cachehit, sc->st_hitinuse);
-#endif
 }
 
 static void
 APSWStatement_dealloc(APSWStatement *stmt)
 {
+  if(stmt->pinnedcache)
+    {
+      /* remove from pinned list */
+      if(stmt->lru_prev)
+        stmt->lru_prev->lru_next=stmt->lru_next;
+      else
+        stmt->pinnedcache->pinned=stmt->lru_next;
+      if(stmt->lru_next)
+        stmt->lru_next->lru_prev=stmt->lru_prev;
+      stmt->pinnedcache=NULL;
+    }
   if(stmt->vdbestatement)
     _PYSQLITE_CALL_V(sqlite3_finalize(stmt->vdbestatement));
   assert(stmt->inuse==0);
   APSWBuffer_XDECREF_likely(stmt->utf8);
   APSWBuffer_XDECREF_likely(stmt->next);
+  APSWBuffer_XDECREF_likely(stmt->key);
+  statementcache_trimspares(NULL, stmt, 0);
   Py_XDECREF(stmt->origquery);
   Py_TYPE(stmt)->tp_free((PyObject*)stmt);
 }
@@ -48,6 +48,39 @@ do {                                                \
   Py_END_ALLOW_THREADS;                             \
  } while(0)
 
+/* Calls that take the database mutex but never block on I/O, locks
+   or callbacks (eg binding parameters and reading column values).
+   Releasing and reacquiring the GIL costs far more than the call and
+   hands the GIL to other threads hundreds of times a row.  The call
+   is made with the GIL held if the database mutex can be acquired
+   without waiting.  If another thread holds the mutex (and so could be
+   waiting on the GIL) we fall back to releasing the GIL as above. */
+#define _PYSQLITE_CHEAP_CALL_V(db, x)                       \
+do {                                                        \
+  sqlite3_mutex *apsw_cheap_mutex=sqlite3_db_mutex(db);     \
+  if(sqlite3_mutex_try(apsw_cheap_mutex)==SQLITE_OK)        \
+    {                                                       \
+      x;                                                    \
+      sqlite3_mutex_leave(apsw_cheap_mutex);                \
+    }                                                       \
+  else                                                      \
+    _PYSQLITE_CALL_V(x);                                    \
+ } while(0)
+
+#define _PYSQLITE_CHEAP_CALL_E(db, x)                       \
+do {                                                        \
+  sqlite3_mutex *apsw_cheap_mutex=sqlite3_db_mutex(db);     \
+  if(sqlite3_mutex_try(apsw_cheap_mutex)==SQLITE_OK)        \
+    {                                                       \
+      x;                                                    \
+      if(res!=SQLITE_OK && res!=SQLITE_DONE && res!=SQLITE_ROW) \
+        apsw_set_errmsg(sqlite3_errmsg((db)));              \
+      sqlite3_mutex_leave(apsw_cheap_mutex);                \
+    }                                                       \
+  else                                                      \
+    _PYSQLITE_CALL_E(db, x);                                \
+ } while(0)
+
 #define INUSE_CALL(x)                               \
   do {                                              \
        assert(self->inuse==0); self->inuse=1;       \
@@ -64,6 +97,9 @@ do {                                                \
 /* call from cursor code - same as blob */
 #define PYSQLITE_CUR_CALL PYSQLITE_BLOB_CALL
 
+/* cheap call from cursor code */
+#define PYSQLITE_CUR_CHEAP_CALL(y) INUSE_CALL(_PYSQLITE_CHEAP_CALL_E(self->connection->db, y))
+
 /* from statement cache */
 #define PYSQLITE_SC_CALL(y)   _PYSQLITE_CALL_E(sc->db, y)
 
@@ -253,8 +289,9 @@ static PyObject *
 convert_column_to_pyobject(sqlite3_stmt *stmt, int col)
 {
   int coltype;
+  sqlite3 *db=sqlite3_db_handle(stmt);
 
-  _PYSQLITE_CALL_V(coltype=sqlite3_column_type(stmt, col));
+  _PYSQLITE_CHEAP_CALL_V(db, coltype=sqlite3_column_type(stmt, col));
 
   APSW_FAULT_INJECT(UnknownColumnType,,coltype=12348);
 
@@ -263,7 +300,7 @@ convert_column_to_pyobject(sqlite3_stmt *stmt, int col)
     case SQLITE_INTEGER:
       {
         sqlite3_int64 val;
-        _PYSQLITE_CALL_V(val=sqlite3_column_int64(stmt, col));
+        _PYSQLITE_CHEAP_CALL_V(db, val=sqlite3_column_int64(stmt, col));
 #if PY_MAJOR_VERSION<3
         if (val>=LONG_MIN && val<=LONG_MAX)
           return PyInt_FromLong((long)val);
@@ -274,14 +311,14 @@ convert_column_to_pyobject(sqlite3_stmt *stmt, int col)
     case SQLITE_FLOAT:
       { 
         double d;
-        _PYSQLITE_CALL_V(d=sqlite3_column_double(stmt, col));
+        _PYSQLITE_CHEAP_CALL_V(db, d=sqlite3_column_double(stmt, col));
         return PyFloat_FromDouble(d);
       }
     case SQLITE_TEXT:
       {
         const char *data;
         size_t len;
-        _PYSQLITE_CALL_V( (data=(const char*)sqlite3_column_text(stmt, col), len=sqlite3_column_bytes(stmt, col)) );
+        _PYSQLITE_CHEAP_CALL_V(db, (data=(const char*)sqlite3_column_text(stmt, col), len=sqlite3_column_bytes(stmt, col)) );
         return convertutf8stringsize(data, len);
       }
 
@@ -292,7 +329,7 @@ convert_column_to_pyobject(sqlite3_stmt *stmt, int col)
       {
         const void *data;
         size_t len;
-        _PYSQLITE_CALL_V( (data=sqlite3_column_blob(stmt, col), len=sqlite3_column_bytes(stmt, col)) );
+        _PYSQLITE_CHEAP_CALL_V(db, (data=sqlite3_column_blob(stmt, col), len=sqlite3_column_bytes(stmt, col)) );
         return converttobytes(data, len);
       }
 
@@ -332,6 +369,40 @@ convert_column_to_pyobject(sqlite3_stmt *stmt, int col)
         { PyErr_Format(ExcConnectionClosed, "The connection has been closed"); return e; } \
     } while(0)
          
+/* Built in row factories - see Cursor.setrowfactory.  The names
+   are in the same order as the values. */
+enum { ROWFACTORY_TUPLE, ROWFACTORY_DICT, ROWFACTORY_ROW, ROWFACTORY_SCALAR };
+static const char *const rowfactory_names[]={"tuple", "dict", "row", "scalar"};
+
+/* Returns the row factory named by a string, or -1 with an exception
+   set */
+static int
+rowfactory_fromname(PyObject *name)
+{
+  PyObject *utf8;
+  int i, res=-1;
+
+  if(!PyUnicode_Check(name)
+#if PY_MAJOR_VERSION < 3
+     && !PyString_Check(name)
+#endif
+     )
+    {
+      PyErr_Format(PyExc_TypeError, "row factory must be a string");
+      return -1;
+    }
+  utf8=getutf8string(name);
+  if(!utf8)
+    return -1;
+  for(i=0;i<(int)(sizeof(rowfactory_names)/sizeof(rowfactory_names[0]));i++)
+    if(!strcmp(PyBytes_AS_STRING(utf8), rowfactory_names[i]))
+      res=i;
+  if(res<0)
+    PyErr_Format(PyExc_ValueError, "Unknown row factory \"%s\" - it must be one of tuple, dict, row or scalar", PyBytes_AS_STRING(utf8));
+  Py_DECREF(utf8);
+  return res;
+}
+
 /* It is 2009 - why do I have to write this? */
 static char *apsw_strdup(const char *source)
 {
@@ -209,12 +209,58 @@ typedef struct
 
 static PyTypeObject APSWVFSType;
 
+/* file methods whose lookup is cached (see APSWMethodCache) */
+enum { FM_xRead, FM_xReadInto, FM_xWrite, FM_xUnlock, FM_xLock, FM_xTruncate, FM_xSync, FM_xSectorSize,
+       FM_xDeviceCharacteristics, FM_xFileSize, FM_xCheckReservedLock, FM_xFileControl,
+       FM_xShmMap, FM_xShmLock, FM_xShmBarrier, FM_xShmUnmap, FM_COUNT };
+
+/* bits of shmpython.  They are in the same order as the FM_xShm entries */
+#define SHM_PY_MAP     1
+#define SHM_PY_LOCK    2
+#define SHM_PY_BARRIER 4
+#define SHM_PY_UNMAP   8
+
 typedef struct /* inherits */
 {
   const struct sqlite3_io_methods *pMethods;  /* structure sqlite needs */
   PyObject *file;
+  int readinto;                               /* use xReadInto instead of xRead, -1 if not known */
+  unsigned int readintoversion;               /* type version tag readinto was decided with */
+  unsigned shmpython;                         /* SHM_PY bits for xShm methods overridden in Python */
+  APSWMethodCache methods[FM_COUNT];          /* cached file methods */
+  int isvfsfile;                              /* file is a VFSFile or subclass */
 } APSWSQLite3File;
 
+/* Read cache for VFSFile.  Pages are found via a hash table chained by
+   offset and kept on a doubly linked list in least recently used
+   order.  Only reads of whole pages (a power of two at least 512
+   bytes at a multiple of the size) are cached, and all have the same
+   size so writes only look at the pages they cover.  Hits are served
+   without the GIL so the lock protects the structure, while memory is
+   only allocated and freed with the GIL held. */
+typedef struct APSWVFSCachePage
+{
+  sqlite3_int64 offset;
+  struct APSWVFSCachePage *hashnext;     /* next page in same bucket */
+  struct APSWVFSCachePage *prev, *next;  /* lru list - prev is more recently used */
+} APSWVFSCachePage;
+
+/* page data follows the structure */
+#define CACHEPAGE_DATA(p) ((char*)(p)+sizeof(APSWVFSCachePage))
+
+typedef struct
+{
+  PyThread_type_lock lock;
+  int pagesize;                          /* size of all cached pages, 0 if not known yet */
+  unsigned maxpages, npages;             /* maxpages is also the number of buckets */
+  APSWVFSCachePage **buckets;
+  APSWVFSCachePage *mru, *lru;
+  int disabled;                          /* shared memory (wal) is in use */
+  int readahead;                         /* pages to read at once when sequential */
+  sqlite3_int64 nextoffset;              /* offset following the last read from the file */
+  sqlite3_int64 hits, misses, evictions, invalidations, readaheads;
+} APSWVFSReadCache;
+
 /* this is only used if there is inheritance */
 typedef struct
 {
@@ -222,6 +268,8 @@ typedef struct
   struct sqlite3_file *base;
   char *filename;  /* obtained from fullpathname - has to be around for lifetime of base */
   int filenamefree;  /* filename should be freed on close */
+  APSWVFSReadCache *readcache; /* NULL unless set_read_cache was used */
+  int shmmapped;               /* shared memory has been mapped so the read cache can't be used */
   /* If you add any new members then also initialize them in
      apswvfspy_xOpen() as that function does not call init because it
      has values already */
@@ -239,6 +287,218 @@ typedef struct
   char *filename;
 } APSWURIFilename;
 
+#define readcache_bucket(rc, offset) ((unsigned)(((offset)/(rc)->pagesize)%(rc)->maxpages))
+
+/* Caller holds the lock for all of the readcache functions except
+   where noted */
+static APSWVFSCachePage *
+readcache_find(APSWVFSReadCache *rc, sqlite3_int64 offset)
+{
+  APSWVFSCachePage *p=rc->buckets[readcache_bucket(rc, offset)];
+  while(p && p->offset!=offset)
+    p=p->hashnext;
+  return p;
+}
+
+static void
+readcache_lru_unlink(APSWVFSReadCache *rc, APSWVFSCachePage *p)
+{
+  if(p->prev) p->prev->next=p->next; else rc->mru=p->next;
+  if(p->next) p->next->prev=p->prev; else rc->lru=p->prev;
+}
+
+static void
+readcache_lru_push(APSWVFSReadCache *rc, APSWVFSCachePage *p)
+{
+  p->prev=NULL;
+  p->next=rc->mru;
+  if(rc->mru) rc->mru->prev=p; else rc->lru=p;
+  rc->mru=p;
+}
+
+/* GIL must be held */
+static void
+readcache_remove(APSWVFSReadCache *rc, APSWVFSCachePage *p)
+{
+  APSWVFSCachePage **pp=&rc->buckets[readcache_bucket(rc, p->offset)];
+  while(*pp!=p)
+    pp=&(*pp)->hashnext;
+  *pp=p->hashnext;
+  readcache_lru_unlink(rc, p);
+  PyMem_Free(p);
+  rc->npages--;
+}
+
+/* GIL must be held */
+static void
+readcache_empty(APSWVFSReadCache *rc)
+{
+  APSWVFSCachePage *p=rc->mru, *next;
+  while(p)
+    {
+      next=p->next;
+      PyMem_Free(p);
+      p=next;
+    }
+  rc->mru=rc->lru=NULL;
+  rc->npages=0;
+  rc->pagesize=0;
+  if(rc->buckets)
+    memset(rc->buckets, 0, sizeof(APSWVFSCachePage*)*rc->maxpages);
+}
+
+#define readcache_cacheable(amount, offset) \
+  ((amount)>=512 && !((amount)&((amount)-1)) && !((offset)%(amount)))
+
+/* Copies a cached page into buf returning 1, or returns 0 if it isn't
+   cached.  Takes the lock and does not need the GIL. */
+static int
+readcache_get(APSWVFSReadCache *rc, void *buf, int amount, sqlite3_int64 offset)
+{
+  APSWVFSCachePage *p;
+  int hit=0;
+
+  PyThread_acquire_lock(rc->lock, WAIT_LOCK);
+  if(rc->maxpages && !rc->disabled)
+    {
+      p=(amount==rc->pagesize && !(offset%amount))?readcache_find(rc, offset):NULL;
+      if(p)
+        {
+          memcpy(buf, CACHEPAGE_DATA(p), amount);
+          readcache_lru_unlink(rc, p);
+          readcache_lru_push(rc, p);
+          rc->hits++;
+          hit=1;
+        }
+      else
+        rc->misses++;
+    }
+  PyThread_release_lock(rc->lock);
+  return hit;
+}
+
+/* Remembers the result of a successful read, evicting the least
+   recently used page if full.  Takes the lock and needs the GIL.
+   Memory allocation failures mean the page isn't cached. */
+static void
+readcache_put(APSWVFSReadCache *rc, const void *buf, int amount, sqlite3_int64 offset)
+{
+  APSWVFSCachePage *p;
+
+  PyThread_acquire_lock(rc->lock, WAIT_LOCK);
+  if(!rc->maxpages || rc->disabled || !readcache_cacheable(amount, offset))
+    goto finally;
+  if(amount!=rc->pagesize)
+    {
+      /* page size changed */
+      rc->invalidations+=rc->npages;
+      readcache_empty(rc);
+      rc->pagesize=amount;
+    }
+  p=readcache_find(rc, offset);
+  if(p)
+    {
+      memcpy(CACHEPAGE_DATA(p), buf, amount);
+      goto finally;
+    }
+  if(rc->npages>=rc->maxpages)
+    {
+      readcache_remove(rc, rc->lru);
+      rc->evictions++;
+    }
+  p=PyMem_Malloc(sizeof(APSWVFSCachePage)+amount);
+  if(!p)
+    goto finally;
+  p->offset=offset;
+  memcpy(CACHEPAGE_DATA(p), buf, amount);
+  p->hashnext=rc->buckets[readcache_bucket(rc, offset)];
+  rc->buckets[readcache_bucket(rc, offset)]=p;
+  readcache_lru_push(rc, p);
+  rc->npages++;
+
+ finally:
+  PyThread_release_lock(rc->lock);
+}
+
+/* Discards pages overlapping amount bytes at offset.  A negative amount
+   means everything from offset on.  Takes the lock and needs the
+   GIL. */
+static void
+readcache_invalidate(APSWVFSReadCache *rc, sqlite3_int64 offset, sqlite3_int64 amount)
+{
+  APSWVFSCachePage *p, *next;
+  sqlite3_int64 o;
+
+  PyThread_acquire_lock(rc->lock, WAIT_LOCK);
+  if(!rc->npages)
+    goto finally;
+  if(amount<0)
+    {
+      for(p=rc->mru; p; p=next)
+        {
+          next=p->next;
+          if(p->offset+rc->pagesize>offset)
+            {
+              readcache_remove(rc, p);
+              rc->invalidations++;
+            }
+        }
+    }
+  else
+    {
+      for(o=offset-offset%rc->pagesize; o<offset+amount; o+=rc->pagesize)
+        {
+          p=readcache_find(rc, o);
+          if(p)
+            {
+              readcache_remove(rc, p);
+              rc->invalidations++;
+            }
+        }
+    }
+ finally:
+  PyThread_release_lock(rc->lock);
+}
+
+/* Returns how many pages to read from the file for a cache miss,
+   which is more than one when this read follows on from the last one.
+   Takes the lock and needs the GIL. */
+static int
+readcache_readahead(APSWVFSReadCache *rc, int amount, sqlite3_int64 offset)
+{
+  int pages=1;
+
+  PyThread_acquire_lock(rc->lock, WAIT_LOCK);
+  if(rc->readahead>1 && rc->maxpages && !rc->disabled && offset==rc->nextoffset
+     && readcache_cacheable(amount, offset))
+    {
+      pages=rc->readahead;
+      if((unsigned)pages>rc->maxpages)
+        pages=(int)rc->maxpages;
+      if((sqlite3_int64)pages*amount>INT_MAX)
+        pages=INT_MAX/amount;
+    }
+  rc->nextoffset=offset+(sqlite3_int64)pages*amount;
+  if(pages>1)
+    rc->readaheads++;
+  PyThread_release_lock(rc->lock);
+  return pages;
+}
+
+/* Discards all pages.  Takes the lock and needs the GIL. */
+static void
+readcache_clear(APSWVFSReadCache *rc)
+{
+  PyThread_acquire_lock(rc->lock, WAIT_LOCK);
+  rc->invalidations+=rc->npages;
+  readcache_empty(rc);
+  PyThread_release_lock(rc->lock);
+}
+
+/* the read cache for a file or NULL */
+#define vfsfile_readcache(apswfile) \
+  ((apswfile)->isvfsfile?((APSWVFSFile*)(apswfile)->file)->readcache:NULL)
+
 
 /** .. class:: VFS
 
@@ -499,6 +759,28 @@ apswvfspy_xFullPathname(APSWVFS *self, PyObject *name)
   return result;
 }
 
+/* Returns SHM_PY bits for which of the xShm methods a VFSFile
+   subclass overrides in Python.  The others go directly to the
+   inherited file without needing the GIL.  This is decided when the
+   file is opened since the GIL isn't available to check later. */
+static unsigned
+vfsfile_shmoverrides(PyObject *file)
+{
+  static const char *const names[]={"xShmMap", "xShmLock", "xShmBarrier", "xShmUnmap"};
+  unsigned res=0, i;
+
+  for(i=0;i<sizeof(names)/sizeof(names[0]);i++)
+    {
+      PyObject *method=PyObject_GetAttrString(file, names[i]);
+      if(!method)
+        PyErr_Clear();
+      else if(!PyCFunction_Check(method))
+        res|=1u<<i;
+      Py_XDECREF(method);
+    }
+  return res;
+}
+
 static int
 apswvfs_xOpen(sqlite3_vfs *vfs, const char *zName, sqlite3_file *file, int inflags, int *pOutFlags)
 {
@@ -549,12 +831,16 @@ apswvfs_xOpen(sqlite3_vfs *vfs, const char *zName, sqlite3_file *file, int infla
      object supports version 2 io_methods (Shm* family of functions)
      then we need to allocate an io_methods dupe of our own and fill
      in their shm methods. */
-  if(Py_TYPE(pyresult)==&APSWVFSFileType)
+  apswfile->shmpython=0;
+  apswfile->isvfsfile=0;
+  if(PyObject_TypeCheck(pyresult, &APSWVFSFileType))
     {
       APSWVFSFile *f=(APSWVFSFile*)pyresult;
-      if(!f->base || !f->base->pMethods  || !f->base->pMethods->xShmMap)
+      apswfile->isvfsfile=1;
+      if(!f->base || !f->base->pMethods || f->base->pMethods->iVersion<2 || !f->base->pMethods->xShmMap)
 	goto version1;
       apswfile->pMethods=&apsw_io_methods_v2;
+      apswfile->shmpython=vfsfile_shmoverrides(pyresult);
     }
   else
     {
@@ -562,6 +848,8 @@ apswvfs_xOpen(sqlite3_vfs *vfs, const char *zName, sqlite3_file *file, int infla
       apswfile->pMethods=&apsw_io_methods_v1;
     }
 
+  memset(apswfile->methods, 0, sizeof(apswfile->methods));
+  apswfile->readinto=-1;
   apswfile->file=pyresult;
   pyresult=NULL;
   result=SQLITE_OK;
@@ -673,6 +961,8 @@ apswvfspy_xOpen(APSWVFS *self, PyObject *args)
   apswfile->base=file;
   apswfile->filename=filename;
   apswfile->filenamefree=!!utf8name;
+  apswfile->readcache=NULL;
+  apswfile->shmmapped=0;
   filename=NULL;
   file=NULL;
   result=(PyObject*)(void*)apswfile;
@@ -1837,6 +2127,14 @@ APSWVFSFile_dealloc(APSWVFSFile *self)
     }
   if(self->filenamefree)
     PyMem_Free(self->filename);
+  if(self->readcache)
+    {
+      readcache_empty(self->readcache);
+      PyMem_Free(self->readcache->buckets);
+      PyThread_free_lock(self->readcache->lock);
+      PyMem_Free(self->readcache);
+      self->readcache=NULL;
+    }
 
   if(PyErr_Occurred())
     {
@@ -1858,6 +2156,8 @@ APSWVFSFile_new(PyTypeObject *type, APSW_ARGUNUSED PyObject *args, APSW_ARGUNUSE
     {
       self->base=NULL;
       self->filename=NULL;
+      self->readcache=NULL;
+      self->shmmapped=0;
     }
 
   return (PyObject*)self;
@@ -1876,7 +2176,8 @@ APSWVFSFile_new(PyTypeObject *type, APSW_ARGUNUSED PyObject *args, APSW_ARGUNUSE
 
       If the VFS that you inherit from supports :ref:`write ahead
       logging <wal>` then your :class:`VFSFile` will also support the
-      xShm methods necessary to implement wal.
+      xShm methods necessary to implement wal.  This also applies to
+      subclasses of :class:`VFSFile`.
 
     .. seealso::
 
@@ -2009,18 +2310,156 @@ APSWVFSFile_init(APSWVFSFile *self, PyObject *args, PyObject *kwds)
   return res;
 }
 
+/* Decides if xReadInto should be used for a file.  It is used if the
+   object provides it, except when only the VFSFile implementation is
+   present and xRead has been overridden.  The answer is remembered
+   while the type is unchanged and the instance can't have its own
+   xRead or xReadInto.  Returns -1 with an exception on error. */
 static int
-apswvfsfile_xRead(sqlite3_file *file, void *bufout, int amount, sqlite3_int64 offset)
+vfsfile_usereadinto(APSWSQLite3File *apswfile)
+{
+  PyObject *file=apswfile->file, *readinto, *read=NULL;
+  PyObject *readname, *readintoname;
+  PyTypeObject *type=Py_TYPE(file);
+  int res, cacheable;
+
+  readname=methodcache_name(&apswfile->methods[FM_xRead], "xRead");
+  readintoname=methodcache_name(&apswfile->methods[FM_xReadInto], "xReadInto");
+  if(!readname || !readintoname)
+    return -1;
+
+  cacheable=!instance_may_override(file, readname) && !instance_may_override(file, readintoname);
+#ifdef Py_TPFLAGS_VALID_VERSION_TAG
+  if(cacheable && apswfile->readinto>=0 && PyType_HasFeature(type, Py_TPFLAGS_VALID_VERSION_TAG)
+     && type->tp_version_tag==apswfile->readintoversion)
+    return apswfile->readinto;
+#endif
+
+  readinto=PyObject_GetAttr(file, readintoname);
+  if(!readinto)
+    {
+      PyErr_Clear();
+      res=0;
+    }
+  else if(PyCFunction_Check(readinto))
+    {
+      read=PyObject_GetAttr(file, readname);
+      if(!read)
+        PyErr_Clear();
+      res=read && PyCFunction_Check(read);
+    }
+  else
+    res=1;
+  Py_XDECREF(read);
+  Py_XDECREF(readinto);
+
+  apswfile->readinto=-1;
+#ifdef Py_TPFLAGS_VALID_VERSION_TAG
+  if(cacheable && PyType_HasFeature(type, Py_TPFLAGS_VALID_VERSION_TAG))
+    {
+      apswfile->readinto=res;
+      apswfile->readintoversion=type->tp_version_tag;
+    }
+#endif
+  return res;
+}
+
+/* Reads by calling xReadInto with a writable view of SQLite's buffer.
+   The view is released afterwards so the memory can't be accessed
+   once we return.  Before Python 3.3 a bytearray is used and copied. */
+static int
+apswvfsfile_xReadInto(APSWSQLite3File *apswfile, void *bufout, int amount, sqlite3_int64 offset, int *pgot)
+{
+  int result=SQLITE_ERROR;
+  PyObject *view=NULL, *pyresult=NULL, *released=NULL;
+  long got;
+
+#if PY_VERSION_HEX >= 0x03030000
+  view=PyMemoryView_FromMemory((char*)bufout, amount, PyBUF_WRITE);
+#else
+  view=PyByteArray_FromStringAndSize(NULL, amount);
+#endif
+  if(!view) goto finally;
+
+  pyresult=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xReadInto], "xReadInto", 1, "(OL)", view, offset);
+
+#if PY_VERSION_HEX >= 0x03030000
+  /* done even if there was an error */
+  if(pyresult)
+    released=PyObject_CallMethod(view, "release", NULL);
+  else
+    {
+      PyObject *etype, *evalue, *etraceback;
+      PyErr_Fetch(&etype, &evalue, &etraceback);
+      released=PyObject_CallMethod(view, "release", NULL);
+      PyErr_Restore(etype, evalue, etraceback);
+    }
+  if(!released) goto finally;
+#endif
+  if(!pyresult) goto finally;
+
+  if(!PyIntLong_Check(pyresult))
+    {
+      PyErr_Format(PyExc_TypeError, "xReadInto should return the number of bytes read");
+      goto finally;
+    }
+  got=PyIntLong_AsLong(pyresult);
+  if(PyErr_Occurred()) goto finally;
+  if(got<0 || got>amount)
+    {
+      PyErr_Format(PyExc_ValueError, "xReadInto returned %ld but the buffer is %d bytes", got, amount);
+      goto finally;
+    }
+
+#if PY_VERSION_HEX < 0x03030000
+  memcpy(bufout, PyByteArray_AS_STRING(view), got);
+#endif
+  *pgot=(int)got;
+  if(got<amount)
+    {
+      result=SQLITE_IOERR_SHORT_READ;
+      memset((char*)bufout+got, 0, amount-got);
+    }
+  else
+    result=SQLITE_OK;
+
+ finally:
+  if(PyErr_Occurred())
+    {
+      result=MakeSqliteMsgFromPyException(NULL);
+      AddTraceBackHere(__FILE__, __LINE__, "apswvfsfile_xReadInto", "{s: i, s: L, s: O}", "amount", amount, "offset", offset, "result", pyresult?pyresult:Py_None);
+    }
+  Py_XDECREF(released);
+  Py_XDECREF(pyresult);
+  Py_XDECREF(view);
+  return result;
+}
+
+/* Reads using xReadInto or xRead.  got is set to how many bytes were
+   provided, with the remainder of a short read zero filled */
+static int
+apswvfsfile_readpython(APSWSQLite3File *apswfile, void *bufout, int amount, sqlite3_int64 offset, int *got)
 {
   int result=SQLITE_ERROR;
   PyObject *pybuf=NULL;
-  int asrb;
+  int asrb, usereadinto;
   Py_ssize_t size;
   const void *buffer;
 
-  FILEPREAMBLE;
+  *got=0;
+  usereadinto=vfsfile_usereadinto(apswfile);
+  if(usereadinto<0)
+    {
+      result=MakeSqliteMsgFromPyException(NULL);
+      goto finally;
+    }
+  if(usereadinto)
+    {
+      result=apswvfsfile_xReadInto(apswfile, bufout, amount, offset, got);
+      goto finally;
+    }
 
-  pybuf=Call_PythonMethodV(apswfile->file, "xRead", 1, "(iL)", amount, offset);
+  pybuf=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xRead], "xRead", 1, "(iL)", amount, offset);
   if(!pybuf)
     {
       assert(PyErr_Occurred());
@@ -2047,11 +2486,13 @@ apswvfsfile_xRead(sqlite3_file *file, void *bufout, int amount, sqlite3_int64 of
       result=SQLITE_IOERR_SHORT_READ;
       memset(bufout, 0, amount); /* see https://sqlite.org/cvstrac/chngview?cn=5867 */
       memcpy(bufout, buffer, size);
+      *got=(int)size;
     }
   else
     {
       memcpy(bufout, buffer, amount);
       result=SQLITE_OK;
+      *got=amount;
     }
 
  finally:
@@ -2059,10 +2500,59 @@ apswvfsfile_xRead(sqlite3_file *file, void *bufout, int amount, sqlite3_int64 of
     AddTraceBackHere(__FILE__, __LINE__, "apswvfsfile_xRead", "{s: i, s: L, s: O}", "amount", amount, "offset", offset, "result", pybuf?pybuf:Py_None);
 
   Py_XDECREF(pybuf);
+  return result;
+}
+
+/* Cache misses come here.  When reads are sequential several pages
+   are read at once, with those after the first going into the cache */
+static int
+apswvfsfile_xReadPython(sqlite3_file *file, void *bufout, int amount, sqlite3_int64 offset, APSWVFSReadCache *rc)
+{
+  int result, got, pages=1, i;
+  char *ahead=NULL;
+
+  FILEPREAMBLE;
+
+  if(rc)
+    pages=readcache_readahead(rc, amount, offset);
+  if(pages>1)
+    ahead=PyMem_Malloc((size_t)amount*pages);
+
+  if(!ahead)
+    {
+      result=apswvfsfile_readpython(apswfile, bufout, amount, offset, &got);
+      if(rc && result==SQLITE_OK)
+        readcache_put(rc, bufout, amount, offset);
+      goto finally;
+    }
+
+  result=apswvfsfile_readpython(apswfile, ahead, amount*pages, offset, &got);
+  /* reading ahead past the end of the file is expected */
+  if(result==SQLITE_OK || result==SQLITE_IOERR_SHORT_READ)
+    {
+      memcpy(bufout, ahead, amount);
+      result=(got>=amount)?SQLITE_OK:SQLITE_IOERR_SHORT_READ;
+      for(i=0; i<pages && (i+1)*amount<=got; i++)
+        readcache_put(rc, ahead+i*amount, amount, offset+(sqlite3_int64)i*amount);
+    }
+  PyMem_Free(ahead);
+
+ finally:
   FILEPOSTAMBLE;
   return result;
 }
 
+static int
+apswvfsfile_xRead(sqlite3_file *file, void *bufout, int amount, sqlite3_int64 offset)
+{
+  APSWVFSReadCache *rc=vfsfile_readcache((APSWSQLite3File*)(void*)file);
+
+  /* cache hits don't need the GIL */
+  if(rc && readcache_get(rc, bufout, amount, offset))
+    return SQLITE_OK;
+  return apswvfsfile_xReadPython(file, bufout, amount, offset, rc);
+}
+
 /** .. method:: xRead(amount, offset) -> bytes
 
     Read the specified *amount* of data starting at *offset*. You
@@ -2121,6 +2611,74 @@ apswvfsfilepy_xRead(APSWVFSFile *self, PyObject *args)
   return NULL;
 }
 
+/** .. method:: xReadInto(buffer, offset) -> int
+
+    Read into the writable *buffer* starting at *offset*, filling the
+    whole buffer, and return how many bytes were read (the buffer size
+    except at the end of the file).  If your file object has this
+    method then it is used instead of :meth:`~VFSFile.xRead`, with a
+    :class:`memoryview` of SQLite's own buffer avoiding allocating and
+    copying data.  The memoryview is released when the method returns
+    so you must not keep any references to it.
+
+    Layers such as encryption or compression can implement this by
+    calling the inherited method and then changing the data in place::
+
+      def xReadInto(self, buffer, offset):
+          res=super(MyFile, self).xReadInto(buffer, offset)
+          decrypt_in_place(buffer, res, offset)
+          return res
+
+    It is not used if you override :meth:`~VFSFile.xRead` but not
+    this method.
+
+    :param buffer: Object supporting the writable buffer interface
+    :param offset: Where to start reading. This number may be 64 bit once the database is larger than 2GB.
+*/
+static PyObject *
+apswvfsfilepy_xReadInto(APSWVFSFile *self, PyObject *args)
+{
+  sqlite3_int64 offset;
+  int res;
+  PyObject *wbuf;
+  void *buffer;
+  Py_ssize_t bufsize;
+  int amount;
+
+  CHECKVFSFILEPY;
+  VFSFILENOTIMPLEMENTED(xRead, 1);
+
+  if(!PyArg_ParseTuple(args, "OL", &wbuf, &offset))
+    {
+      assert(PyErr_Occurred());
+      return NULL;
+    }
+
+  if(PyObject_AsWriteBuffer(wbuf, &buffer, &bufsize))
+    return NULL;
+
+  if(bufsize>APSW_INT32_MAX)
+    return PyErr_Format(PyExc_ValueError, "Buffer is too large");
+  amount=(int)bufsize;
+
+  res=self->base->pMethods->xRead(self->base, buffer, amount, offset);
+
+  if(res==SQLITE_OK)
+    return PyInt_FromLong(amount);
+
+  if(res==SQLITE_IOERR_SHORT_READ)
+    {
+      /* We don't know how short the read was, so look for first
+         non-trailing null byte as in xRead */
+      while(amount && ((char*)buffer)[amount-1]==0)
+        amount--;
+      return PyInt_FromLong(amount);
+    }
+
+  SET_EXC(res, NULL);
+  return NULL;
+}
+
 static int
 apswvfsfile_xWrite(sqlite3_file *file, const void *buffer, int amount, sqlite3_int64 offset)
 {
@@ -2138,7 +2696,10 @@ apswvfsfile_xWrite(sqlite3_file *file, const void *buffer, int amount, sqlite3_i
   pybuf=PyBytes_FromStringAndSize(buffer, amount);
   if(!pybuf) goto finally;
 
-  pyresult=Call_PythonMethodV(apswfile->file, "xWrite", 1, "(OL)", pybuf, offset);
+  if(vfsfile_readcache(apswfile))
+    readcache_invalidate(vfsfile_readcache(apswfile), offset, amount);
+
+  pyresult=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xWrite], "xWrite", 1, "(OL)", pybuf, offset);
 
  finally:
   if(PyErr_Occurred())
@@ -2207,7 +2768,7 @@ apswvfsfile_xUnlock(sqlite3_file *file, int flag)
   PyObject *pyresult=NULL;
   FILEPREAMBLE;
 
-  pyresult=Call_PythonMethodV(apswfile->file, "xUnlock", 1, "(i)", flag);
+  pyresult=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xUnlock], "xUnlock", 1, "(i)", flag);
   if(!pyresult)
     result=MakeSqliteMsgFromPyException(NULL);
   else
@@ -2255,7 +2816,11 @@ apswvfsfile_xLock(sqlite3_file *file, int flag)
   PyObject *pyresult=NULL;
   FILEPREAMBLE;
 
-  pyresult=Call_PythonMethodV(apswfile->file, "xLock", 1, "(i)", flag);
+  /* another process could have changed the file while we had no lock */
+  if(flag==SQLITE_LOCK_SHARED && vfsfile_readcache(apswfile))
+    readcache_clear(vfsfile_readcache(apswfile));
+
+  pyresult=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xLock], "xLock", 1, "(i)", flag);
   if(!pyresult)
     {
       result=MakeSqliteMsgFromPyException(NULL);
@@ -2308,7 +2873,10 @@ apswvfsfile_xTruncate(sqlite3_file *file, sqlite3_int64 size)
   PyObject *pyresult=NULL;
   FILEPREAMBLE;
 
-  pyresult=Call_PythonMethodV(apswfile->file, "xTruncate", 1, "(L)", size);
+  if(vfsfile_readcache(apswfile))
+    readcache_invalidate(vfsfile_readcache(apswfile), size, -1);
+
+  pyresult=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xTruncate], "xTruncate", 1, "(L)", size);
   if(!pyresult)
     result=MakeSqliteMsgFromPyException(NULL);
   else
@@ -2354,7 +2922,7 @@ apswvfsfile_xSync(sqlite3_file *file, int flags)
   PyObject *pyresult=NULL;
   FILEPREAMBLE;
 
-  pyresult=Call_PythonMethodV(apswfile->file, "xSync", 1, "(i)", flags);
+  pyresult=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xSync], "xSync", 1, "(i)", flags);
   if(!pyresult)
     result=MakeSqliteMsgFromPyException(NULL);
   else
@@ -2404,7 +2972,7 @@ apswvfsfile_xSectorSize(sqlite3_file *file)
   PyObject *pyresult=NULL;
   FILEPREAMBLE;
 
-  pyresult=Call_PythonMethodV(apswfile->file, "xSectorSize", 0, "()");
+  pyresult=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xSectorSize], "xSectorSize", 0, "()");
   if(!pyresult)
     result=MakeSqliteMsgFromPyException(NULL);
   else if(pyresult!=Py_None)
@@ -2454,7 +3022,7 @@ apswvfsfile_xDeviceCharacteristics(sqlite3_file *file)
   PyObject *pyresult=NULL;
   FILEPREAMBLE;
 
-  pyresult=Call_PythonMethodV(apswfile->file, "xDeviceCharacteristics", 0, "()");
+  pyresult=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xDeviceCharacteristics], "xDeviceCharacteristics", 0, "()");
   if(!pyresult)
     result=MakeSqliteMsgFromPyException(NULL);
   else if(pyresult!=Py_None)
@@ -2505,7 +3073,7 @@ apswvfsfile_xFileSize(sqlite3_file *file, sqlite3_int64 *pSize)
   PyObject *pyresult=NULL;
   FILEPREAMBLE;
 
-  pyresult=Call_PythonMethodV(apswfile->file, "xFileSize", 1, "()");
+  pyresult=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xFileSize], "xFileSize", 1, "()");
   if(!pyresult)
     result=MakeSqliteMsgFromPyException(NULL);
   else if(PyLong_Check(pyresult))
@@ -2558,7 +3126,7 @@ apswvfsfile_xCheckReservedLock(sqlite3_file *file, int *pResOut)
   PyObject *pyresult=NULL;
   FILEPREAMBLE;
 
-  pyresult=Call_PythonMethodV(apswfile->file, "xCheckReservedLock", 1, "()");
+  pyresult=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xCheckReservedLock], "xCheckReservedLock", 1, "()");
   if(!pyresult)
     result=MakeSqliteMsgFromPyException(NULL);
   else if(PyIntLong_Check(pyresult))
@@ -2616,7 +3184,7 @@ apswvfsfile_xFileControl(sqlite3_file *file, int op, void *pArg)
   PyObject *pyresult=NULL;
   FILEPREAMBLE;
 
-  pyresult=Call_PythonMethodV(apswfile->file, "xFileControl", 1, "(iN)", op, PyLong_FromVoidPtr(pArg));
+  pyresult=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xFileControl], "xFileControl", 1, "(iN)", op, PyLong_FromVoidPtr(pArg));
   if(!pyresult)
       result=MakeSqliteMsgFromPyException(NULL);
   else
@@ -2699,7 +3267,7 @@ apswvfsfilepy_xFileControl(APSWVFSFile *self, PyObject *args)
 static int
 apswvfsfile_xClose(sqlite3_file *file)
 {
-  int result=SQLITE_ERROR;
+  int result=SQLITE_ERROR, i;
   PyObject *pyresult=NULL;
   FILEPREAMBLE;
 
@@ -2712,6 +3280,8 @@ apswvfsfile_xClose(sqlite3_file *file)
   if(PyErr_Occurred())
     AddTraceBackHere(__FILE__, __LINE__, "apswvfsfile.xClose", NULL);
 
+  for(i=0;i<FM_COUNT;i++)
+    APSWMethodCache_clear(&apswfile->methods[i]);
   Py_XDECREF(apswfile->file);
   apswfile->file=NULL;
   Py_XDECREF(pyresult);
@@ -2751,15 +3321,347 @@ apswvfsfilepy_xClose(APSWVFSFile *self)
   return NULL;
 }
 
+/** .. method:: xShmMap(page, pagesize, iswrite) -> int
+
+  Returns the address of the *page* numbered region of shared memory
+  used for :ref:`write ahead logging <wal>`, creating it if *iswrite*
+  is true.  The address is returned as a number, or None if the region
+  doesn't exist and *iswrite* was false.
+
+  Your file will only be asked to do shared memory if the VFS you
+  inherit from supports it.  The xShm methods you don't override go
+  directly to the inherited file without involving Python, so only
+  override them if needed (eg for tracing).  Which methods are
+  overridden is decided when the file is opened.
+*/
+static PyObject *
+apswvfsfilepy_xShmMap(APSWVFSFile *self, PyObject *args)
+{
+  int page, pagesize, iswrite, res;
+  void volatile *ptr=NULL;
+
+  CHECKVFSFILEPY;
+  VFSFILENOTIMPLEMENTED(xShmMap, 2);
+
+  if(!PyArg_ParseTuple(args, "iii", &page, &pagesize, &iswrite))
+    return NULL;
+
+  res=self->base->pMethods->xShmMap(self->base, page, pagesize, iswrite, &ptr);
+
+  if(res==SQLITE_OK)
+    {
+      if(!ptr)
+        Py_RETURN_NONE;
+      return PyLong_FromVoidPtr((void*)ptr);
+    }
+
+  SET_EXC(res, NULL);
+  return NULL;
+}
+
+/** .. method:: xShmLock(offset, n, flags)
+
+  Acquires or releases locks on the shared memory.  See
+  :meth:`~VFSFile.xShmMap`.
+*/
+static PyObject *
+apswvfsfilepy_xShmLock(APSWVFSFile *self, PyObject *args)
+{
+  int offset, n, flags, res;
+
+  CHECKVFSFILEPY;
+  VFSFILENOTIMPLEMENTED(xShmLock, 2);
+
+  if(!PyArg_ParseTuple(args, "iii", &offset, &n, &flags))
+    return NULL;
+
+  res=self->base->pMethods->xShmLock(self->base, offset, n, flags);
+
+  if(res==SQLITE_OK)
+    Py_RETURN_NONE;
+
+  SET_EXC(res, NULL);
+  return NULL;
+}
+
+/** .. method:: xShmBarrier()
+
+  Memory barrier between threads and processes using the shared
+  memory.  See :meth:`~VFSFile.xShmMap`.
+*/
+static PyObject *
+apswvfsfilepy_xShmBarrier(APSWVFSFile *self)
+{
+  CHECKVFSFILEPY;
+  VFSFILENOTIMPLEMENTED(xShmBarrier, 2);
+
+  self->base->pMethods->xShmBarrier(self->base);
+  Py_RETURN_NONE;
+}
+
+/** .. method:: xShmUnmap(deleteflag)
+
+  Unmaps the shared memory, deleting it if *deleteflag* is true.  See
+  :meth:`~VFSFile.xShmMap`.
+*/
+static PyObject *
+apswvfsfilepy_xShmUnmap(APSWVFSFile *self, PyObject *args)
+{
+  int deleteflag, res;
+
+  CHECKVFSFILEPY;
+  VFSFILENOTIMPLEMENTED(xShmUnmap, 2);
+
+  if(!PyArg_ParseTuple(args, "i", &deleteflag))
+    return NULL;
+
+  res=self->base->pMethods->xShmUnmap(self->base, deleteflag);
+
+  if(res==SQLITE_OK)
+    Py_RETURN_NONE;
+
+  SET_EXC(res, NULL);
+  return NULL;
+}
+
+/** .. method:: set_read_cache(pages, readahead=0)
+
+  Keeps up to *pages* recently read pages of the file in memory.
+  Reading them again is answered without calling
+  :meth:`~VFSFile.xRead` (or your override of it) and without
+  acquiring the GIL.  This helps when the working set is larger than
+  SQLite's own page cache (see `pragma cache_size
+  <https://sqlite.org/pragma.html#pragma_cache_size>`__), and is
+  mainly useful for main database files.  Zero turns the cache off.
+  Calling this method always discards the current contents.
+
+  Pages are discarded when SQLite writes or truncates over them, and
+  the whole cache is discarded each time SQLite acquires a shared lock
+  since other processes could have changed the file.  The cache stops
+  being used once the file uses shared memory for :ref:`write ahead
+  logging <wal>` because other connections then change the file
+  without locking it, and calling this method again does not turn it
+  back on.
+
+  Reads and writes you make directly on the file object rather than
+  via SQLite do not update the cache.
+
+  :param readahead: When a page is read that wasn't cached and
+     immediately follows the previous read, this many pages are
+     read at once with a single larger :meth:`~VFSFile.xRead` (or
+     :meth:`~VFSFile.xReadInto`) call, and the extra pages are put in
+     the cache.  This is useful for full table scans and
+     :meth:`Connection.backup` where there is a high cost per read
+     such as network storage.  Zero or one turns it off.  Reads ahead
+     near the end of the file will be short, which is expected.
+
+  .. seealso::
+
+    * :meth:`~VFSFile.read_cache_stats`
+*/
+static PyObject *
+APSWVFSFile_set_read_cache(APSWVFSFile *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[]={"pages", "readahead", NULL};
+  int pages, readahead=0;
+  APSWVFSReadCache *rc;
+  APSWVFSCachePage **buckets=NULL;
+
+  CHECKVFSFILEPY;
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "i|i:set_read_cache(pages, readahead=0)", kwlist, &pages, &readahead))
+    return NULL;
+  if(pages<0 || readahead<0)
+    return PyErr_Format(PyExc_ValueError, "pages and readahead must be zero or positive, not %d and %d", pages, readahead);
+
+  if(!self->readcache)
+    {
+      if(!pages)
+        Py_RETURN_NONE;
+      rc=PyMem_Malloc(sizeof(APSWVFSReadCache));
+      if(!rc)
+        return PyErr_NoMemory();
+      memset(rc, 0, sizeof(APSWVFSReadCache));
+      rc->lock=PyThread_allocate_lock();
+      if(!rc->lock)
+        {
+          PyMem_Free(rc);
+          return PyErr_NoMemory();
+        }
+      self->readcache=rc;
+    }
+  rc=self->readcache;
+
+  if(pages)
+    {
+      buckets=PyMem_Malloc(sizeof(APSWVFSCachePage*)*pages);
+      if(!buckets)
+        return PyErr_NoMemory();
+      memset(buckets, 0, sizeof(APSWVFSCachePage*)*pages);
+    }
+
+  PyThread_acquire_lock(rc->lock, WAIT_LOCK);
+  readcache_empty(rc);
+  PyMem_Free(rc->buckets);
+  rc->buckets=buckets;
+  rc->maxpages=pages;
+  rc->readahead=readahead;
+  rc->nextoffset=-1;
+  /* once mapped SQLite keeps its shared lock so nothing would empty
+     the cache again */
+  rc->disabled=self->shmmapped;
+  PyThread_release_lock(rc->lock);
+
+  Py_RETURN_NONE;
+}
+
+/** .. method:: read_cache_stats() -> dict
+
+  Returns a dictionary of information about the cache set up by
+  :meth:`~VFSFile.set_read_cache`.  The counters are cumulative over
+  the life of the file.
+
+  .. list-table::
+    :header-rows: 1
+    :widths: auto
+
+    * - Key
+      - Meaning
+    * - maxpages
+      - Maximum number of pages kept
+    * - pages
+      - Number of pages currently in the cache
+    * - pagesize
+      - Size of the cached pages (0 until the first page is cached)
+    * - hits
+      - Reads answered from the cache
+    * - misses
+      - Reads that were not in the cache
+    * - evictions
+      - Pages discarded to make space
+    * - invalidations
+      - Pages discarded because of writes, truncation or locking
+    * - readahead
+      - How many pages are read at once for sequential reads
+    * - readaheads
+      - Number of times multiple pages were read at once
+    * - disabled
+      - True if the cache is not being used because of shared memory
+*/
+static PyObject *
+APSWVFSFile_read_cache_stats(APSWVFSFile *self)
+{
+  APSWVFSReadCache rc;
+
+  CHECKVFSFILEPY;
+
+  memset(&rc, 0, sizeof(rc));
+  if(self->readcache)
+    {
+      PyThread_acquire_lock(self->readcache->lock, WAIT_LOCK);
+      rc=*self->readcache;
+      PyThread_release_lock(self->readcache->lock);
+    }
+
+  return Py_BuildValue("{s: I, s: I, s: i, s: L, s: L, s: L, s: L, s: i, s: L, s: O}",
+                       "maxpages", rc.maxpages, "pages", rc.npages, "pagesize", rc.pagesize,
+                       "hits", rc.hits, "misses", rc.misses, "evictions", rc.evictions,
+                       "invalidations", rc.invalidations, "readahead", rc.readahead,
+                       "readaheads", rc.readaheads, "disabled", rc.disabled?Py_True:Py_False);
+}
+
 #define APSWPROXYBASE						\
   APSWSQLite3File *apswfile=(APSWSQLite3File*)(void*)file;	\
   APSWVFSFile *f=(APSWVFSFile*) (apswfile->file);               \
-  assert(Py_TYPE(f)==&APSWVFSFileType)
+  assert(PyObject_TypeCheck((PyObject*)f, &APSWVFSFileType))
+
+/* The xShm methods go straight to the inherited file without the GIL
+   unless they are overridden in Python, in which case the
+   apswvfsfile_xShm functions call the Python method */
+
+static int
+apswvfsfile_xShmLock(sqlite3_file *file, int offset, int n, int flags)
+{
+  int result=SQLITE_OK;
+  PyObject *pyresult;
+  FILEPREAMBLE;
+
+  pyresult=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xShmLock], "xShmLock", 1, "(iii)", offset, n, flags);
+  if(!pyresult)
+    {
+      result=MakeSqliteMsgFromPyException(NULL);
+      AddTraceBackHere(__FILE__, __LINE__, "apswvfsfile_xShmLock", "{s: i, s: i, s: i}", "offset", offset, "n", n, "flags", flags);
+    }
+  Py_XDECREF(pyresult);
+  FILEPOSTAMBLE;
+  return result;
+}
+
+static int
+apswvfsfile_xShmMap(sqlite3_file *file, int iPage, int pgsz, int isWrite, void volatile **pp)
+{
+  int result=SQLITE_OK;
+  PyObject *pyresult;
+  FILEPREAMBLE;
+
+  *pp=NULL;
+  pyresult=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xShmMap], "xShmMap", 1, "(iii)", iPage, pgsz, isWrite);
+  if(pyresult && pyresult!=Py_None)
+    {
+      if(PyIntLong_Check(pyresult))
+        *pp=PyLong_AsVoidPtr(pyresult);
+      else
+        PyErr_Format(PyExc_TypeError, "xShmMap should return a number (pointer) or None");
+    }
+  if(PyErr_Occurred())
+    {
+      *pp=NULL;
+      result=MakeSqliteMsgFromPyException(NULL);
+      AddTraceBackHere(__FILE__, __LINE__, "apswvfsfile_xShmMap", "{s: i, s: i, s: i, s: O}", "page", iPage, "pagesize", pgsz,
+                       "iswrite", isWrite, "result", pyresult?pyresult:Py_None);
+    }
+  Py_XDECREF(pyresult);
+  FILEPOSTAMBLE;
+  return result;
+}
+
+static void
+apswvfsfile_xShmBarrier(sqlite3_file *file)
+{
+  PyObject *pyresult;
+  FILEPREAMBLE;
+
+  pyresult=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xShmBarrier], "xShmBarrier", 1, "()");
+  if(!pyresult)
+    AddTraceBackHere(__FILE__, __LINE__, "apswvfsfile_xShmBarrier", NULL);
+  Py_XDECREF(pyresult);
+  FILEPOSTAMBLE;
+}
+
+static int
+apswvfsfile_xShmUnmap(sqlite3_file *file, int deleteFlag)
+{
+  int result=SQLITE_OK;
+  PyObject *pyresult;
+  FILEPREAMBLE;
+
+  pyresult=Call_PythonMethodCachedV(apswfile->file, &apswfile->methods[FM_xShmUnmap], "xShmUnmap", 1, "(i)", deleteFlag);
+  if(!pyresult)
+    {
+      result=MakeSqliteMsgFromPyException(NULL);
+      AddTraceBackHere(__FILE__, __LINE__, "apswvfsfile_xShmUnmap", "{s: i}", "deleteflag", deleteFlag);
+    }
+  Py_XDECREF(pyresult);
+  FILEPOSTAMBLE;
+  return result;
+}
 
 static int
 apswproxyxShmLock(sqlite3_file *file, int offset, int n, int flags)
 {
   APSWPROXYBASE;
+  if(apswfile->shmpython&SHM_PY_LOCK)
+    return apswvfsfile_xShmLock(file, offset, n, flags);
   return f->base->pMethods->xShmLock(f->base, offset, n, flags);
 }
 
@@ -2767,6 +3669,17 @@ static int
 apswproxyxShmMap(sqlite3_file *file, int iPage, int pgsz, int isWrite, void volatile **pp)
 {
   APSWPROXYBASE;
+  f->shmmapped=1;
+  if(f->readcache && !f->readcache->disabled)
+    {
+      /* other connections change the file without locking it, so the
+         read cache can't be used and is emptied by the next xLock */
+      PyThread_acquire_lock(f->readcache->lock, WAIT_LOCK);
+      f->readcache->disabled=1;
+      PyThread_release_lock(f->readcache->lock);
+    }
+  if(apswfile->shmpython&SHM_PY_MAP)
+    return apswvfsfile_xShmMap(file, iPage, pgsz, isWrite, pp);
   return f->base->pMethods->xShmMap(f->base, iPage, pgsz, isWrite, pp);
 }
 
@@ -2774,13 +3687,18 @@ static void
 apswproxyxShmBarrier(sqlite3_file *file)
 {
   APSWPROXYBASE;
-  f->base->pMethods->xShmBarrier(f->base);
+  if(apswfile->shmpython&SHM_PY_BARRIER)
+    apswvfsfile_xShmBarrier(file);
+  else
+    f->base->pMethods->xShmBarrier(f->base);
 }
 
 static int
 apswproxyxShmUnmap(sqlite3_file *file, int deleteFlag)
 {
   APSWPROXYBASE;
+  if(apswfile->shmpython&SHM_PY_UNMAP)
+    return apswvfsfile_xShmUnmap(file, deleteFlag);
   return f->base->pMethods->xShmUnmap(f->base, deleteFlag);
 }
 
@@ -2831,6 +3749,7 @@ static const struct sqlite3_io_methods apsw_io_methods_v2=
 
 static PyMethodDef APSWVFSFile_methods[]={
   {"xRead", (PyCFunction)apswvfsfilepy_xRead, METH_VARARGS, "xRead"},
+  {"xReadInto", (PyCFunction)apswvfsfilepy_xReadInto, METH_VARARGS, "xReadInto"},
   {"xUnlock", (PyCFunction)apswvfsfilepy_xUnlock, METH_VARARGS, "xUnlock"},
   {"xLock", (PyCFunction)apswvfsfilepy_xLock, METH_VARARGS, "xLock"},
   {"xClose", (PyCFunction)apswvfsfilepy_xClose, METH_NOARGS, "xClose"},
@@ -2842,6 +3761,12 @@ static PyMethodDef APSWVFSFile_methods[]={
   {"xSync", (PyCFunction)apswvfsfilepy_xSync, METH_VARARGS, "xSync"},
   {"xTruncate", (PyCFunction)apswvfsfilepy_xTruncate, METH_VARARGS, "xTruncate"},
   {"xFileControl", (PyCFunction)apswvfsfilepy_xFileControl, METH_VARARGS, "xFileControl"},
+  {"xShmMap", (PyCFunction)apswvfsfilepy_xShmMap, METH_VARARGS, "xShmMap"},
+  {"xShmLock", (PyCFunction)apswvfsfilepy_xShmLock, METH_VARARGS, "xShmLock"},
+  {"xShmBarrier", (PyCFunction)apswvfsfilepy_xShmBarrier, METH_NOARGS, "xShmBarrier"},
+  {"xShmUnmap", (PyCFunction)apswvfsfilepy_xShmUnmap, METH_VARARGS, "xShmUnmap"},
+  {"set_read_cache", (PyCFunction)APSWVFSFile_set_read_cache, METH_VARARGS|METH_KEYWORDS, "Sets up the read cache"},
+  {"read_cache_stats", (PyCFunction)APSWVFSFile_read_cache_stats, METH_NOARGS, "Read cache statistics"},
   {"excepthook", (PyCFunction)apswvfs_excepthook, METH_VARARGS, "Exception hook"},
   /* Sentinel */
   {0, 0, 0, 0}
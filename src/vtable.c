@@ -76,10 +76,24 @@ way.  Note the (optional) arguments which are passed to the module.
 */
 
 
+/* How many changes UpdateBatch gets at most unless the table has
+   UpdateBatchSize */
+#define APSW_VTAB_BATCHSIZE 1000
+
+/* BestIndex plans remembered per table before the cache is emptied */
+#define APSW_VTAB_BESTINDEX_MAX 256
+
 typedef struct {
   sqlite3_vtab used_by_sqlite; /* I don't touch this */
   PyObject *vtable;            /* object implementing vtable */
   PyObject *functions;         /* functions returned by vtabFindFunction */
+  PyObject *batch;             /* list of pending changes if vtable implements UpdateBatch */
+  Py_ssize_t batchsize;        /* changes are delivered when there are this many */
+  int batchrowids;             /* vtable implements UpdateBatchRowid */
+  int havenextrowid;           /* nextrowid is valid */
+  sqlite3_int64 nextrowid;     /* rowid for the next insert without one */
+  PyObject *bestindexcache;    /* dict of constraint signature to plan, NULL if vtable opted out */
+  int bestindexdetail;         /* constraints include IN and LIMIT/OFFSET details */
 } apsw_vtable;
 
 static struct {
@@ -100,6 +114,24 @@ static struct {
     }
   };
 
+/* Returns the truth of an optional attribute on the vtable, dflt if
+   it is not present or -1 with an exception */
+static int
+apswvtabTableFlag(PyObject *vtable, const char *name, int dflt)
+{
+  PyObject *value;
+  int res;
+
+  if(!PyObject_HasAttrString(vtable, name))
+    return dflt;
+  value=PyObject_GetAttrString(vtable, name);
+  if(!value)
+    return -1;
+  res=PyObject_IsTrue(value);
+  Py_DECREF(value);
+  return res;
+}
+
 static int
 apswvtabCreateOrConnect(sqlite3 *db,
 		    void *pAux,
@@ -158,6 +190,39 @@ apswvtabCreateOrConnect(sqlite3 *db,
   assert((void*)avi==(void*)&(avi->used_by_sqlite)); /* detect if weird padding happens */
   memset(avi, 0, sizeof(apsw_vtable));
 
+  if(PyObject_HasAttrString(vtable, "UpdateBatch"))
+    {
+      avi->batch=PyList_New(0);
+      if(!avi->batch) goto pyexception;
+      avi->batchsize=APSW_VTAB_BATCHSIZE;
+      if(PyObject_HasAttrString(vtable, "UpdateBatchSize"))
+        {
+          PyObject *size=PyObject_GetAttrString(vtable, "UpdateBatchSize");
+          if(!size) goto pyexception;
+          avi->batchsize=PyIntLong_Check(size)?PyIntLong_AsLong(size):-1;
+          Py_DECREF(size);
+          if(PyErr_Occurred()) goto pyexception;
+          if(avi->batchsize<1)
+            {
+              PyErr_Format(PyExc_ValueError, "UpdateBatchSize should be a positive integer");
+              goto pyexception;
+            }
+        }
+      avi->batchrowids=PyObject_HasAttrString(vtable, "UpdateBatchRowid");
+    }
+
+  {
+    int cache=apswvtabTableFlag(vtable, "BestIndexCache", 1);
+    if(cache<0) goto pyexception;
+    if(cache)
+      {
+        avi->bestindexcache=PyDict_New();
+        if(!avi->bestindexcache) goto pyexception;
+      }
+    avi->bestindexdetail=apswvtabTableFlag(vtable, "BestIndexDetail", 0);
+    if(avi->bestindexdetail<0) goto pyexception;
+  }
+
   schema=PySequence_GetItem(pyres, 0);
   if(!schema) goto pyexception;
 
@@ -195,7 +260,11 @@ apswvtabCreateOrConnect(sqlite3 *db,
   Py_XDECREF(schema);
   Py_XDECREF(vtable);
   if(avi)
-    PyMem_Free(avi);
+    {
+      Py_XDECREF(avi->batch);
+      Py_XDECREF(avi->bestindexcache);
+      PyMem_Free(avi);
+    }
 
   PyGILState_Release(gilstate);
   return res;
@@ -347,6 +416,8 @@ apswvtabDestroyOrDisconnect(sqlite3_vtab *pVtab, int stringindex)
 
       Py_DECREF(vtable);
       Py_XDECREF( ((apsw_vtable*)pVtab)->functions );
+      Py_XDECREF( ((apsw_vtable*)pVtab)->batch );
+      Py_XDECREF( ((apsw_vtable*)pVtab)->bestindexcache );
       PyMem_Free(pVtab);
       goto finally;
     }
@@ -479,6 +550,13 @@ apswvtabDisconnect(sqlite3_vtab *pVTab)
        set the boolean to False then SQLite won't do that double
        checking.
 
+     (integer, boolean, boolean)
+       If the third item is True then all the values of an IN
+       constraint (eg ``customer in ('Acme', 'Widgets')``) are passed
+       to :meth:`~VTCursor.Filter` together as a tuple rather than
+       Filter being called once per value.  It can only be True for
+       constraints whose *isin* detail (see below) is True.
+
   Example query: ``select * from foo where price > 74.99 and
   quantity<=10 and customer=='Acme Widgets'``.  customer is column 0,
   price column 2 and quantity column 5.  You can index on customer
@@ -579,22 +657,248 @@ apswvtabDisconnect(sqlite3_vtab *pVTab)
     "Acme Widgets",  # constraintarg[0] - customer
     74.99            # constraintarg[1] - price
 
+  **Remembered answers**
+
+  SQLite asks the same question repeatedly, for example each time a
+  statement is prepared again after a schema change, and while
+  considering join orders.  Your answer is remembered for each
+  distinct set of constraints and orderbys so BestIndex is only called
+  the first time.  The answers are kept until the table is
+  disconnected.  If your answer can change, for example because the
+  estimated cost depends on how many rows there currently are, set
+  *BestIndexCache* to False on your table object.
+
+  **Detail**
+
+  Set *BestIndexDetail* to True on your table object to have each
+  constraint be four items - ``(column, op, isin, value)``.
+
+  isin
+    True if the constraint is an IN whose values can be passed to
+    :meth:`~VTCursor.Filter` together (see the constraints used
+    above).  The op will be :const:`SQLITE_INDEX_CONSTRAINT_EQ`.
+
+  value
+    For :const:`SQLITE_INDEX_CONSTRAINT_LIMIT` and
+    :const:`SQLITE_INDEX_CONSTRAINT_OFFSET` constraints this is the
+    integer limit or offset when it is a constant in the query,
+    otherwise None.  Using a LIMIT or OFFSET constraint gets its value
+    passed to Filter so you can stop producing rows early.
+
+  IN, LIMIT and OFFSET need SQLite 3.38 or later.
+
 */
 
+/* Is constraint i an IN whose values can be given to Filter together?
+   With handle of 1 also asks SQLite to do so. */
+static int
+apswvtabConstraintIn(sqlite3_index_info *indexinfo, int i, int handle)
+{
+#if SQLITE_VERSION_NUMBER >= 3038000
+  if(!sqlite3_vtab_in(indexinfo, i, -1))
+    return 0;
+  if(handle>0)
+    sqlite3_vtab_in(indexinfo, i, 1);
+  return 1;
+#else
+  (void)indexinfo; (void)i; (void)handle;
+  return 0;
+#endif
+}
+
+/* Sets *value from a LIMIT or OFFSET constraint, returning non-zero
+   if SQLite knows it while planning */
+static int
+apswvtabConstraintLimit(sqlite3_index_info *indexinfo, int i, sqlite3_int64 *value)
+{
+#if SQLITE_VERSION_NUMBER >= 3038000
+  sqlite3_value *rhs=NULL;
+
+  if((indexinfo->aConstraint[i].op==SQLITE_INDEX_CONSTRAINT_LIMIT || indexinfo->aConstraint[i].op==SQLITE_INDEX_CONSTRAINT_OFFSET)
+     && sqlite3_vtab_rhs_value(indexinfo, i, &rhs)==SQLITE_OK && sqlite3_value_type(rhs)==SQLITE_INTEGER)
+    {
+      *value=sqlite3_value_int64(rhs);
+      return 1;
+    }
+#else
+  (void)indexinfo; (void)i; (void)value;
+#endif
+  return 0;
+}
+
+/* Everything BestIndex would be given, as bytes used to look up
+   earlier answers.  Returns a new reference or NULL with an
+   exception. */
+static PyObject *
+apswvtabBestIndexKey(apsw_vtable *av, sqlite3_index_info *indexinfo)
+{
+  sqlite3_int64 *sig, value;
+  PyObject *key;
+  int i, n=0, flags;
+
+  sig=PyMem_Malloc(sizeof(sqlite3_int64)*(2+3*indexinfo->nConstraint+2*indexinfo->nOrderBy));
+  if(!sig)
+    return PyErr_NoMemory();
+
+  sig[n++]=indexinfo->nConstraint;
+  sig[n++]=indexinfo->nOrderBy;
+  for(i=0;i<indexinfo->nConstraint;i++)
+    {
+      value=0;
+      flags=0;
+      if(indexinfo->aConstraint[i].usable)
+        {
+          flags=1|(apswvtabConstraintIn(indexinfo, i, -1)<<1);
+          if(av->bestindexdetail && apswvtabConstraintLimit(indexinfo, i, &value))
+            flags|=4;
+        }
+      sig[n++]=indexinfo->aConstraint[i].iColumn;
+      sig[n++]=(indexinfo->aConstraint[i].op<<8)|flags;
+      sig[n++]=value;
+    }
+  for(i=0;i<indexinfo->nOrderBy;i++)
+    {
+      sig[n++]=indexinfo->aOrderBy[i].iColumn;
+      sig[n++]=indexinfo->aOrderBy[i].desc;
+    }
+
+  key=PyBytes_FromStringAndSize((char*)sig, n*sizeof(sqlite3_int64));
+  PyMem_Free(sig);
+  return key;
+}
+
+/* A remembered BestIndex answer is a bytes object containing this
+   header, an apswbestindexusage for each constraint and then the
+   idxStr.  They are copied in and out with memcpy as the bytes data
+   need not be aligned. */
+typedef struct
+{
+  int idxnum;
+  int orderbyconsumed;
+  double estimatedcost;
+  int idxstrlen;                /* -1 if there is no idxStr */
+} apswbestindexplan;
+
+typedef struct
+{
+  int argvindex;
+  int omit;
+  int inlist;
+} apswbestindexusage;
+
+/* Records what BestIndex told SQLite.  inlists says which constraints
+   had IN values requested together. */
+static PyObject *
+apswvtabBestIndexPlan(sqlite3_index_info *indexinfo, const char *inlists)
+{
+  apswbestindexplan plan;
+  apswbestindexusage usage;
+  PyObject *res;
+  char *p;
+  int i;
+
+  plan.idxnum=indexinfo->idxNum;
+  plan.orderbyconsumed=indexinfo->orderByConsumed;
+  plan.estimatedcost=indexinfo->estimatedCost;
+  plan.idxstrlen=indexinfo->idxStr?(int)strlen(indexinfo->idxStr):-1;
+
+  res=PyBytes_FromStringAndSize(NULL, sizeof(plan)+indexinfo->nConstraint*sizeof(usage)+(plan.idxstrlen>0?plan.idxstrlen:0));
+  if(!res)
+    return NULL;
+
+  p=PyBytes_AS_STRING(res);
+  memcpy(p, &plan, sizeof(plan));
+  p+=sizeof(plan);
+  for(i=0;i<indexinfo->nConstraint;i++)
+    {
+      usage.argvindex=indexinfo->aConstraintUsage[i].argvIndex;
+      usage.omit=indexinfo->aConstraintUsage[i].omit;
+      usage.inlist=inlists[i];
+      memcpy(p, &usage, sizeof(usage));
+      p+=sizeof(usage);
+    }
+  if(plan.idxstrlen>0)
+    memcpy(p, indexinfo->idxStr, plan.idxstrlen);
+  return res;
+}
+
+/* Gives SQLite a remembered BestIndex answer.  Returns -1 with an
+   exception on failure. */
+static int
+apswvtabBestIndexApply(sqlite3_index_info *indexinfo, PyObject *planbytes)
+{
+  apswbestindexplan plan;
+  apswbestindexusage usage;
+  const char *p=PyBytes_AS_STRING(planbytes);
+  int i;
+
+  memcpy(&plan, p, sizeof(plan));
+  p+=sizeof(plan);
+  for(i=0;i<indexinfo->nConstraint;i++)
+    {
+      memcpy(&usage, p, sizeof(usage));
+      p+=sizeof(usage);
+      indexinfo->aConstraintUsage[i].argvIndex=usage.argvindex;
+      indexinfo->aConstraintUsage[i].omit=(unsigned char)usage.omit;
+      if(usage.inlist)
+        apswvtabConstraintIn(indexinfo, i, 1);
+    }
+  indexinfo->idxNum=plan.idxnum;
+  indexinfo->orderByConsumed=plan.orderbyconsumed;
+  indexinfo->estimatedCost=plan.estimatedcost;
+  if(plan.idxstrlen>=0)
+    {
+      indexinfo->idxStr=sqlite3_mprintf("%.*s", plan.idxstrlen, p);
+      if(!indexinfo->idxStr)
+        {
+          PyErr_NoMemory();
+          return -1;
+        }
+      indexinfo->needToFreeIdxStr=1;
+    }
+  return 0;
+}
+
 static int
 apswvtabBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *indexinfo)
 {
   PyGILState_STATE gilstate;
+  apsw_vtable *av=(apsw_vtable*)pVtab;
   PyObject *vtable;
   PyObject *constraints=NULL, *orderbys=NULL;
   PyObject *res=NULL, *indices=NULL;
+  PyObject *key=NULL, *plan=NULL;
+  char *inlists=NULL;
   int i,j;
   int nconstraints=0;
   int sqliteres=SQLITE_OK;
 
   gilstate=PyGILState_Ensure();
 
-  vtable=((apsw_vtable*)pVtab)->vtable;
+  vtable=av->vtable;
+
+  /* has the same question been answered before? */
+  if(av->bestindexcache)
+    {
+      key=apswvtabBestIndexKey(av, indexinfo);
+      if(!key) goto pyexception;
+      {
+        PyObject *cached=PyDict_GetItem(av->bestindexcache, key);
+        if(cached)
+          {
+            if(apswvtabBestIndexApply(indexinfo, cached))
+              goto pyexception;
+            goto finally;
+          }
+      }
+      inlists=PyMem_Malloc(indexinfo->nConstraint+1);
+      if(!inlists)
+        {
+          PyErr_NoMemory();
+          goto pyexception;
+        }
+      memset(inlists, 0, indexinfo->nConstraint+1);
+    }
 
   /* count how many usable constraints there are */
   for(i=0;i<indexinfo->nConstraint;i++)
@@ -610,7 +914,22 @@ apswvtabBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *indexinfo)
       PyObject *constraint=NULL;
       if(!indexinfo->aConstraint[i].usable) continue;
 
-      constraint=Py_BuildValue("(iB)", indexinfo->aConstraint[i].iColumn, indexinfo->aConstraint[i].op);
+      if(av->bestindexdetail)
+        {
+          sqlite3_int64 value;
+          PyObject *pyvalue;
+          if(apswvtabConstraintLimit(indexinfo, i, &value))
+            pyvalue=PyLong_FromLongLong(value);
+          else
+            {
+              pyvalue=Py_None;
+              Py_INCREF(pyvalue);
+            }
+          constraint=Py_BuildValue("(iBNN)", indexinfo->aConstraint[i].iColumn, indexinfo->aConstraint[i].op,
+                                   PyBool_FromLong(apswvtabConstraintIn(indexinfo, i, -1)), pyvalue);
+        }
+      else
+        constraint=Py_BuildValue("(iB)", indexinfo->aConstraint[i].iColumn, indexinfo->aConstraint[i].op);
       if(!constraint) goto pyexception;
 
       PyTuple_SET_ITEM(constraints, j, constraint);
@@ -639,7 +958,7 @@ apswvtabBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *indexinfo)
 
   /* do we have useful index information? */
   if(res==Py_None)
-    goto finally;
+    goto remember;
 
   /* check we have a sequence */
   if(!PySequence_Check(res) || PySequence_Size(res)>5)
@@ -651,7 +970,7 @@ apswvtabBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *indexinfo)
 
   /* dig the argv indices out */
   if(PySequence_Size(res)==0)
-    goto finally;
+    goto remember;
 
   indices=PySequence_GetItem(res, 0);
   if(indices!=Py_None)
@@ -666,8 +985,8 @@ apswvtabBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *indexinfo)
       /* iterate through the items - i is the SQLite sequence number and j is the apsw one (usable entries) */
       for(i=0,j=0;i<indexinfo->nConstraint;i++)
 	{
-	  PyObject *constraint=NULL, *argvindex=NULL, *omit=NULL;
-	  int omitv;
+	  PyObject *constraint=NULL, *argvindex=NULL, *omit=NULL, *inlist=NULL;
+	  int omitv, inlistv=0;
 	  if(!indexinfo->aConstraint[i].usable) continue;
 	  constraint=PySequence_GetItem(indices, j);
 	  if(PyErr_Occurred() || !constraint) goto pyexception;
@@ -685,10 +1004,10 @@ apswvtabBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *indexinfo)
 	      Py_DECREF(constraint);
 	      continue;
 	    }
-	  /* or a sequence two items long */
-	  if(!PySequence_Check(constraint) || PySequence_Size(constraint)!=2)
+	  /* or a sequence two or three items long */
+	  if(!PySequence_Check(constraint) || (PySequence_Size(constraint)!=2 && PySequence_Size(constraint)!=3))
 	    {
-	      PyErr_Format(PyExc_TypeError, "Bad constraint (#%d) - it should be one of None, an integer or a tuple of an integer and a boolean", j);
+	      PyErr_Format(PyExc_TypeError, "Bad constraint (#%d) - it should be one of None, an integer or a tuple of an integer and one or two booleans", j);
 	      AddTraceBackHere(__FILE__, __LINE__, "VirtualTable.xBestIndex.result_constraint", "{s: O, s: O, s: O, s: O}",
 			       "self", vtable, "result", res, "indices", indices, "constraint", constraint);
 	      Py_DECREF(constraint);
@@ -707,24 +1026,44 @@ apswvtabBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *indexinfo)
 	  omitv=PyObject_IsTrue(omit);
 	  if(omitv==-1)
             goto constraintfail;
+          /* third item asks for all the values of an IN together */
+          if(PySequence_Size(constraint)==3)
+            {
+              inlist=PySequence_GetItem(constraint, 2);
+              if(!inlist) goto constraintfail;
+              inlistv=PyObject_IsTrue(inlist);
+              if(inlistv==-1)
+                goto constraintfail;
+              if(inlistv && !apswvtabConstraintIn(indexinfo, i, 1))
+                {
+                  PyErr_Format(PyExc_ValueError, "Constraint #%d is not an IN that can have its values passed together", j);
+                  AddTraceBackHere(__FILE__, __LINE__, "VirtualTable.xBestIndex.result_constraint_inlist", "{s: O, s: O, s: O, s: O}",
+                                   "self", vtable, "result", res, "indices", indices, "constraint", constraint);
+                  goto constraintfail;
+                }
+              if(inlists)
+                inlists[i]=(char)inlistv;
+            }
           indexinfo->aConstraintUsage[i].argvIndex=PyIntLong_AsLong(argvindex)+1;
 	  indexinfo->aConstraintUsage[i].omit=omitv;
 	  Py_DECREF(constraint);
 	  Py_DECREF(argvindex);
 	  Py_DECREF(omit);
+	  Py_XDECREF(inlist);
 	  continue;
 
 	constraintfail:
 	  Py_DECREF(constraint);
 	  Py_XDECREF(argvindex);
 	  Py_XDECREF(omit);
+	  Py_XDECREF(inlist);
 	  goto pyexception;
 	}
     }
 
   /* item #1 is idxnum */
   if(PySequence_Size(res)<2)
-    goto finally;
+    goto remember;
   {
     PyObject *idxnum=PySequence_GetItem(res, 1);
     if(!idxnum) goto pyexception;
@@ -744,7 +1083,7 @@ apswvtabBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *indexinfo)
 
   /* item #2 is idxStr */
   if(PySequence_Size(res)<3)
-    goto finally;
+    goto remember;
   {
     PyObject *utf8str=NULL, *idxstr=NULL;
     idxstr=PySequence_GetItem(res, 2);
@@ -766,7 +1105,7 @@ apswvtabBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *indexinfo)
 
   /* item 3 is orderByConsumed */
   if(PySequence_Size(res)<4)
-    goto finally;
+    goto remember;
   {
     PyObject *orderbyconsumed=NULL;
     int iorderbyconsumed;
@@ -787,7 +1126,7 @@ apswvtabBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *indexinfo)
 
   /* item 4 (final) is estimated cost */
   if(PySequence_Size(res)<5)
-    goto finally;
+    goto remember;
   assert(PySequence_Size(res)==5);
   {
     PyObject *estimatedcost=NULL, *festimatedcost=NULL;
@@ -807,6 +1146,16 @@ apswvtabBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *indexinfo)
     Py_DECREF(estimatedcost);
   }
 
+ remember:
+  if(key)
+    {
+      plan=apswvtabBestIndexPlan(indexinfo, inlists);
+      if(!plan) goto pyexception;
+      if(PyDict_Size(av->bestindexcache)>=APSW_VTAB_BESTINDEX_MAX)
+        PyDict_Clear(av->bestindexcache);
+      if(PyDict_SetItem(av->bestindexcache, key, plan))
+        goto pyexception;
+    }
   goto finally;
 
  pyexception: /* we had an exception in python code */
@@ -815,6 +1164,10 @@ apswvtabBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *indexinfo)
   AddTraceBackHere(__FILE__, __LINE__, "VirtualTable.xBestIndex", "{s: O, s: O, s: (OO)}", "self", vtable, "result", res?res:Py_None, "args", constraints?constraints:Py_None, orderbys?orderbys:Py_None);
 
  finally:
+  Py_XDECREF(key);
+  Py_XDECREF(plan);
+  if(inlists)
+    PyMem_Free(inlists);
   Py_XDECREF(indices);
   Py_XDECREF(res);
   Py_XDECREF(constraints);
@@ -847,6 +1200,44 @@ apswvtabBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *indexinfo)
   provide the method.
 */
 
+/* Delivers any pending changes to UpdateBatch returning a SQLite error
+   code */
+static int
+apswvtabUpdateBatchFlush(sqlite3_vtab *pVtab)
+{
+  apsw_vtable *av=(apsw_vtable*)pVtab;
+  PyObject *changes=NULL, *res=NULL;
+  int sqliteres=SQLITE_OK;
+
+  if(!av->batch || !PyList_GET_SIZE(av->batch))
+    return SQLITE_OK;
+
+  /* UpdateBatch gets its own list so it can keep it */
+  changes=av->batch;
+  av->batch=PyList_New(0);
+  av->havenextrowid=0;
+  if(!av->batch)
+    {
+      av->batch=changes;
+      changes=NULL;
+      goto pyexception;
+    }
+
+  res=Call_PythonMethodV(av->vtable, "UpdateBatch", 1, "(O)", changes);
+  if(res)
+    goto finally;
+
+ pyexception:
+  assert(PyErr_Occurred());
+  sqliteres=MakeSqliteMsgFromPyException(&(pVtab->zErrMsg));
+  AddTraceBackHere(__FILE__, __LINE__, "VirtualTable.xUpdateBatch", "{s: O, s: O}", "self", av->vtable, "changes", changes?changes:Py_None);
+
+ finally:
+  Py_XDECREF(changes);
+  Py_XDECREF(res);
+  return sqliteres;
+}
+
 static struct {
   const char *methodname;
   const char *pyexceptionname;
@@ -881,10 +1272,26 @@ apswvtabTransactionMethod(sqlite3_vtab *pVtab, int stringindex)
   gilstate=PyGILState_Ensure();
   vtable=((apsw_vtable*)pVtab)->vtable;
 
+  /* pending changes are delivered before Sync and Commit, and
+     discarded on Rollback */
+  if(stringindex==1 || stringindex==2)
+    {
+      sqliteres=apswvtabUpdateBatchFlush(pVtab);
+      if(sqliteres!=SQLITE_OK)
+        goto finally;
+    }
+  else if(stringindex==3 && ((apsw_vtable*)pVtab)->batch)
+    {
+      apsw_vtable *av=(apsw_vtable*)pVtab;
+      av->havenextrowid=0;
+      if(PyList_SetSlice(av->batch, 0, PyList_GET_SIZE(av->batch), NULL))
+        goto pyexception;
+    }
+
   res=Call_PythonMethod(vtable, transaction_strings[stringindex].methodname, 0, NULL);
   if(res) goto finally;
 
-  /*  pyexception: we had an exception in python code */
+ pyexception: /* we had an exception in python code */
   sqliteres=MakeSqliteMsgFromPyException(&(pVtab->zErrMsg));
   AddTraceBackHere(__FILE__, __LINE__,  transaction_strings[stringindex].pyexceptionname, "{s: O}", "self", vtable);
 
@@ -924,9 +1331,18 @@ apswvtabRollback(sqlite3_vtab *pVtab)
   Returns a :class:`cursor <VTCursor>` object.
 */
 
+/* cursor methods whose lookup is cached (see APSWMethodCache) */
+enum { CM_Filter, CM_Eof, CM_Column, CM_Next, CM_Rowid, CM_Rows, CM_COUNT };
+
 typedef struct {
   sqlite3_vtab_cursor used_by_sqlite;   /* I don't touch this */
   PyObject *cursor;                     /* Object implementing cursor */
+  int userows;                          /* cursor implements Rows */
+  PyObject *rows;                       /* tuple of the current block from Rows */
+  Py_ssize_t nrows;                     /* number of rows in block */
+  Py_ssize_t rowindex;                  /* current row within block */
+  int eof;                              /* no more rows */
+  APSWMethodCache methods[CM_COUNT];    /* cached cursor methods */
 } apsw_vtable_cursor;
 
 
@@ -942,6 +1358,11 @@ apswvtabOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor)
 
   vtable=((apsw_vtable*)pVtab)->vtable;
 
+  /* reads must see pending changes */
+  sqliteres=apswvtabUpdateBatchFlush(pVtab);
+  if(sqliteres!=SQLITE_OK)
+    goto finally;
+
   res=Call_PythonMethod(vtable, "Open", 1, NULL);
   if(!res)
     goto pyexception;
@@ -950,6 +1371,7 @@ apswvtabOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor)
   memset(avc, 0, sizeof(apsw_vtable_cursor));
 
   avc->cursor=res;
+  avc->userows=PyObject_HasAttrString(res, "Rows");
   res=NULL;
   *ppCursor=(sqlite3_vtab_cursor*)avc;
   goto finally;
@@ -991,11 +1413,50 @@ apswvtabOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor)
   :param newrowid: If not the same as *row* then also change the rowid to this.
   :param fields: A tuple of values the same length and order as columns in your table
 */
+/** .. method:: UpdateBatch(changes)
+
+  This method is optional.  If your table has it then changes are
+  collected in C and delivered as a list, instead of calling
+  :meth:`~VTTable.UpdateDeleteRow`, :meth:`~VTTable.UpdateInsertRow`
+  and :meth:`~VTTable.UpdateChangeRow` for each row.  This is much
+  faster for statements changing many rows such as ``INSERT INTO
+  table SELECT ...``.
+
+  Each change is a tuple whose first item is the name of the method
+  that would have been called, followed by that method's arguments::
+
+    ("UpdateDeleteRow", rowid)
+    ("UpdateInsertRow", rowid, fields)
+    ("UpdateChangeRow", row, newrowid, fields)
+
+  Pending changes are delivered when there are
+  *UpdateBatchSize* of them (an integer attribute of your table
+  defaulting to 1,000), before :meth:`~VTTable.Sync` and
+  :meth:`~VTTable.Commit`, and before a cursor is
+  :meth:`opened <VTTable.Open>` so reads see them.  They are discarded
+  without being delivered on :meth:`~VTTable.Rollback`.
+
+  An insert that doesn't specify a rowid needs one to be assigned
+  immediately.  If your table has :meth:`~VTTable.UpdateBatchRowid`
+  then the rowids are counted from what it returns and *rowid* in
+  the change is the one assigned.  Otherwise the pending changes are
+  delivered and :meth:`~VTTable.UpdateInsertRow` called as normal for
+  that row.
+*/
+/** .. method:: UpdateBatchRowid() -> int
+
+  This method is optional and only used with
+  :meth:`~VTTable.UpdateBatch`.  Return the rowid to use for the next
+  insert that doesn't specify one.  Following inserts get the rowids
+  after it, until the pending changes are delivered or discarded at
+  which point it is called again when needed.
+*/
 static int
 apswvtabUpdate(sqlite3_vtab *pVtab, int argc, sqlite3_value **argv, sqlite3_int64 *pRowid)
 {
   PyObject *vtable, *args=NULL, *res=NULL;
   PyGILState_STATE gilstate;
+  apsw_vtable *av=(apsw_vtable*)pVtab;
   int sqliteres=SQLITE_OK;
   int i;
   const char *methodname="unknown";
@@ -1004,7 +1465,7 @@ apswvtabUpdate(sqlite3_vtab *pVtab, int argc, sqlite3_value **argv, sqlite3_int6
 
   gilstate=PyGILState_Ensure();
 
-  vtable=((apsw_vtable*)pVtab)->vtable;
+  vtable=av->vtable;
 
   /* case 1 - argc=1 means delete row */
   if(argc==1)
@@ -1070,6 +1531,66 @@ apswvtabUpdate(sqlite3_vtab *pVtab, int argc, sqlite3_value **argv, sqlite3_int6
       PyTuple_SET_ITEM(args, PyTuple_GET_SIZE(args)-1, fields);
     }
 
+  if(av->batch)
+    {
+      PyObject *change, *rowid;
+      int autorowid=argc!=1 && sqlite3_value_type(argv[0])==SQLITE_NULL && sqlite3_value_type(argv[1])==SQLITE_NULL;
+
+      if(autorowid && !av->batchrowids)
+        {
+          /* UpdateInsertRow will choose the rowid after earlier changes */
+          sqliteres=apswvtabUpdateBatchFlush(pVtab);
+          if(sqliteres!=SQLITE_OK)
+            goto finally;
+          goto unbatched;
+        }
+
+      if(autorowid)
+        {
+          if(!av->havenextrowid)
+            {
+              res=Call_PythonMethod(vtable, "UpdateBatchRowid", 1, NULL);
+              if(!res) goto pyexception;
+              rowid=PyNumber_Long(res);
+              if(!rowid) goto pyexception;
+              av->nextrowid=PyLong_AsLongLong(rowid);
+              Py_DECREF(rowid);
+              if(PyErr_Occurred())
+                {
+                  AddTraceBackHere(__FILE__, __LINE__, "VirtualTable.xUpdateBatchRowid.ReturnedValue", "{s: O}", "result", res);
+                  goto pyexception;
+                }
+              Py_CLEAR(res);
+              av->havenextrowid=1;
+            }
+          rowid=PyLong_FromLongLong(av->nextrowid);
+          if(!rowid) goto pyexception;
+          /* replaces None */
+          PyTuple_SetItem(args, 0, rowid);
+          *pRowid=av->nextrowid++;
+        }
+
+      change=PyTuple_New(1+PyTuple_GET_SIZE(args));
+      if(!change) goto pyexception;
+      for(i=0; i<PyTuple_GET_SIZE(args); i++)
+        {
+          Py_INCREF(PyTuple_GET_ITEM(args, i));
+          PyTuple_SET_ITEM(change, i+1, PyTuple_GET_ITEM(args, i));
+        }
+      PyTuple_SET_ITEM(change, 0, MAKESTR(methodname));
+      if(!PyTuple_GET_ITEM(change, 0) || PyList_Append(av->batch, change))
+        {
+          Py_DECREF(change);
+          goto pyexception;
+        }
+      Py_DECREF(change);
+
+      if(PyList_GET_SIZE(av->batch)>=av->batchsize)
+        sqliteres=apswvtabUpdateBatchFlush(pVtab);
+      goto finally;
+    }
+
+ unbatched:
   res=Call_PythonMethod(vtable, methodname, 1, args);
   if(!res)
     goto pyexception;
@@ -1242,6 +1763,59 @@ apswvtabRename(sqlite3_vtab *pVtab, const char *zNew)
 */
 
 
+/* Gets the next block of rows from the cursor's Rows method.  The
+   GIL must be held.  Returns 0 on success else -1 with an exception
+   set.  An empty block or None means there are no more rows. */
+static int
+apswvtabFetchRows(apsw_vtable_cursor *avc)
+{
+  PyObject *res;
+
+  Py_CLEAR(avc->rows);
+  avc->nrows=avc->rowindex=0;
+  avc->eof=1;
+
+  res=Call_PythonMethodCached(avc->cursor, &avc->methods[CM_Rows], "Rows", 1, NULL);
+  if(!res)
+    return -1;
+  if(res!=Py_None)
+    {
+      avc->rows=PySequence_Tuple(res);
+      if(!avc->rows)
+        {
+          Py_DECREF(res);
+          return -1;
+        }
+      avc->nrows=PyTuple_GET_SIZE(avc->rows);
+      avc->eof=(avc->nrows==0);
+    }
+  Py_DECREF(res);
+  return 0;
+}
+
+/* Returns the current row from the Rows block, as a borrowed
+   reference, with an exception if it isn't a tuple or list big enough
+   for item */
+static PyObject *
+apswvtabCurrentRow(apsw_vtable_cursor *avc, int item)
+{
+  PyObject *row;
+
+  assert(avc->rows && avc->rowindex<avc->nrows);
+  row=PyTuple_GET_ITEM(avc->rows, avc->rowindex);
+  if(!PyTuple_Check(row) && !PyList_Check(row))
+    {
+      PyErr_Format(PyExc_TypeError, "Rows must return a sequence of tuples or lists");
+      return NULL;
+    }
+  if(item<0 || item>=PySequence_Fast_GET_SIZE(row))
+    {
+      PyErr_Format(PyExc_IndexError, "Row from Rows has %d items but item %d was needed", (int)PySequence_Fast_GET_SIZE(row), item);
+      return NULL;
+    }
+  return row;
+}
+
 /** .. method:: Filter(indexnum, indexname, constraintargs)
 
   This method is always called first to initialize an iteration to the
@@ -1250,7 +1824,59 @@ apswvtabRename(sqlite3_vtab *pVtab, const char *zNew)
   object with constraintargs being a tuple of the constraints you
   requested. If you always return None in BestIndex then indexnum will
   be zero, indexstring will be None and constraintargs will be empty).
+
+  If BestIndex asked for the values of an IN constraint together then
+  that constraintarg is a tuple of the values.
+
+  If the cursor has a :meth:`~VTCursor.Rows` method then it is called
+  after Filter.
 */
+
+/* Converts a Filter argument.  The values of an IN that BestIndex
+   asked to have passed together become a tuple. */
+static PyObject *
+apswvtabFilterArg(sqlite3_value *arg)
+{
+#if SQLITE_VERSION_NUMBER >= 3038000
+  sqlite3_value *item=NULL;
+  PyObject *values, *value, *res;
+  int rc;
+
+  /* value lists are NULL valued so other values skip the check */
+  if(sqlite3_value_type(arg)!=SQLITE_NULL)
+    return convert_value_to_pyobject(arg);
+  rc=sqlite3_vtab_in_first(arg, &item);
+  if(rc!=SQLITE_OK && rc!=SQLITE_DONE)
+    return convert_value_to_pyobject(arg);
+
+  values=PyList_New(0);
+  if(!values)
+    return NULL;
+  for(; rc==SQLITE_OK; rc=sqlite3_vtab_in_next(arg, &item))
+    {
+      value=convert_value_to_pyobject(item);
+      if(!value || PyList_Append(values, value))
+        {
+          Py_XDECREF(value);
+          Py_DECREF(values);
+          return NULL;
+        }
+      Py_DECREF(value);
+    }
+  if(rc!=SQLITE_DONE)
+    {
+      Py_DECREF(values);
+      SET_EXC(rc, NULL);
+      return NULL;
+    }
+  res=PyList_AsTuple(values);
+  Py_DECREF(values);
+  return res;
+#else
+  return convert_value_to_pyobject(arg);
+#endif
+}
+
 static int
 apswvtabFilter(sqlite3_vtab_cursor *pCursor, int idxNum, const char *idxStr,
                   int argc, sqlite3_value **sqliteargv)
@@ -1269,13 +1895,14 @@ apswvtabFilter(sqlite3_vtab_cursor *pCursor, int idxNum, const char *idxStr,
   if(!argv) goto pyexception;
   for(i=0;i<argc;i++)
     {
-      PyObject *value=convert_value_to_pyobject(sqliteargv[i]);
+      PyObject *value=apswvtabFilterArg(sqliteargv[i]);
       if(!value) goto pyexception;
       PyTuple_SET_ITEM(argv, i, value);
     }
 
-  res=Call_PythonMethodV(cursor, "Filter", 1, "(iO&O)", idxNum, convertutf8string, idxStr, argv);
-  if(res) goto finally; /* result is ignored */
+  res=Call_PythonMethodCachedV(cursor, &((apsw_vtable_cursor*)pCursor)->methods[CM_Filter], "Filter", 1, "(iO&O)", idxNum, convertutf8string, idxStr, argv);
+  if(res && (!((apsw_vtable_cursor*)pCursor)->userows || !apswvtabFetchRows((apsw_vtable_cursor*)pCursor)))
+    goto finally; /* result is ignored */
 
  pyexception: /* we had an exception in python code */
   assert(PyErr_Occurred());
@@ -1310,6 +1937,10 @@ apswvtabEof(sqlite3_vtab_cursor *pCursor)
   PyGILState_STATE gilstate;
   int sqliteres=0; /* nb a true/false value not error code */
 
+  /* answered from the block without needing Python */
+  if(((apsw_vtable_cursor*)pCursor)->userows)
+    return ((apsw_vtable_cursor*)pCursor)->eof;
+
   gilstate=PyGILState_Ensure();
 
   /* is there already an error? */
@@ -1317,7 +1948,7 @@ apswvtabEof(sqlite3_vtab_cursor *pCursor)
 
   cursor=((apsw_vtable_cursor*)pCursor)->cursor;
 
-  res=Call_PythonMethod(cursor, "Eof", 1, NULL);
+  res=Call_PythonMethodCached(cursor, &((apsw_vtable_cursor*)pCursor)->methods[CM_Eof], "Eof", 1, NULL);
   if(!res) goto pyexception;
 
   sqliteres=PyObject_IsTrue(res);
@@ -1359,7 +1990,16 @@ apswvtabColumn(sqlite3_vtab_cursor *pCursor, sqlite3_context *result, int ncolum
 
   cursor=((apsw_vtable_cursor*)pCursor)->cursor;
 
-  res=Call_PythonMethodV(cursor, "Column", 1, "(i)", ncolumn);
+  if(((apsw_vtable_cursor*)pCursor)->userows)
+    {
+      /* item zero is the rowid which is what -1 asks for */
+      PyObject *row=apswvtabCurrentRow((apsw_vtable_cursor*)pCursor, ncolumn+1);
+      if(!row) goto pyexception;
+      res=PySequence_Fast_GET_ITEM(row, ncolumn+1);
+      Py_INCREF(res);
+    }
+  else
+    res=Call_PythonMethodCachedV(cursor, &((apsw_vtable_cursor*)pCursor)->methods[CM_Column], "Column", 1, "(i)", ncolumn);
   if(!res) goto pyexception;
 
   set_context_result(result, res);
@@ -1394,13 +2034,29 @@ apswvtabNext(sqlite3_vtab_cursor *pCursor)
   PyObject *cursor, *res=NULL;
   PyGILState_STATE gilstate;
   int sqliteres=SQLITE_OK;
+  apsw_vtable_cursor *avc=(apsw_vtable_cursor*)pCursor;
+
+  /* moving within the current block doesn't need Python */
+  if(avc->userows && avc->rowindex+1<avc->nrows)
+    {
+      avc->rowindex++;
+      return SQLITE_OK;
+    }
 
   gilstate=PyGILState_Ensure();
 
-  cursor=((apsw_vtable_cursor*)pCursor)->cursor;
+  cursor=avc->cursor;
 
-  res=Call_PythonMethod(cursor, "Next", 1, NULL);
-  if(res) goto finally;
+  if(avc->userows)
+    {
+      if(!apswvtabFetchRows(avc))
+        goto finally;
+    }
+  else
+    {
+      res=Call_PythonMethodCached(cursor, &avc->methods[CM_Next], "Next", 1, NULL);
+      if(res) goto finally;
+    }
 
   /* pyexception:  we had an exception in python code */
   assert(PyErr_Occurred());
@@ -1427,12 +2083,15 @@ apswvtabClose(sqlite3_vtab_cursor *pCursor)
   PyObject *cursor, *res=NULL;
   PyGILState_STATE gilstate;
   char **zErrMsgLocation=&(pCursor->pVtab->zErrMsg); /* we free pCursor but still need this field */
-  int sqliteres=SQLITE_OK;
+  int sqliteres=SQLITE_OK, i;
 
   gilstate=PyGILState_Ensure();
 
   cursor=((apsw_vtable_cursor*)pCursor)->cursor;
 
+  Py_CLEAR(((apsw_vtable_cursor*)pCursor)->rows);
+  for(i=0;i<CM_COUNT;i++)
+    APSWMethodCache_clear(&((apsw_vtable_cursor*)pCursor)->methods[i]);
   res=Call_PythonMethod(cursor, "Close", 1, NULL);
   PyMem_Free(pCursor); /* always free */
   if(res) goto finally;
@@ -1465,7 +2124,15 @@ apswvtabRowid(sqlite3_vtab_cursor *pCursor, sqlite3_int64 *pRowid)
 
   cursor=((apsw_vtable_cursor*)pCursor)->cursor;
 
-  res=Call_PythonMethod(cursor, "Rowid", 1, NULL);
+  if(((apsw_vtable_cursor*)pCursor)->userows)
+    {
+      PyObject *row=apswvtabCurrentRow((apsw_vtable_cursor*)pCursor, 0);
+      if(!row) goto pyexception;
+      res=PySequence_Fast_GET_ITEM(row, 0);
+      Py_INCREF(res);
+    }
+  else
+    res=Call_PythonMethodCached(cursor, &((apsw_vtable_cursor*)pCursor)->methods[CM_Rowid], "Rowid", 1, NULL);
   if(!res) goto pyexception;
 
   /* extract result */
@@ -1491,6 +2158,29 @@ apswvtabRowid(sqlite3_vtab_cursor *pCursor, sqlite3_int64 *pRowid)
 
 
 
+/** .. method:: Rows() -> sequence of rows
+
+  This method is optional.  If your cursor has it then it is used
+  instead of :meth:`~VTCursor.Eof`, :meth:`~VTCursor.Next`,
+  :meth:`~VTCursor.Column` and :meth:`~VTCursor.Rowid`, avoiding
+  calls into Python for each row and column.
+
+  It is called after :meth:`~VTCursor.Filter` and then again each
+  time SQLite has used all the rows previously returned.  Return a
+  sequence of rows with each row being a tuple or list whose first
+  item is the rowid followed by the column values.  Return an empty
+  sequence or None when there are no more rows.  How many rows to
+  return each time is up to you - a few hundred is a good choice.
+  Column -1 (the rowid) also comes from the first item.
+
+  .. code-block:: python
+
+    def Rows(self):
+        block=self.data[self.pos:self.pos+500]
+        self.pos+=len(block)
+        return block
+*/
+
 /* it would be nice to use C99 style initializers here ... */
 static struct sqlite3_module apsw_vtable_module=
   {
@@ -322,6 +322,7 @@ class APSW(unittest.TestCase):
         'createaggregatefunction': 2,
         'createcollation': 2,
         'createscalarfunction': 3,
+        'createwindowfunction': 2,
         'collationneeded': 1,
         'setauthorizer': 1,
         'setbusyhandler': 1,
@@ -336,6 +337,7 @@ class APSW(unittest.TestCase):
         'filecontrol': 3,
         'setexectrace': 1,
         'setrowtrace': 1,
+        'setrowfactory': 1,
         '__enter__': 0,
         '__exit__': 3,
         'backup': 3,
@@ -344,13 +346,24 @@ class APSW(unittest.TestCase):
         'readonly': 1,
         'db_filename': 1,
         'set_last_insert_rowid': 1,
+        'set_statement_pool_depth': 1,
+        'set_blob_pool': 1,
+        'set_query_stats': 1,
+        'set_statement_cache_budget': 1,
+        'prepare': 1,
         }
 
     cursor_nargs = {
         'execute': 1,
         'executemany': 2,
+        'fetchinto': 2,
+        'executemanycolumns': 3,
+        'importcsv': 2,
+        'fetchinserts': 1,
+        'columnview': 1,
         'setexectrace': 1,
         'setrowtrace': 1,
+        'setrowfactory': 1,
     }
 
     blob_nargs = {'write': 1, 'read': 1, 'readinto': 1, 'reopen': 1, 'seek': 2}
@@ -783,6 +796,500 @@ class APSW(unittest.TestCase):
         self.assertEqual(c.fetchall(), [])
         self.assertEqual(c.execute("select 3; select 4").fetchall(), [(3, ), (4, )])
 
+    def testFetchMany(self):
+        "Check batched fetching with fetchmany and fetchall"
+        c = self.db.cursor()
+        self.assertRaises(TypeError, c.fetchmany, "3")
+        self.assertRaises(ValueError, c.fetchmany, -1)
+        self.assertEqual(c.fetchmany(), [])
+        self.assertEqual(c.fetchmany(10), [])
+        c.execute("create table foo(w,x,y,z)")
+        vals = [(i, i * 1.5, u(r"\N{LATIN SMALL LETTER E WITH CIRCUMFLEX}") * (i % 7), b(r"\x01\x02" * (i % 5)) if i % 3 else None)
+                for i in range(1000)]
+        c.executemany("insert into foo values(?,?,?,?)", vals)
+        expected = c.execute("select * from foo order by w").fetchall()
+        self.assertEqual(expected, [tuple(v) for v in vals])
+        self.assertEqual(expected, list(c.execute("select * from foo order by w")))
+        # various sizes including across batch boundaries
+        for size in (0, 1, 2, 63, 64, 65, 129, 999, 1000, 5000):
+            c.execute("select * from foo order by w")
+            got = []
+            while True:
+                rows = c.fetchmany(size=size)
+                self.assertTrue(len(rows) <= size)
+                got.extend(rows)
+                if len(rows) < size or not size:
+                    break
+            if size:
+                self.assertEqual(got, expected)
+                self.assertEqual(c.fetchmany(size), [])
+        # mixing with next
+        c.execute("select * from foo order by w")
+        self.assertEqual(next(c), expected[0])
+        self.assertEqual(c.fetchmany(10), expected[1:11])
+        self.assertEqual(c.fetchone(), expected[11])
+        self.assertEqual(c.fetchall(), expected[12:])
+        # multiple statements (with different numbers of columns) and empty ones
+        self.assertEqual(c.execute("select 1; ; select 2,3 union all select 4,5; select 6").fetchmany(10), [(1, ), (2, 3),
+                                                                                                           (4, 5), (6, )])
+        self.assertEqual(c.execute("select 1; create table bar(x); select 2").fetchall(), [(1, ), (2, )])
+        # executemany
+        self.assertEqual(c.executemany("select ?", [(i, ) for i in range(200)]).fetchall(), [(i, ) for i in range(200)])
+        # large values are handled directly and not copied into the batch
+        big = b(r"\xaa" * 1000000)
+        c.execute("create table big(x)")
+        c.executemany("insert into big values(?)", [(big, ), (3, ), (big, ), (u("a") * 300000, ), (None, )])
+        self.assertEqual(c.execute("select * from big").fetchall(), [(big, ), (3, ), (big, ), (u("a") * 300000, ),
+                                                                     (None, )])
+        # row tracer still gets called for each row
+        counter = [0]
+
+        def tracefunc(cursor, row):
+            self.assertEqual(cursor.getdescription()[0][0], "w")
+            counter[0] += 1
+            if counter[0] % 2:
+                return None
+            return row
+
+        c.setrowtrace(tracefunc)
+        self.assertEqual(c.execute("select * from foo order by w").fetchmany(10), expected[1:20:2])
+        c.setrowtrace(None)
+        self.assertEqual(counter[0], 20)
+
+        # errors part way through
+        def func(x):
+            if x == 500:
+                1 / 0
+            return x
+
+        self.db.createscalarfunction("func", func)
+        c.execute("select func(w) from foo")
+        self.assertEqual(c.fetchmany(10), [(i, ) for i in range(10)])
+        self.assertRaises(ZeroDivisionError, c.fetchall)
+        self.assertEqual(c.fetchall(), [])
+        self.assertRaises(apsw.SQLError, c.execute("select 3; create table bar(x); select 4").fetchall)
+
+    def testFetchInto(self):
+        "Check columnar fetching into buffers"
+        import array
+        # Python 2 has no 'q' typecode
+        try:
+            array.array('q')
+            q = 'q'
+        except ValueError:
+            q = 'l'
+        if array.array(q).itemsize != 8:
+            return
+        c = self.db.cursor()
+        c.execute("create table foo(w,x,y,z)")
+        vals = [(i, i * 1.5, u(r"\N{LATIN SMALL LETTER E WITH CIRCUMFLEX}") * (i % 7), b(r"\x01\x02" * (i % 5)) if i % 3 else None)
+                for i in range(1000)]
+        c.executemany("insert into foo values(?,?,?,?)", vals)
+        ints = array.array(q, [0] * 70)
+        floats = array.array('d', [0] * 100)
+        toffsets = array.array(q, [0] * 101)
+        tdata = bytearray(1000)
+        boffsets = array.array(q, [0] * 101)
+        bdata = bytearray(1000)
+        buffers = [ints, floats, (toffsets, tdata), (boffsets, bdata)]
+        # not executed
+        self.assertEqual(c.fetchinto("iftb", buffers), 0)
+        c.execute("select * from foo order by w")
+        # bad parameters
+        self.assertRaises(TypeError, c.fetchinto, "iftb")
+        self.assertRaises(TypeError, c.fetchinto, 3, buffers)
+        self.assertRaises(TypeError, c.fetchinto, "iftb", 3)
+        self.assertRaises(ValueError, c.fetchinto, "ift", buffers)
+        self.assertRaises(ValueError, c.fetchinto, "iftbi", buffers)
+        self.assertRaises(ValueError, c.fetchinto, "iftx", buffers)
+        self.assertRaises(ValueError, c.fetchinto, "iftb", buffers[:3])
+        self.assertRaises(ValueError, c.fetchinto, "ift-", buffers)
+        self.assertRaises(TypeError, c.fetchinto, "iftb", [ints, floats, tdata, (boffsets, bdata)])
+        self.assertRaises(TypeError, c.fetchinto, "iftb", [ints, floats, (toffsets, tdata), (boffsets, u("abc"))])
+        self.assertRaises(ValueError, c.fetchinto, "iftb", [array.array(q), floats, (toffsets, tdata), (boffsets, bdata)])
+        self.assertRaises(ValueError, c.fetchinto, "i---", [array.array(q, [0] * 0)])
+        got = []
+        while True:
+            n = c.fetchinto("iftb", buffers)
+            # limited by ints, offsets or text space
+            self.assertTrue(0 <= n <= 70)
+            if not n:
+                break
+            for i in range(n):
+                got.append((ints[i], floats[i], bytes(tdata[toffsets[i]:toffsets[i + 1]]).decode("utf8"),
+                            bytes(bdata[boffsets[i]:boffsets[i + 1]])))
+        self.assertEqual(len(got), len(vals))
+        for g, v in zip(got, vals):
+            self.assertEqual(g[:3], v[:3])
+            self.assertEqual(g[3], bytes(v[3] or b("")))
+        self.assertEqual(c.fetchinto("iftb", buffers), 0)
+        # skipping, mixing with other fetches, and conversions
+        c.execute("select * from foo order by w")
+        self.assertEqual(next(c), vals[0])
+        self.assertEqual(c.fetchinto("-i--", [ints]), 70)
+        self.assertEqual(list(ints), [int(1.5 * i) for i in range(1, 71)])
+        self.assertEqual(c.fetchinto("f---", [floats]), 100)
+        self.assertEqual(list(floats), [float(i) for i in range(71, 171)])
+        self.assertEqual(c.fetchone(), vals[171])
+        # nulls become zero/empty
+        self.assertEqual(c.execute("select null, null, null, 3").fetchinto("iftt", [ints, floats, (toffsets, tdata), (boffsets, bdata)]), 1)
+        self.assertEqual((ints[0], floats[0], toffsets[1], bytes(bdata[:boffsets[1]])), (0, 0.0, 0, bytes(b("3"))))
+        # value too large for buffer stays available
+        c.execute("select x'aabbcc' union all select x'aabbccdd'")
+        self.assertEqual(c.fetchinto("b", [(boffsets, bytearray(3))]), 1)
+        self.assertRaises(ValueError, c.fetchinto, "b", [(boffsets, bytearray(3))])
+        self.assertEqual(c.fetchall(), [(b(r"\xaa\xbb\xcc\xdd"), )])
+        # multiple statements with different columns and empty ones
+        c.execute("select 1; ; create table bar(x); select 2,3 union all select 4,5; select 6")
+        self.assertEqual(c.fetchinto("i", [ints]), 1)
+        self.assertEqual(ints[0], 1)
+        self.assertRaises(ValueError, c.fetchinto, "i", [ints])
+        self.assertEqual(c.fetchinto("if", [ints, floats]), 2)
+        self.assertEqual((ints[0], ints[1], floats[0], floats[1]), (2, 4, 3.0, 5.0))
+        self.assertEqual(c.fetchinto("t", [(toffsets, tdata)]), 1)
+        self.assertEqual(bytes(tdata[:toffsets[1]]), bytes(b("6")))
+        self.assertEqual(c.fetchinto("t", [(toffsets, tdata)]), 0)
+        # executemany
+        c.executemany("select ?", [(i, ) for i in range(200)])
+        total = 0
+        while True:
+            n = c.fetchinto("i", [ints])
+            if not n:
+                break
+            self.assertEqual(list(ints[:n]), list(range(total, total + n)))
+            total += n
+        self.assertEqual(total, 200)
+
+        # errors part way through
+        def func(x):
+            if x == 500:
+                1 / 0
+            return x
+
+        self.db.createscalarfunction("func", func)
+        c.execute("select func(w) from foo")
+        self.assertRaises(ZeroDivisionError, c.fetchinto, "f", [array.array('d', [0] * 1000)])
+        self.assertEqual(c.fetchinto("i", [ints]), 0)
+
+        # the buffers can't be resized while rows are copied into them
+        resized = []
+
+        def resize(x):
+            try:
+                tdata.extend(b("x"))
+                resized.append(True)
+            except BufferError:
+                resized.append(False)
+            return x
+
+        self.db.createscalarfunction("resize", resize)
+        c.execute("select resize(w), 'a' from foo limit 3")
+        del resized[:]
+        self.assertEqual(c.fetchinto("it", [ints, (toffsets, tdata)]), 3)
+        self.assertEqual(resized, [False, False])
+        self.assertEqual(bytes(tdata[:toffsets[3]]), bytes(b("aaa")))
+        tdata.extend(b("x"))
+
+    def testColumnView(self):
+        "Check zero copy access to column values"
+        import hashlib
+        c = self.db.cursor()
+        big = b(r"\x01\x02\x00\xff" * 250000)
+        text = u(r"\u1234 some text \u0001 \U0001f600")
+        c.execute("create table foo(b,t,i,n)")
+        c.execute("insert into foo values(?,?,3,null)", (big, text))
+        c.execute("insert into foo values(x'', '', 4.5, null)")
+        self.assertRaises(apsw.ExecutionCompleteError, c.columnview, 0)
+        c.execute("select * from foo order by i")
+        # the row hasn't been returned yet
+        self.assertRaises(ValueError, c.columnview, 0)
+        c.fetchone()
+        self.assertRaises(TypeError, c.columnview, "0")
+        self.assertRaises(IndexError, c.columnview, 4)
+        self.assertRaises(IndexError, c.columnview, -1)
+        self.assertRaises(TypeError, c.columnview, 2)
+        self.assertEqual(c.columnview(3), None)
+        v = c.columnview(0)
+        self.assertEqual(len(v), len(big))
+        self.assertEqual(v.tobytes(), bytes(big))
+        self.assertEqual(hashlib.sha1(v).hexdigest(), hashlib.sha1(big).hexdigest())
+        t = c.columnview(1)
+        self.assertEqual(t.tobytes(), text.encode("utf8"))
+        # exported buffers pin the row
+        m = memoryview(t)
+        self.assertEqual(m.tobytes(), text.encode("utf8"))
+        self.assertRaises(BufferError, c.fetchone)
+        self.assertRaises(BufferError, c.fetchall)
+        self.assertRaises(BufferError, c.execute, "select 3")
+        self.assertRaises(BufferError, c.close)
+        del m
+        # stale after moving on
+        for row in c:
+            self.assertEqual(len(c.columnview(0)), 0)
+            self.assertEqual(c.columnview(1).tobytes(), bytes(b("")))
+            self.assertRaises(TypeError, c.columnview, 2)
+        for view in v, t:
+            self.assertRaises(ValueError, len, view)
+            self.assertRaises(ValueError, view.tobytes)
+            self.assertRaises(ValueError, memoryview, view)
+        self.assertRaises(apsw.ExecutionCompleteError, c.columnview, 0)
+        # batches leave the last row returned current
+        c.execute("select 'a' union all select 'b' union all select 'c'")
+        self.assertEqual(c.fetchmany(2), [("a", ), ("b", )])
+        self.assertEqual(c.columnview(0).tobytes(), bytes(b("b")))
+        self.assertEqual(c.fetchall(), [("c", )])
+        # closing
+        c.execute("select 'a' union all select 'b'")
+        next(c)
+        v = c.columnview(0)
+        c.close()
+        self.assertRaises(ValueError, v.tobytes)
+        self.assertRaises(apsw.CursorClosedError, c.columnview, 0)
+
+    def testExecuteManyColumns(self):
+        "Check bulk execution from column buffers"
+        import array
+        try:
+            array.array('q')
+            q = 'q'
+        except ValueError:
+            q = 'l'
+        if array.array(q).itemsize != 8:
+            return
+        c = self.db.cursor()
+        c.execute("create table foo(w,x,y,z)")
+        vals = [(i, i * 1.5, u(r"\N{LATIN SMALL LETTER E WITH CIRCUMFLEX}") * (i % 7), b(r"\x01\x02" * (i % 5)))
+                for i in range(1000)]
+        ints = array.array(q, [v[0] for v in vals])
+        floats = array.array('d', [v[1] for v in vals])
+        toffsets = array.array(q, [0])
+        tdata = bytearray()
+        boffsets = array.array(q, [0])
+        bdata = bytearray()
+        for v in vals:
+            tdata.extend(v[2].encode("utf8"))
+            toffsets.append(len(tdata))
+            bdata.extend(bytes(v[3]))
+            boffsets.append(len(bdata))
+        buffers = [ints, floats, (toffsets, bytes(tdata)), (boffsets, bdata)]
+        sql = "insert into foo values(?,?,?,?)"
+        # bad parameters
+        self.assertRaises(TypeError, c.executemanycolumns, sql, "iftb")
+        self.assertRaises(TypeError, c.executemanycolumns, sql, "iftb", 3)
+        self.assertRaises(ValueError, c.executemanycolumns, sql, "ift", buffers)
+        self.assertRaises(ValueError, c.executemanycolumns, sql, "ift-", buffers)
+        self.assertRaises(ValueError, c.executemanycolumns, sql, "iftx", buffers)
+        self.assertRaises(ValueError, c.executemanycolumns, sql, "iftb", buffers[:3])
+        self.assertRaises(TypeError, c.executemanycolumns, sql, "iftb", [ints, floats, tdata, (boffsets, bdata)])
+        self.assertRaises(ValueError, c.executemanycolumns, sql + "; select 3", "iftb", buffers)
+        self.assertRaises(apsw.SQLError, c.executemanycolumns, "insert into nosuchtable values(?)", "i", [ints])
+        self.assertRaises(ValueError, c.executemanycolumns, "select ?", "t", [(array.array(q, [0, 10]), b("abc"))])
+        self.assertRaises(ValueError, c.executemanycolumns, "select ?", "t", [(array.array(q, [2, 1]), b("abc"))])
+        self.assertRaises(ValueError, c.executemanycolumns, "select ?", "t", [(array.array(q, [-1, 1]), b("abc"))])
+        self.assertEqual(c.execute("select count(*) from foo").fetchall(), [(0, )])
+        # the real thing
+        self.assertEqual(c.executemanycolumns(sql, "iftb", buffers), 1000)
+        self.assertEqual(c.execute("select * from foo order by w").fetchall(), vals)
+        # limited by smallest buffer, and statements returning rows
+        self.assertEqual(c.executemanycolumns("select ?, ?", "if", [ints, floats[:10]]), 10)
+        self.assertEqual(c.executemanycolumns("select ?", "i", [array.array(q)]), 0)
+        self.assertEqual(c.executemanycolumns("", "", []), 0)
+        # cursor is usable afterwards
+        self.assertEqual(c.execute("select 3").fetchall(), [(3, )])
+        # text and blobs are not confused
+        c.execute("delete from foo")
+        self.assertEqual(c.executemanycolumns("insert into foo(w,x) values(?,?)", "bt", [(boffsets, bdata), (boffsets, bdata)]), 1000)
+        self.assertEqual(c.execute("select typeof(w), typeof(x), count(*) from foo group by 1,2").fetchall(), [("blob", "text", 1000)])
+
+        # errors part way through
+        def func(x):
+            if x == 500:
+                1 / 0
+            return x
+
+        self.db.createscalarfunction("func", func)
+        c.execute("delete from foo")
+        self.assertRaises(ZeroDivisionError, c.executemanycolumns, "insert into foo(w) values(func(?))", "i", [ints])
+        self.assertEqual(c.execute("select count(*) from foo").fetchall(), [(500, )])
+        c.execute("create unique index foo_w on foo(w)")
+        self.assertRaises(apsw.ConstraintError, c.executemanycolumns, "insert into foo(w) values(?)", "i", [ints])
+        self.assertEqual(c.execute("select count(*) from foo").fetchall(), [(500, )])
+        c.execute("drop index foo_w; delete from foo")
+
+        # the buffers can't be resized while rows are executed
+        resized = []
+
+        def resize(x):
+            try:
+                bdata.extend(b("x"))
+                resized.append(True)
+            except BufferError:
+                resized.append(False)
+            return x
+
+        self.db.createscalarfunction("resize", resize)
+        self.assertEqual(c.executemanycolumns("insert into foo(w, z) values(resize(?), ?)", "ib", [ints[:3], (boffsets, bdata)]), 3)
+        self.assertEqual(resized, [False] * 3)
+        self.assertEqual(c.execute("select z from foo order by w").fetchall(), [(v[3], ) for v in vals[:3]])
+        bdata.extend(b("x"))
+
+        # and offsets changed while running are checked again
+        def corrupt(x):
+            if x == 2:
+                boffsets[4] = 10**9
+            return x
+
+        self.db.createscalarfunction("corrupt", corrupt)
+        self.assertRaises(apsw.RangeError, c.executemanycolumns, "insert into foo(w, z) values(corrupt(?), ?)", "ib", [ints, (boffsets, bdata)])
+        self.assertEqual(c.execute("select count(*) from foo").fetchall(), [(3 + 3, )])
+
+    def testImportCSV(self):
+        "Check importing delimited text"
+        import csv
+
+        class Source:
+            # returns the data in pieces of size (ignoring what was asked for)
+            def __init__(self, data, size=7):
+                self.data = data
+                self.size = size
+
+            def read(self, n):
+                res = self.data[:self.size]
+                self.data = self.data[self.size:]
+                return res
+
+        c = self.db.cursor()
+        c.execute("create table foo(x,y,z)")
+        sql = "insert into foo values(?,?,?)"
+        text = u('a,b,c\r\n1,"two, and ""quoted""",\r\n"multi\nline",x"y,3\n\n') + u(r"\N{LATIN SMALL LETTER E WITH CIRCUMFLEX}") + u(',"",""z\r')
+        expected = None
+        if py3:
+            import io
+            expected = [tuple(row) for row in csv.reader(io.StringIO(text, newline="")) if row]
+        # compare against the csv module with both text and bytes, at various chunk sizes
+        for size in 1, 2, 3, 7, 1000:
+            for data in text, text.encode("utf8"):
+                c.execute("delete from foo")
+                self.assertEqual(c.importcsv(Source(data, size), sql), 4)
+                got = c.execute("select * from foo").fetchall()
+                if expected is not None:
+                    self.assertEqual(got, expected)
+                self.assertEqual(got[1], ("1", 'two, and "quoted"', ""))
+                self.assertEqual(got[2], ("multi\nline", 'x"y', "3"))
+        # skip, nullempty and converters
+        c.execute("delete from foo")
+        self.assertEqual(c.importcsv(Source(text), sql, skip=1, nullempty=True, converters=[None, len, None]), 3)
+        self.assertEqual(c.execute("select * from foo").fetchall()[:2], [("1", 17, None), ("multi\nline", 3, "3")])
+        # without quoting and another delimiter
+        c.execute("delete from foo")
+        self.assertEqual(c.importcsv(Source('a|"b|c"\n"|"|"\n'), sql, delimiter="|", quoting=False), 2)
+        self.assertEqual(c.execute("select * from foo").fetchall(), [("a", '"b', 'c"'), ('"', '"', '"')])
+        # batches - all rows end up in the table and there is no transaction left open
+        c.execute("delete from foo")
+        rows = "".join(["%d,%d,%d\n" % (i, i, i) for i in range(1000)])
+        self.assertEqual(c.importcsv(Source(rows, 100), sql, batch=7, converters=[int, None, None]), 1000)
+        self.assertTrue(self.db.getautocommit())
+        self.assertEqual(c.execute("select count(*), sum(x) from foo").fetchall(), [(1000, 499500)])
+        c.execute("delete from foo")
+        self.assertEqual(c.importcsv(Source(rows, 100), sql, batch=0), 1000)
+        # bad parameters
+        self.assertRaises(TypeError, c.importcsv, Source(rows))
+        self.assertRaises(TypeError, c.importcsv, Source(rows), sql, delimiter=3)
+        self.assertRaises(ValueError, c.importcsv, Source(rows), sql, delimiter="ab")
+        self.assertRaises(ValueError, c.importcsv, Source(rows), sql, delimiter="\n")
+        self.assertRaises(ValueError, c.importcsv, Source(rows), sql, skip=-1)
+        self.assertRaises(ValueError, c.importcsv, Source(rows), sql, converters=[None])
+        self.assertRaises(TypeError, c.importcsv, Source(rows), sql, converters=[None, 3, None])
+        self.assertRaises(ValueError, c.importcsv, Source(rows), "select 3")
+        self.assertRaises(ValueError, c.importcsv, Source(rows), sql + "; select 3")
+        self.assertRaises(AttributeError, c.importcsv, 3, sql)
+        self.assertRaises(TypeError, c.importcsv, Source([1, 2, 3]), sql)
+        self.assertEqual(c.importcsv(Source(rows), ""), 0)
+        # errors part way through roll back the batch
+        c.execute("delete from foo")
+        self.assertRaises(ValueError, c.importcsv, Source(rows + "1,2\n"), sql)
+        self.assertEqual(c.execute("select count(*) from foo").fetchall(), [(0, )])
+        self.assertRaises(ValueError, c.importcsv, Source(rows + "1,2\n", 100), sql, batch=100)
+        self.assertEqual(c.execute("select count(*) from foo").fetchall(), [(900, )])
+        c.execute("delete from foo")
+        self.assertRaises(ZeroDivisionError, c.importcsv, Source(rows), sql, converters=[lambda x: 1 / (int(x) - 500), None, None])
+        self.assertEqual(c.execute("select count(*) from foo").fetchall(), [(0, )])
+        c.execute("create unique index foo_x on foo(x)")
+        self.assertRaises(apsw.ConstraintError, c.importcsv, Source(rows + rows), sql, batch=0)
+        self.assertEqual(c.execute("select count(*) from foo").fetchall(), [(1000, )])
+        # cursor is usable afterwards
+        self.assertEqual(c.execute("select 3").fetchall(), [(3, )])
+
+    def testFetchInserts(self):
+        "Check formatting rows as SQL inserts"
+        c = self.db.cursor()
+        vals = [None, 0, 1, -1, 2**63 - 1, -2**63, 0.0, -0.0, 0.1, 1.0 / 3, 1e15, 1e16, 123456789.125, 1e-4, 1e-5, 1.5e300,
+                5e-324, -2.5e-12, u(""), u("a'b''c"), u(r"nul\x00in\x00middle\x00"), u(r"\N{LATIN SMALL LETTER E WITH CIRCUMFLEX}") + "'",
+                b(""), b(r"\x00\x01\xfe\xff")]
+        c.execute("create table foo(x); create table bar(x)")
+        c.executemany("insert into foo values(?)", [(v, ) for v in vals])
+
+        def fmt(v):
+            # Python 2 format_sql_value uses str() for floats not repr()
+            if isinstance(v, float):
+                return repr(v)
+            return apsw.format_sql_value(v)
+
+        expected = "".join(["INSERT INTO bar VALUES(%s);\n" % (fmt(v), ) for v in vals])
+        c.execute("select * from foo")
+        self.assertEqual(c.fetchinserts("bar", maxbytes=1 << 20), expected)
+        self.assertEqual(c.fetchinserts("bar"), "")
+        # round trip
+        c.execute(expected)
+        self.assertEqual(c.execute("select * from foo").fetchall(), c.execute("select * from bar").fetchall())
+        # small chunks, multiple columns and statements
+        c.execute("delete from bar")
+        pieces = []
+        c.execute("select x, x from foo; select 1; select 'two', 3")
+        while True:
+            piece = c.fetchinserts('"bar"', 40)
+            if not piece:
+                break
+            pieces.append(piece)
+        self.assertTrue(len(pieces) > 10)
+        text = "".join(pieces)
+        self.assertEqual(text.count("\n"), len(vals) + 2)
+        self.assertTrue(text.endswith('INSERT INTO "bar" VALUES(1);\nINSERT INTO "bar" VALUES(\'two\',3);\n'))
+        self.assertEqual(c.fetchinserts("bar"), "")
+        # mixing with other fetching
+        c.execute("select x from foo")
+        self.assertEqual(next(c), (None, ))
+        self.assertEqual(c.fetchinserts("t", 1), "INSERT INTO t VALUES(0);\n")
+        self.assertEqual(c.fetchone(), (1, ))
+        # errors
+        self.assertRaises(TypeError, c.fetchinserts)
+        self.assertRaises(TypeError, c.fetchinserts, 3)
+        self.assertRaises(ValueError, c.fetchinserts, "t", 0)
+        self.db.createscalarfunction("fail", lambda x: 1 / x)
+        c.execute("select fail(1) union all select fail(0)")
+        self.assertRaises(ZeroDivisionError, c.fetchinserts, "t")
+        self.assertEqual(c.execute("select 3").fetchall(), [(3, )])
+        # floats must not use the locale decimal point
+        import locale
+        orig = locale.setlocale(locale.LC_NUMERIC)
+        try:
+            for name in ("de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "fr_FR.utf8", "nl_NL.UTF-8", "ru_RU.UTF-8"):
+                try:
+                    locale.setlocale(locale.LC_NUMERIC, name)
+                except locale.Error:
+                    continue
+                if locale.localeconv()["decimal_point"] != ".":
+                    break
+            else:
+                return
+            floats = [1.5, -1.5, 0.1, 1e-7, 1e20, 123456789.125, -2.5e-12] + [random.uniform(-1e6, 1e6) for _ in range(100)]
+            c.execute("delete from bar")
+            c.executemany("insert into bar values(?)", [(v, ) for v in floats])
+            c.execute("select * from bar")
+            self.assertEqual(c.fetchinserts("bar"), "".join(["INSERT INTO bar VALUES(%s);\n" % (repr(v), ) for v in floats]))
+        finally:
+            locale.setlocale(locale.LC_NUMERIC, orig)
+
     def testTypes(self):
         "Check type information is maintained"
         c = self.db.cursor()
@@ -1227,6 +1734,94 @@ class APSW(unittest.TestCase):
         self.assertEqual(traced, [False, False])
         self.assertEqual(self.db.getrowtrace(), contrace)
 
+    def testRowFactory(self):
+        "Verify row factories"
+        c = self.db.cursor()
+        c.execute("create table foo(x,y,z)")
+        c.executemany("insert into foo values(?,?,?)", [(i, "s%d" % i, i * 0.5) for i in range(500)])
+        self.assertEqual(self.db.getrowfactory(), "tuple")
+        self.assertEqual(c.getrowfactory(), None)
+        for bad in (3, b"dict" if py3 else u"dic\u00e9t", "dictionary"):
+            self.assertRaises((TypeError, ValueError), c.setrowfactory, bad)
+            self.assertRaises((TypeError, ValueError), self.db.setrowfactory, bad)
+        self.db.setrowfactory(None)
+        self.assertEqual(self.db.getrowfactory(), "tuple")
+
+        expected = [(i, "s%d" % i, i * 0.5) for i in range(500)]
+        sql = "select x,y,z from foo order by x"
+        # each kind via iteration, fetchone and the batched fetchall/fetchmany
+        for factory, convert in (
+            ("tuple", lambda r: r),
+            ("dict", lambda r: {"x": r[0], "y": r[1], "z": r[2]}),
+            ("row", lambda r: r),
+        ):
+            c.setrowfactory(factory)
+            self.assertEqual(c.getrowfactory(), factory)
+            want = [convert(r) for r in expected]
+            self.assertEqual([r for r in c.execute(sql)], want)
+            self.assertEqual(c.execute(sql).fetchall(), want)
+            c.execute(sql)
+            self.assertEqual(c.fetchone(), want[0])
+            self.assertEqual(c.fetchmany(7), want[1:8])
+            self.assertEqual(c.fetchall(), want[8:])
+
+        # row behaviour
+        c.setrowfactory("row")
+        row = c.execute("select 1 as one, 'two' as two, 1 as one, null as [hello world]").fetchall()[0]
+        self.assertEqual(row, (1, "two", 1, None))
+        self.assertEqual(len(row), 4)
+        self.assertEqual(row.one, 1)
+        self.assertEqual(row["two"], "two")
+        self.assertEqual(row["hello world"], None)
+        self.assertEqual(row[-1], None)
+        self.assertEqual(row[1:3], ("two", 1))
+        self.assertEqual(list(row), [1, "two", 1, None])
+        self.assertTrue("two" in row)
+        self.assertEqual(row._fields, ("one", "two", "one", "hello world"))
+        self.assertEqual(row._asdict(), {"one": 1, "two": "two", "hello world": None})
+        self.assertEqual(hash(row), hash((1, "two", 1, None)))
+        self.assertTrue("one=1" in repr(row))
+        self.assertRaises(IndexError, lambda: row[4])
+        self.assertRaises(KeyError, lambda: row["three"])
+        self.assertRaises(AttributeError, lambda: row.three)
+        self.assertRaises(TypeError, lambda: row[1.5])
+        rows = c.execute("select x, y from foo where x<3 order by x").fetchall()
+        self.assertTrue(rows[0]._fields is rows[1]._fields)
+        self.assertTrue(rows[0] < rows[1])
+        self.assertEqual(rows[2], rows[2])
+
+        # dict with duplicate names - first wins
+        c.setrowfactory("dict")
+        self.assertEqual(next(c.execute("select 1 as a, 2 as a, 3 as b")), {"a": 1, "b": 3})
+
+        # scalar
+        c.setrowfactory("scalar")
+        self.assertEqual(next(c.execute("select count(*) from foo")), 500)
+        self.assertEqual(c.execute("select x from foo order by x").fetchall(), list(range(500)))
+        self.assertRaises(ValueError, c.execute("select x, y from foo").fetchall)
+        self.assertRaises(ValueError, lambda: next(c.execute("select x, y from foo")))
+
+        # multiple statements get their own names
+        c.setrowfactory("row")
+        res = c.execute("select 1 as a; select 2 as b").fetchall()
+        self.assertEqual(res[0].a, 1)
+        self.assertEqual(res[1].b, 2)
+
+        # connection default and cursor override
+        self.db.setrowfactory("dict")
+        c2 = self.db.cursor()
+        self.assertEqual(c2.execute("select 1 as a").fetchall(), [{"a": 1}])
+        c2.setrowfactory("tuple")
+        self.assertEqual(c2.execute("select 1 as a").fetchall(), [(1, )])
+        c2.setrowfactory(None)
+        self.assertEqual(c2.execute("select 1 as a").fetchall(), [{"a": 1}])
+
+        # row tracer gets the factory's row
+        c2.setrowtrace(lambda cursor, row: row["a"] * 2)
+        self.assertEqual(c2.execute("select 21 as a").fetchall(), [42])
+        c2.setrowtrace(None)
+        self.db.setrowfactory(None)
+
     def testScalarFunctions(self):
         "Verify scalar functions"
         c = self.db.cursor()
@@ -1475,6 +2070,149 @@ class APSW(unittest.TestCase):
         self.db.createaggregatefunction("badfunc", badfactory)
         self.assertRaises(ZeroDivisionError, c.execute, "select badfunc(x) from foo")
 
+    def testFunctionHints(self):
+        "Verify function argument and return type hints"
+        c = self.db.cursor()
+        got = []
+
+        def func(*args):
+            got.append(args)
+            return args[0]
+
+        self.assertRaises(ValueError, self.db.createscalarfunction, "foo", func, argtypes="ix")
+        self.assertRaises(ValueError, self.db.createscalarfunction, "foo", func, 3, argtypes="ii")
+        self.assertRaises(ValueError, self.db.createscalarfunction, "foo", func, returntype="")
+        self.assertRaises(ValueError, self.db.createscalarfunction, "foo", func, returntype="it")
+        self.assertRaises(ValueError, self.db.createscalarfunction, "foo", func, returntype="?")
+        self.assertRaises(TypeError, self.db.createscalarfunction, "foo", func, argtypes=3)
+        self.assertRaises(ValueError, self.db.createaggregatefunction, "foo", func, argtypes="z")
+        # numargs comes from argtypes
+        self.db.createscalarfunction("foo", func, argtypes="ift?b")
+        self.assertRaises(apsw.SQLError, c.execute, "select foo(1)")
+        got = []
+        c.execute("select foo('12', 3, 4.5, 'x', 'abc')").fetchall()
+        c.execute("select foo(null, null, null, null, null)").fetchall()
+        self.assertEqual(got, [(12, 3.0, u("4.5"), u("x"), b("abc")), (None, None, None, None, None)])
+        self.assertEqual(type(got[0][4]), type(b("abc")))
+        # return types use a fast path when they match and normal handling otherwise
+        for rt, vals in (("i", (3, 2**40, 2**70, 3.5, u("x"), None)), ("f", (3.5, 3, u("x"))),
+                         ("t", (u(r"\u1234x"), 3, b("abc"))), ("b", (b("abc"), u("x"), 7))):
+            for v in vals:
+                self.db.createscalarfunction("ret", lambda: v, 0, returntype=rt)
+                if v == 2**70:
+                    self.assertRaises(OverflowError, c.execute, "select ret()")
+                    continue
+                self.assertEqual(c.execute("select ret()").fetchall(), [(v, )])
+        # more arguments than fit on the stack
+        self.db.createscalarfunction("many", lambda *args: sum(args), argtypes="i" * 20, returntype="i")
+        self.assertEqual(c.execute("select many(" + ",".join(["'%d'" % i for i in range(20)]) + ")").fetchall(),
+                         [(sum(range(20)), )])
+        self.db.createscalarfunction("manyany", lambda *args: len(args))
+        self.assertEqual(c.execute("select manyany(" + ",".join(["%d" % i for i in range(30)]) + ")").fetchall(), [(30, )])
+        # deterministic
+        self.db.createscalarfunction("det", func, 1, deterministic=True, argtypes="i")
+        c.execute("create table foo(x); insert into foo values(1); insert into foo values(2)")
+        self.db.cursor().execute("create index fooidx on foo(det(x))")
+
+        # aggregates
+        class summer:
+
+            def __init__(self):
+                self.total = 0
+
+            def step(self, ctx, x, y):
+                self.total += x + y
+
+            def final(self, ctx):
+                return self.total
+
+        def factory():
+            s = summer()
+            return None, s.step, s.final
+
+        self.db.createaggregatefunction("summer", factory, argtypes="if", returntype="f", deterministic=True)
+        self.assertEqual(c.execute("select summer(x, x) from foo").fetchall(), [(6.0, )])
+        self.assertRaises(apsw.SQLError, c.execute, "select summer(x) from foo")
+        self.assertEqual(c.execute("select summer(x||'', x+1) from foo").fetchall(), [(8.0, )])
+        self.db.createaggregatefunction(name="summer2", factory=factory, numargs=2)
+        self.assertEqual(c.execute("select summer2(x, x) from foo").fetchall(), [(6, )])
+
+    def testWindowFunctions(self):
+        "Verify window functions"
+        c = self.db.cursor()
+        c.execute("create table foo(t, x)")
+        c.executemany("insert into foo values(?,?)", [(i, (i * 7) % 13) for i in range(200)])
+        counts = {"step": 0, "inverse": 0, "value": 0, "final": 0}
+
+        def factory():
+
+            def step(total, x):
+                counts["step"] += 1
+                total[0] += x
+
+            def inverse(total, x):
+                counts["inverse"] += 1
+                total[0] -= x
+
+            def value(total):
+                counts["value"] += 1
+                return total[0]
+
+            def final(total):
+                counts["final"] += 1
+                return total[0]
+
+            return [0], step, final, value, inverse
+
+        self.db.createwindowfunction("movingsum", factory, 1)
+        sql = "select %s(x) over (order by t rows between 9 preceding and current row) from foo order by t"
+        self.assertEqual(c.execute(sql % "movingsum").fetchall(), c.execute(sql % "sum").fetchall())
+        # each row is added and removed once rather than recomputing each frame
+        self.assertEqual(counts["step"], 200)
+        self.assertEqual(counts["inverse"], 190)
+        self.assertEqual(counts["value"], 200)
+        # also works as a plain aggregate
+        self.assertEqual(c.execute("select movingsum(x) from foo").fetchall(), c.execute("select sum(x) from foo").fetchall())
+        # keywords and hints
+        self.db.createwindowfunction(name="hinted", factory=factory, argtypes="i", returntype="i", deterministic=True)
+        self.assertEqual(c.execute((sql % "hinted").replace("x)", "x||'')")).fetchall(), c.execute(sql % "sum").fetchall())
+        self.assertRaises(TypeError, self.db.createwindowfunction, "foo", 12)
+        self.assertRaises(ValueError, self.db.createwindowfunction, "foo", factory, argtypes="z")
+
+        # bad factories
+        def badfactory():
+            return [0], lambda *args: 0, lambda *args: 0
+
+        self.db.createwindowfunction("badfunc", badfactory)
+        self.assertRaises(TypeError, c.execute, "select badfunc(x) over () from foo")
+
+        def badfactory():
+            return [0], lambda *args: 0, lambda *args: 0, 3, lambda *args: 0
+
+        self.db.createwindowfunction("badfunc", badfactory)
+        self.assertRaises(TypeError, c.execute, "select badfunc(x) over () from foo")
+
+        def badfactory():
+            return [0], lambda *args: 0, lambda *args: 0, lambda *args: 0, None
+
+        self.db.createwindowfunction("badfunc", badfactory, 1)
+        self.assertRaises(TypeError, c.execute, "select badfunc(x) over () from foo")
+
+        # exceptions in each function
+        for which in range(1, 5):
+
+            def badfactory():
+                funcs = [[0], lambda *args: 0, lambda *args: 0, lambda *args: 0, lambda *args: 0]
+                funcs[which] = lambda *args: 1 / 0
+                return tuple(funcs)
+
+            self.db.createwindowfunction("badfunc", badfactory, 1)
+            self.assertRaises(ZeroDivisionError, lambda: c.execute(sql % "badfunc").fetchall())
+
+        # deleting
+        self.db.createwindowfunction("movingsum", None, 1)
+        self.assertRaises(apsw.SQLError, c.execute, sql % "movingsum")
+
     def testCollation(self):
         "Verify collations"
         # create a whole bunch to check they are freed
@@ -2064,6 +2802,34 @@ class APSW(unittest.TestCase):
         t.go()
         self.assertEqual(vals["raised"], True)
 
+    def testCheapCallContention(self):
+        "Verify binding and column reads while another thread holds the database mutex"
+        # bindings and column values are done with the GIL held when
+        # the database mutex is free.  A function that sleeps runs
+        # with the mutex held and needs the GIL back afterwards, so
+        # this would deadlock if the mutex were waited for.
+        def slow(x):
+            time.sleep(0.001)
+            return x
+
+        self.db.createscalarfunction("slow", slow)
+        vals = {"stop": False}
+
+        def wt():
+            c = self.db.cursor()
+            while not vals["stop"]:
+                c.execute("select slow(1)").fetchall()
+
+        t = ThreadRunner(wt)
+        t.start()
+        try:
+            c = self.db.cursor()
+            for i in range(2000):
+                self.assertEqual(c.execute("select ?, ?, ?", (i, "abc", i * 1.5)).fetchall(), [(i, "abc", i * 1.5)])
+        finally:
+            vals["stop"] = True
+        t.go()
+
     def testStringsWithNulls(self):
         "Verify that strings with nulls in them are handled correctly"
 
@@ -2476,6 +3242,10 @@ class APSW(unittest.TestCase):
             )
             numbadbextindex = len(badbestindex)
 
+            # the BestIndex methods are swapped and give different
+            # answers to the same question so don't remember them
+            BestIndexCache = False
+
             def __init__(self, data):
                 self.data = data
                 self.bestindex3val = 0
@@ -3096,6 +3866,424 @@ class APSW(unittest.TestCase):
 
         self.assertEqual(oldestmanual, oldestsql)
 
+    def testVTableRows(self):
+        "Verify virtual table cursors returning blocks of rows"
+        data = [(i * 3, i, u("row%d") % i, i * 0.5) for i in range(2345)]
+
+        class Source:
+            def Create(self, db, modulename, dbname, tablename, *args):
+                return "create table foo(a, b, c)", Table()
+
+            Connect = Create
+
+        class Table:
+            def BestIndex(self, *args):
+                return None
+
+            def Open(self):
+                return Cursor()
+
+            def Disconnect(self):
+                pass
+
+            Destroy = Disconnect
+
+        class Cursor:
+            blocksize = 100
+            calls = 0
+
+            def Filter(self, *args):
+                self.pos = 0
+
+            def Rows(self):
+                Cursor.calls += 1
+                res = data[self.pos:self.pos + self.blocksize]
+                self.pos += len(res)
+                return res
+
+            def Column(self, col):
+                1 / 0
+
+            Eof = Next = Rowid = Column
+
+            def Close(self):
+                pass
+
+        self.db.createmodule("rows", Source())
+        c = self.db.cursor()
+        c.execute("create virtual table foo using rows()")
+        self.assertEqual(c.execute("select rowid, a, b, c from foo").fetchall(), data)
+        self.assertEqual(Cursor.calls, 2345 // 100 + 2)
+        self.assertEqual(c.execute("select count(*), sum(a) from foo").fetchall(), [(2345, sum(range(2345)))])
+        # nested looping restarts with Filter
+        self.assertEqual(c.execute("select count(*) from foo as x, foo as y where x.a=y.a").fetchall(), [(2345, )])
+        # other sequence types and ending with None
+        for rows in ([], None, [[1, 2, 3, 4]], ((1, 2, 3, 4), [5, 6, 7, 8])):
+            def Filter(self, *args):
+                self.pos = 0
+
+            def Rows(self, rows=rows):
+                res = rows if self.pos == 0 else None
+                self.pos = 1
+                return res
+
+            Cursor.Filter = Filter
+            Cursor.Rows = Rows
+            expected = [tuple(r) for r in rows] if rows else []
+            self.assertEqual(c.execute("select rowid,* from foo").fetchall(), expected)
+        # bad rows
+        for rows, exc in ((3, TypeError), ([3], TypeError), ([(1, 2)], IndexError), ([()], IndexError),
+                          ([("x", 1, 2, 3)], ValueError), ([(2**70, 1, 2, 3)], OverflowError)):
+
+            def Rows(self, rows=rows):
+                return rows
+
+            Cursor.Rows = Rows
+            self.assertRaises(exc, lambda: c.execute("select rowid,* from foo").fetchall())
+
+        def Rows(self):
+            1 / 0
+
+        Cursor.Rows = Rows
+        self.assertRaises(ZeroDivisionError, c.execute, "select * from foo")
+
+    def testVTableUpdateBatch(self):
+        "Verify virtual table changes delivered in batches"
+        batches = []
+
+        class Source:
+            def Create(self, db, modulename, dbname, tablename, *args):
+                return "create table foo(a, b)", Table()
+
+            Connect = Create
+
+        class Table:
+            data = {}
+
+            def BestIndex(self, *args):
+                return None
+
+            def Open(self):
+                return Cursor(self)
+
+            def UpdateBatch(self, changes):
+                batches.append(len(changes))
+                for change in changes:
+                    getattr(self, change[0])(*change[1:])
+
+            def UpdateDeleteRow(self, rowid):
+                del self.data[rowid]
+
+            def UpdateInsertRow(self, rowid, fields):
+                if rowid is None:
+                    rowid = max(self.data) + 1 if self.data else 1
+                self.data[rowid] = fields
+                return rowid
+
+            def UpdateChangeRow(self, row, newrowid, fields):
+                del self.data[row]
+                self.data[newrowid] = fields
+
+            def Disconnect(self):
+                pass
+
+            Destroy = Disconnect
+
+        class Cursor:
+            def __init__(self, table):
+                self.table = table
+
+            def Filter(self, *args):
+                self.pos = 0
+
+            def Rows(self):
+                res = [(k, ) + v for k, v in sorted(self.table.data.items())][self.pos:self.pos + 100]
+                self.pos += len(res)
+                return res
+
+            def Close(self):
+                pass
+
+        self.db.createmodule("batch", Source())
+        c = self.db.cursor()
+        c.execute("create virtual table foo using batch()")
+        c.execute("create table src(x)")
+        c.executemany("insert into src values(?)", [(i, ) for i in range(1, 2501)])
+        # without UpdateBatchRowid each insert needing a rowid is a separate call
+        c.execute("insert into foo values(1, 2); insert into foo values(3, 4)")
+        self.assertEqual([], batches)
+        self.assertEqual({1: (1, 2), 2: (3, 4)}, Table.data)
+        # with rowids given everything is batched
+        c.execute("insert into foo(rowid, a, b) select x+10, x, 'text' from src")
+        self.assertEqual([1000, 1000, 500], batches)
+        self.assertEqual(2502, c.execute("select count(*) from foo").fetchall()[0][0])
+        del batches[:]
+        Table.UpdateBatchSize = 700
+        c.execute("update foo set b=a*2 where rowid>10")
+        c.execute("delete from foo where rowid>1000")
+        self.assertEqual([1000, 1000, 500, 1000, 510], batches)
+        self.assertEqual(992, c.execute("select count(*) from foo").fetchall()[0][0])
+        self.assertEqual((990, 1980), Table.data[1000])
+        # size is read when the table is connected
+        self.db.close()
+        self.db = apsw.Connection(TESTFILEPREFIX + "testdb")
+        self.db.createmodule("batch", Source())
+        c = self.db.cursor()
+        del batches[:]
+        c.execute("delete from foo where rowid>100")
+        self.assertEqual([700, 200], batches)
+        # rowids counted from UpdateBatchRowid
+        calls = []
+
+        def UpdateBatchRowid(self):
+            calls.append(1)
+            return 10000
+
+        Table.UpdateBatchRowid = UpdateBatchRowid
+        self.db.close()
+        self.db = apsw.Connection(TESTFILEPREFIX + "testdb")
+        self.db.createmodule("batch", Source())
+        c = self.db.cursor()
+        del batches[:]
+        c.execute("insert into foo(a, b) values(1, 1), (2, 2), (3, 3)")
+        self.assertEqual(10002, self.db.last_insert_rowid())
+        self.assertEqual([3], batches)
+        self.assertEqual([(10000, 1), (10001, 2), (10002, 3)],
+                         c.execute("select rowid, a from foo where rowid>=10000").fetchall())
+        # rollback discards pending changes
+        del batches[:]
+        c.execute("begin; insert into foo(rowid, a, b) values(7, 7, 7)")
+        c.execute("rollback")
+        self.assertEqual([], batches)
+        self.assertTrue(7 not in Table.data)
+        # errors
+        def UpdateBatch(self, changes):
+            1 / 0
+
+        Table.UpdateBatch = UpdateBatch
+        self.db.close()
+        self.db = apsw.Connection(TESTFILEPREFIX + "testdb")
+        self.db.createmodule("batch", Source())
+        c = self.db.cursor()
+        self.assertRaises(ZeroDivisionError, c.execute, "insert into foo(rowid, a, b) values(8, 8, 8)")
+        Table.UpdateBatchRowid = lambda self: "three"
+        self.assertRaises(ValueError, c.execute, "insert into foo(a, b) values(8, 8)")
+        Table.UpdateBatchSize = 0
+        self.db.close()
+        self.db = apsw.Connection(TESTFILEPREFIX + "testdb")
+        self.db.createmodule("batch", Source())
+        self.assertRaises(ValueError, self.db.cursor().execute, "select * from foo")
+
+    def testVTableBestIndexCache(self):
+        "Verify remembered BestIndex answers and IN/LIMIT details"
+        calls = []
+        filters = []
+
+        class Source:
+            def Create(self, db, modulename, dbname, tablename, *args):
+                return "create table foo(a, b)", Table() if modulename == "bicache" else NoCacheTable()
+
+            Connect = Create
+
+        class Table:
+            BestIndexDetail = False
+            forcein = False
+
+            def BestIndex(self, constraints, orderbys):
+                calls.append(constraints)
+                used = []
+                kinds = []
+                for c in constraints:
+                    if c[0] == 0 and c[1] == apsw.SQLITE_INDEX_CONSTRAINT_EQ:
+                        isin = self.forcein or (self.BestIndexDetail and c[2])
+                        used.append((len(kinds), True, isin))
+                        kinds.append("in" if isin else "eq")
+                    elif self.BestIndexDetail and c[1] == apsw.SQLITE_INDEX_CONSTRAINT_LIMIT:
+                        used.append((len(kinds), True))
+                        kinds.append("limit")
+                    else:
+                        used.append(None)
+                return used, len(kinds), ",".join(kinds), False, 10 if kinds else 1000
+
+            def Open(self):
+                return Cursor()
+
+            def Disconnect(self):
+                pass
+
+            Destroy = Disconnect
+
+        class NoCacheTable(Table):
+            BestIndexCache = False
+
+        class Cursor:
+            def Filter(self, indexnum, indexname, constraintargs):
+                filters.append((indexname, constraintargs))
+                rows = [(a, a * 2) for a in range(1, 51)]
+                for kind, arg in zip(indexname.split(",") if indexname else [], constraintargs):
+                    if kind == "eq":
+                        rows = [r for r in rows if r[0] == arg]
+                    elif kind == "in":
+                        rows = [r for r in rows if r[0] in arg]
+                    else:
+                        rows = rows[:arg]
+                self.rows = rows
+                self.pos = 0
+
+            def Eof(self):
+                return self.pos >= len(self.rows)
+
+            def Rowid(self):
+                return self.rows[self.pos][0]
+
+            def Column(self, col):
+                return self.rows[self.pos][col] if col >= 0 else self.Rowid()
+
+            def Next(self):
+                self.pos += 1
+
+            def Close(self):
+                pass
+
+        self.db.createmodule("bicache", Source())
+        self.db.createmodule("binocache", Source())
+        c = self.db.cursor()
+        c.execute("create virtual table foo using bicache(); create virtual table bar using binocache()")
+
+        # same question is only asked once - spaces defeat the statement cache
+        for i in range(3):
+            self.assertEqual([(6, )], c.execute("select b from foo where a=3" + " " * i).fetchall())
+        self.assertEqual(1, len(calls))
+        self.assertEqual([("eq", (3, ))] * 3, filters)
+        self.assertEqual([(8, )], c.execute("select b from foo where a = 4").fetchall())
+        self.assertEqual(1, len(calls))
+        self.assertEqual([], c.execute("select b from foo where b=3").fetchall())
+        self.assertEqual(2, len(calls))
+        # without asking for IN values together Filter is called for each
+        del filters[:]
+        self.assertEqual([(2, ), (4, )], c.execute("select b from foo where a in (1, 2)").fetchall())
+        self.assertEqual([("eq", (1, )), ("eq", (2, ))], filters)
+
+        # opted out
+        del calls[:]
+        for i in range(3):
+            self.assertEqual([(6, )], c.execute("select b from bar where a=3" + " " * i).fetchall())
+        self.assertEqual(3, len(calls))
+
+        if apsw.SQLITE_VERSION_NUMBER < 3038000:
+            return
+
+        # details including IN values together and LIMIT
+        Table.BestIndexDetail = True
+        self.db.close()
+        self.db = apsw.Connection(TESTFILEPREFIX + "testdb")
+        self.db.createmodule("bicache", Source())
+        c = self.db.cursor()
+        del calls[:]
+        del filters[:]
+        sql = "select b from foo where a in (1, 2, 3, 4) limit 2"
+        for i in range(2):
+            self.assertEqual([(2, ), (4, )], c.execute(sql + " " * i).fetchall())
+        self.assertEqual(1, len(calls))
+        self.assertIn((0, apsw.SQLITE_INDEX_CONSTRAINT_EQ, True, None), calls[0])
+        self.assertEqual(1, len([con for con in calls[0] if con[1:] == (apsw.SQLITE_INDEX_CONSTRAINT_LIMIT, False, 2)]))
+        # the IN request is remembered too
+        self.assertEqual(2, len(filters))
+        for name, args in filters:
+            self.assertEqual(sorted(zip(name.split(","), args)), [("in", (1, 2, 3, 4)), ("limit", 2)])
+        # limit is only known when constant
+        del calls[:]
+        self.assertEqual([(2, ), (4, ), (6, )], c.execute("select b from foo where a in (1, 2, 3, 4) limit ?", (3, )).fetchall())
+        self.assertEqual(1, len([con for con in calls[0] if con[1:] == (apsw.SQLITE_INDEX_CONSTRAINT_LIMIT, False, None)]))
+        # = isn't an IN
+        self.assertEqual([(14, )], c.execute("select b from foo where a=7").fetchall())
+        self.assertEqual(((0, apsw.SQLITE_INDEX_CONSTRAINT_EQ, False, None), ), calls[-1])
+        Table.forcein = True
+        self.assertRaises(ValueError, c.execute, "select b from foo where a=8 and b=16")
+        Table.forcein = False
+        Table.BestIndexDetail = False
+
+    def testMethodCache(self):
+        "Verify cached methods notice changes"
+
+        class Source:
+            def Create(self, db, modulename, dbname, tablename, *args):
+                return "create table foo(a)", Table()
+
+            Connect = Create
+
+        class Table:
+            def BestIndex(self, *args):
+                return None
+
+            def Open(self):
+                self.cursor = self.cursorclass()
+                return self.cursor
+
+            def Disconnect(self):
+                pass
+
+            Destroy = Disconnect
+
+        class Cursor(object):
+            def Filter(self, *args):
+                self.pos = 0
+
+            def Eof(self):
+                return self.pos >= 4
+
+            def Rowid(self):
+                return self.pos
+
+            def Column(self, col):
+                return 1
+
+            def Next(self):
+                self.pos += 1
+                self.changer()
+
+            def Close(self):
+                pass
+
+        def Column2(self, col):
+            return 2
+
+        def onclass(cursor):
+            if cursor.pos == 2:
+                Cursor.Column = Column2
+
+        def oninstance(cursor):
+            if cursor.pos == 2:
+                cursor.Column = lambda col: 3
+
+        def addremove(cursor):
+            if cursor.pos == 1:
+                cursor.Column = lambda col: 3
+            elif cursor.pos == 3:
+                del cursor.Column
+
+        # attribute lookup that can't be seen from the instance dict
+        class SwitchCursor(Cursor):
+            switched = False
+
+            def __getattribute__(self, name):
+                if name == "Column" and object.__getattribute__(self, "switched"):
+                    return lambda col: 4
+                return object.__getattribute__(self, name)
+
+        def onattribute(cursor):
+            if cursor.pos == 2:
+                cursor.switched = True
+
+        self.db.createmodule("cache", Source())
+        c = self.db.cursor()
+        c.execute("create virtual table foo using cache()")
+        for cursorclass, changer, expected in ((Cursor, onclass, [1, 1, 2, 2]), (Cursor, oninstance, [2, 2, 3, 3]),
+                                               (Cursor, addremove, [2, 3, 3, 2]), (SwitchCursor, onattribute, [2, 2, 4, 4])):
+            Table.cursorclass = cursorclass
+            Cursor.changer = changer
+            self.assertEqual([r[0] for r in c.execute("select a from foo")], expected)
+
     def testClosingChecks(self):
         "Check closed connection is correctly detected"
         cur = self.db.cursor()
@@ -3748,6 +4936,304 @@ class APSW(unittest.TestCase):
         self.db = apsw.Connection(TESTFILEPREFIX + "testdb", statementcachesize=-1)
         self.testStatementCache(-1)
 
+    def testStatementCacheStats(self):
+        "Check statement cache statistics and first statement keying"
+        db = apsw.Connection(":memory:", statementcachesize=3)
+        self.assertRaises(TypeError, db.cache_stats, 3)
+        self.assertEqual(
+            db.cache_stats(), {
+                "size": 3,
+                "budget": 0,
+                "entries": 0,
+                "bytes": 0,
+                "hits": 0,
+                "misses": 0,
+                "misses_inuse": 0,
+                "first_statement_hits": 0,
+                "pool_depth": 2,
+                "pool_hits": 0,
+                "evictions": 0,
+                "reprepares": 0
+            })
+        c = db.cursor()
+        c.execute("create table foo(x)")
+        c.execute("insert into foo values(1),(2)")
+        s = db.cache_stats()
+        self.assertEqual((s["entries"], s["hits"], s["misses"]), (2, 0, 2))
+        # includes memory used by SQLite
+        self.assertTrue(s["bytes"] > len("create table foo(x)") + len("insert into foo values(1),(2)"))
+        c.execute("insert into foo values(1),(2)")
+        self.assertEqual(db.cache_stats()["hits"], 1)
+        # in use by another cursor
+        c2 = db.cursor()
+        c.execute("select x from foo").fetchall()
+        c.execute("select x from foo")
+        c2.execute("select x from foo")
+        s = db.cache_stats()
+        self.assertEqual((s["hits"], s["misses"], s["misses_inuse"]), (2, 4, 1))
+        c.close(True)
+        c2.close(True)
+        c = db.cursor()
+        # evictions
+        for i in range(5):
+            c.execute("select %d" % (i, ))
+        s = db.cache_stats()
+        self.assertEqual((s["entries"], s["evictions"]), (3, 4))
+        # multiple statements are cached by first statement
+        db = apsw.Connection(":memory:")
+        c = db.cursor()
+        self.assertEqual(c.execute("select 1; select 2").fetchall(), [(1, ), (2, )])
+        s = db.cache_stats()
+        self.assertEqual((s["misses"], s["first_statement_hits"]), (2, 0))
+        self.assertEqual(c.execute("select 1; select 3").fetchall(), [(1, ), (3, )])
+        self.assertEqual(db.cache_stats()["first_statement_hits"], 1)
+        self.assertEqual(c.execute("select 1;").fetchall(), [(1, )])
+        self.assertEqual(c.execute("select 1").fetchall(), [(1, )])
+        self.assertEqual(c.execute(" select 3 ;select 4").fetchall(), [(3, ), (4, )])
+        self.assertEqual(c.execute("select ';'; select 5;").fetchall(), [(";", ), (5, )])
+        self.assertEqual(c.execute("select ';'; select 6;").fetchall(), [(";", ), (6, )])
+        # semicolons in quotes and comments
+        for first, value in (("select 'a;'", "a;"), ("select 1 as \"a;\"", 1), ("select 1 as [a;]", 1),
+                             ("select 1 as `a;`", 1), ("select 'a'';'", "a';"), ("select 'a;' -- ;\n", "a;"),
+                             ("select 'a;' /* ; */", "a;"), ("select 'a;'/**/", "a;")):
+            for i in range(2):
+                before = db.cache_stats()["first_statement_hits"]
+                self.assertEqual(c.execute(first + "; select 7").fetchall(), [(value, ), (7, )])
+            self.assertEqual(db.cache_stats()["first_statement_hits"], before + 1)
+        # and triggers are found by sqlite
+        c.execute("create table trig(x); create table trig2(x)")
+        trigger = "create trigger trig_t after insert on trig begin insert into trig2 values(1); insert into trig2 values(2); end"
+        c.execute(trigger + "; insert into trig values(3)")
+        self.assertEqual(c.execute("select x from trig2").fetchall(), [(1, ), (2, )])
+        self.assertEqual(c.execute("drop trigger trig_t; " + trigger.upper() + "; select 8").fetchall(), [(8, )])
+        self.assertEqual(c.executemany("select ?; select ?+1", [(1, 1), (2, 2)]).fetchall(), [(1, ), (2, ), (2, ), (3, )])
+        # large scripts
+        c.execute("create table foo(x)")
+        script = "insert into foo values(3);" * 1000
+        self.assertTrue(len(script) > 16384)
+        before = db.cache_stats()
+        c.execute(script)
+        c.execute(script)
+        after = db.cache_stats()
+        self.assertEqual(c.execute("select count(*) from foo").fetchall(), [(2000, )])
+        self.assertTrue(after["hits"] - before["hits"] > 1990)
+        self.assertTrue(after["misses"] - before["misses"] < 10)
+        # spare copies for nested use of the same query
+        self.assertRaises(TypeError, db.set_statement_pool_depth, "3")
+        self.assertRaises(ValueError, db.set_statement_pool_depth, -1)
+        self.assertRaises(ValueError, db.set_statement_pool_depth, 1001)
+        c.execute("delete from foo; insert into foo values(1),(2),(3)")
+        query = "select x from foo order by x"
+
+        def nested(depth):
+            res = []
+            for (x, ) in db.cursor().execute(query):
+                res.append(x)
+                if depth:
+                    res.extend(nested(depth - 1))
+            return res
+
+        expected = nested(3)
+        self.assertEqual(len(expected), 3 + 9 + 27 + 81)
+        # 40 executions with up to 4 at once.  The first always uses
+        # the cached statement.  With no pool the others are prepared,
+        # and the pool fills up as they finish.
+        for depth, expected_pool_hits in ((0, 0), (5, 36), (5, 39), (2, 36)):
+            db.set_statement_pool_depth(depth)
+            before = db.cache_stats()
+            self.assertEqual(before["pool_depth"], depth)
+            self.assertEqual(nested(3), expected)
+            after = db.cache_stats()
+            self.assertEqual(after["pool_hits"] - before["pool_hits"], expected_pool_hits)
+            self.assertEqual(after["misses"] - before["misses"], 39 - expected_pool_hits)
+        # spares count in the bytes
+        withspares = db.cache_stats()["bytes"]
+        db.set_statement_pool_depth(0)
+        nospares = db.cache_stats()["bytes"]
+        self.assertTrue(nospares < withspares)
+        db.set_statement_pool_depth(2)
+        nested(3)
+        self.assertEqual(db.cache_stats()["bytes"], withspares)
+        # and make it go over budget
+        db.set_statement_cache_budget(nospares)
+        nested(3)
+        self.assertTrue(db.cache_stats()["bytes"] <= nospares)
+        db.set_statement_cache_budget(0)
+        # limit by bytes
+        self.assertRaises(TypeError, db.set_statement_cache_budget, "3")
+        self.assertRaises(ValueError, db.set_statement_cache_budget, -1)
+        self.assertRaises(OverflowError, db.set_statement_cache_budget, 2**80)
+        db.set_statement_cache_budget(100000)
+        s = db.cache_stats()
+        self.assertEqual(s["budget"], 100000)
+        self.assertTrue(s["bytes"] <= 100000)
+        # large queries are cached
+        bigquery = "select x " + " " * 40000 + "from foo"
+        for i in range(3):
+            c.execute(bigquery).fetchall()
+        s = db.cache_stats()
+        c.execute(bigquery).fetchall()
+        self.assertEqual(db.cache_stats()["hits"], s["hits"] + 1)
+        # and expelled when over budget
+        for i in range(200):
+            c.execute("select x, %d from foo" % (i, )).fetchall()
+        s = db.cache_stats()
+        self.assertTrue(s["bytes"] <= 100000)
+        c.execute(bigquery).fetchall()
+        self.assertEqual(db.cache_stats()["misses"], s["misses"] + 1)
+        # reducing evicts immediately
+        db.set_statement_cache_budget(1000)
+        s = db.cache_stats()
+        self.assertTrue(s["bytes"] <= 1000)
+        self.assertTrue(s["entries"] < 10)
+        # back to entries
+        db.set_statement_cache_budget(0)
+        for i in range(200):
+            c.execute("select x, %d from foo" % (i, )).fetchall()
+        self.assertEqual(db.cache_stats()["entries"], 100)
+        # closed
+        db.close()
+        self.assertRaises(apsw.ConnectionClosedError, db.cache_stats)
+        self.assertRaises(apsw.ConnectionClosedError, db.set_statement_pool_depth, 2)
+        self.assertRaises(apsw.ConnectionClosedError, db.set_statement_cache_budget, 2)
+
+    def testPreparedStatement(self):
+        "Check Connection.prepare statements outside the cache"
+        db = apsw.Connection(":memory:")
+        c = db.cursor()
+        self.assertRaises(TypeError, db.prepare)
+        self.assertRaises(TypeError, db.prepare, 3)
+        self.assertRaises(apsw.SQLError, db.prepare, "select nonsense from nowhere")
+        c.execute("create table foo(x,y)")
+        ins = db.prepare("insert into foo values(?,?)")
+        self.assertRaises(TypeError, db.prepare, ins)
+        before = db.cache_stats()
+        for i in range(100):
+            c.execute(ins, (i, i * 2))
+        c.executemany(ins, [(i, -i) for i in range(100, 110)])
+        db.cursor().executemany(ins, ((1000, 0), ))
+        after = db.cache_stats()
+        # the cache wasn't involved at all
+        self.assertEqual((before["hits"], before["misses"]), (after["hits"], after["misses"]))
+        self.assertEqual(c.execute("select count(*), sum(x), sum(y) from foo").fetchall(),
+                         [(111, sum(range(110)) + 1000, 2 * sum(range(100)) - sum(range(100, 110)))])
+        # bindings are not remembered
+        self.assertRaises(apsw.BindingsError, c.execute, ins)
+        sel = db.prepare("select x from foo where x<3 order by x")
+        self.assertEqual(db.cursor().execute(sel).fetchall(), [(0, ), (1, ), (2, )])
+        # nested use falls back to the cache
+        res = []
+        for (x, ) in db.cursor().execute(sel):
+            for (y, ) in db.cursor().execute(sel):
+                res.append((x, y))
+        self.assertEqual(len(res), 9)
+        self.assertEqual(c.execute(sel).fetchall(), [(0, ), (1, ), (2, )])
+        # tracers see the query
+        queries = []
+
+        def tracer(cursor, sql, bindings):
+            queries.append(sql)
+            return True
+
+        c.setexectrace(tracer)
+        c.execute(sel).fetchall()
+        c.setexectrace(None)
+        self.assertEqual(queries, ["select x from foo where x<3 order by x"])
+        # multiple statements
+        multi = db.prepare("select 1; select 2")
+        for i in range(3):
+            self.assertEqual(c.execute(multi).fetchall(), [(1, ), (2, )])
+        # schema changes
+        c.execute("alter table foo add column z")
+        self.assertEqual(c.execute(sel).fetchall(), [(0, ), (1, ), (2, )])
+        # wrong connection
+        db2 = apsw.Connection(":memory:")
+        self.assertRaises(ValueError, db2.cursor().execute, sel)
+        # statements don't keep connection from closing and won't work after
+        del ins
+        db.close()
+        self.assertRaises(apsw.ConnectionClosedError, db.prepare, "select 3")
+        self.assertRaises(ValueError, db2.cursor().execute, sel)
+        del sel
+        del multi
+
+    def testQueryStats(self):
+        "Verify per statement statistics"
+        db = apsw.Connection(":memory:")
+        c = db.cursor()
+        self.assertEqual(db.query_stats(), {})
+        self.assertRaises(TypeError, db.set_query_stats, "3")
+        self.assertRaises(ValueError, db.set_query_stats, -1)
+        self.assertRaises(ZeroDivisionError, db.query_stats, reset=BadIsTrue())
+        db.set_query_stats(3)
+        c.execute("create table foo(x,y)")
+        c.executemany("insert into foo values(?,?)", [(i, i % 7) for i in range(1000)])
+        sel = "select x from foo where y=? order by x desc"
+        for y in range(7):
+            # iteration, fetchall and fetchmany, fetchone all count rows
+            self.assertEqual(len(list(c.execute(sel, (y, )))), len(range(y, 1000, 7)))
+            self.assertEqual(len(c.execute(sel, (y, )).fetchall()), len(range(y, 1000, 7)))
+            c.execute(sel, (y, ))
+            c.fetchone()
+            c.fetchmany(5)
+            c.fetchall()
+        c.execute("select 1; select 2, 3 union all select 4, 5").fetchall()
+        stats = db.query_stats()
+        self.assertEqual(stats["insert into foo values(?,?)"]["count"], 1000)
+        self.assertEqual(stats["insert into foo values(?,?)"]["rows"], 0)
+        s = stats[sel]
+        self.assertEqual(s["count"], 21)
+        self.assertEqual(s["rows"], 3000)
+        self.assertEqual(s["sorts"], 21)
+        self.assertTrue(s["fullscan_steps"] >= 21 * 999)
+        self.assertTrue(s["vm_steps"] > s["fullscan_steps"])
+        self.assertTrue(s["time"] > 0)
+        # the limit of 3 distinct statements was reached
+        self.assertEqual(len(stats), 3)
+        self.assertTrue("create table foo(x,y)" in stats)
+
+        # reset and multiple statements
+        self.assertEqual(len(db.query_stats(reset=True)), 3)
+        self.assertEqual(db.query_stats(), {})
+        c.execute("select 1; select 2, 3 union all select 4, 5").fetchall()
+        stats = db.query_stats()
+        self.assertEqual(stats["select 1;"]["rows"], 1)
+        self.assertEqual(stats["select 2, 3 union all select 4, 5"]["rows"], 2)
+
+        # prepared statements and executemany
+        db.set_query_stats(100)
+        ins = db.prepare("insert into foo values(?, 1)")
+        c.executemany(ins, [(i, ) for i in range(10)])
+        self.assertEqual(db.query_stats()["insert into foo values(?, 1)"]["count"], 10)
+        # autoindexes
+        c.execute("create table bar(x)")
+        c.executemany("insert into bar values(?)", [(i, ) for i in range(100)])
+        # drop the unique values so the planner doesn't just scan
+        q = "select count(*) from foo, bar where foo.y+0=bar.x"
+        c.execute(q).fetchall()
+        self.assertTrue(db.query_stats()[q]["autoindexes"] > 0 or db.query_stats()[q]["fullscan_steps"] > 0)
+
+        # enabling while a cursor is part way through doesn't count
+        # that execution
+        db.set_query_stats(0)
+        q = "select x from foo where y=? order by x"
+        c2 = db.cursor()
+        c2.execute(q, (3, ))
+        c2.fetchone()
+        db.set_query_stats(100)
+        c2.fetchall()
+        self.assertEqual(db.query_stats(), {})
+        c2.execute(q, (3, )).fetchall()
+        s = db.query_stats()[q]
+        self.assertEqual((s["count"], s["rows"]), (1, len(range(3, 1000, 7))))
+        self.assertTrue(s["time"] < 60)
+
+        # disabling
+        db.set_query_stats(0)
+        c.execute("select 3").fetchall()
+        self.assertEqual(db.query_stats(), {})
+        db.close()
+
     def testWikipedia(self):
         "Use front page of wikipedia to check unicode handling"
         # the text also includes characters that can't be represented in 16 bits
@@ -3775,18 +5261,18 @@ class APSW(unittest.TestCase):
         'sqlite3api': { # items of interest - sqlite3 calls
                         'match': re.compile(r"(sqlite3_[A-Za-z0-9_]+)\s*\("),
                         # what must also be on same or preceding line
-                        'needs': re.compile("PYSQLITE(_|_BLOB_|_CON_|_CUR_|_SC_|_VOID_|_BACKUP_)CALL"),
+                        'needs': re.compile("PYSQLITE(_|_BLOB_|_CON_|_CUR_|_SC_|_VOID_|_BACKUP_|_CHEAP_|_CUR_CHEAP_)CALL"),
 
            # except if match.group(1) matches this - these don't
            # acquire db mutex so no need to wrap (determined by
            # examining sqlite3.c).  If they acquire non-database
            # mutexes then that is ok.
 
-           # In the case of sqlite3_result_*|declare_vtab, the mutex
+           # In the case of sqlite3_result_*|declare_vtab|vtab_in*, the mutex
            # is already held by enclosing sqlite3_step and the
            # methods will only be called from that same thread so it
            # isn't a problem.
-                        'skipcalls': re.compile("^sqlite3_(blob_bytes|column_count|bind_parameter_count|data_count|vfs_.+|changes|total_changes|get_autocommit|last_insert_rowid|complete|interrupt|limit|free|threadsafe|value_.+|libversion|enable_shared_cache|initialize|shutdown|config|memory_.+|soft_heap_limit(64)?|randomness|db_readonly|db_filename|release_memory|status64|result_.+|user_data|mprintf|aggregate_context|declare_vtab|backup_remaining|backup_pagecount|sourceid|uri_.+)$"),
+                        'skipcalls': re.compile("^sqlite3_(blob_bytes|column_count|bind_parameter_count|data_count|vfs_.+|changes|total_changes|get_autocommit|last_insert_rowid|complete|interrupt|limit|free|threadsafe|value_.+|libversion|enable_shared_cache|initialize|shutdown|config|memory_.+|soft_heap_limit(64)?|randomness|db_readonly|db_filename|release_memory|status64|result_.+|user_data|mprintf|aggregate_context|declare_vtab|vtab_in(_first|_next)?|vtab_rhs_value|backup_remaining|backup_pagecount|sourceid|uri_.+|db_handle)$"),
                         # also ignore this file
                         'skipfiles': re.compile(r"[/\\]apsw.c$"),
                         # error message
@@ -3802,7 +5288,7 @@ class APSW(unittest.TestCase):
     def sourceCheckMutexCall(self, filename, name, lines):
         # we check that various calls are wrapped with various macros
         for i, line in enumerate(lines):
-            if "PYSQLITE_CALL" in line and "Py" in line:
+            if ("PYSQLITE_CALL" in line or "CHEAP_CALL" in line) and "Py" in line:
                 self.fail("%s: %s() line %d - Py call while GIL released - %s" % (filename, name, i, line.strip()))
             for k, v in self.calls.items():
                 if v.get('skipfiles', None) and v['skipfiles'].match(filename):
@@ -3819,13 +5305,14 @@ class APSW(unittest.TestCase):
     def sourceCheckFunction(self, filename, name, lines):
         # not further checked
         if name.split("_")[0] in ("ZeroBlobBind", "APSWVFS", "APSWVFSFile", "APSWBuffer", "FunctionCBInfo",
-                                  "apswurifilename"):
+                                  "apswurifilename", "ColumnView", "APSWBlobReadMany", "APSWRow"):
             return
 
         checks = {
             "APSWCursor": {
-                "skip": ("dealloc", "init", "dobinding", "dobindings", "doexectrace", "dorowtrace", "step", "close",
-                         "close_internal"),
+                "skip": ("dealloc", "init", "dobinding", "dobindings", "doexectrace", "dorowtrace", "step", "internal_step", "close",
+                         "close_internal", "rowfields", "makerow",
+                         "importcsv_convert", "importcsv_transaction"),
                 "req": {
                     "use": "CHECK_USE",
                     "closed": "CHECK_CURSOR_CLOSED",
@@ -3834,7 +5321,8 @@ class APSW(unittest.TestCase):
             },
             "Connection": {
                 "skip": ("internal_cleanup", "dealloc", "init", "close", "interrupt", "close_internal",
-                         "remove_dependent", "readonly", "getmainfilename", "db_filename"),
+                         "remove_dependent", "readonly", "getmainfilename", "db_filename", "blobpool_clear",
+                         "blobpool_take", "blobpool_park"),
                 "req": {
                     "use": "CHECK_USE",
                     "closed": "CHECK_CLOSED",
@@ -3842,13 +5330,36 @@ class APSW(unittest.TestCase):
                 "order": ("use", "closed")
             },
             "APSWBlob": {
-                "skip": ("dealloc", "init", "close", "close_internal"),
+                "skip": ("dealloc", "init", "close", "close_internal", "fdwriteall", "fdread", "copylength"),
                 "req": {
                     "use": "CHECK_USE",
                     "closed": "CHECK_BLOB_CLOSED"
                 },
                 "order": ("use", "closed")
             },
+            "APSWConnectionPool": {
+                "skip": ("dealloc", "init", "new", "open", "writer_lock", "writer_unlock", "reader_entry", "readonly",
+                         "leave", "close"),
+                "req": {
+                    "closed": "CHECK_POOL_CLOSED"
+                },
+            },
+            "APSWAsyncConnection": {
+                "skip": ("dealloc", "init", "new", "setup", "cursorcall", "close", "aexit"),
+                "req": {
+                    "closed": "CHECK_ASYNC_CLOSED"
+                },
+            },
+            "APSWAsyncCursor": {
+                "skip": ("dealloc", "aiter", "anext", "fetchone", "fetchall"),
+                "req": {
+                    "closed": "CHECK_ASYNC_CLOSED"
+                },
+            },
+            "APSWAsyncResult": {
+                "skip": ("dealloc", "await", "next"),
+                "req": {},
+            },
             "APSWBackup": {
                 "skip": ("dealloc", "init", "close_internal", "get_remaining", "get_pagecount"),
                 "req": {
@@ -3877,6 +5388,13 @@ class APSW(unittest.TestCase):
                     "check": "CHECKVFSPY",
                 },
             },
+            "apswvfsfilepy_xReadInto": {
+                "req": {
+                    "check": "CHECKVFSFILEPY",
+                    "notimpl": "VFSFILENOTIMPLEMENTED(xRead,"
+                },
+                "order": ("check", "notimpl"),
+            },
             "apswvfsfile": {
                 "req": {
                     "preamble": "FILEPREAMBLE",
@@ -4008,8 +5526,37 @@ class APSW(unittest.TestCase):
             self.assertRaises(OverflowError, apsw.config, x * x * x * x)
             self.assertTrue(apsw.config(apsw.SQLITE_CONFIG_PCACHE_HDRSZ) >= 0)
             apsw.config(apsw.SQLITE_CONFIG_PMASZ, -1)
+            self.assertRaises(TypeError, apsw.config, apsw.SQLITE_CONFIG_LOOKASIDE, 64)
+            apsw.config(apsw.SQLITE_CONFIG_LOOKASIDE, 64, 100)
+            # allocators
+            self.assertEqual("system", apsw.config(apsw.SQLITE_CONFIG_GETMALLOC))
+            self.assertRaises(TypeError, apsw.config, apsw.SQLITE_CONFIG_MALLOC)
+            self.assertRaises(ValueError, apsw.config, apsw.SQLITE_CONFIG_MALLOC, "chicken")
+            apsw.config(apsw.SQLITE_CONFIG_MALLOC, "pooled")
+            apsw.config(apsw.SQLITE_CONFIG_MALLOC, "pooled")
+            self.assertEqual("pooled", apsw.config(apsw.SQLITE_CONFIG_GETMALLOC))
+            apsw.initialize()
+            db = apsw.Connection(":memory:")
+            self.assertRaises(apsw.MisuseError, apsw.config, apsw.SQLITE_CONFIG_MALLOC, "system")
+            c = db.cursor()
+            c.execute("create table foo(x,y)")
+            c.executemany("insert into foo values(?,?)", [(i, b(r"\x01") * (i * 37 % 20000)) for i in range(1000)])
+            # group_concat grows its result with realloc
+            self.assertEqual(3000, len(c.execute("select group_concat(printf('%03d', x), '') from foo").fetchall()[0][0]))
+            self.assertEqual(sum(i * 37 % 20000 for i in range(1000)), c.execute("select sum(length(y)) from foo").fetchall()[0][0])
+            self.assertTrue(db.memoryused() > 0)
+            db.close()
+            del c
+            del db
+            gc.collect()
+            apsw.shutdown()
+            apsw.config(apsw.SQLITE_CONFIG_MALLOC, "system")
+            self.assertEqual("system", apsw.config(apsw.SQLITE_CONFIG_GETMALLOC))
         finally:
             # put back to normal
+            if apsw.config(apsw.SQLITE_CONFIG_GETMALLOC) != "system":
+                apsw.shutdown()
+                apsw.config(apsw.SQLITE_CONFIG_MALLOC, "system")
             apsw.config(apsw.SQLITE_CONFIG_SERIALIZED)
             apsw.config(apsw.SQLITE_CONFIG_MEMSTATUS, True)
             apsw.initialize()
@@ -4028,6 +5575,17 @@ class APSW(unittest.TestCase):
         self.assertTrue(type(res) in (int, long))
         apsw.softheaplimit(l("0x1234567890abc"))
         self.assertEqual(l("0x1234567890abc"), apsw.softheaplimit(l("0x1234567890abe")))
+        # per connection
+        db = apsw.Connection(":memory:")
+        before = db.memoryused()
+        self.assertTrue(before > 0)
+        db.cursor().execute("create table foo(x); insert into foo values(randomblob(100000))")
+        self.assertTrue(db.memoryused() > before)
+        self.assertRaises(TypeError, db.config, apsw.SQLITE_DBCONFIG_LOOKASIDE, 64)
+        db2 = apsw.Connection(":memory:")
+        db2.config(apsw.SQLITE_DBCONFIG_LOOKASIDE, 128, 20)
+        db2.config(apsw.SQLITE_DBCONFIG_LOOKASIDE, 0, 0)
+        self.assertEqual(0, db2.status(apsw.SQLITE_DBSTATUS_LOOKASIDE_USED)[0])
 
     def testRandomness(self):
         "Verify randomness routine"
@@ -4348,6 +5906,179 @@ class APSW(unittest.TestCase):
         self.assertRaises(apsw.SQLError, blobro.reopen, l("0x1ffffffff"))
         blobro.close()
 
+    def testBlobCopy(self):
+        "Verify Blob copy_to and copy_from"
+        import io
+        cur = self.db.cursor()
+        rowid = next(cur.execute("create table foo(x blob); insert into foo values(zeroblob(300000)); select rowid from foo"))[0]
+        data = os.urandom(300000)
+        blob = self.db.blobopen("main", "foo", "x", rowid, True)
+        self.assertRaises(TypeError, blob.copy_to)
+        self.assertRaises(ValueError, blob.copy_to, io.BytesIO(), chunk=0)
+        self.assertRaises(ValueError, blob.copy_to, io.BytesIO(), 300001)
+        self.assertRaises(ValueError, blob.copy_from, io.BytesIO(), 300001)
+        self.assertRaises(AttributeError, blob.copy_to, object())
+        self.assertRaises(AttributeError, blob.copy_from, object())
+
+        # file like objects - readinto
+        self.assertEqual(blob.copy_from(io.BytesIO(data), chunk=7000), 300000)
+        self.assertEqual(blob.tell(), 300000)
+        blob.seek(0)
+        self.assertEqual(blob.read(), data)
+        blob.seek(0)
+        out = io.BytesIO()
+        self.assertEqual(blob.copy_to(out, chunk=4096), 300000)
+        self.assertEqual(out.getvalue(), data)
+        blob.seek(1000)
+        out = io.BytesIO()
+        self.assertEqual(blob.copy_to(out, 10), 10)
+        self.assertEqual(out.getvalue(), data[1000:1010])
+        self.assertEqual(blob.tell(), 1010)
+
+        # read only and short source
+        class Reader:
+            def __init__(self, data):
+                self.f = io.BytesIO(data)
+
+            def read(self, n):
+                return self.f.read(n)
+
+        blob.seek(0)
+        self.assertEqual(blob.copy_from(Reader(data[::-1][:5000]), chunk=999), 5000)
+        blob.seek(0)
+        self.assertEqual(blob.read(5001), data[::-1][:5000] + data[5000:5001])
+
+        # partial writes
+        class Writer:
+            def __init__(self):
+                self.chunks = []
+
+            def write(self, b):
+                self.chunks.append(b[:1000])
+                return len(self.chunks[-1])
+
+        w = Writer()
+        blob.seek(0)
+        self.assertEqual(blob.copy_to(w, 25000), 25000)
+        self.assertEqual(BYTES("").join(w.chunks), data[::-1][:5000] + data[5000:25000])
+        self.assertTrue(max(len(c) for c in w.chunks) <= 1000)
+
+        # file descriptors
+        fname = TESTFILEPREFIX + "testfile"
+        fd = os.open(fname, os.O_CREAT | os.O_RDWR | getattr(os, "O_BINARY", 0))
+        try:
+            blob.seek(0)
+            self.assertEqual(blob.copy_to(fd, chunk=65536), 300000)
+            os.lseek(fd, 0, 0)
+            blob.seek(0)
+            f = open(fname, "rb")
+            self.assertEqual(blob.read(), f.read())
+            f.close()
+            os.lseek(fd, 0, 0)
+            os.write(fd, data)
+            os.lseek(fd, 0, 0)
+            blob.seek(0)
+            self.assertEqual(blob.copy_from(fd, chunk=12345), 300000)
+            blob.seek(0)
+            self.assertEqual(blob.read(), data)
+            # at end of file
+            blob.seek(0)
+            self.assertEqual(blob.copy_from(fd), 0)
+        finally:
+            os.close(fd)
+        self.assertRaises(OSError, blob.copy_to, fd)
+        self.assertRaises(OSError, blob.copy_from, fd)
+
+        # errors from the file like objects
+        class Bad:
+            def write(self, b):
+                1 / 0
+
+            def readinto(self, b):
+                return "three"
+
+        blob.seek(0)
+        self.assertRaises(ZeroDivisionError, blob.copy_to, Bad())
+        self.assertRaises(TypeError, blob.copy_from, Bad())
+        Bad.readinto = lambda self, b: len(b) + 1
+        self.assertRaises(ValueError, blob.copy_from, Bad())
+        Bad.write = lambda self, b: blob.close()
+        self.assertRaises(ValueError, blob.copy_to, Bad())
+        self.assertRaises(ValueError, blob.copy_to, io.BytesIO())
+
+        blobro = self.db.blobopen("main", "foo", "x", rowid, False)
+        self.assertRaises(apsw.ReadOnlyError, blobro.copy_from, io.BytesIO(data))
+        # the error is also reported by close
+        blobro.close(True)
+
+    def testBlobPool(self):
+        "Verify blob handle pooling and blobreadmany"
+        cur = self.db.cursor()
+        cur.execute("create table foo(x blob)")
+        data = [os.urandom(i * 37) for i in range(20)]
+        rowids = []
+        for d in data:
+            cur.execute("insert into foo values(zeroblob(?))", (len(d), ))
+            rowids.append(self.db.last_insert_rowid())
+            blob = self.db.blobopen("main", "foo", "x", rowids[-1], True)
+            blob.write(d)
+            blob.close()
+
+        self.assertRaises(TypeError, self.db.set_blob_pool, "3")
+        self.assertRaises(ValueError, self.db.set_blob_pool, -1)
+        self.assertRaises(ValueError, self.db.set_blob_pool, 1001)
+
+        # blobreadmany
+        self.assertEqual(list(self.db.blobreadmany("main", "foo", "x", rowids)), data)
+        self.assertEqual(list(self.db.blobreadmany("main", "foo", "x", [])), [])
+        self.assertEqual(list(self.db.blobreadmany("main", "foo", "x", reversed(rowids))), data[::-1])
+        self.assertRaises(TypeError, self.db.blobreadmany, "main", "foo", "x", 3)
+        self.assertRaises(TypeError, list, self.db.blobreadmany("main", "foo", "x", ["1"]))
+        it = self.db.blobreadmany("main", "foo", "x", [rowids[0], 99999, rowids[1]])
+        self.assertEqual(_realnext(it), data[0])
+        self.assertRaises(apsw.SQLError, _realnext, it)
+        self.assertEqual(_realnext(it), data[1])
+        self.assertRaises(StopIteration, _realnext, it)
+        self.assertRaises(StopIteration, _realnext, it)
+
+        # pooled handles
+        self.db.set_blob_pool(2)
+        for _ in range(3):
+            for rowid, d in zip(rowids, data):
+                blob = self.db.blobopen("main", "foo", "x", rowid, False)
+                self.assertEqual(blob.read(), d)
+                blob.close()
+        self.assertEqual(list(self.db.blobreadmany("main", "foo", "x", rowids)), data)
+        # a parked handle keeps the table busy
+        self.assertRaises(apsw.LockedError, cur.execute, "drop table foo")
+        self.db.set_blob_pool(2)
+        blob = self.db.blobopen("main", "foo", "x", rowids[3], False)
+        # a row that doesn't exist after reopening a parked handle
+        blob.close()
+        self.assertRaises(apsw.SQLError, self.db.blobopen, "main", "foo", "x", 99999, False)
+        self.assertEqual(self.db.blobopen("main", "foo", "x", rowids[4], False).read(), data[4])
+        # writeable handles are never parked so their changes are committed
+        blob = self.db.blobopen("main", "foo", "x", rowids[1], True)
+        blob.write(b"a" * 37)
+        blob.close()
+        db2 = apsw.Connection(TESTFILEPREFIX + "testdb")
+        self.assertEqual(db2.cursor().execute("select hex(x) from foo where rowid=?", (rowids[1], )).fetchall()[0][0],
+                         "61" * 37)
+        db2.close()
+        self.db.set_blob_pool(0)
+        cur.execute("create table bar(x); drop table bar")
+
+        # closing the connection
+        self.db.set_blob_pool(5)
+        list(self.db.blobreadmany("main", "foo", "x", rowids[:3]))
+        it = self.db.blobreadmany("main", "foo", "x", rowids)
+        _realnext(it)
+        self.db.close()
+        self.assertRaises(apsw.ConnectionClosedError, _realnext, it)
+        self.assertRaises(apsw.ConnectionClosedError, self.db.set_blob_pool, 1)
+        self.assertRaises(apsw.ConnectionClosedError, self.db.blobreadmany, "main", "foo", "x", rowids)
+        del it
+
     def testBlobReadError(self):
         "Ensure blob read errors are handled well"
         cur = self.db.cursor()
@@ -4455,6 +6186,9 @@ class APSW(unittest.TestCase):
 
         db2 = apsw.Connection(TESTFILEPREFIX + "testdb2", vfs=vfs.vfsname)
         db2.cursor().execute(query)
+        # VFSFile subclasses support wal too
+        if db2.cursor().execute("pragma journal_mode").fetchall()[0][0] == "wal":
+            db2.cursor().execute("pragma journal_mode=delete").fetchall()
         db2.close()
         waswal = self.db.cursor().execute("pragma journal_mode").fetchall()[0][0] == "wal"
         if waswal:
@@ -5626,6 +7360,355 @@ class APSW(unittest.TestCase):
             if n not in ('xClose', 'excepthook') and not n.startswith("__"):
                 self.assertRaises(apsw.VFSFileClosedError, getattr(t, n))
 
+    def testVFSReadInto(self):
+        "Verify VFS files reading into SQLite's buffer"
+        calls = {"xRead": 0, "xReadInto": 0}
+
+        def flip(buffer, amount):
+            for i in range(amount):
+                buffer[i] = buffer[i] ^ 0xa5
+
+        class ReadIntoVFSFile(apsw.VFSFile):
+            def __init__(self, name, flags):
+                apsw.VFSFile.__init__(self, "", name, flags)
+
+            def xRead(self, amount, offset):
+                calls["xRead"] += 1
+                return super(ReadIntoVFSFile, self).xRead(amount, offset)
+
+            def xReadInto(self, buffer, offset):
+                calls["xReadInto"] += 1
+                return super(ReadIntoVFSFile, self).xReadInto(buffer, offset)
+
+        class ReadIntoVFS(apsw.VFS):
+            def __init__(self):
+                apsw.VFS.__init__(self, "readinto", "")
+
+            def xOpen(self, name, flags):
+                return ReadIntoVFSFile(name, flags)
+
+        vfs = ReadIntoVFS()
+        self.db.cursor().execute("create table foo(x); insert into foo values(randomblob(5000))")
+        expected = self.db.cursor().execute("select * from foo").fetchall()
+        self.db.close()
+
+        def query():
+            db = apsw.Connection(TESTFILEPREFIX + "testdb", vfs="readinto")
+            try:
+                return db.cursor().execute("select * from foo").fetchall()
+            finally:
+                db.close()
+
+        self.assertEqual(query(), expected)
+        self.assertEqual(calls["xRead"], 0)
+        self.assertNotEqual(calls["xReadInto"], 0)
+
+        # direct use
+        t = ReadIntoVFSFile(os.path.abspath(TESTFILEPREFIX + "testdb"), [apsw.SQLITE_OPEN_MAIN_DB | apsw.SQLITE_OPEN_READONLY, 0])
+        whole = t.xRead(1000000, 0)
+        buf = bytearray(100)
+        self.assertEqual(t.xReadInto(buf, 16), 100)
+        self.assertEqual(bytes(buf), whole[16:116])
+        buf = bytearray(100)
+        self.assertEqual(t.xReadInto(buf, len(whole) - 10), 10)
+        self.assertRaises(TypeError, t.xReadInto, u("abc"), 0)
+        self.assertRaises(TypeError, t.xReadInto, buf)
+        t.xClose()
+
+        # the view can't be used after returning
+        kept = []
+
+        def xReadInto(self, buffer, offset):
+            if py3:
+                kept.append(buffer)
+            return super(ReadIntoVFSFile, self).xReadInto(buffer, offset)
+
+        ReadIntoVFSFile.xReadInto = xReadInto
+        self.assertEqual(query(), expected)
+        for view in kept:
+            self.assertRaises(ValueError, len, view)
+
+        # changing the data in place
+        def xReadInto(self, buffer, offset):
+            res = super(ReadIntoVFSFile, self).xReadInto(buffer, offset)
+            flip(buffer, 4)
+            return res
+
+        ReadIntoVFSFile.xReadInto = xReadInto
+        self.assertRaises(apsw.NotADBError, query)
+
+        # short reads are zero filled so the header is wrong
+        ReadIntoVFSFile.xReadInto = lambda self, buffer, offset: 0
+        self.assertRaises(apsw.NotADBError, query)
+
+        # bad returns
+        for ret, exc in ((None, TypeError), (-1, ValueError), (1000000, ValueError), (0.5, TypeError)):
+            ReadIntoVFSFile.xReadInto = lambda self, buffer, offset, ret=ret: ret
+            self.assertRaises(apsw.SQLError, self.assertRaisesUnraisable, exc, query)
+
+        def xReadInto(self, buffer, offset):
+            1 / 0
+
+        ReadIntoVFSFile.xReadInto = xReadInto
+        self.assertRaises(apsw.SQLError, self.assertRaisesUnraisable, ZeroDivisionError, query)
+
+        # without its own xReadInto, xRead is used since it is overridden
+        del ReadIntoVFSFile.xReadInto
+        calls["xRead"] = 0
+        self.assertEqual(query(), expected)
+        self.assertNotEqual(calls["xRead"], 0)
+
+        # likewise when set on the instance
+        def xOpen(self, name, flags):
+            f = ReadIntoVFSFile(name, flags)
+            f.xRead = lambda amount, offset: 1 / 0
+            return f
+
+        ReadIntoVFS.xOpen = xOpen
+        self.assertRaises(apsw.SQLError, self.assertRaisesUnraisable, ZeroDivisionError, query)
+
+    def testVFSShm(self):
+        "Verify VFS files shared memory methods"
+        calls = {}
+
+        class ShmVFSFile(apsw.VFSFile):
+            def __init__(self, name, flags):
+                apsw.VFSFile.__init__(self, "", name, flags)
+
+        class ShmVFS(apsw.VFS):
+            def __init__(self):
+                apsw.VFS.__init__(self, "shmvfs", "")
+
+            def xOpen(self, name, flags):
+                return ShmVFSFile(name, flags)
+
+        vfs = ShmVFS()
+
+        def check():
+            db = apsw.Connection(TESTFILEPREFIX + "testdb", vfs="shmvfs")
+            db2 = apsw.Connection(TESTFILEPREFIX + "testdb", vfs="shmvfs")
+            try:
+                self.assertEqual(db.cursor().execute("pragma journal_mode=wal").fetchall(), [("wal", )])
+                db.cursor().execute("create table if not exists foo(x); insert into foo values(3)")
+                c = db2.cursor()
+                return c.execute("select count(*) from foo").fetchall()[0][0]
+            finally:
+                db2.close()
+                db.close()
+
+        # no overrides
+        self.db.close()
+        self.assertEqual(check(), 1)
+
+        # python overrides
+        def counter(name):
+            def method(self, *args):
+                calls[name] = calls.get(name, 0) + 1
+                return getattr(super(ShmVFSFile, self), name)(*args)
+
+            return method
+
+        for name in ("xShmMap", "xShmLock", "xShmBarrier", "xShmUnmap"):
+            setattr(ShmVFSFile, name, counter(name))
+        # all four are used
+        self.assertEqual(check(), 2)
+        self.assertEqual(sorted(calls.keys()), ["xShmBarrier", "xShmLock", "xShmMap", "xShmUnmap"])
+
+        # errors
+        ShmVFSFile.xShmMap = lambda self, *args: 1 / 0
+        self.assertRaises(apsw.SQLError, self.assertRaisesUnraisable, ZeroDivisionError, check)
+        ShmVFSFile.xShmMap = lambda self, *args: "not a pointer"
+        self.assertRaises(apsw.SQLError, self.assertRaisesUnraisable, TypeError, check)
+        del ShmVFSFile.xShmMap
+        ShmVFSFile.xShmLock = lambda self, *args: 1 / 0
+        self.assertRaises(apsw.SQLError, self.assertRaisesUnraisable, ZeroDivisionError, check)
+        del ShmVFSFile.xShmLock
+        self.assertEqual(check(), 3)
+
+        # direct use
+        t = ShmVFSFile(os.path.abspath(TESTFILEPREFIX + "testdb"), [apsw.SQLITE_OPEN_MAIN_DB | apsw.SQLITE_OPEN_READWRITE, 0])
+        self.assertRaises(TypeError, t.xShmMap, "one", 2, 3)
+        self.assertRaises(TypeError, t.xShmLock, 1)
+        self.assertRaises(TypeError, t.xShmUnmap)
+        t.xClose()
+
+    def testVFSReadCache(self):
+        "Verify VFS file read cache"
+        reads = []
+        files = []
+
+        class CacheVFSFile(apsw.VFSFile):
+            def __init__(self, name, flags):
+                apsw.VFSFile.__init__(self, "", name, flags)
+                if flags[0] & apsw.SQLITE_OPEN_MAIN_DB:
+                    self.set_read_cache(1000)
+                    files.append(self)
+
+            def xRead(self, amount, offset):
+                reads.append(offset)
+                return super(CacheVFSFile, self).xRead(amount, offset)
+
+        class CacheVFS(apsw.VFS):
+            def __init__(self):
+                apsw.VFS.__init__(self, "cachevfs", "")
+
+            def xOpen(self, name, flags):
+                return CacheVFSFile(name, flags)
+
+        vfs = CacheVFS()
+        self.db.close()
+        db = apsw.Connection(TESTFILEPREFIX + "testdb", vfs="cachevfs")
+        c = db.cursor()
+        c.execute("pragma page_size=1024; pragma cache_size=5; create table foo(x)")
+        c.execute("begin; insert into foo values(zeroblob(500))")
+        for i in range(8):
+            c.execute("insert into foo select * from foo")
+        c.execute("commit")
+        f = files[0]
+        stats = f.read_cache_stats()
+        self.assertEqual(stats["maxpages"], 1000)
+
+        def scan():
+            del reads[:]
+            return c.execute("select count(*), sum(length(x)) from foo").fetchall()[0]
+
+        c.execute("begin")
+        expected = scan()
+        self.assertEqual(expected, (256, 256 * 500))
+        self.assertTrue(len(reads) > 100)
+        before = f.read_cache_stats()
+        self.assertEqual(before["pagesize"], 1024)
+        self.assertTrue(before["pages"] > 100)
+        # second scan in same transaction is served from the cache
+        self.assertEqual(scan(), expected)
+        self.assertEqual(reads, [])
+        after = f.read_cache_stats()
+        self.assertTrue(after["hits"] - before["hits"] > 100)
+        self.assertEqual(after["misses"], before["misses"])
+        # writes invalidate
+        c.execute("update foo set x=zeroblob(400)")
+        c.execute("commit")
+        self.assertTrue(f.read_cache_stats()["invalidations"] > 100)
+        self.assertEqual(scan(), (256, 256 * 400))
+        # eviction
+        f.set_read_cache(10)
+        self.assertEqual(f.read_cache_stats()["pages"], 0)
+        c.execute("begin")
+        scan()
+        stats = f.read_cache_stats()
+        self.assertEqual(stats["pages"], 10)
+        self.assertTrue(stats["evictions"] > 100)
+        c.execute("commit")
+        # truncation
+        f.set_read_cache(1000)
+        c.execute("begin")
+        scan()
+        c.execute("delete from foo; commit; vacuum")
+        self.assertEqual(c.execute("select count(*) from foo").fetchall(), [(0, )])
+        # disabled
+        f.set_read_cache(0)
+        stats = f.read_cache_stats()
+        self.assertEqual((stats["maxpages"], stats["pages"]), (0, 0))
+        c.execute("insert into foo values(1); begin")
+        scan()
+        self.assertNotEqual(reads, [])
+        self.assertEqual(f.read_cache_stats()["hits"], stats["hits"])
+        c.execute("commit")
+        self.assertRaises(TypeError, f.set_read_cache, "three")
+        self.assertRaises(ValueError, f.set_read_cache, -1)
+        # wal stops it being used
+        f.set_read_cache(100)
+        self.assertEqual(c.execute("pragma journal_mode=wal").fetchall(), [("wal", )])
+        hits = f.read_cache_stats()["hits"]
+        c.execute("begin")
+        scan()
+        scan()
+        self.assertEqual(f.read_cache_stats()["disabled"], True)
+        self.assertEqual(f.read_cache_stats()["hits"], hits)
+        self.assertEqual(f.read_cache_stats()["pages"], 0)
+        c.execute("commit")
+        # setting it again while in wal mode must not turn it back on
+        f.set_read_cache(100)
+        self.assertEqual(f.read_cache_stats()["disabled"], True)
+        before = scan()
+        db2 = apsw.Connection(TESTFILEPREFIX + "testdb")
+        db2.cursor().execute("update foo set x=zeroblob(300); pragma wal_checkpoint(full)")
+        self.assertEqual(scan(), (before[0], before[0] * 300))
+        self.assertEqual(f.read_cache_stats()["hits"], hits)
+        db2.close()
+        db.close()
+        self.assertRaises(apsw.VFSFileClosedError, f.set_read_cache, 10)
+        self.assertRaises(apsw.VFSFileClosedError, f.read_cache_stats)
+
+    def testVFSReadAhead(self):
+        "Verify VFS file read ahead"
+        reads = []
+        files = []
+
+        class AheadVFSFile(apsw.VFSFile):
+            def __init__(self, name, flags):
+                apsw.VFSFile.__init__(self, "", name, flags)
+                if flags[0] & apsw.SQLITE_OPEN_MAIN_DB:
+                    self.set_read_cache(1000, readahead=16)
+                    files.append(self)
+
+            def xRead(self, amount, offset):
+                reads.append(amount)
+                return super(AheadVFSFile, self).xRead(amount, offset)
+
+        class AheadVFS(apsw.VFS):
+            def __init__(self):
+                apsw.VFS.__init__(self, "aheadvfs", "")
+
+            def xOpen(self, name, flags):
+                return AheadVFSFile(name, flags)
+
+        vfs = AheadVFS()
+        self.db.close()
+        db = apsw.Connection(TESTFILEPREFIX + "testdb", vfs="aheadvfs")
+        c = db.cursor()
+        c.execute("pragma page_size=1024; pragma cache_size=5; create table foo(x)")
+        c.execute("begin; insert into foo values(zeroblob(500))")
+        for i in range(8):
+            c.execute("insert into foo select * from foo")
+        c.execute("insert into foo values(1); commit")
+        f = files[0]
+
+        def scan():
+            del reads[:]
+            return c.execute("select count(*), sum(length(x)) from foo").fetchall()[0]
+
+        expected = (257, 256 * 500 + 1)
+        self.assertEqual(scan(), expected)
+        stats = f.read_cache_stats()
+        self.assertEqual(stats["readahead"], 16)
+        self.assertTrue(stats["readaheads"] > 5)
+        self.assertTrue(16 * 1024 in reads)
+        # far fewer reads than pages
+        self.assertTrue(len(reads) < stats["pages"] / 4)
+        # backup reads sequentially including the last short read ahead
+        db2 = apsw.Connection(":memory:")
+        b = db2.backup("main", db, "main")
+        b.step()
+        b.finish()
+        self.assertEqual(db2.cursor().execute("select count(*), sum(length(x)) from foo").fetchall()[0], expected)
+        # xReadInto is used for reading ahead too
+        def xReadInto(self, buf, offset):
+            reads.append(-len(buf))
+            return super(AheadVFSFile, self).xReadInto(buf, offset)
+
+        AheadVFSFile.xReadInto = xReadInto
+        del AheadVFSFile.xRead
+        self.assertEqual(scan(), expected)
+        self.assertTrue(-16 * 1024 in reads)
+        # readahead off
+        f.set_read_cache(1000, readahead=0)
+        self.assertEqual(scan(), expected)
+        self.assertEqual(set(r for r in reads if r < -100), set([-1024]))
+        self.assertRaises(ValueError, f.set_read_cache, 10, -1)
+        db2.close()
+        db.close()
+
     def testWith(self):
         "Context manager functionality"
         # we need py 2.5 for with stuff
@@ -5842,6 +7925,180 @@ class APSW(unittest.TestCase):
                 list(c2.execute("select * from [%s] order by _ROWID_" % (table, ))),
             )
 
+    def testConnectionPool(self):
+        "Verify connection pool"
+        name = TESTFILEPREFIX + "testpool"
+        for suffix in ("", "-wal", "-shm"):
+            deletefile(name + suffix)
+        self.assertRaises(TypeError, apsw.ConnectionPool)
+        self.assertRaises(TypeError, apsw.ConnectionPool, name, prepare=3)
+        self.assertRaises(apsw.CantOpenError, apsw.ConnectionPool, name, flags=apsw.SQLITE_OPEN_READWRITE)
+        pool = apsw.ConnectionPool(name)
+        self.assertEqual([], pool.execute("create table foo(x not null, y)"))
+        pool.close()
+        # statements to prepare must be valid
+        self.assertRaises(apsw.SQLError, apsw.ConnectionPool, name, prepare=["select nosuchcolumn from foo"])
+        pool = apsw.ConnectionPool(name, prepare=["select x from foo where y=?"])
+        self.assertRaises(ValueError, pool.__init__, name)
+        pool.execute("insert into foo values(?,?)", (1, 2))
+        pool.execute("insert into foo values(:x, :y)", {"x": 3, "y": 4})
+        self.assertEqual([(1, 2), (3, 4)], pool.execute("select * from foo order by x"))
+        self.assertEqual([(3, )], pool.execute("select x from foo where y=?", (4, )))
+        self.assertEqual("wal", pool.execute("pragma journal_mode")[0][0])
+        # reads use a read only connection per thread
+        reader = pool.reader()
+        self.assertTrue(reader is pool.reader())
+        self.assertRaises(apsw.ReadOnlyError, reader.cursor().execute, "insert into foo values(5,6)")
+        self.assertRaises(apsw.SQLError, pool.execute, "select nosuchcolumn from foo")
+        self.assertRaises(TypeError, pool.execute, 3)
+        # a failing change is rolled back
+        self.assertRaises(apsw.ConstraintError, pool.execute, "insert into foo values(7,8); insert into foo values(null,0)")
+        self.assertEqual(2, pool.execute("select count(*) from foo")[0][0])
+        # with holds the writer and reads see uncommitted changes
+        with pool as db:
+            self.assertTrue(isinstance(db, apsw.Connection))
+            db.cursor().execute("insert into foo values(5,6)")
+            with pool:
+                pool.execute("insert into foo values(7,8)")
+            self.assertEqual(4, pool.execute("select count(*) from foo")[0][0])
+            self.assertEqual(2, reader.cursor().execute("select count(*) from foo").fetchall()[0][0])
+            self.assertRaises(ValueError, pool.close)
+        self.assertEqual(4, pool.execute("select count(*) from foo")[0][0])
+        try:
+            with pool:
+                pool.execute("delete from foo")
+                1 / 0
+        except ZeroDivisionError:
+            pass
+        self.assertEqual(4, pool.execute("select count(*) from foo")[0][0])
+        self.assertRaises(ValueError, pool.__exit__, None, None, None)
+        # threads get their own readers and share the writer
+        conns = []
+
+        def worker(n):
+            conns.append(pool.reader())
+            for i in range(50):
+                pool.execute("insert into foo values(?,?)", (n, i))
+                self.assertTrue(pool.execute("select count(*) from foo")[0][0] >= 5)
+                with pool as db:
+                    db.cursor().execute("update foo set y=y+1 where x=? and y=?", (n, i))
+            pool.release()
+
+        threads = [ThreadRunner(worker, n) for n in range(100, 104)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.go()
+        self.assertEqual(len(set(id(c) for c in conns)), len(conns))
+        self.assertEqual(4 + 4 * 50, pool.execute("select count(*) from foo")[0][0])
+        self.assertEqual(4 + 4 * 50, pool.execute("select count(*) from foo where x<100 or y>0")[0][0])
+        # a reader closed directly is reopened
+        reader.close()
+        self.assertTrue(reader is not pool.reader())
+        pool.release()
+        pool.release()
+        pool.close()
+        pool.close()
+        self.assertRaises(apsw.ConnectionClosedError, pool.execute, "select 3")
+        self.assertRaises(apsw.ConnectionClosedError, pool.reader)
+        self.assertRaises(apsw.ConnectionClosedError, pool.__enter__)
+        for suffix in ("", "-wal", "-shm"):
+            deletefile(name + suffix)
+
+    def testAsyncConnection(self):
+        "Verify awaitable connection"
+        if not hasattr(apsw, "AsyncConnection"):
+            return
+        import asyncio
+        self.assertRaises(TypeError, apsw.AsyncConnection)
+        self.assertRaises(ValueError, apsw.AsyncConnection, ":memory:", batchsize=0)
+        self.assertRaises(apsw.CantOpenError, apsw.AsyncConnection, TESTFILEPREFIX + "nosuchdir/db")
+        # async syntax is compiled at runtime so the file still works with older Pythons
+        code = """
+async def check(self, db):
+    import asyncio
+    self.assertRaises(ValueError, db.__init__, ":memory:")
+    self.assertRaises(TypeError, db.run, 3)
+    await db.run(lambda c: c.cursor().execute("create table foo(x, y)"))
+    self.assertEqual(12, await db.run(lambda c, a, b: a * b, 3, 4))
+    await db.executemany("insert into foo values(?, ?)", ((i, str(i)) for i in range(1000)))
+    # more rows than a batch, fetched by async for
+    rows = []
+    async for row in await db.execute("select * from foo order by x"):
+        rows.append(row)
+    self.assertEqual([(i, str(i)) for i in range(1000)], rows)
+    cursor = await db.execute("select x from foo where x<?", (150, ))
+    self.assertEqual((0, ), await cursor.fetchone())
+    self.assertEqual([(i, ) for i in range(1, 150)], await cursor.fetchall())
+    self.assertEqual(None, await cursor.fetchone())
+    self.assertEqual([], await cursor.fetchall())
+    cursor = await db.execute("select x from foo")
+    await cursor.fetchone()
+    await cursor.close()
+    self.assertEqual(None, await cursor.fetchone())
+    # errors come back to the coroutine
+    try:
+        await db.execute("select nosuchcolumn from foo")
+        1 / 0
+    except apsw.SQLError:
+        pass
+    try:
+        await db.run(lambda c: 1 / 0)
+        self.fail("expected ZeroDivisionError")
+    except ZeroDivisionError:
+        pass
+    # coroutines share the connection
+    async def reader(n):
+        count = 0
+        async for x, y in await db.execute("select * from foo where x%10=?", (n, )):
+            self.assertEqual(n, x % 10)
+            count += 1
+        return count
+    self.assertEqual([100] * 10, await asyncio.gather(*[reader(n) for n in range(10)]))
+    # the loop keeps running during a long query
+    ticks = []
+    async def ticker():
+        while True:
+            await asyncio.sleep(0.001)
+            ticks.append(1)
+    t = asyncio.ensure_future(ticker())
+    cursor = await db.execute("select count(*) from foo a, foo b where a.x<b.x")
+    self.assertEqual((1000 * 999 // 2, ), await cursor.fetchone())
+    t.cancel()
+    self.assertTrue(len(ticks) > 2)
+    # cancelled waits don't upset anything
+    fut = asyncio.ensure_future(db.execute("select * from foo"))
+    await asyncio.sleep(0)
+    fut.cancel()
+    self.assertEqual([(1000, )], await (await db.execute("select count(*) from foo")).fetchall())
+    # an abandoned cursor is closed by the worker
+    cursor = await db.execute("select x from foo")
+    await cursor.fetchone()
+    del cursor
+    cursor = await db.execute("select x from foo")
+    async with db as ctx:
+        self.assertTrue(ctx is db)
+    await db.close()
+    try:
+        await db.execute("select 3")
+        1 / 0
+    except apsw.ConnectionClosedError:
+        pass
+    self.assertRaises(apsw.ConnectionClosedError, db.run, len)
+    self.assertRaises(apsw.ConnectionClosedError, cursor.fetchall)
+
+loop.run_until_complete(check(self, db))
+"""
+        loop = asyncio.new_event_loop()
+        try:
+            l = {"self": self, "loop": loop, "db": apsw.AsyncConnection(":memory:", batchsize=100)}
+            execwrapper(code, globals(), l)
+            # dropping it without closing stops the worker
+            db = apsw.AsyncConnection(":memory:")
+            del db
+        finally:
+            loop.close()
+
     def testBackup(self):
         "Verify hot backup functionality"
         # bad calls
@@ -5972,6 +8229,65 @@ class APSW(unittest.TestCase):
         self.assertRaises(apsw.BusyError, b.__exit__, None, None, None)
         b.__exit__(None, None, None)
 
+    def testBackupRun(self):
+        "Verify backup run"
+        db2 = apsw.Connection(":memory:")
+        self.fillWithRandomStuff(db2)
+
+        b = self.db.backup("main", db2, "main")
+        self.assertRaises(TypeError, b.run, "3")
+        self.assertRaises(TypeError, b.run, progress=3)
+        self.assertRaises(ValueError, b.run, interval=0)
+        self.assertRaises(ValueError, b.run, sleep=-1)
+        calls = []
+        self.assertEqual(True, b.run(1, progress=lambda *args: calls.append(args), interval=3))
+        self.assertEqual(True, b.done)
+        self.assertTrue(len(calls) > 1)
+        self.assertEqual(calls[-1][0], 0)
+        self.assertTrue(calls[0][0] > calls[1][0])
+        b.finish()
+        self.assertDbIdentical(self.db, db2)
+
+        # stopping early
+        self.db.cursor().execute("drop table a")
+        b = self.db.backup("main", db2, "main")
+        self.assertEqual(False, b.run(1, progress=lambda *args: True, sleep=1))
+        self.assertEqual(False, b.done)
+        self.assertEqual(True, b.run())
+        b.finish()
+        self.assertDbIdentical(self.db, db2)
+
+        # exceptions and closing in the callback
+        b = self.db.backup("main", db2, "main")
+        self.assertRaises(ZeroDivisionError, b.run, 1, progress=lambda *args: 1 / 0)
+        self.assertRaises(ZeroDivisionError, b.run, 1, progress=lambda *args: BadIsTrue())
+        self.assertRaises(apsw.ConnectionClosedError, b.run, 1, progress=lambda *args: b.finish())
+        db2.close()
+
+        # busy source is retried
+        src = apsw.Connection(TESTFILEPREFIX + "testdb2")
+        self.fillWithRandomStuff(src)
+        locker = apsw.Connection(TESTFILEPREFIX + "testdb2")
+        locker.cursor().execute("begin exclusive")
+
+        b = self.db.backup("main", src, "main")
+        b4 = time.time()
+        self.assertRaises(apsw.BusyError, b.run, busytimeout=100)
+        self.assertTrue(time.time() - b4 >= 0.1)
+
+        def unlock():
+            time.sleep(0.2)
+            locker.cursor().execute("rollback")
+
+        t = ThreadRunner(unlock)
+        t.start()
+        self.assertEqual(True, b.run(busytimeout=-1))
+        t.go()
+        b.finish()
+        self.assertDbIdentical(self.db, src)
+        locker.close()
+        src.close()
+
     def testLog(self):
         "Verifies logging functions"
         self.assertRaises(TypeError, apsw.log)
@@ -8165,6 +10481,10 @@ shell.write(shell.stdout, "hello world\\n")
             def __init__(self, name, flags):
                 super(FaultVFSFile, self).__init__("", name, flags)
 
+            # xReadReadBufferFail needs xRead rather than xReadInto
+            def xRead(self, amount, offset):
+                return super(FaultVFSFile, self).xRead(amount, offset)
+
         vfs = FaultVFS()
 
         ## xFullPathnameConversion
@@ -8391,6 +10711,23 @@ shell.write(shell.stdout, "hello world\\n")
         except MemoryError:
             pass
 
+        ## SQLTextGrowFails
+        c = apsw.Connection(":memory:").cursor()
+        c.execute("create table foo(x); insert into foo values(1); insert into foo values(zeroblob(50000)); insert into foo values(3)")
+        expected = "".join(["INSERT INTO t VALUES(%s);\n" % (apsw.format_sql_value(v), ) for v, in c.execute("select * from foo")])
+        # rows done before the failure are returned and the rest follow
+        c.execute("select * from foo")
+        apsw.faultdict["SQLTextGrowFails"] = True
+        first = c.fetchinserts("t")
+        self.assertEqual(first, "INSERT INTO t VALUES(1);\n")
+        self.assertEqual(first + c.fetchinserts("t"), expected)
+        self.assertEqual(c.fetchinserts("t"), "")
+        # failing on the first row leaves it current
+        c.execute("select * from foo where x!=1")
+        apsw.faultdict["SQLTextGrowFails"] = True
+        self.assertRaises(MemoryError, c.fetchinserts, "t")
+        self.assertEqual(c.fetchinserts("t"), expected[len(first):])
+
         ## WalAutocheckpointFails
         apsw.faultdict["WalAutocheckpointFails"] = True
         try:
@@ -5,7 +5,7 @@
 # Find things that haven't been documented and should be or have been
 # but don't exist.
 
-import glob, sys
+import glob, sys, tempfile
 
 import apsw
 
@@ -37,12 +37,15 @@ cur=con.cursor()
 cur.execute("create table x(y); insert into x values(x'abcdef1012');select * from x")
 blob=con.blobopen("main", "x", "y", con.last_insert_rowid(), 0)
 vfs=apsw.VFS("aname", "")
-vfsfile=apsw.VFSFile("", ":memory:", [apsw.SQLITE_OPEN_MAIN_DB|apsw.SQLITE_OPEN_CREATE|apsw.SQLITE_OPEN_READWRITE, 0])
+pool=apsw.ConnectionPool(":memory:")
+# a real file is opened so use a temporary one
+vfsfilename=tempfile.NamedTemporaryFile()
+vfsfile=apsw.VFSFile("", vfsfilename.name, [apsw.SQLITE_OPEN_MAIN_DB|apsw.SQLITE_OPEN_CREATE|apsw.SQLITE_OPEN_READWRITE, 0])
 
 # virtual tables aren't real - just check their size hasn't changed
 assert len(classes['VTModule'])==2
 del classes['VTModule']
-assert len(classes['VTTable'])==13
+assert len(classes['VTTable'])==15
 del classes['VTTable']
 assert len(classes['VTCursor'])==6
 del classes['VTCursor']
@@ -52,6 +55,7 @@ for name, obj in ( ('Connection', con),
                    ('blob', blob),
                    ('VFS', vfs),
                    ('VFSFile', vfsfile),
+                   ('ConnectionPool', pool),
                    ('apsw', apsw),
                    ):
     if name not in classes:
@@ -79,7 +83,7 @@ for name, obj in ( ('Connection', con),
             if isinstance(getattr(apsw, c), type) and issubclass(getattr(apsw,c), Exception):
                 continue
             # ignore classes !!!
-            if c in ("Connection", "VFS", "VFSFile", "zeroblob", "Shell", "URIFilename"):
+            if c in ("Connection", "VFS", "VFSFile", "zeroblob", "Shell", "URIFilename", "ConnectionPool", "AsyncConnection"):
                 continue
             # ignore mappings !!!
             if c.startswith("mapping_"):
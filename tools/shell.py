@@ -1191,7 +1191,17 @@ Enter SQL statements terminated with a ";"
                             self.write(self.stdout, "DROP TABLE IF EXISTS "+self._fmt_sql_identifier(table)+";\n")
                             self.write(self.stdout, sqldef(sql[0]))
                             self._output_table=self._fmt_sql_identifier(table)
-                            self.process_sql("select * from "+self._fmt_sql_identifier(table), internal=True)
+                            if self.colour is self._colours["off"]:
+                                # the rows are formatted in C in large chunks
+                                cur=self.db.cursor()
+                                cur.execute("select * from "+self._output_table)
+                                while True:
+                                    text=cur.fetchinserts(self._output_table)
+                                    if not text:
+                                        break
+                                    self.write(self.stdout, text)
+                            else:
+                                self.process_sql("select * from "+self._output_table, internal=True)
                         # Now any indices or triggers
                         first=True
                         for name,sql in self.db.cursor().execute("SELECT name,sql FROM sqlite_master "
@@ -1598,29 +1608,10 @@ Enter SQL statements terminated with a ";"
             if ncols<1:
                 raise self.Error("No such table '%s'" % (cmd[1],))
 
-            cur=self.db.cursor()
             sql="insert into %s values(%s)" % (self._fmt_sql_identifier(cmd[1]), ",".join("?"*ncols))
 
-            kwargs={}
-            if self.separator==",":
-                kwargs["dialect"]="excel"
-            elif self.separator=="\t":
-                kwargs["dialect"]="excel-tab"
-            else:
-                kwargs["quoting"]=csv.QUOTE_NONE
-                kwargs["delimiter"]=self.separator
-                kwargs["doublequote"]=False
-                kwargs["quotechar"]="\x00"
-            row=1
-            for line in self._csvin_wrapper(cmd[0], kwargs):
-                if len(line)!=ncols:
-                    raise self.Error("row %d has %d columns but should have %d" % (row, len(line), ncols))
-                try:
-                    cur.execute(sql, line)
-                except:
-                    self.write(self.stderr, "Error inserting row %d" % (row,))
-                    raise
-                row+=1
+            # quoting is only done for comma and tab separators
+            self._importcsv(cmd[0], sql, delimiter=self.separator, quoting=self.separator in (",", "\t"))
             self.db.cursor().execute("COMMIT")
 
         except:
@@ -1628,6 +1619,22 @@ Enter SQL statements terminated with a ";"
                 self.db.cursor().execute(final)
             raise
 
+    def _importcsv(self, filename, sql, **kwargs):
+        # Executes sql for each record in the file using
+        # Cursor.importcsv which does the parsing and binding in C.
+        # The file is decoded from the current encoding.
+        if len(kwargs["delimiter"])!=1:
+            raise self.Error("The separator must be a single character to import")
+        thefile=codecs.open(filename, "r", self.encoding[0])
+        try:
+            try:
+                return self.db.cursor().importcsv(thefile, sql, **kwargs)
+            except ValueError:
+                # wrong number of columns
+                raise self.Error(str(sys.exc_info()[1]))
+        finally:
+            thefile.close()
+
     def _csvin_wrapper(self, filename, dialect):
         # Returns a csv reader that works around python bugs and uses
         # dialect dict to configure reader
@@ -1824,8 +1831,7 @@ Enter SQL statements terminated with a ";"
                 fmt="(delimited by \"%s\")" % (format["delimiter"],)
             self.write(self.stdout, "Detected Format %s  Columns %d  Rows %d\n" % (fmt, ncols, lines))
             # Header row
-            reader=self._csvin_wrapper(cmd[0], format)
-            for header in reader:
+            for header in self._csvin_wrapper(cmd[0], format):
                 break
             # Check schema
             identity=lambda x:x
@@ -1839,17 +1845,14 @@ Enter SQL statements terminated with a ";"
             # Make the table
             sql="CREATE TABLE %s(%s)" % (self._fmt_sql_identifier(tablename), ", ".join([self._fmt_sql_identifier(h) for h in header]))
             c.execute(sql)
-            # prep work for each row
+            # The data - text is bound directly, and empty values are null
             sql="INSERT INTO %s VALUES(%s)" % (self._fmt_sql_identifier(tablename), ",".join(["?"]*ncols))
-            for line in reader:
-                vals=[]
-                for i in range(ncols):
-                    l=line[i]
-                    if not l:
-                        vals.append(None)
-                    else:
-                        vals.append(datas[i](l))
-                c.execute(sql, vals)
+            if "dialect" in format:
+                delimiter={"excel": ",", "excel-tab": "\t"}[format["dialect"]]
+            else:
+                delimiter=format["delimiter"]
+            self._importcsv(cmd[0], sql, delimiter=delimiter, quoting="dialect" in format, skip=1, nullempty=True,
+                            converters=[None if d is identity else d for d in datas])
 
             c.execute("COMMIT")
             self.write(self.stdout, "Auto-import into table \"%s\" complete\n" % (tablename,))
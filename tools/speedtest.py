@@ -14,6 +14,7 @@ import random
 import time
 import gc
 import optparse
+import tempfile
 
 # This would be a py 2 vs py 3 funky thing
 write=sys.stdout.write
@@ -21,6 +22,9 @@ if sys.version_info>=(3,):
     xrange=range
     unichr=chr
 
+# time.clock is gone in Python 3.8
+cpuclock=getattr(time, "process_time", None) or time.clock
+
 # Sigh
 try:
     maxuni=0x10ffff
@@ -31,6 +35,8 @@ except ValueError:
 def doit():
     random.seed(0)
     options.tests=[t.strip() for t in options.tests.split(",")]
+    if options.tests==["all"]:
+        options.tests=alltests
 
     write("         Python %s %s\n" % (sys.executable, str(sys.version_info)))
     write("          Scale %d\n" % (options.scale,))
@@ -398,9 +404,294 @@ def doit():
         "pysqlite individual statements without bindings"
         return pysqlite_statements(con, withoutbindings)
 
+    # The functions are called for every row so these show the per row
+    # cost of calling into Python
+    functionrows=options.scale*20000
+    functionsql="with recursive c(x) as (select 1 union all select x+1 from c where x<%d) select sum(addone(x)), summer(x) from c" % (functionrows,)
+
+    def addone(x):
+        return x+1
+
+    class summer:
+        def __init__(self):
+            self.total=0
+        def step(self, *args):
+            self.total+=args[-1]
+        def finalize(self, *args):
+            return self.total
+
+    def summerfactory():
+        s=summer()
+        return None, s.step, s.finalize
+
+    def apsw_functions(con, hints=False):
+        "APSW scalar and aggregate functions"
+        if hints:
+            con.createscalarfunction("addone", addone, deterministic=True, argtypes="i", returntype="i")
+            con.createaggregatefunction("summer", summerfactory, deterministic=True, argtypes="i", returntype="i")
+        else:
+            con.createscalarfunction("addone", addone, 1)
+            con.createaggregatefunction("summer", summerfactory, 1)
+        for row in con.cursor().execute(functionsql): pass
+
+    def pysqlite_functions(con):
+        "pysqlite scalar and aggregate functions"
+        con.create_function("addone", 1, addone)
+        con.create_aggregate("summer", 1, summer)
+        for row in con.execute(functionsql): pass
+
+    def apsw_functions_hints(con):
+        "APSW functions with type hints"
+        return apsw_functions(con, hints=True)
+
+    def pysqlite_functions_hints(con):
+        "pysqlite functions (no hints)"
+        return pysqlite_functions(con)
+
+    # The tests below are microbenchmarks of individual hot paths.
+    # They are kept in the benchmarks dict instead of being looked up
+    # by name from locals.  Those needing data have a prepare function
+    # run before timing starts, and perunit gives the number of items
+    # processed so the cost of each can be shown.
+    microrows=options.scale*20000
+    benchmarks={}
+    prepares={}
+    perunit={"functions": (functionrows, "row"),
+             "functions_hints": (functionrows, "row")}
+
+    def benchmark(test, apswfunc=None, pysqlitefunc=None, prepare=None, count=None, unit="row"):
+        if apswfunc: benchmarks["apsw_"+test]=apswfunc
+        if pysqlitefunc: benchmarks["pysqlite_"+test]=pysqlitefunc
+        if prepare: prepares[test]=prepare
+        if count: perunit[test]=(count, unit)
+
+    def microsql(columns):
+        return "with recursive c(x) as (select 1 union all select x+1 from c where x<"+str(microrows)+") select "+columns+" from c"
+
+    # fetching rows of each type
+    fetchtypes=( ("integer", "x"),
+                 ("float", "x*1.5"),
+                 ("text", "printf('%08d some text', x)"),
+                 ("blob", "cast(printf('%016d', x) as blob)"),
+                 ("null", "null") )
+
+    def fetch_prepare(columns):
+        def prepare(con):
+            cur=con.cursor()
+            cur.execute("create table t("+", ".join(["c%d" % (i,) for i in range(len(columns))])+")")
+            cur.execute("insert into t "+microsql(", ".join(columns)))
+        return prepare
+
+    def fetch(con):
+        for row in con.cursor().execute("select * from t"): pass
+
+    for name, expr in fetchtypes:
+        benchmark("fetch_"+name, fetch, fetch, fetch_prepare([expr]), microrows)
+
+    # wide rows have four columns of each type
+    benchmark("fetch_wide", fetch, fetch, fetch_prepare([expr for name, expr in fetchtypes]*4), microrows)
+
+    # executemany
+    manyrows=[]
+
+    def executemany_prepare(con):
+        if not manyrows:
+            manyrows.extend([(i, "row number %d" % (i,), i*1.5) for i in xrange(microrows)])
+        con.cursor().execute("create table t(a,b,c)")
+
+    def executemany(con):
+        cur=con.cursor()
+        cur.execute("begin")
+        cur.executemany("insert into t values(?,?,?)", manyrows)
+        cur.execute("commit")
+
+    benchmark("executemany", executemany, executemany, executemany_prepare, microrows)
+
+    # statement cache hits and misses
+    def cache_hit(con):
+        cur=con.cursor()
+        for i in xrange(microrows):
+            for row in cur.execute("select ?", (i,)): pass
+
+    def cache_miss(con):
+        cur=con.cursor()
+        for i in xrange(microrows):
+            for row in cur.execute("select %d" % (i,)): pass
+
+    benchmark("cache_hit", cache_hit, cache_hit, None, microrows, "statement")
+    benchmark("cache_miss", cache_miss, cache_miss, None, microrows, "statement")
+
+    if options.apsw:
+        # virtual table scan
+        vtdata=[(i, i*1.5, "row") for i in xrange(microrows)]
+
+        class VTModule:
+            def __init__(self, cursor):
+                self.cursor=cursor
+            def Create(self, db, modulename, dbname, tablename, *args):
+                return "create table x(a,b,c)", VTTable(self.cursor)
+            Connect=Create
+
+        class VTTable:
+            def __init__(self, cursor):
+                self.cursor=cursor
+            def BestIndex(self, *args):
+                return None
+            def Open(self):
+                return self.cursor()
+            def Disconnect(self):
+                pass
+            Destroy=Disconnect
+
+        class VTRowCursor:
+            def Filter(self, *args):
+                self.pos=0
+            def Eof(self):
+                return self.pos>=microrows
+            def Rowid(self):
+                return self.pos
+            def Column(self, col):
+                if col<0: return self.pos
+                return vtdata[self.pos][col]
+            def Next(self):
+                self.pos+=1
+            def Close(self):
+                pass
+
+        # Falls back to the per row methods on builds without Rows
+        class VTBlockCursor(VTRowCursor):
+            def Rows(self):
+                block=[(i,)+vtdata[i] for i in xrange(self.pos, min(self.pos+500, microrows))]
+                self.pos+=len(block)
+                return block
+
+        def vtable_prepare(cursor):
+            def prepare(con):
+                con.createmodule("speedvt", VTModule(cursor))
+                con.cursor().execute("create virtual table temp.vt using speedvt()")
+            return prepare
+
+        def apsw_vtable(con):
+            for row in con.cursor().execute("select sum(a), sum(b), max(c) from vt"): pass
+
+        benchmark("vtable", apsw_vtable, None, vtable_prepare(VTRowCursor), microrows)
+        benchmark("vtable_rows", apsw_vtable, None, vtable_prepare(VTBlockCursor), microrows)
+
+        # Python VFS page reads.  The file methods are inherited so
+        # this measures the cost of going through Python for each
+        # page.
+        class SpeedVFSFile(apsw.VFSFile):
+            def __init__(self, inheritfromvfsname, filename, flags):
+                apsw.VFSFile.__init__(self, inheritfromvfsname, filename, flags)
+
+        class SpeedVFS(apsw.VFS):
+            def __init__(self):
+                apsw.VFS.__init__(self, "speedtest", "")
+            def xOpen(self, name, flags):
+                return SpeedVFSFile("", name, flags)
+
+        vfsinstance=[]
+        vfsfile=os.path.join(tempfile.gettempdir(), "speedtest-vfs-%d.db" % (os.getpid(),))
+        vfspasses=options.scale*5
+
+        def vfs_prepare(con):
+            if not vfsinstance:
+                vfsinstance.append(SpeedVFS())
+            if not os.path.exists(vfsfile):
+                db=apsw.Connection(vfsfile)
+                cur=db.cursor()
+                cur.execute("pragma page_size=1024")
+                cur.execute("create table t(b)")
+                cur.execute("insert into t "+microsql("randomblob(200)")+" limit "+str(microrows//10))
+                db.close()
+            db=apsw.Connection(vfsfile)
+            perunit["vfs"]=(db.cursor().execute("pragma page_count").fetchall()[0][0]*vfspasses, "page")
+            db.close()
+
+        def apsw_vfs(con):
+            db=apsw.Connection(vfsfile, vfs="speedtest", flags=apsw.SQLITE_OPEN_READONLY)
+            cur=db.cursor()
+            # a tiny cache so that every pass reads all the pages again
+            cur.execute("pragma cache_size=-64")
+            for i in xrange(vfspasses):
+                for row in cur.execute("select sum(length(b)) from t"): pass
+            db.close()
+
+        benchmark("vfs", apsw_vfs, None, vfs_prepare, 1, "page")
+
+        # blob streaming
+        blobsize=16*1024*1024
+        blobchunk=65536
+        blobpasses=options.scale*4
+
+        def blob_prepare(con):
+            cur=con.cursor()
+            cur.execute("create table blobs(x)")
+            cur.execute("insert into blobs values(zeroblob(%d))" % (blobsize,))
+
+        def apsw_blob_read(con):
+            blob=con.blobopen("main", "blobs", "x", 1, False)
+            for i in xrange(blobpasses):
+                blob.seek(0)
+                while blob.read(blobchunk): pass
+            blob.close()
+
+        def apsw_blob_readinto(con):
+            blob=con.blobopen("main", "blobs", "x", 1, False)
+            buf=bytearray(blobchunk)
+            for i in xrange(blobpasses):
+                blob.seek(0)
+                for offset in xrange(0, blobsize, blobchunk):
+                    blob.readinto(buf)
+            blob.close()
+
+        def apsw_blob_write(con):
+            blob=con.blobopen("main", "blobs", "x", 1, True)
+            data=b"\xaa"*blobchunk
+            for i in xrange(blobpasses):
+                blob.seek(0)
+                for offset in xrange(0, blobsize, blobchunk):
+                    blob.write(data)
+            blob.close()
+
+        blobchunks=blobpasses*blobsize//blobchunk
+        benchmark("blob_read", apsw_blob_read, None, blob_prepare, blobchunks, "64kb chunk")
+        benchmark("blob_readinto", apsw_blob_readinto, None, blob_prepare, blobchunks, "64kb chunk")
+        benchmark("blob_write", apsw_blob_write, None, blob_prepare, blobchunks, "64kb chunk")
+
+    # backup
+    backuppasses=10
+
+    def backup_prepare(con):
+        cur=con.cursor()
+        cur.execute("create table t(a,b)")
+        cur.execute("insert into t "+microsql("x, printf('%050d', x)"))
+        perunit["backup"]=(cur.execute("pragma page_count").fetchall()[0][0]*backuppasses, "page")
+
+    def apsw_backup(con):
+        for i in xrange(backuppasses):
+            dest=apsw.Connection(":memory:")
+            with dest.backup("main", con, "main") as b:
+                b.step()
+            dest.close()
+
+    # only newer versions of pysqlite have backup
+    if options.pysqlite and hasattr(pysqlite.Connection, "backup"):
+        def pysqlite_backup(con):
+            for i in xrange(backuppasses):
+                dest=pysqlite.connect(":memory:")
+                con.backup(dest)
+                dest.close()
+    else:
+        apswonly.append("backup")
+
+    benchmark("backup", apsw_backup, None, backup_prepare, 1, "page")
+
     # Do the work
     write("\nRunning tests - elapsed, CPU (results in seconds, lower is better)\n")
 
+    results={}
+
     for i in range(options.iterations):
         write("%d/%d\n" % (i+1, options.iterations))
         for test in options.tests:
@@ -408,25 +699,64 @@ def doit():
             for driver in ( ("apsw", "pysqlite"), ("pysqlite", "apsw"))[i%2]:
                 if getattr(options, driver):
                     name=driver+"_"+test
-                    func=locals().get(name, None)
+                    func=benchmarks.get(name, None) or locals().get(name, None)
                     if not func:
+                        if driver=="pysqlite" and test in apswonly:
+                            # the test can't be done with pysqlite
+                            continue
                         sys.stderr.write("No such test "+name+"\n")
                         sys.exit(1)
 
                     if os.path.exists(options.database):
                         os.remove(options.database)
-                    write("\t"+func.__name__+(" "*(40-len(func.__name__))))
+                    write("\t"+name+(" "*(40-len(name))))
                     sys.stdout.flush()
                     con=locals().get(driver+"_setup")(options.database)
+                    if test in prepares:
+                        prepares[test](con)
                     gc.collect(2)
-                    b4cpu=time.clock()
+                    b4cpu=cpuclock()
                     b4=time.time()
                     func(con)
                     con.close() # see note above as to why we include this in the timing
                     gc.collect(2)
                     after=time.time()
-                    aftercpu=time.clock()
-                    write("%0.3f %0.3f\n" % (after-b4, aftercpu-b4cpu))
+                    aftercpu=cpuclock()
+                    write("%0.3f %0.3f" % (after-b4, aftercpu-b4cpu))
+                    if test in perunit:
+                        write("  (%0.3f microseconds per %s)" % ((aftercpu-b4cpu)*1000000.0/perunit[test][0], perunit[test][1]))
+                    write("\n")
+                    r=results.setdefault(name, {"elapsed": [], "cpu": []})
+                    r["elapsed"].append(after-b4)
+                    r["cpu"].append(aftercpu-b4cpu)
+                    if test in perunit:
+                        r["count"], r["unit"]=perunit[test]
+
+    if options.apsw and os.path.exists(vfsfile):
+        os.remove(vfsfile)
+
+    info={"python": sys.version.split()[0],
+          "scale": options.scale,
+          "iterations": options.iterations,
+          "sc-size": options.scsize}
+    if options.apsw:
+        info["apsw"]=apsw.apswversion()
+        info["apsw-file"]=apsw.__file__
+        info["sqlite"]=apsw.sqlitelibversion()
+    if options.pysqlite:
+        info["pysqlite"]=pysqlite.version
+        info["pysqlite-sqlite"]=pysqlite.sqlite_version
+
+    if options.json:
+        import json
+        f=open(options.json, "w")
+        json.dump({"info": info, "results": results}, f, indent=2, sort_keys=True)
+        f.write("\n")
+        f.close()
+
+    if options.compare:
+        if not compare(options.compare, info, results):
+            regressed[0]=True
 
     # Cleanup if using valgrind
     if options.apsw:
@@ -434,6 +764,39 @@ def doit():
             # Cleans out buffer recycle cache
             apsw._fini()
 
+# Compares results against those saved with --json by an earlier run
+# (typically of a different build).  The best CPU time of each test is
+# used as it is the least noisy.  Returns False if any test is slower
+# by more than the threshold.
+def compare(filename, info, results):
+    import json
+    f=open(filename, "r")
+    old=json.load(f)
+    f.close()
+
+    write("\nComparison with %s - best CPU time (results in seconds)\n" % (filename,))
+    for k in sorted(set(old["info"].keys()) | set(info.keys())):
+        if old["info"].get(k)!=info.get(k):
+            write("%16s %s -> %s\n" % (k, old["info"].get(k), info.get(k)))
+    write("\n\t%-40s %8s %8s %8s\n" % ("test", "before", "after", "change"))
+
+    ok=True
+    for name in sorted(results.keys()):
+        after=min(results[name]["cpu"])
+        if name not in old["results"]:
+            write("\t%-40s %8s %8.3f\n" % (name, "-", after))
+            continue
+        before=min(old["results"][name]["cpu"])
+        change=(after-before)*100.0/max(before, 0.000001)
+        write("\t%-40s %8.3f %8.3f %+7.1f%%" % (name, before, after, change))
+        if change>options.threshold:
+            write("  REGRESSION")
+            ok=False
+        write("\n")
+    return ok
+
+regressed=[False]
+
 parser=optparse.OptionParser()
 parser.add_option("--apsw", dest="apsw", action="store_true", default=False,
                   help="Include apsw in testing (%default)")
@@ -446,13 +809,19 @@ parser.add_option("--scale", dest="scale", type="int", default=10,
 parser.add_option("--database", dest="database", default=":memory:",
                   help="The database file to use [Default %default]")
 parser.add_option("--tests", dest="tests", default="bigstmt,statements,statements_nobindings",
-                  help="What tests to run [Default %default]")
+                  help="What tests to run.  Use 'all' for every test [Default %default]")
 parser.add_option("--iterations", dest="iterations", default=4, type="int", metavar="N",
                   help="How many times to run the tests [Default %default]")
 parser.add_option("--tests-detail", dest="tests_detail", default=False, action="store_true",
                   help="Print details of what the tests do.  (Does not run the tests)")
 parser.add_option("--dump-sql", dest="dump_filename", metavar="FILENAME",
                   help="Name of file to dump SQL to.  This is useful for feeding into the SQLite command line shell.")
+parser.add_option("--json", dest="json", metavar="FILENAME",
+                  help="Save the results as JSON to FILENAME")
+parser.add_option("--compare", dest="compare", metavar="FILENAME",
+                  help="Compare the results with those saved by --json in FILENAME.  The exit code is 1 if any test regressed.")
+parser.add_option("--threshold", dest="threshold", type="float", default=10, metavar="PERCENT",
+                  help="How much slower a test has to be in --compare to be a regression [Default %default]")
 parser.add_option("--sc-size", dest="scsize", type="int", default=100, metavar="N",
                   help="Size of the statement cache. APSW will disable cache with value of zero.  Pysqlite ensures a minimum of 5 [Default %default]")
 parser.add_option("--unicode", dest="unicode", type="int", default=0,
@@ -461,6 +830,14 @@ parser.add_option("--data-size", dest="size", type="int", default=0,  metavar="S
                   help="Maximum size in characters of data items - keep this number small unless you are on 64 bits and have lots of memory with a small scale - you can easily consume multiple gigabytes [Default same as original TCL speedtest]")
 
 
+alltests=["bigstmt", "statements", "statements_nobindings", "functions", "functions_hints",
+          "fetch_integer", "fetch_float", "fetch_text", "fetch_blob", "fetch_null", "fetch_wide",
+          "executemany", "cache_hit", "cache_miss", "vtable", "vtable_rows", "vfs",
+          "blob_read", "blob_readinto", "blob_write", "backup"]
+
+# these use functionality pysqlite doesn't have
+apswonly=["vtable", "vtable_rows", "vfs", "blob_read", "blob_readinto", "blob_write"]
+
 tests_detail="""\
 bigstmt:
 
@@ -495,6 +872,62 @@ statements_nobindings:
   In theory all the tests above should run in almost identical time
   as well as when using the SQLite command line shell.  This tool
   shows you what happens in practise.
+
+functions:
+
+  Calls a scalar and an aggregate function implemented in Python on
+  each of scale * 20,000 rows.  The time is almost entirely the
+  overhead of calling into Python so the cost per row is also shown.
+
+functions_hints:
+
+  The same as functions but APSW uses the argtypes and returntype
+  hints when registering the functions.
+
+The remaining tests do scale * 20,000 of something unless noted and
+show the cost of each.  Use --tests all to run all of them.
+
+fetch_integer, fetch_float, fetch_text, fetch_blob, fetch_null:
+
+  Fetches rows of one column of the type.
+
+fetch_wide:
+
+  Fetches rows of 20 columns, four of each type.
+
+executemany:
+
+  Inserts rows of three values with executemany in a transaction.
+
+cache_hit:
+
+  Executes "select ?" which will always be in the statement cache.
+
+cache_miss:
+
+  Executes "select N" with a different N each time so the statement
+  cache never has it.
+
+vtable, vtable_rows (APSW only):
+
+  Sums three columns of a Python virtual table.  vtable_rows
+  returns blocks of rows with VTCursor.Rows.
+
+vfs (APSW only):
+
+  Reads pages of a database scale * 5 times through a VFS
+  implemented in Python, with a tiny page cache.
+
+blob_read, blob_readinto, blob_write (APSW only):
+
+  Streams a 16MB blob scale * 4 times in 64kb chunks.
+
+backup:
+
+  Backs up a database of scale * 20,000 rows to memory 10 times.
+
+Results can be saved with --json and then compared against a later
+run (for example of a different build) with --compare.
     \n"""
 
 if __name__=="__main__":
@@ -511,3 +944,5 @@ if __name__=="__main__":
         parser.error("You should select at least one of --apsw or --pysqlite")
 
     doit()
+    if regressed[0]:
+        sys.exit(1)